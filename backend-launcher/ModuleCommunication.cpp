@@ -142,7 +142,7 @@ namespace ogon { namespace launcher {
 	}
 
 	UINT ModuleCommunication::doRead() {
-		return serveOneCall(mContext, NULL);
+		return serveOneCall(mContext, 0, NULL);
 	}
 
 	void ModuleCommunication::initHandles(HANDLE readHandle, HANDLE writeHandle) {
@@ -489,6 +489,7 @@ namespace ogon { namespace launcher {
 	bool ModuleCommunication::getPropertyBool(UINT32 sessionID, const char *path, bool *value) {
 		ogon::module::PropertyBoolRequest request;
 		UINT error;
+		UINT32 callID;
 
 		request.set_sessionid(sessionID);
 		request.set_path(path);
@@ -500,7 +501,8 @@ namespace ogon { namespace launcher {
 			return false;
 		}
 
-		error = writepbRpc(mContext,encodedRequest, getNextCallID(), ogon::module::PropertyBool, false, true );
+		callID = getNextCallID();
+		error = writepbRpc(mContext, encodedRequest, callID, ogon::module::PropertyBool, false, true );
 
 		if (error) {
 			WLog_Print(logger_ModuleCommunication, WLOG_ERROR , "writepbRpc failed!");
@@ -509,7 +511,7 @@ namespace ogon { namespace launcher {
 
 		propertyBoolResult propertyBool;
 
-		error = serveOneCall(mContext, &propertyBool);
+		error = serveOneCall(mContext, callID, &propertyBool);
 		if (error == REMOTE_CLIENT_SUCCESS)
 		{
 			if (propertyBool.success) {
@@ -531,6 +533,7 @@ namespace ogon { namespace launcher {
 	bool ModuleCommunication::getPropertyNumber(UINT32 sessionID, const char *path, long *value) {
 		ogon::module::PropertyNumberRequest request;
 		UINT error;
+		UINT32 callID;
 
 		request.set_sessionid(sessionID);
 		request.set_path(path);
@@ -542,7 +545,8 @@ namespace ogon { namespace launcher {
 			return false;
 		}
 
-		error = writepbRpc(mContext,encodedRequest, getNextCallID(), ogon::module::PropertyNumber, false, true );
+		callID = getNextCallID();
+		error = writepbRpc(mContext, encodedRequest, callID, ogon::module::PropertyNumber, false, true );
 
 		if (error) {
 			WLog_Print(logger_ModuleCommunication, WLOG_ERROR , "writepbRpc failed!");
@@ -551,7 +555,7 @@ namespace ogon { namespace launcher {
 
 		propertyNumberResult propertyNumber;
 
-		error = serveOneCall(mContext, &propertyNumber);
+		error = serveOneCall(mContext, callID, &propertyNumber);
 		if (error == REMOTE_CLIENT_SUCCESS)
 		{
 			if (propertyNumber.success) {
@@ -573,6 +577,7 @@ namespace ogon { namespace launcher {
 												unsigned int valueLength) {
 		ogon::module::PropertyStringRequest request;
 		UINT error;
+		UINT32 callID;
 
 		request.set_sessionid(sessionID);
 		request.set_path(path);
@@ -584,7 +589,8 @@ namespace ogon { namespace launcher {
 			return false;
 		}
 
-		error = writepbRpc(mContext, encodedRequest, getNextCallID(), ogon::module::PropertyString, false, true );
+		callID = getNextCallID();
+		error = writepbRpc(mContext, encodedRequest, callID, ogon::module::PropertyString, false, true );
 
 		if (error) {
 			WLog_Print(logger_ModuleCommunication, WLOG_ERROR , "writepbRpc failed!");
@@ -593,7 +599,7 @@ namespace ogon { namespace launcher {
 
 		propertyStringResult propertyString;
 
-		error = serveOneCall(mContext, &propertyString);
+		error = serveOneCall(mContext, callID, &propertyString);
 
 		if (error == REMOTE_CLIENT_SUCCESS)
 		{
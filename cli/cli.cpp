@@ -39,6 +39,9 @@
 #include <winpr/user.h>
 #include <getopt.h>
 
+#include <ogon/wtsapi.h>
+#include "../common/framestats.h"
+
 using namespace std;
 
 static struct option long_options[] = {
@@ -56,10 +59,11 @@ static struct option long_options[] = {
 		{"startShadow", no_argument, 0,  'm' },
 		{"stopShadow", no_argument, 0,  't' },
 		{"text", required_argument, 0,  'g' },
+		{"stats", no_argument, 0,  'S' },
 		{0, 0, 0, 0 }
 };
 
-#define SHORT_OPTS "hlxu:p:s:e:doD:O:mtg:"
+#define SHORT_OPTS "hlxu:p:s:e:doD:O:mtg:S"
 
 #define TICKS_PER_SECOND 10000000
 #define EPOCH_DIFFERENCE 11644473600LL
@@ -265,42 +269,17 @@ BOOL printSessionDetailed(UINT32 sessionId, WTS_CONNECTSTATE_CLASS connectState,
 	return TRUE;
 }
 
-BOOL printSession(UINT32 sessionId, WTS_CONNECTSTATE_CLASS connectState, HANDLE hServer, BOOL printHeader) {
-
-	LPSTR pUsername = NULL;
-	LPSTR pDomain = NULL;
-	BOOL bSuccess;
-	DWORD bytesReturned = 0;
+void printSession(const WTS_SESSION_INFO_1 *sessionInfo, BOOL printHeader) {
 
 	if (printHeader) {
 		// 10 15 15 5
 		printf("SessionId  Username        Domain          State\n");
 	}
 
-	/* WTSUserName */
-
-	bSuccess = WTSQuerySessionInformation(hServer, sessionId, WTSUserName, &pUsername, &bytesReturned);
-
-	if (!bSuccess) {
-		printf("WTSQuerySessionInformation WTSUserName failed: %" PRIu32 "\n", GetLastError());
-		return FALSE;
-	}
-
-	/* WTSDomainName */
-
-	bSuccess = WTSQuerySessionInformation(hServer, sessionId, WTSDomainName, &pDomain, &bytesReturned);
-
-	if (!bSuccess) {
-		printf("WTSQuerySessionInformation WTSDomainName failed: %" PRIu32 "\n", GetLastError());
-		WTSFreeMemory(pUsername);
-		return FALSE;
-	}
-	printf("%9u  %-15.15s %-15.15s %s\n", sessionId, (char*)pUsername, (char*)pDomain, stateToString(connectState));
-
-	WTSFreeMemory(pUsername);
-	WTSFreeMemory(pDomain);
-
-	return TRUE;
+	printf("%9u  %-15.15s %-15.15s %s\n", sessionInfo->SessionId,
+		sessionInfo->pUserName ? sessionInfo->pUserName : "",
+		sessionInfo->pDomainName ? sessionInfo->pDomainName : "",
+		stateToString(sessionInfo->State));
 }
 
 
@@ -308,13 +287,39 @@ BOOL printSession(UINT32 sessionId, WTS_CONNECTSTATE_CLASS connectState, HANDLE
 bool listSessions(HANDLE hServer, bool detailed) {
 	DWORD index;
 	DWORD count;
+	DWORD level = 1;
 	BOOL bSuccess;
 	PWTS_SESSION_INFO pSessionInfo;
+	PWTS_SESSION_INFO_1 pSessionInfo1;
 	BOOL first = true;
 
 	count = 0;
 	pSessionInfo = NULL;
+	pSessionInfo1 = NULL;
+
+	if (!detailed) {
+		/* user and domain of all sessions come with a single request */
+		bSuccess = WTSEnumerateSessionsEx(hServer, &level, 0, &pSessionInfo1, &count);
+
+		if (!bSuccess) {
+			printf("WTSEnumerateSessionsEx failed: %" PRIu32 "\n", GetLastError());
+			return false;
+		}
 
+		if (count == 0) {
+			printf("No sessions found!\n");
+		}
+
+		for (index = 0; index < count; index++) {
+			printSession(&pSessionInfo1[index], first);
+			first = false;
+		}
+
+		WTSFreeMemoryEx(WTSTypeSessionInfoLevel1, pSessionInfo1, count);
+		return true;
+	}
+
+	/* the enumeration prefetches the information the detailed view queries */
 	bSuccess = WTSEnumerateSessions(hServer, 0, 1, &pSessionInfo, &count);
 
 	if (!bSuccess) {
@@ -327,12 +332,7 @@ bool listSessions(HANDLE hServer, bool detailed) {
 	}
 
 	for (index = 0; index < count; index++) {
-		if (detailed) {
-			printSessionDetailed(pSessionInfo[index].SessionId, pSessionInfo[index].State, hServer);
-		} else {
-			printSession(pSessionInfo[index].SessionId, pSessionInfo[index].State, hServer, first);
-			first = false;
-		}
+		printSessionDetailed(pSessionInfo[index].SessionId, pSessionInfo[index].State, hServer);
 	}
 
 	WTSFreeMemory(pSessionInfo);
@@ -343,20 +343,19 @@ bool listSessions(HANDLE hServer, bool detailed) {
 bool terminateUserSessions(HANDLE hServer, const char* user, bool onlyDisconnect) {
 	DWORD index;
 	DWORD count;
+	DWORD level = 1;
 	BOOL bSuccess;
-	PWTS_SESSION_INFO pSessionInfo;
-	LPSTR pUserName = NULL;
-	DWORD bytesReturned = 0;
+	PWTS_SESSION_INFO_1 pSessionInfo;
 	UINT32 sessionId;
 	BOOL bReturnValue = true;
 
 	count = 0;
 	pSessionInfo = NULL;
 
-	bSuccess = WTSEnumerateSessions(hServer, 0, 1, &pSessionInfo, &count);
+	bSuccess = WTSEnumerateSessionsEx(hServer, &level, 0, &pSessionInfo, &count);
 
 	if (!bSuccess) {
-		printf("WTSEnumerateSessions failed: %" PRIu32 "\n", GetLastError());
+		printf("WTSEnumerateSessionsEx failed: %" PRIu32 "\n", GetLastError());
 		return false;
 	}
 
@@ -367,19 +366,7 @@ bool terminateUserSessions(HANDLE hServer, const char* user, bool onlyDisconnect
 	for (index = 0; index < count; index++) {
 		sessionId = pSessionInfo[index].SessionId;
 
-		if (!WTSQuerySessionInformation(hServer, sessionId, WTSUserName, &pUserName, &bytesReturned) ||
-		    !pUserName || !bytesReturned)
-		{
-			printf("WTSQuerySessionInformation failed: %" PRIu32 "\n", GetLastError());
-			bReturnValue = false;
-			continue;
-		}
-
-		bSuccess = strcmp(pUserName, user) == 0;
-		WTSFreeMemory(pUserName);
-		pUserName = NULL;
-
-		if (!bSuccess) {
+		if (!pSessionInfo[index].pUserName || strcmp(pSessionInfo[index].pUserName, user) != 0) {
 			continue;
 		}
 
@@ -406,11 +393,63 @@ bool terminateUserSessions(HANDLE hServer, const char* user, bool onlyDisconnect
 		}
 	}
 
-	WTSFreeMemory(pSessionInfo);
+	WTSFreeMemoryEx(WTSTypeSessionInfoLevel1, pSessionInfo, count);
 
 	return bReturnValue;
 }
 
+static const char *frameMetricUnit(UINT32 metric) {
+	switch (metric) {
+		case OGON_FRAME_METRIC_DAMAGE_AREA:
+			return "px";
+		case OGON_FRAME_METRIC_FRAME_BYTES:
+			return "bytes";
+		case OGON_FRAME_METRIC_ACK_RTT:
+			return "ms";
+		case OGON_FRAME_METRIC_QUEUE_DEPTH:
+			return "frames";
+		default:
+			return "us";
+	}
+}
+
+BOOL printFrameStats(HANDLE hServer, UINT32 sessionId) {
+	LPSTR pBuffer = NULL;
+	DWORD bytesReturned = 0;
+	UINT32 metric;
+
+	if (!WTSQuerySessionInformation(hServer, sessionId, OGON_WTS_INFO_FRAME_STATS, &pBuffer, &bytesReturned) ||
+		(bytesReturned < sizeof(ogon_frame_stats)))
+	{
+		printf("Querying the frame statistics of session %" PRIu32 " failed: %" PRIu32 "\n", sessionId, GetLastError());
+		WTSFreeMemory(pBuffer);
+		return FALSE;
+	}
+
+	ogon_frame_stats *stats = (ogon_frame_stats *)pBuffer;
+	printf("SessionId: %" PRIu32 "\n", sessionId);
+	printf("\tFrames:                      %" PRIu64 "\n", stats->frames);
+	printf("\tSuppressed frames:           %" PRIu64 "\n", stats->suppressedFrames);
+	printf("\tBytes sent:                  %" PRIu64 "\n", stats->bytesSent);
+	printf("\tCodec:                       %s\n", frame_stats_metric_name((OGON_FRAME_METRIC)stats->codecMetric));
+	printf("\t%-24s %10s %12s %12s %12s\n", "metric", "count", "avg", "p50 <=", "p99 <=");
+
+	for (metric = 0; metric < OGON_FRAME_METRIC_COUNT; metric++) {
+		const ogon_frame_histogram *histogram = &stats->histograms[metric];
+		if (!histogram->count) {
+			continue;
+		}
+		printf("\t%-24s %10" PRIu64 " %9" PRIu64 " %-2s %9" PRIu64 " %-2s %9" PRIu64 " %s\n",
+			frame_stats_metric_name((OGON_FRAME_METRIC)metric), histogram->count,
+			histogram->sum / histogram->count, frameMetricUnit(metric),
+			frame_stats_quantile(histogram, 0.5), frameMetricUnit(metric),
+			frame_stats_quantile(histogram, 0.99), frameMetricUnit(metric));
+	}
+
+	WTSFreeMemory(pBuffer);
+	return TRUE;
+}
+
 void printhelprow(const char *kshort, const char *klong,const char *helptext) {
 	printf("    %s, %-20s %s\n", kshort,klong,helptext);
 }
@@ -432,6 +471,7 @@ void printhelp(const char *bin) {
 	printhelprow("-g", "--text=<text>", "display a message in the specified session");
 	printhelprow("-D", "--disconnectUser=<username>", "disconnect all sessions of the specified user");
 	printhelprow("-O", "--logoffUser=<username>", "log off all sessions of the specified user");
+	printhelprow("-S", "--stats", "prints the frame statistics of a session");
 	printf("\nexamples:\n\n");
 	printf("  disconnect within a rdp session: ogon-cli -d\n");
 	printf("  disconnect outside a rdp session: ogon-cli -d -s <sessionId> -u <username> -p <password>\n\n");
@@ -439,6 +479,7 @@ void printhelp(const char *bin) {
 	printf("  logoff outside a rdp session: ogon-cli -o -s <sessionId> -u <username> -p <password>\n\n");
 	printf("  list sessions: ogon-cli -l -u <username> -p <password>\n");
 	printf("  list sessions detailed: ogon-cli -x -u <username> -p <password>\n\n");
+	printf("  frame statistics of a session: ogon-cli -S -s <sessionId>\n\n");
 	printf("  shadow a session: ogon-cli -s <sessionId> -m\n\n");
 	printf("    Note: To abort shadowing press CTRL + F10.\n");
 
@@ -458,6 +499,7 @@ int main(int argc,char * const argv[]) {
 	bool startShadow = false;
 	bool stopShadow = false;
 	bool textMessage = false;
+	bool frameStats = false;
 	std::string message;
 	char *envval = NULL;
 	std::string servername = "";
@@ -535,6 +577,10 @@ int main(int argc,char * const argv[]) {
 				textMessage = true;
 				break;
 
+			case 'S':
+				frameStats = true;
+				break;
+
 			case '?':
 			default:
 				printhelp(argv[0]);
@@ -626,6 +672,12 @@ int main(int argc,char * const argv[]) {
 		sessionId = currentSessionId;
 	}
 
+	if (frameStats) {
+		if (printFrameStats(serverHandle, sessionId))
+			retVal = 0;
+		goto out;
+	}
+
 	if (textMessage) {
 		char *message_title;
 		char *message_text;
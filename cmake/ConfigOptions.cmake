@@ -7,3 +7,9 @@ option(WITH_OPENH264 "Add support for H.264 encoding" ON)
 # Debugging options
 option(WITH_DEBUG_STATE "Enable frame state machine debugging." OFF)
 option(WITH_ENCODER_STATS "Enable encoding stats" OFF)
+
+# Tracing
+option(WITH_USDT "Add USDT probes (sys/sdt.h) to the frame pipeline" ON)
+
+# Load testing
+option(WITH_LOADTEST "Build the synthetic backend, its module and the headless load driver" OFF)
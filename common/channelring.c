@@ -0,0 +1,288 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * channelring
+ * Shared memory transport for virtual channel data
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "channelring.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <winpr/sysinfo.h>
+
+#ifdef __linux__
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+static void channel_ring_reset(ogon_channel_ring *ring) {
+	memset(ring, 0, sizeof(*ring));
+	ring->fd = -1;
+}
+
+static BOOL channel_ring_map(ogon_channel_ring *ring, int fd, size_t size) {
+	void *mapping;
+
+	mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mapping == MAP_FAILED) {
+		return FALSE;
+	}
+	ring->header = (ogon_channel_ring_header *)mapping;
+	ring->data = (BYTE *)mapping + sizeof(ogon_channel_ring_header);
+	ring->mappedSize = size;
+	return TRUE;
+}
+
+BOOL channel_ring_create(ogon_channel_ring *ring, UINT32 size) {
+	channel_ring_reset(ring);
+
+#ifdef __linux__
+	UINT32 dataSize = OGON_CHANNEL_RING_MIN_SIZE;
+	size_t fileSize;
+	int fd;
+
+	if (size > OGON_CHANNEL_RING_MAX_SIZE) {
+		size = OGON_CHANNEL_RING_MAX_SIZE;
+	}
+	while (dataSize < size) {
+		dataSize <<= 1;
+	}
+	fileSize = sizeof(ogon_channel_ring_header) + dataSize;
+
+	fd = memfd_create("ogon-channel-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0) {
+		return FALSE;
+	}
+
+	/* the rdp server must never see the file shrink under its mapping */
+	if ((ftruncate(fd, fileSize) < 0) ||
+		(fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) ||
+		!channel_ring_map(ring, fd, fileSize))
+	{
+		close(fd);
+		return FALSE;
+	}
+
+	ring->header->magic = OGON_CHANNEL_RING_MAGIC;
+	ring->header->size = dataSize;
+	ring->mask = dataSize - 1;
+	ring->fd = fd;
+	return TRUE;
+#else
+	(void)size;
+	return FALSE;
+#endif
+}
+
+BOOL channel_ring_attach(ogon_channel_ring *ring, int fd) {
+	channel_ring_reset(ring);
+
+#ifdef __linux__
+	struct stat st;
+	UINT32 dataSize;
+	int seals;
+
+	seals = fcntl(fd, F_GET_SEALS);
+	if ((seals < 0) || !(seals & F_SEAL_SHRINK) || (fstat(fd, &st) < 0)) {
+		goto out_close;
+	}
+	if ((st.st_size < (off_t)sizeof(ogon_channel_ring_header) + OGON_CHANNEL_RING_MIN_SIZE) ||
+		(st.st_size > (off_t)sizeof(ogon_channel_ring_header) + OGON_CHANNEL_RING_MAX_SIZE))
+	{
+		goto out_close;
+	}
+	if (!channel_ring_map(ring, fd, st.st_size)) {
+		goto out_close;
+	}
+	close(fd);
+
+	/* the size is only trusted if it matches the file */
+	dataSize = ring->header->size;
+	if ((ring->header->magic != OGON_CHANNEL_RING_MAGIC) || (dataSize & (dataSize - 1)) ||
+		(sizeof(ogon_channel_ring_header) + dataSize != ring->mappedSize))
+	{
+		channel_ring_destroy(ring);
+		return FALSE;
+	}
+	ring->mask = dataSize - 1;
+	return TRUE;
+
+out_close:
+#endif
+	close(fd);
+	return FALSE;
+}
+
+void channel_ring_destroy(ogon_channel_ring *ring) {
+	if (ring->header) {
+		munmap(ring->header, ring->mappedSize);
+	}
+	if (ring->fd >= 0) {
+		close(ring->fd);
+	}
+	channel_ring_reset(ring);
+}
+
+#ifdef __linux__
+static void channel_ring_futex_wait(UINT32 *address, UINT32 value, DWORD timeout) {
+	struct timespec ts;
+
+	/* the ring is shared between processes, no FUTEX_PRIVATE_FLAG */
+	if (timeout == INFINITE) {
+		syscall(SYS_futex, address, FUTEX_WAIT, value, NULL, NULL, 0);
+		return;
+	}
+	ts.tv_sec = timeout / 1000;
+	ts.tv_nsec = (timeout % 1000) * 1000000;
+	syscall(SYS_futex, address, FUTEX_WAIT, value, &ts, NULL, 0);
+}
+
+static void channel_ring_futex_wake(UINT32 *address) {
+	syscall(SYS_futex, address, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+#endif
+
+UINT32 channel_ring_used(const ogon_channel_ring *ring) {
+	UINT32 head = __atomic_load_n(&ring->header->head, __ATOMIC_ACQUIRE);
+	UINT32 used = head - ring->header->tail;
+
+	/* the other side may scribble over the indices, never read outside the ring */
+	if (used > ring->mask + 1) {
+		return 0;
+	}
+	return used;
+}
+
+UINT32 channel_ring_write(ogon_channel_ring *ring, const BYTE *data, UINT32 length) {
+	UINT32 head = ring->header->head;
+	UINT32 tail = __atomic_load_n(&ring->header->tail, __ATOMIC_ACQUIRE);
+	UINT32 space = ring->mask + 1 - (head - tail);
+	UINT32 offset, first;
+
+	if (length > space) {
+		length = space;
+	}
+	if (!length) {
+		return 0;
+	}
+
+	offset = head & ring->mask;
+	first = ring->mask + 1 - offset;
+	if (first > length) {
+		first = length;
+	}
+	memcpy(ring->data + offset, data, first);
+	memcpy(ring->data, data + first, length - first);
+
+	__atomic_store_n(&ring->header->head, head + length, __ATOMIC_RELEASE);
+	return length;
+}
+
+BOOL channel_ring_need_doorbell(ogon_channel_ring *ring) {
+	/* pairs with the fence in channel_ring_prepare_wait */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(&ring->header->consumerWaiting, __ATOMIC_RELAXED)) {
+		return FALSE;
+	}
+	return __atomic_exchange_n(&ring->header->consumerWaiting, 0, __ATOMIC_SEQ_CST) ? TRUE : FALSE;
+}
+
+BOOL channel_ring_wait_writable(ogon_channel_ring *ring, DWORD timeout) {
+#ifdef __linux__
+	UINT64 deadline = (timeout == INFINITE) ? 0 : GetTickCount64() + timeout;
+	UINT64 now;
+	UINT32 tail;
+
+	for (;;) {
+		__atomic_store_n(&ring->header->producerWaiting, 1, __ATOMIC_SEQ_CST);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		tail = __atomic_load_n(&ring->header->tail, __ATOMIC_ACQUIRE);
+		if (ring->header->head - tail <= ring->mask) {
+			__atomic_store_n(&ring->header->producerWaiting, 0, __ATOMIC_RELAXED);
+			return TRUE;
+		}
+
+		if (timeout == INFINITE) {
+			channel_ring_futex_wait(&ring->header->tail, tail, INFINITE);
+			continue;
+		}
+
+		now = GetTickCount64();
+		if (now >= deadline) {
+			__atomic_store_n(&ring->header->producerWaiting, 0, __ATOMIC_RELAXED);
+			return FALSE;
+		}
+		channel_ring_futex_wait(&ring->header->tail, tail, (DWORD)(deadline - now));
+	}
+#else
+	(void)ring;
+	(void)timeout;
+	return FALSE;
+#endif
+}
+
+UINT32 channel_ring_read(ogon_channel_ring *ring, BYTE *target, UINT32 length) {
+	UINT32 used = channel_ring_used(ring);
+	UINT32 tail = ring->header->tail;
+	UINT32 offset, first;
+
+	if (length > used) {
+		length = used;
+	}
+	if (!length) {
+		return 0;
+	}
+
+	offset = tail & ring->mask;
+	first = ring->mask + 1 - offset;
+	if (first > length) {
+		first = length;
+	}
+	memcpy(target, ring->data + offset, first);
+	memcpy(target + first, ring->data, length - first);
+
+	__atomic_store_n(&ring->header->tail, tail + length, __ATOMIC_RELEASE);
+
+#ifdef __linux__
+	/* pairs with the fence in channel_ring_wait_writable */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ring->header->producerWaiting, __ATOMIC_RELAXED) &&
+		__atomic_exchange_n(&ring->header->producerWaiting, 0, __ATOMIC_SEQ_CST))
+	{
+		channel_ring_futex_wake(&ring->header->tail);
+	}
+#endif
+	return length;
+}
+
+BOOL channel_ring_prepare_wait(ogon_channel_ring *ring, UINT32 wanted) {
+	__atomic_store_n(&ring->header->consumerWaiting, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (channel_ring_used(ring) >= wanted) {
+		__atomic_store_n(&ring->header->consumerWaiting, 0, __ATOMIC_RELAXED);
+		return FALSE;
+	}
+	return TRUE;
+}
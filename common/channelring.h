@@ -0,0 +1,126 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * channelring
+ * Shared memory transport for virtual channel data
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifndef _OGON_CHANNELRING_H_
+#define _OGON_CHANNELRING_H_
+
+#include <winpr/wtypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * A single producer / single consumer byte ring in a memory file which is
+ * shared between an application writing to a virtual channel and the rdp
+ * server. The ring carries exactly the byte stream that would otherwise be
+ * written to the channel pipe (4 byte little endian length + payload).
+ *
+ * The application creates the ring and passes the file descriptor to the rdp
+ * server with the setup message, the very first thing sent on a freshly
+ * connected channel pipe. From then on the pipe only serves as doorbell: the
+ * application writes a single byte to it when the rdp server went to sleep on
+ * an empty ring. A producer waiting for space is woken with a futex.
+ */
+
+/** length header value of the setup message, the ring fd is attached with SCM_RIGHTS */
+#define OGON_CHANNEL_RING_SETUP 0xFFFFFFFF
+
+#define OGON_CHANNEL_RING_MAGIC 0x474E5243 /* "CRNG" */
+#define OGON_CHANNEL_RING_DEFAULT_SIZE (1024 * 1024)
+#define OGON_CHANNEL_RING_MIN_SIZE (64 * 1024)
+#define OGON_CHANNEL_RING_MAX_SIZE (64 * 1024 * 1024)
+
+/** @brief the shared part, producer and consumer indices are on separate cache lines */
+typedef struct _ogon_channel_ring_header {
+	UINT32 magic;
+	UINT32 size;            /* of the data area, a power of two */
+	UINT32 head;            /* written by the producer, free running */
+	UINT32 consumerWaiting; /* the consumer wants a doorbell for new data */
+	BYTE reserved1[48];
+	UINT32 tail;            /* written by the consumer, free running */
+	UINT32 producerWaiting; /* the producer sleeps on tail for free space */
+	BYTE reserved2[56];
+} ogon_channel_ring_header;
+
+/** @brief a mapping of the ring in one of the processes */
+typedef struct _ogon_channel_ring {
+	ogon_channel_ring_header *header;
+	BYTE *data;
+	UINT32 mask;
+	size_t mappedSize;
+	int fd; /* only kept by the creator until the setup message was sent */
+} ogon_channel_ring;
+
+/**
+ * creates a new ring backed by an anonymous memory file
+ * @param size of the data area, rounded up to a power of two
+ * @return FALSE if shared memory rings are not available
+ */
+BOOL channel_ring_create(ogon_channel_ring *ring, UINT32 size);
+
+/**
+ * maps a ring created by the other process, the fd is owned by the ring
+ * afterwards (it's closed once mapped)
+ */
+BOOL channel_ring_attach(ogon_channel_ring *ring, int fd);
+
+void channel_ring_destroy(ogon_channel_ring *ring);
+
+/** @return the number of bytes ready for the consumer */
+UINT32 channel_ring_used(const ogon_channel_ring *ring);
+
+/**
+ * producer: copies as much of data into the ring as fits
+ * @return the number of bytes written
+ */
+UINT32 channel_ring_write(ogon_channel_ring *ring, const BYTE *data, UINT32 length);
+
+/**
+ * producer: call after channel_ring_write, tells if the consumer is waiting
+ * for a doorbell. The request is consumed, only one doorbell is sent per wait.
+ */
+BOOL channel_ring_need_doorbell(ogon_channel_ring *ring);
+
+/**
+ * producer: waits until the consumer frees space in a full ring
+ * @param timeout in milliseconds, INFINITE waits forever
+ * @return FALSE on timeout
+ */
+BOOL channel_ring_wait_writable(ogon_channel_ring *ring, DWORD timeout);
+
+/**
+ * consumer: copies up to length bytes out of the ring and frees the space
+ * @return the number of bytes read
+ */
+UINT32 channel_ring_read(ogon_channel_ring *ring, BYTE *target, UINT32 length);
+
+/**
+ * consumer: announces that the consumer goes to sleep until at least wanted
+ * bytes are available and asks for a doorbell
+ * @return FALSE if the data arrived in between, the consumer must not sleep then
+ */
+BOOL channel_ring_prepare_wait(ogon_channel_ring *ring, UINT32 wanted);
+
+#ifdef __cplusplus
+};
+#endif /* __cplusplus */
+
+#endif /* _OGON_CHANNELRING_H_ */
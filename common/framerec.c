@@ -0,0 +1,489 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * framerec
+ * Recording and replay of the frames a backend delivered
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#include "framerec.h"
+#include "framestats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#define FRAMEREC_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define FRAMEREC_ALIGN(x, a) (((x) + ((a) - 1)) & ~((size_t)(a) - 1))
+
+/* largest encoding of a tile: one run pair for every second pixel */
+#define FRAMEREC_MAX_TILE_DATA \
+	(OGON_FRAMEREC_TILE_SIZE * OGON_FRAMEREC_TILE_SIZE * 6 + 4)
+
+struct _ogon_frame_recorder {
+	FILE *fp;
+	UINT32 width;
+	UINT32 height;
+	UINT32 tilesX;
+	UINT32 tilesY;
+	UINT32 *shadow;  /* content of the framebuffer as recorded so far */
+	BYTE *tileMarks; /* tiles touched by the damage of the current frame */
+	BYTE *buffer;    /* the frame record being built */
+	size_t bufferSize;
+	UINT32 frameCount;
+	UINT64 dataSize;
+	UINT64 startTime;
+	BOOL failed;
+};
+
+static BOOL frame_recorder_reserve(ogon_frame_recorder *recorder, size_t used, size_t needed) {
+	size_t newSize;
+	BYTE *buffer;
+
+	if (used + needed <= recorder->bufferSize) {
+		return TRUE;
+	}
+
+	newSize = recorder->bufferSize ? recorder->bufferSize : 64 * 1024;
+	while (newSize < used + needed) {
+		newSize *= 2;
+	}
+	if (!(buffer = realloc(recorder->buffer, newSize))) {
+		return FALSE;
+	}
+	recorder->buffer = buffer;
+	recorder->bufferSize = newSize;
+	return TRUE;
+}
+
+static BOOL frame_recorder_write_header(ogon_frame_recorder *recorder) {
+	ogon_framerec_header header;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = OGON_FRAMEREC_MAGIC;
+	header.version = OGON_FRAMEREC_VERSION;
+	header.width = recorder->width;
+	header.height = recorder->height;
+	header.tileSize = OGON_FRAMEREC_TILE_SIZE;
+	header.frameCount = recorder->frameCount;
+	header.dataSize = recorder->dataSize;
+
+	if ((fseek(recorder->fp, 0, SEEK_SET) != 0) || (fwrite(&header, sizeof(header), 1, recorder->fp) != 1)) {
+		return FALSE;
+	}
+	return fseek(recorder->fp, 0, SEEK_END) == 0;
+}
+
+ogon_frame_recorder *frame_recorder_new(const char *path, UINT32 width, UINT32 height) {
+	ogon_frame_recorder *recorder;
+	int fd;
+
+	if (!width || !height || (width > 0xFFFF) || (height > 0xFFFF)) {
+		return NULL;
+	}
+
+	if (!(recorder = calloc(1, sizeof(ogon_frame_recorder)))) {
+		return NULL;
+	}
+
+	recorder->width = width;
+	recorder->height = height;
+	recorder->tilesX = (width + OGON_FRAMEREC_TILE_SIZE - 1) / OGON_FRAMEREC_TILE_SIZE;
+	recorder->tilesY = (height + OGON_FRAMEREC_TILE_SIZE - 1) / OGON_FRAMEREC_TILE_SIZE;
+
+	/* the replay starts with a black framebuffer as well */
+	if (!(recorder->shadow = calloc((size_t)width * height, sizeof(UINT32))) ||
+		!(recorder->tileMarks = calloc(recorder->tilesX * recorder->tilesY, 1)))
+	{
+		goto fail;
+	}
+
+	/* the frames show the user's desktop, never write through a link or into someone else's file */
+	if ((fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600)) < 0) {
+		goto fail;
+	}
+	if (!(recorder->fp = fdopen(fd, "wb"))) {
+		close(fd);
+		unlink(path);
+		goto fail;
+	}
+
+	/* written again with the frame count on close */
+	if (!frame_recorder_write_header(recorder)) {
+		fclose(recorder->fp);
+		unlink(path);
+		goto fail;
+	}
+
+	recorder->startTime = frame_stats_now();
+	return recorder;
+
+fail:
+	free(recorder->tileMarks);
+	free(recorder->shadow);
+	free(recorder);
+	return NULL;
+}
+
+void frame_recorder_free(ogon_frame_recorder *recorder) {
+	if (!recorder) {
+		return;
+	}
+
+	if (!recorder->failed) {
+		frame_recorder_write_header(recorder);
+	}
+	fclose(recorder->fp);
+
+	free(recorder->buffer);
+	free(recorder->tileMarks);
+	free(recorder->shadow);
+	free(recorder);
+}
+
+BOOL frame_recorder_matches(const ogon_frame_recorder *recorder, UINT32 width, UINT32 height) {
+	return (recorder->width == width) && (recorder->height == height);
+}
+
+/**
+ * codes the XOR of a tile against the shadow and updates the shadow
+ * @return the size of the encoded data, 0 if the tile didn't change
+ */
+static UINT32 frame_recorder_encode_tile(ogon_frame_recorder *recorder, const BYTE *data,
+	UINT32 scanline, UINT32 tileX, UINT32 tileY, BYTE *out)
+{
+	UINT32 x0 = tileX * OGON_FRAMEREC_TILE_SIZE;
+	UINT32 y0 = tileY * OGON_FRAMEREC_TILE_SIZE;
+	UINT32 w = recorder->width - x0;
+	UINT32 h = recorder->height - y0;
+	UINT32 x, y, delta;
+	UINT16 *run = NULL;
+	UINT32 *pos = (UINT32 *)out;
+	UINT32 *end = pos;
+	BOOL changed = FALSE;
+
+	if (w > OGON_FRAMEREC_TILE_SIZE) {
+		w = OGON_FRAMEREC_TILE_SIZE;
+	}
+	if (h > OGON_FRAMEREC_TILE_SIZE) {
+		h = OGON_FRAMEREC_TILE_SIZE;
+	}
+
+	for (y = y0; y < y0 + h; y++) {
+		const UINT32 *src = (const UINT32 *)(data + (size_t)y * scanline);
+		UINT32 *shadow = recorder->shadow + (size_t)y * recorder->width;
+
+		for (x = x0; x < x0 + w; x++) {
+			delta = src[x] ^ shadow[x];
+			if (!delta) {
+				if (!run || run[1] || (run[0] == 0xFFFF)) {
+					run = (UINT16 *)pos++;
+					run[0] = run[1] = 0;
+				}
+				run[0]++;
+				continue;
+			}
+
+			if (!run || (run[1] == 0xFFFF)) {
+				run = (UINT16 *)pos++;
+				run[0] = run[1] = 0;
+			}
+			run[1]++;
+			*pos++ = delta;
+			end = pos;
+			shadow[x] = src[x];
+			changed = TRUE;
+		}
+	}
+
+	/* trailing unchanged pixels need no run */
+	return changed ? (UINT32)((BYTE *)end - out) : 0;
+}
+
+BOOL frame_recorder_add_frame(ogon_frame_recorder *recorder, const BYTE *data, UINT32 scanline,
+	const ogon_framerec_rect *rects, UINT32 numRects)
+{
+	ogon_framerec_frame *frame;
+	ogon_framerec_rect *rect;
+	ogon_framerec_tile *tile;
+	size_t used, recordSize;
+	UINT32 i, tileX, tileY, lastX, lastY, size;
+
+	if (recorder->failed) {
+		return FALSE;
+	}
+
+	if (!frame_recorder_reserve(recorder, 0, sizeof(ogon_framerec_frame) +
+		(size_t)numRects * sizeof(ogon_framerec_rect)))
+	{
+		recorder->failed = TRUE;
+		return FALSE;
+	}
+
+	frame = (ogon_framerec_frame *)recorder->buffer;
+	memset(frame, 0, sizeof(*frame));
+	frame->timestamp = frame_stats_now() - recorder->startTime;
+	used = sizeof(ogon_framerec_frame);
+
+	for (i = 0; i < numRects; i++) {
+		const ogon_framerec_rect *r = &rects[i];
+		if (!r->width || !r->height || ((UINT32)r->x + r->width > recorder->width) ||
+			((UINT32)r->y + r->height > recorder->height))
+		{
+			continue;
+		}
+
+		rect = (ogon_framerec_rect *)(recorder->buffer + used);
+		*rect = *r;
+		used += sizeof(ogon_framerec_rect);
+		frame->numRects++;
+
+		lastX = ((UINT32)r->x + r->width - 1) / OGON_FRAMEREC_TILE_SIZE;
+		lastY = ((UINT32)r->y + r->height - 1) / OGON_FRAMEREC_TILE_SIZE;
+		for (tileY = r->y / OGON_FRAMEREC_TILE_SIZE; tileY <= lastY; tileY++) {
+			for (tileX = r->x / OGON_FRAMEREC_TILE_SIZE; tileX <= lastX; tileX++) {
+				recorder->tileMarks[tileY * recorder->tilesX + tileX] = 1;
+			}
+		}
+	}
+
+	for (tileY = 0; tileY < recorder->tilesY; tileY++) {
+		for (tileX = 0; tileX < recorder->tilesX; tileX++) {
+			BYTE *mark = &recorder->tileMarks[tileY * recorder->tilesX + tileX];
+			if (!*mark) {
+				continue;
+			}
+			*mark = 0;
+
+			if (!frame_recorder_reserve(recorder, used, sizeof(ogon_framerec_tile) + FRAMEREC_MAX_TILE_DATA)) {
+				recorder->failed = TRUE;
+				return FALSE;
+			}
+			/* the buffer might have moved */
+			frame = (ogon_framerec_frame *)recorder->buffer;
+
+			tile = (ogon_framerec_tile *)(recorder->buffer + used);
+			size = frame_recorder_encode_tile(recorder, data, scanline, tileX, tileY,
+				recorder->buffer + used + sizeof(ogon_framerec_tile));
+			if (!size) {
+				continue;
+			}
+			tile->tileX = tileX;
+			tile->tileY = tileY;
+			tile->size = size;
+			used += sizeof(ogon_framerec_tile) + size;
+			frame->numTiles++;
+		}
+	}
+
+	recordSize = FRAMEREC_ALIGN(used, 8);
+	if (!frame_recorder_reserve(recorder, used, recordSize - used)) {
+		recorder->failed = TRUE;
+		return FALSE;
+	}
+	frame = (ogon_framerec_frame *)recorder->buffer;
+	memset(recorder->buffer + used, 0, recordSize - used);
+	frame->size = (UINT32)recordSize;
+
+	if (fwrite(recorder->buffer, recordSize, 1, recorder->fp) != 1) {
+		recorder->failed = TRUE;
+		return FALSE;
+	}
+
+	recorder->frameCount++;
+	recorder->dataSize += recordSize;
+	return TRUE;
+}
+
+/** @return the size of the frame record at offset, 0 if it's incomplete or corrupt */
+static size_t frame_replay_record_size(const ogon_frame_replay *replay, size_t offset) {
+	const ogon_framerec_frame *frame;
+
+	if (replay->end - offset < sizeof(ogon_framerec_frame)) {
+		return 0;
+	}
+	frame = (const ogon_framerec_frame *)(replay->map + offset);
+	if ((frame->size < sizeof(ogon_framerec_frame)) || (frame->size % 8) ||
+		(frame->size > replay->end - offset))
+	{
+		return 0;
+	}
+	return frame->size;
+}
+
+BOOL frame_replay_open(ogon_frame_replay *replay, const char *path) {
+	const ogon_framerec_header *header;
+	struct stat st;
+	void *map;
+	size_t offset, size;
+	int fd;
+
+	memset(replay, 0, sizeof(*replay));
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+		return FALSE;
+	}
+	if ((fstat(fd, &st) < 0) || ((size_t)st.st_size < sizeof(ogon_framerec_header))) {
+		close(fd);
+		return FALSE;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return FALSE;
+	}
+
+	replay->map = (const BYTE *)map;
+	replay->mapSize = st.st_size;
+	replay->end = replay->mapSize;
+	header = replay->header = (const ogon_framerec_header *)map;
+
+	if ((header->magic != OGON_FRAMEREC_MAGIC) || (header->version != OGON_FRAMEREC_VERSION) ||
+		(header->tileSize != OGON_FRAMEREC_TILE_SIZE) || !header->width || !header->height ||
+		(header->width > 0xFFFF) || (header->height > 0xFFFF))
+	{
+		goto fail;
+	}
+
+	/* a recording which wasn't closed properly is used up to its last complete frame */
+	if (header->dataSize && (header->dataSize <= replay->mapSize - sizeof(ogon_framerec_header))) {
+		replay->end = sizeof(ogon_framerec_header) + header->dataSize;
+	}
+	for (offset = sizeof(ogon_framerec_header); (size = frame_replay_record_size(replay, offset)); offset += size) {
+		replay->frameCount++;
+	}
+	replay->end = offset;
+
+	replay->width = header->width;
+	replay->height = header->height;
+	replay->scanline = FRAMEREC_ALIGN(replay->width * 4, 16);
+	if (!(replay->framebuffer = calloc(replay->height, replay->scanline))) {
+		goto fail;
+	}
+
+	frame_replay_rewind(replay);
+	return TRUE;
+
+fail:
+	munmap((void *)replay->map, replay->mapSize);
+	memset(replay, 0, sizeof(*replay));
+	return FALSE;
+}
+
+void frame_replay_close(ogon_frame_replay *replay) {
+	if (!replay->map) {
+		return;
+	}
+
+	munmap((void *)replay->map, replay->mapSize);
+	free(replay->framebuffer);
+	memset(replay, 0, sizeof(*replay));
+}
+
+void frame_replay_rewind(ogon_frame_replay *replay) {
+	memset(replay->framebuffer, 0, (size_t)replay->height * replay->scanline);
+	replay->offset = sizeof(ogon_framerec_header);
+	replay->frameIndex = 0;
+	replay->timestamp = 0;
+}
+
+static BOOL frame_replay_decode_tile(ogon_frame_replay *replay, const ogon_framerec_tile *tile,
+	const BYTE *data)
+{
+	UINT32 x0 = tile->tileX * OGON_FRAMEREC_TILE_SIZE;
+	UINT32 y0 = tile->tileY * OGON_FRAMEREC_TILE_SIZE;
+	UINT32 w, h, pixel, count, zeros, literals;
+	const UINT32 *pos = (const UINT32 *)data;
+	const UINT32 *end = pos + tile->size / 4;
+
+	if ((x0 >= replay->width) || (y0 >= replay->height) || (tile->size % 4)) {
+		return FALSE;
+	}
+	w = FRAMEREC_MIN(replay->width - x0, OGON_FRAMEREC_TILE_SIZE);
+	h = FRAMEREC_MIN(replay->height - y0, OGON_FRAMEREC_TILE_SIZE);
+	count = w * h;
+
+	for (pixel = 0; pos < end; ) {
+		const UINT16 *run = (const UINT16 *)pos++;
+		zeros = run[0];
+		literals = run[1];
+		if ((pixel + zeros + literals > count) || (literals > (UINT32)(end - pos))) {
+			return FALSE;
+		}
+
+		for (pixel += zeros; literals; literals--, pixel++) {
+			UINT32 *dst = (UINT32 *)(replay->framebuffer + (size_t)(y0 + pixel / w) * replay->scanline) +
+				x0 + pixel % w;
+			*dst ^= *pos++;
+		}
+	}
+	return TRUE;
+}
+
+int frame_replay_next(ogon_frame_replay *replay, const ogon_framerec_rect **rects, UINT32 *numRects) {
+	const ogon_framerec_frame *frame;
+	const ogon_framerec_tile *tile;
+	const BYTE *pos, *end;
+	size_t size;
+	UINT32 i;
+
+	if (replay->offset >= replay->end) {
+		return 0;
+	}
+	if (!(size = frame_replay_record_size(replay, replay->offset))) {
+		return -1;
+	}
+
+	frame = (const ogon_framerec_frame *)(replay->map + replay->offset);
+	pos = (const BYTE *)(frame + 1);
+	end = (const BYTE *)frame + size;
+
+	if (frame->numRects > (size_t)(end - pos) / sizeof(ogon_framerec_rect)) {
+		return -1;
+	}
+	*rects = (const ogon_framerec_rect *)pos;
+	*numRects = frame->numRects;
+	pos += frame->numRects * sizeof(ogon_framerec_rect);
+
+	/* the rects are used to copy from the framebuffer */
+	for (i = 0; i < frame->numRects; i++) {
+		if (((UINT32)(*rects)[i].x + (*rects)[i].width > replay->width) ||
+			((UINT32)(*rects)[i].y + (*rects)[i].height > replay->height))
+		{
+			return -1;
+		}
+	}
+
+	for (i = 0; i < frame->numTiles; i++) {
+		if ((size_t)(end - pos) < sizeof(ogon_framerec_tile)) {
+			return -1;
+		}
+		tile = (const ogon_framerec_tile *)pos;
+		pos += sizeof(ogon_framerec_tile);
+		if ((tile->size > (size_t)(end - pos)) || !frame_replay_decode_tile(replay, tile, pos)) {
+			return -1;
+		}
+		pos += tile->size;
+	}
+
+	replay->offset += size;
+	replay->frameIndex++;
+	replay->timestamp = frame->timestamp;
+	return 1;
+}
@@ -0,0 +1,144 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * framerec
+ * Recording and replay of the frames a backend delivered
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifndef _OGON_FRAMEREC_H_
+#define _OGON_FRAMEREC_H_
+
+#include <winpr/wtypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * A recording holds what the rdp server got from the backend at every sync
+ * reply: the damage rectangles and the content of the 64x64 tiles which
+ * really changed. Replaying it reproduces the framebuffer and damage of every
+ * frame, so the encoders can be run on the same input again and again.
+ *
+ * Layout (native byte order, every record 8 byte aligned):
+ *
+ *  ogon_framerec_header
+ *  frames:  ogon_framerec_frame
+ *           numRects x ogon_framerec_rect
+ *           numTiles x (ogon_framerec_tile + encoded tile data)
+ *
+ * The tile data is the XOR against the previous content of the tile, coded
+ * as pairs of UINT16 run lengths (unchanged pixels, changed pixels) each
+ * followed by the changed pixels. Recordings are meant to be mapped and read
+ * in place.
+ */
+
+#define OGON_FRAMEREC_MAGIC 0x43455246 /* "FREC" */
+#define OGON_FRAMEREC_VERSION 1
+#define OGON_FRAMEREC_TILE_SIZE 64
+
+/** @brief file header, frameCount and dataSize are set when the recording is closed */
+typedef struct _ogon_framerec_header {
+	UINT32 magic;
+	UINT32 version;
+	UINT32 width;
+	UINT32 height;
+	UINT32 tileSize;
+	UINT32 frameCount;
+	UINT64 dataSize;  /* bytes of frame records following the header */
+} ogon_framerec_header;
+
+typedef struct _ogon_framerec_frame {
+	UINT32 size;      /* of the whole record, including this header and padding */
+	UINT32 numRects;
+	UINT32 numTiles;
+	UINT32 reserved;
+	UINT64 timestamp; /* microseconds since the recording started */
+} ogon_framerec_frame;
+
+typedef struct _ogon_framerec_rect {
+	UINT16 x;
+	UINT16 y;
+	UINT16 width;
+	UINT16 height;
+} ogon_framerec_rect;
+
+typedef struct _ogon_framerec_tile {
+	UINT16 tileX;
+	UINT16 tileY;
+	UINT32 size;      /* of the encoded data following, padded to 4 bytes */
+} ogon_framerec_tile;
+
+typedef struct _ogon_frame_recorder ogon_frame_recorder;
+
+/**
+ * starts a recording of a framebuffer with 32 bits per pixel
+ * @param path created with mode 0600, must not exist yet
+ * @return NULL if the file can't be created
+ */
+ogon_frame_recorder *frame_recorder_new(const char *path, UINT32 width, UINT32 height);
+
+/** finishes the header and closes the file */
+void frame_recorder_free(ogon_frame_recorder *recorder);
+
+/** @return TRUE if the recording was started for a framebuffer of this size */
+BOOL frame_recorder_matches(const ogon_frame_recorder *recorder, UINT32 width, UINT32 height);
+
+/**
+ * records a frame, only tiles touched by the rectangles are compared
+ * @param data the framebuffer, 4 bytes per pixel
+ * @return FALSE on write errors, the recording is unusable afterwards
+ */
+BOOL frame_recorder_add_frame(ogon_frame_recorder *recorder, const BYTE *data, UINT32 scanline,
+	const ogon_framerec_rect *rects, UINT32 numRects);
+
+/** @brief a mapped recording and the framebuffer it's replayed to */
+typedef struct _ogon_frame_replay {
+	const BYTE *map;
+	size_t mapSize;
+	size_t end;         /* of the last complete frame record */
+	const ogon_framerec_header *header;
+	UINT32 width;
+	UINT32 height;
+	UINT32 frameCount;
+	size_t offset;      /* of the next frame record */
+	UINT32 frameIndex;
+	UINT64 timestamp;   /* of the last frame read */
+	BYTE *framebuffer;  /* width * 4 bytes per line */
+	UINT32 scanline;
+} ogon_frame_replay;
+
+/** maps a recording and allocates its framebuffer */
+BOOL frame_replay_open(ogon_frame_replay *replay, const char *path);
+
+void frame_replay_close(ogon_frame_replay *replay);
+
+/** clears the framebuffer and starts again with the first frame */
+void frame_replay_rewind(ogon_frame_replay *replay);
+
+/**
+ * applies the next frame to the framebuffer
+ * @param rects set to the damage rectangles of the frame, points into the mapping
+ * @return 1 if a frame was read, 0 at the end of the recording and -1 if it's corrupt,
+ *         which includes rectangles outside of the framebuffer
+ */
+int frame_replay_next(ogon_frame_replay *replay, const ogon_framerec_rect **rects, UINT32 *numRects);
+
+#ifdef __cplusplus
+};
+#endif /* __cplusplus */
+
+#endif /* _OGON_FRAMEREC_H_ */
@@ -0,0 +1,164 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * framestats
+ * Recording and formatting of the frame pipeline statistics
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#include "framestats.h"
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+static const char *metricNames[OGON_FRAME_METRIC_COUNT] = {
+	"damage_area",
+	"simplify_time",
+	"encode_bitmap",
+	"encode_rfx",
+	"encode_gfx_rfx",
+	"encode_gfx_progressive",
+	"encode_h264",
+	"frame_bytes",
+	"ack_rtt",
+	"queue_depth",
+	"input_latency",
+	"input_queue",
+	"input_render",
+	"input_encode",
+	"input_network"
+};
+
+const char *frame_stats_metric_name(OGON_FRAME_METRIC metric) {
+	if ((metric < 0) || (metric >= OGON_FRAME_METRIC_COUNT)) {
+		return "unknown";
+	}
+	return metricNames[metric];
+}
+
+UINT64 frame_stats_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (UINT64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void frame_stats_record(ogon_frame_stats *stats, OGON_FRAME_METRIC metric, UINT64 value) {
+	ogon_frame_histogram *histogram;
+	UINT32 bucket;
+
+	if ((metric < 0) || (metric >= OGON_FRAME_METRIC_COUNT)) {
+		return;
+	}
+	histogram = &stats->histograms[metric];
+
+	/* the number of significant bits is the bucket */
+	bucket = value ? 64 - __builtin_clzll(value) : 0;
+	if (bucket >= OGON_FRAME_STATS_BUCKETS) {
+		bucket = OGON_FRAME_STATS_BUCKETS - 1;
+	}
+
+	histogram->buckets[bucket]++;
+	histogram->count++;
+	histogram->sum += value;
+}
+
+void frame_stats_add(ogon_frame_stats *total, const ogon_frame_stats *stats) {
+	UINT32 metric, bucket;
+
+	total->frames += stats->frames;
+	total->suppressedFrames += stats->suppressedFrames;
+	total->bytesSent += stats->bytesSent;
+	for (metric = 0; metric < OGON_FRAME_METRIC_COUNT; metric++) {
+		ogon_frame_histogram *histogram = &total->histograms[metric];
+
+		histogram->count += stats->histograms[metric].count;
+		histogram->sum += stats->histograms[metric].sum;
+		for (bucket = 0; bucket < OGON_FRAME_STATS_BUCKETS; bucket++) {
+			histogram->buckets[bucket] += stats->histograms[metric].buckets[bucket];
+		}
+	}
+}
+
+UINT64 frame_stats_bucket_bound(UINT32 bucket) {
+	if (bucket >= OGON_FRAME_STATS_BUCKETS - 1) {
+		return UINT64_MAX;
+	}
+	return ((UINT64)1 << bucket) - 1;
+}
+
+UINT64 frame_stats_quantile(const ogon_frame_histogram *histogram, double quantile) {
+	UINT64 rank, cumulative = 0;
+	UINT32 bucket;
+
+	if (!histogram->count) {
+		return 0;
+	}
+
+	rank = (UINT64)(quantile * histogram->count);
+	if (rank >= histogram->count) {
+		rank = histogram->count - 1;
+	}
+
+	for (bucket = 0; bucket < OGON_FRAME_STATS_BUCKETS; bucket++) {
+		cumulative += histogram->buckets[bucket];
+		if (cumulative > rank) {
+			return frame_stats_bucket_bound(bucket);
+		}
+	}
+	return frame_stats_bucket_bound(OGON_FRAME_STATS_BUCKETS - 1);
+}
+
+void frame_stats_input_received(ogon_input_latency *latency, UINT64 now) {
+	if (!latency->receivedAt) {
+		latency->receivedAt = now;
+	}
+}
+
+void frame_stats_input_replied(ogon_input_latency *latency, UINT64 requestedAt, UINT64 now, BOOL damaged) {
+	/* the backend handles its messages in order, an input forwarded before the
+	 * sync request is contained in this reply */
+	if (!latency->receivedAt || (latency->receivedAt >= requestedAt)) {
+		return;
+	}
+	if (damaged) {
+		latency->requestedAt = requestedAt;
+		latency->repliedAt = now;
+	} else if (!latency->repliedAt) {
+		/* nothing to show for the input, a later frame must not be charged with it */
+		frame_stats_input_reset(latency);
+	}
+}
+
+void frame_stats_input_frame_sent(ogon_frame_stats *stats, ogon_input_latency *latency, UINT64 now) {
+	if (!latency->repliedAt) {
+		return;
+	}
+	frame_stats_record(stats, OGON_FRAME_METRIC_INPUT_QUEUE, latency->requestedAt - latency->receivedAt);
+	frame_stats_record(stats, OGON_FRAME_METRIC_INPUT_RENDER, latency->repliedAt - latency->requestedAt);
+	frame_stats_record(stats, OGON_FRAME_METRIC_INPUT_ENCODE, now - latency->repliedAt);
+	frame_stats_record(stats, OGON_FRAME_METRIC_INPUT_LATENCY, now - latency->receivedAt);
+	frame_stats_input_reset(latency);
+}
+
+void frame_stats_input_expire(ogon_input_latency *latency, UINT64 now) {
+	if (latency->receivedAt && (now - latency->receivedAt > FRAME_STATS_INPUT_EXPIRY)) {
+		frame_stats_input_reset(latency);
+	}
+}
+
+void frame_stats_input_reset(ogon_input_latency *latency) {
+	memset(latency, 0, sizeof(*latency));
+}
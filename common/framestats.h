@@ -0,0 +1,86 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * framestats
+ * Recording and formatting of the frame pipeline statistics
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifndef _OGON_COMMON_FRAMESTATS_H_
+#define _OGON_COMMON_FRAMESTATS_H_
+
+#include <ogon/framestats.h>
+
+/* an input not followed by a frame within this time (us) is no longer measured */
+#define FRAME_STATS_INPUT_EXPIRY 5000000
+
+/* timestamps of the oldest input not yet followed by a frame */
+typedef struct _ogon_input_latency {
+	UINT64 receivedAt;  /* input forwarded to the backend */
+	UINT64 requestedAt; /* sync request written after it whose reply is sent as a frame */
+	UINT64 repliedAt;   /* sync reply to that request */
+} ogon_input_latency;
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** @return the name of a metric as used in logs and the metrics output */
+const char *frame_stats_metric_name(OGON_FRAME_METRIC metric);
+
+/** @return a monotonic timestamp in microseconds */
+UINT64 frame_stats_now(void);
+
+/** adds a value to one of the histograms, cheap enough for every frame */
+void frame_stats_record(ogon_frame_stats *stats, OGON_FRAME_METRIC metric, UINT64 value);
+
+/** adds the counters and histograms of stats to total, the codec of total is kept */
+void frame_stats_add(ogon_frame_stats *total, const ogon_frame_stats *stats);
+
+/** @return the largest value counted in a bucket, UINT64_MAX for the last one */
+UINT64 frame_stats_bucket_bound(UINT32 bucket);
+
+/**
+ * estimates a quantile of a histogram
+ * @param quantile between 0.0 and 1.0
+ * @return the upper bound of the bucket the quantile falls into, 0 if empty
+ */
+UINT64 frame_stats_quantile(const ogon_frame_histogram *histogram, double quantile);
+
+/** an input was forwarded to the backend, only the oldest one pending is measured */
+void frame_stats_input_received(ogon_input_latency *latency, UINT64 now);
+
+/**
+ * a sync reply arrived, it covers the pending input if that was forwarded
+ * before the request
+ * @param damaged FALSE if the reply brings no damage, a covered input then
+ *        caused no frame and is dropped
+ */
+void frame_stats_input_replied(ogon_input_latency *latency, UINT64 requestedAt, UINT64 now, BOOL damaged);
+
+/** a frame was sent, records the input phases if it follows a covered input */
+void frame_stats_input_frame_sent(ogon_frame_stats *stats, ogon_input_latency *latency, UINT64 now);
+
+/** drops the pending input if no frame followed within FRAME_STATS_INPUT_EXPIRY */
+void frame_stats_input_expire(ogon_input_latency *latency, UINT64 now);
+
+/** drops the pending input, e.g. when the input goes to another backend */
+void frame_stats_input_reset(ogon_input_latency *latency);
+
+#ifdef __cplusplus
+};
+#endif /* __cplusplus */
+
+#endif /* _OGON_COMMON_FRAMESTATS_H_ */
@@ -0,0 +1,263 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * logontrace
+ * Per-phase span recording of the logon path
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#include "logontrace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <winpr/sysinfo.h>
+
+#define LOGON_TRACE_BUCKETS 12
+
+/* upper bounds in milliseconds, the last bucket is +Inf */
+static const UINT32 bucketBounds[LOGON_TRACE_BUCKETS - 1] = {
+	10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000
+};
+
+static const char *bucketLabels[LOGON_TRACE_BUCKETS] = {
+	"0.01", "0.025", "0.05", "0.1", "0.25", "0.5", "1", "2.5", "5", "10", "30", "+Inf"
+};
+
+static const char *phaseNames[LOGON_PHASE_COUNT] = {
+	"properties",
+	"connect",
+	"logon_call",
+	"activation",
+	"backend_init",
+	"first_frame",
+	"total",
+	"logon_user",
+	"authenticate",
+	"module_start"
+};
+
+typedef struct _logon_trace_histogram {
+	UINT64 buckets[LOGON_TRACE_BUCKETS];
+	UINT64 count;
+	UINT64 sum; /* in milliseconds */
+} logon_trace_histogram;
+
+static pthread_mutex_t histogramLock = PTHREAD_MUTEX_INITIALIZER;
+static logon_trace_histogram histograms[LOGON_PHASE_COUNT];
+
+const char *logon_trace_phase_name(LOGON_TRACE_PHASE phase) {
+	if ((phase < 0) || (phase >= LOGON_PHASE_COUNT)) {
+		return "unknown";
+	}
+	return phaseNames[phase];
+}
+
+void logon_trace_init(logon_trace *trace) {
+	memset(trace, 0, sizeof(*trace));
+}
+
+void logon_trace_begin(logon_trace *trace, LOGON_TRACE_PHASE phase) {
+	if ((phase < 0) || (phase >= LOGON_PHASE_COUNT) || (trace->ended & (1 << phase))) {
+		return;
+	}
+	trace->begin[phase] = GetTickCount64();
+	trace->begun |= (1 << phase);
+}
+
+BOOL logon_trace_end(logon_trace *trace, LOGON_TRACE_PHASE phase) {
+	UINT64 now;
+
+	if ((phase < 0) || (phase >= LOGON_PHASE_COUNT)) {
+		return FALSE;
+	}
+	if (!(trace->begun & (1 << phase)) || (trace->ended & (1 << phase))) {
+		return FALSE;
+	}
+
+	now = GetTickCount64();
+	trace->duration[phase] = (UINT32)(now - trace->begin[phase]);
+	trace->ended |= (1 << phase);
+	return TRUE;
+}
+
+void logon_trace_set(logon_trace *trace, LOGON_TRACE_PHASE phase, UINT32 duration) {
+	if ((phase < 0) || (phase >= LOGON_PHASE_COUNT)) {
+		return;
+	}
+	trace->duration[phase] = duration;
+	trace->begun |= (1 << phase);
+	trace->ended |= (1 << phase);
+}
+
+BOOL logon_trace_has(const logon_trace *trace, LOGON_TRACE_PHASE phase) {
+	if ((phase < 0) || (phase >= LOGON_PHASE_COUNT)) {
+		return FALSE;
+	}
+	return (trace->ended & (1 << phase)) ? TRUE : FALSE;
+}
+
+UINT32 logon_trace_duration(const logon_trace *trace, LOGON_TRACE_PHASE phase) {
+	if (!logon_trace_has(trace, phase)) {
+		return 0;
+	}
+	return trace->duration[phase];
+}
+
+int logon_trace_summary(const logon_trace *trace, char *buffer, size_t size) {
+	size_t written = 0;
+	int phase;
+	int ret;
+
+	if (!size) {
+		return 0;
+	}
+
+	buffer[0] = '\0';
+	for (phase = 0; phase < LOGON_PHASE_COUNT; phase++) {
+		if (!logon_trace_has(trace, (LOGON_TRACE_PHASE)phase)) {
+			continue;
+		}
+
+		ret = snprintf(buffer + written, size - written, "%s%s=%"PRIu32"ms", written ? " " : "",
+				phaseNames[phase], trace->duration[phase]);
+		if (ret < 0) {
+			break;
+		}
+		if ((size_t)ret >= size - written) {
+			written = size - 1;
+			break;
+		}
+		written += ret;
+	}
+	return (int)written;
+}
+
+void logon_trace_record(LOGON_TRACE_PHASE phase, UINT32 duration) {
+	int bucket;
+
+	if ((phase < 0) || (phase >= LOGON_PHASE_COUNT)) {
+		return;
+	}
+
+	for (bucket = 0; bucket < LOGON_TRACE_BUCKETS - 1; bucket++) {
+		if (duration <= bucketBounds[bucket]) {
+			break;
+		}
+	}
+
+	pthread_mutex_lock(&histogramLock);
+	histograms[phase].buckets[bucket]++;
+	histograms[phase].count++;
+	histograms[phase].sum += duration;
+	pthread_mutex_unlock(&histogramLock);
+}
+
+#define LOGON_TRACE_APPEND(...) \
+	do { \
+		ret = snprintf(buffer ? buffer + written : NULL, (written < size) ? size - written : 0, __VA_ARGS__); \
+		if (ret < 0) { \
+			return -1; \
+		} \
+		written += ret; \
+	} while (0)
+
+int logon_trace_format_metrics(char *buffer, size_t size) {
+	logon_trace_histogram snapshot[LOGON_PHASE_COUNT];
+	size_t written = 0;
+	UINT64 cumulative;
+	int phase, bucket;
+	int ret;
+
+	if (!buffer) {
+		size = 0;
+	}
+
+	pthread_mutex_lock(&histogramLock);
+	memcpy(snapshot, histograms, sizeof(snapshot));
+	pthread_mutex_unlock(&histogramLock);
+
+	LOGON_TRACE_APPEND("# HELP ogon_logon_phase_seconds Duration of the phases of the logon path.\n");
+	LOGON_TRACE_APPEND("# TYPE ogon_logon_phase_seconds histogram\n");
+
+	for (phase = 0; phase < LOGON_PHASE_COUNT; phase++) {
+		if (!snapshot[phase].count) {
+			continue;
+		}
+
+		cumulative = 0;
+		for (bucket = 0; bucket < LOGON_TRACE_BUCKETS; bucket++) {
+			cumulative += snapshot[phase].buckets[bucket];
+			LOGON_TRACE_APPEND("ogon_logon_phase_seconds_bucket{phase=\"%s\",le=\"%s\"} %"PRIu64"\n",
+					phaseNames[phase], bucketLabels[bucket], cumulative);
+		}
+		LOGON_TRACE_APPEND("ogon_logon_phase_seconds_sum{phase=\"%s\"} %"PRIu64".%03"PRIu64"\n",
+				phaseNames[phase], snapshot[phase].sum / 1000, snapshot[phase].sum % 1000);
+		LOGON_TRACE_APPEND("ogon_logon_phase_seconds_count{phase=\"%s\"} %"PRIu64"\n",
+				phaseNames[phase], snapshot[phase].count);
+	}
+
+	return (int)written;
+}
+
+BOOL logon_trace_write_metrics(const char *path) {
+	char *buffer = NULL;
+	char *tmpPath = NULL;
+	size_t bufferSize, pathLen;
+	FILE *fp = NULL;
+	BOOL ret = FALSE;
+	int len;
+
+	if (!path || !*path) {
+		return FALSE;
+	}
+
+	/* the histograms only grow, size the buffer with some headroom */
+	if ((len = logon_trace_format_metrics(NULL, 0)) < 0) {
+		return FALSE;
+	}
+	bufferSize = len + 1024;
+
+	pathLen = strlen(path) + 5;
+	if (!(buffer = malloc(bufferSize)) || !(tmpPath = malloc(pathLen))) {
+		goto out;
+	}
+
+	len = logon_trace_format_metrics(buffer, bufferSize);
+	if ((len < 0) || ((size_t)len >= bufferSize)) {
+		goto out;
+	}
+	snprintf(tmpPath, pathLen, "%s.tmp", path);
+
+	if (!(fp = fopen(tmpPath, "w"))) {
+		goto out;
+	}
+	if (fwrite(buffer, 1, len, fp) != (size_t)len) {
+		fclose(fp);
+		unlink(tmpPath);
+		goto out;
+	}
+	if (fclose(fp) != 0 || rename(tmpPath, path) != 0) {
+		unlink(tmpPath);
+		goto out;
+	}
+	ret = TRUE;
+
+out:
+	free(tmpPath);
+	free(buffer);
+	return ret;
+}
@@ -0,0 +1,105 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * logontrace
+ * Per-phase span recording of the logon path
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifndef _OGON_LOGONTRACE_H_
+#define _OGON_LOGONTRACE_H_
+
+#include <winpr/wtypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Phases of the logon path. The values are sent over ICP (LogonTrace), only
+ * append new phases.
+ */
+typedef enum _LOGON_TRACE_PHASE {
+	/* recorded by the rdp server */
+	LOGON_PHASE_PROPERTIES = 0,   /* ogon_icp_get_property_bulk when the connection is set up */
+	LOGON_PHASE_CONNECT,          /* TCP accept until post connect (negotiation, TLS/NLA, MCS, licensing) */
+	LOGON_PHASE_LOGON_CALL,       /* LogonUser ICP round trip */
+	LOGON_PHASE_ACTIVATION,       /* post connect until the first activation (capability exchange) */
+	LOGON_PHASE_BACKEND_INIT,     /* ogon_backend_initialize */
+	LOGON_PHASE_FIRST_FRAME,      /* backend initialized until the first SyncReply was sent out */
+	LOGON_PHASE_TOTAL,            /* TCP accept until the first frame */
+
+	/* recorded by the session manager */
+	LOGON_PHASE_LOGON_USER,       /* CallInLogonUser received until its response was queued */
+	LOGON_PHASE_AUTHENTICATE,     /* waiting for and running the authentication module (PAM) */
+	LOGON_PHASE_MODULE_START,     /* Session::startModule (backend launcher, X server or greeter) */
+
+	LOGON_PHASE_COUNT
+} LOGON_TRACE_PHASE;
+
+/** @brief spans of a single logon, owned by whoever handles the connection */
+typedef struct _logon_trace {
+	UINT64 begin[LOGON_PHASE_COUNT];
+	UINT32 duration[LOGON_PHASE_COUNT]; /* in milliseconds */
+	UINT32 begun;                       /* bit mask of started phases */
+	UINT32 ended;                       /* bit mask of finished phases */
+} logon_trace;
+
+/** @return the name of a phase as used in logs and the metrics output */
+const char *logon_trace_phase_name(LOGON_TRACE_PHASE phase);
+
+void logon_trace_init(logon_trace *trace);
+
+/** starts the span of a phase, restarting a phase that has already ended is ignored */
+void logon_trace_begin(logon_trace *trace, LOGON_TRACE_PHASE phase);
+
+/**
+ * ends the span of a phase
+ * @return TRUE if the phase was running, its duration is available then
+ */
+BOOL logon_trace_end(logon_trace *trace, LOGON_TRACE_PHASE phase);
+
+/** sets the duration of a phase measured elsewhere (i.e. by the other process) */
+void logon_trace_set(logon_trace *trace, LOGON_TRACE_PHASE phase, UINT32 duration);
+
+BOOL logon_trace_has(const logon_trace *trace, LOGON_TRACE_PHASE phase);
+UINT32 logon_trace_duration(const logon_trace *trace, LOGON_TRACE_PHASE phase);
+
+/**
+ * formats the finished phases of a trace as "phase=123ms phase=45ms ..."
+ * @return the number of characters written (excluding the terminating zero)
+ */
+int logon_trace_summary(const logon_trace *trace, char *buffer, size_t size);
+
+/** adds a phase duration (in milliseconds) to the process wide histograms */
+void logon_trace_record(LOGON_TRACE_PHASE phase, UINT32 duration);
+
+/**
+ * renders the process wide histograms in the Prometheus text exposition format
+ * @return the number of characters needed (like snprintf) or -1 on error
+ */
+int logon_trace_format_metrics(char *buffer, size_t size);
+
+/**
+ * writes the histograms to path, replacing the file atomically so that
+ * scrapers (i.e. a node_exporter textfile collector) never see partial output
+ */
+BOOL logon_trace_write_metrics(const char *path);
+
+#ifdef __cplusplus
+};
+#endif /* __cplusplus */
+
+#endif /* _OGON_LOGONTRACE_H_ */
@@ -0,0 +1,76 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Frame pipeline statistics of a connection
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Library AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifndef _OGON_FRAMESTATS_H_
+#define _OGON_FRAMESTATS_H_
+
+#include <winpr/wtypes.h>
+
+/**
+ * Number of histogram buckets. Bucket 0 counts zero values, bucket i counts
+ * values from 2^(i-1) to 2^i - 1 and the last bucket everything above.
+ */
+#define OGON_FRAME_STATS_BUCKETS 32
+
+/**
+ * The histograms kept by the rdp server for each connection. The values are
+ * sent over ICP and OTSAPI, only append new metrics.
+ */
+typedef enum _OGON_FRAME_METRIC {
+	OGON_FRAME_METRIC_DAMAGE_AREA = 0,     /* damaged pixels of a frame after simplification */
+	OGON_FRAME_METRIC_SIMPLIFY_TIME,       /* microseconds spent comparing and simplifying the damage */
+	OGON_FRAME_METRIC_ENCODE_BITMAP,       /* microseconds to encode and send a frame, per codec */
+	OGON_FRAME_METRIC_ENCODE_RFX,
+	OGON_FRAME_METRIC_ENCODE_GFX_RFX,
+	OGON_FRAME_METRIC_ENCODE_GFX_PROGRESSIVE,
+	OGON_FRAME_METRIC_ENCODE_H264,
+	OGON_FRAME_METRIC_FRAME_BYTES,         /* bytes written to the client for a frame */
+	OGON_FRAME_METRIC_ACK_RTT,             /* milliseconds from the end of a frame until the client acknowledged it */
+	OGON_FRAME_METRIC_QUEUE_DEPTH,         /* frames not yet acknowledged when a frame is sent */
+	OGON_FRAME_METRIC_INPUT_LATENCY,       /* microseconds from an input until the first frame following it was sent */
+	OGON_FRAME_METRIC_INPUT_QUEUE,         /* the phases of the input latency: until the backend was asked for that frame, */
+	OGON_FRAME_METRIC_INPUT_RENDER,        /* until the backend replied, */
+	OGON_FRAME_METRIC_INPUT_ENCODE,        /* until the frame was encoded and sent */
+	OGON_FRAME_METRIC_INPUT_NETWORK,       /* and until the client acknowledged it */
+
+	OGON_FRAME_METRIC_COUNT
+} OGON_FRAME_METRIC;
+
+/** @brief a histogram with power of two buckets */
+typedef struct _ogon_frame_histogram {
+	UINT64 count;
+	UINT64 sum;
+	UINT64 buckets[OGON_FRAME_STATS_BUCKETS];
+} ogon_frame_histogram;
+
+/** @brief counters since the connection was established */
+typedef struct _ogon_frame_stats {
+	UINT64 frames;           /* frames sent */
+	UINT64 suppressedFrames; /* frame timer ticks skipped because the bandwidth was exceeded */
+	UINT64 bytesSent;        /* sum of OGON_FRAME_METRIC_FRAME_BYTES */
+	UINT32 codecMetric;      /* the OGON_FRAME_METRIC_ENCODE_* of the codec currently used */
+	ogon_frame_histogram histograms[OGON_FRAME_METRIC_COUNT];
+} ogon_frame_stats;
+
+#endif /* _OGON_FRAMESTATS_H_ */
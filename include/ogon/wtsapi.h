@@ -0,0 +1,103 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * WTS API Library
+ * ogon specific extensions of the WTS API
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Library AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifndef _OGON_WTSAPI_H_
+#define _OGON_WTSAPI_H_
+
+#include <winpr/wtypes.h>
+#include <ogon/api.h>
+#include <ogon/framestats.h>
+
+/**
+ * WTSVirtualChannelOpenEx flag: the data written to the channel is handed to
+ * the rdp server through a shared memory ring instead of the channel pipe.
+ * Meant for bulk channels, the pipe is used if the ring can't be set up.
+ * Fails with ERROR_NOT_SUPPORTED if the rdp server doesn't support the ring.
+ */
+#define OGON_CHANNEL_OPTION_SHM_RING 0x00010000
+
+/** @brief a message for ogon_WTSVirtualChannelWriteBatch */
+typedef struct _ogon_channel_message {
+	PCHAR buffer;
+	ULONG length;
+} ogon_channel_message;
+
+/**
+ * WTSQuerySessionInformation class: the ogon_frame_stats of the connection
+ * attached to the session, collected live from the rdp server.
+ */
+#define OGON_WTS_INFO_FRAME_STATS ((WTS_INFO_CLASS)1000)
+
+/** reason of the event reported after events were lost, re-read the sessions */
+#define OGON_SESSION_EVENT_RESYNC 0
+
+/** @brief a session change as returned by ogon_WTSWaitSessionEvents */
+typedef struct _ogon_session_event {
+	DWORD reason; /* WTS_SESSION_LOGON, WTS_REMOTE_CONNECT, ... */
+	DWORD sessionId;
+} ogon_session_event;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Writes several messages to a virtual channel opened with
+ * WTSVirtualChannelOpen(Ex). Each message arrives at the client as if it was
+ * written with WTSVirtualChannelWrite, but all of them are handed to the
+ * session with as few system calls as possible.
+ *
+ * @param hChannelHandle the channel
+ * @param messages the messages to send
+ * @param count the number of messages
+ * @param pMessagesWritten receives the number of messages written completely
+ * @return TRUE if all messages were written
+ */
+OGON_API BOOL CDECL ogon_WTSVirtualChannelWriteBatch(HANDLE hChannelHandle,
+	const ogon_channel_message *messages, ULONG count, PULONG pMessagesWritten);
+
+/**
+ * Waits for changes of the sessions visible to the caller, the same changes
+ * WTSWaitSystemEvent reports but with the affected session. The first call
+ * on a server handle subscribes, only later changes are reported.
+ * If the caller fell behind and changes were lost, an event with reason
+ * OGON_SESSION_EVENT_RESYNC is returned first.
+ *
+ * @param hServer the server handle
+ * @param timeout in milliseconds, INFINITE waits until something changed
+ * @param events receives the events
+ * @param count the number of entries in events
+ * @param pReturned receives the number of events returned, 0 on timeout
+ * @return TRUE on success, FALSE with ERROR_OPERATION_ABORTED if the wait was
+ *         flushed with WTSWaitSystemEvent(WTS_EVENT_FLUSH)
+ */
+OGON_API BOOL CDECL ogon_WTSWaitSessionEvents(HANDLE hServer, DWORD timeout,
+	ogon_session_event *events, ULONG count, PULONG pReturned);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _OGON_WTSAPI_H_ */
@@ -0,0 +1,632 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Load test
+ * Headless RDP client driving many sessions
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <winpr/cmdline.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/wlog.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/client.h>
+#include <freerdp/event.h>
+#include <freerdp/gdi/gdi.h>
+#include <freerdp/gdi/gfx.h>
+#include <freerdp/client/channels.h>
+#include <freerdp/client/rdpgfx.h>
+
+#include "../common/global.h"
+#include "../common/framestats.h"
+#include "probe.h"
+
+/**
+ * Connects a number of sessions to an rdp server whose users run the
+ * synthetic backend, decodes everything like a real client would and presses
+ * a key in every session at a fixed interval. The time until the probe of the
+ * synthetic backend changed its color in the decoded framebuffer is the input
+ * latency. After a ramp up and a warm up phase the latencies, the frame rate
+ * and the cpu time of the host are measured for a while and summarized.
+ */
+
+#define DRIVER_SCANCODE_SPACE 0x39
+#define DRIVER_LATENCY_TIMEOUT 5000000 /* microseconds until a press counts as lost */
+
+typedef enum _driver_phase {
+	DRIVER_PHASE_RAMP,
+	DRIVER_PHASE_WARMUP,
+	DRIVER_PHASE_MEASURE,
+	DRIVER_PHASE_STOP,
+} driver_phase;
+
+typedef struct _driver_options {
+	const char *host;
+	UINT32 port;
+	const char *user;          /* may contain a %d for the session number */
+	const char *password;
+	const char *domain;
+	UINT32 sessions;
+	UINT32 width;
+	UINT32 height;
+	BOOL gfx;
+	UINT32 rampMs;
+	UINT32 warmupSec;
+	UINT32 durationSec;
+	UINT32 keyIntervalMs;
+} driver_options;
+
+typedef struct _driver_session {
+	UINT32 index;
+	const driver_options *options;
+	HANDLE thread;
+	rdpContext *context;
+
+	CRITICAL_SECTION lock;     /* the gfx channel paints from its own thread */
+	BOOL connected;
+	BOOL failed;
+	BOOL dropped;              /* disconnected before the end */
+	UINT32 presses;
+	UINT64 pressTime;          /* of the unanswered press, 0 if none */
+	UINT64 frames;             /* painted during the measurement */
+	UINT64 lost;
+	UINT32 *latencies;         /* microseconds, measured presses only */
+	UINT32 numLatencies;
+	UINT32 maxLatencies;
+} driver_session;
+
+typedef struct _driver_context {
+	rdpContext context;
+	driver_session *session;
+} driverContext;
+
+static volatile driver_phase driver_current_phase = DRIVER_PHASE_RAMP;
+
+static BOOL driver_probe_matches(rdpGdi *gdi, UINT32 presses) {
+	UINT32 expected = OGON_PROBE_COLOR(presses);
+	const BYTE *pixel;
+	int red, green;
+
+	if (!gdi || !gdi->primary_buffer || (gdi->width < OGON_PROBE_SIZE) || (gdi->height < OGON_PROBE_SIZE)) {
+		return FALSE;
+	}
+
+	/* the middle of the probe, BGRX */
+	pixel = gdi->primary_buffer + (OGON_PROBE_Y + OGON_PROBE_SIZE / 2) * gdi->stride +
+		(OGON_PROBE_X + OGON_PROBE_SIZE / 2) * 4;
+	red = pixel[2];
+	green = pixel[1];
+
+	/* the codecs are lossy, only tell the two colors apart */
+	if (expected == OGON_PROBE_COLOR_PRESSED) {
+		return (red > 0x60) && (green < 0x60);
+	}
+	return (green > 0x60) && (red < 0x60);
+}
+
+static void driver_add_latency(driver_session *session, UINT32 latency) {
+	if (session->numLatencies == session->maxLatencies) {
+		UINT32 max = session->maxLatencies ? session->maxLatencies * 2 : 256;
+		UINT32 *latencies = realloc(session->latencies, max * sizeof(UINT32));
+
+		if (!latencies) {
+			return;
+		}
+		session->latencies = latencies;
+		session->maxLatencies = max;
+	}
+	session->latencies[session->numLatencies++] = latency;
+}
+
+static BOOL driver_end_paint(rdpContext *context) {
+	driver_session *session = ((driverContext *)context)->session;
+	UINT64 now = frame_stats_now();
+
+	EnterCriticalSection(&session->lock);
+	if (driver_current_phase == DRIVER_PHASE_MEASURE) {
+		session->frames++;
+	}
+	if (session->pressTime && driver_probe_matches(context->gdi, session->presses)) {
+		if (driver_current_phase == DRIVER_PHASE_MEASURE) {
+			driver_add_latency(session, (UINT32)(now - session->pressTime));
+		}
+		session->pressTime = 0;
+	}
+	LeaveCriticalSection(&session->lock);
+	return TRUE;
+}
+
+static BOOL driver_desktop_resize(rdpContext *context) {
+	return gdi_resize(context->gdi, context->settings->DesktopWidth, context->settings->DesktopHeight);
+}
+
+static void driver_channel_connected(void *context, ChannelConnectedEventArgs *e) {
+	rdpContext *rdpcontext = (rdpContext *)context;
+
+	if (strcmp(e->name, RDPGFX_DVC_CHANNEL_NAME) == 0) {
+		gdi_graphics_pipeline_init(rdpcontext->gdi, (RdpgfxClientContext *)e->pInterface);
+	}
+}
+
+static void driver_channel_disconnected(void *context, ChannelDisconnectedEventArgs *e) {
+	rdpContext *rdpcontext = (rdpContext *)context;
+
+	if (strcmp(e->name, RDPGFX_DVC_CHANNEL_NAME) == 0) {
+		gdi_graphics_pipeline_uninit(rdpcontext->gdi, (RdpgfxClientContext *)e->pInterface);
+	}
+}
+
+static BOOL driver_pre_connect(freerdp *instance) {
+	rdpContext *context = instance->context;
+
+	PubSub_SubscribeChannelConnected(context->pubSub, driver_channel_connected);
+	PubSub_SubscribeChannelDisconnected(context->pubSub, driver_channel_disconnected);
+
+	return freerdp_client_load_addins(context->channels, instance->settings);
+}
+
+static BOOL driver_post_connect(freerdp *instance) {
+	if (!gdi_init(instance, PIXEL_FORMAT_BGRX32)) {
+		return FALSE;
+	}
+
+	instance->update->EndPaint = driver_end_paint;
+	instance->update->DesktopResize = driver_desktop_resize;
+	return TRUE;
+}
+
+static void driver_post_disconnect(freerdp *instance) {
+	rdpContext *context = instance->context;
+
+	PubSub_UnsubscribeChannelConnected(context->pubSub, driver_channel_connected);
+	PubSub_UnsubscribeChannelDisconnected(context->pubSub, driver_channel_disconnected);
+	gdi_free(instance);
+}
+
+static BOOL driver_client_new(freerdp *instance, rdpContext *context) {
+	OGON_UNUSED(context);
+
+	instance->PreConnect = driver_pre_connect;
+	instance->PostConnect = driver_post_connect;
+	instance->PostDisconnect = driver_post_disconnect;
+	return TRUE;
+}
+
+static BOOL driver_configure(driver_session *session, rdpSettings *settings) {
+	const driver_options *options = session->options;
+	const char *number = strstr(options->user, "%d");
+	char user[256];
+
+	/* each session needs its own user, e.g. loadtest%d */
+	if (number) {
+		snprintf(user, sizeof(user), "%.*s%"PRIu32"%s", (int)(number - options->user), options->user,
+			session->index + 1, number + 2);
+	} else {
+		snprintf(user, sizeof(user), "%s", options->user);
+	}
+
+	if (!(settings->ServerHostname = _strdup(options->host)) ||
+		!(settings->Username = _strdup(user)) ||
+		(options->password && !(settings->Password = _strdup(options->password))) ||
+		(options->domain && !(settings->Domain = _strdup(options->domain))))
+	{
+		return FALSE;
+	}
+
+	settings->ServerPort = options->port;
+	settings->DesktopWidth = options->width;
+	settings->DesktopHeight = options->height;
+	settings->ColorDepth = 32;
+	settings->IgnoreCertificate = TRUE;
+	settings->SoftwareGdi = TRUE;
+	settings->RemoteFxCodec = TRUE;
+	settings->FastPathOutput = TRUE;
+	settings->FrameMarkerCommandEnabled = TRUE;
+	settings->SurfaceFrameMarkerEnabled = TRUE;
+	settings->SupportGraphicsPipeline = options->gfx;
+	return TRUE;
+}
+
+static void driver_press(driver_session *session, UINT64 now) {
+	rdpInput *input = session->context->input;
+
+	EnterCriticalSection(&session->lock);
+	if (session->pressTime) {
+		/* the previous press never showed up */
+		if (now - session->pressTime < DRIVER_LATENCY_TIMEOUT) {
+			LeaveCriticalSection(&session->lock);
+			return;
+		}
+		if (driver_current_phase == DRIVER_PHASE_MEASURE) {
+			session->lost++;
+		}
+	}
+	session->presses++;
+	session->pressTime = now;
+	LeaveCriticalSection(&session->lock);
+
+	freerdp_input_send_keyboard_event(input, KBD_FLAGS_DOWN, DRIVER_SCANCODE_SPACE);
+	freerdp_input_send_keyboard_event(input, KBD_FLAGS_RELEASE, DRIVER_SCANCODE_SPACE);
+}
+
+static DWORD WINAPI driver_session_thread(LPVOID arg) {
+	driver_session *session = (driver_session *)arg;
+	freerdp *instance = session->context->instance;
+	UINT64 interval = session->options->keyIntervalMs * 1000ULL;
+	/* spread the presses of the sessions over the interval */
+	UINT64 nextPress = frame_stats_now() + interval * session->index / MAX(session->options->sessions, 1);
+
+	if (!freerdp_connect(instance)) {
+		fprintf(stderr, "session %"PRIu32": connection failed (0x%08"PRIX32")\n", session->index + 1,
+			freerdp_get_last_error(session->context));
+		session->failed = TRUE;
+		return 0;
+	}
+	session->connected = TRUE;
+
+	while (driver_current_phase != DRIVER_PHASE_STOP) {
+		HANDLE handles[64];
+		DWORD count;
+		UINT64 now = frame_stats_now();
+		DWORD timeout = (nextPress > now) ? (DWORD)((nextPress - now) / 1000) : 0;
+
+		if (freerdp_shall_disconnect(instance)) {
+			fprintf(stderr, "session %"PRIu32": disconnected by the server\n", session->index + 1);
+			session->dropped = TRUE;
+			break;
+		}
+
+		if (!(count = freerdp_get_event_handles(session->context, handles, ARRAYSIZE(handles)))) {
+			session->dropped = TRUE;
+			break;
+		}
+
+		if (WaitForMultipleObjects(count, handles, FALSE, MIN(timeout, 100)) == WAIT_FAILED) {
+			session->dropped = TRUE;
+			break;
+		}
+
+		if (!freerdp_check_event_handles(session->context)) {
+			fprintf(stderr, "session %"PRIu32": connection lost\n", session->index + 1);
+			session->dropped = TRUE;
+			break;
+		}
+
+		now = frame_stats_now();
+		if (interval && (now >= nextPress)) {
+			driver_press(session, now);
+			nextPress += interval;
+			if (nextPress < now) {
+				nextPress = now + interval;
+			}
+		}
+	}
+
+	freerdp_disconnect(instance);
+	return 0;
+}
+
+/** @return busy and total jiffies of all cpus */
+static BOOL driver_host_cpu(UINT64 *busy, UINT64 *total) {
+	unsigned long long v[8] = { 0 };
+	FILE *fp = fopen("/proc/stat", "r");
+	int n, i;
+
+	if (!fp) {
+		return FALSE;
+	}
+	n = fscanf(fp, "cpu %llu %llu %llu %llu %llu %llu %llu %llu", &v[0], &v[1], &v[2], &v[3],
+		&v[4], &v[5], &v[6], &v[7]);
+	fclose(fp);
+	if (n < 4) {
+		return FALSE;
+	}
+
+	*total = 0;
+	for (i = 0; i < 8; i++) {
+		*total += v[i];
+	}
+	/* idle and iowait */
+	*busy = *total - v[3] - v[4];
+	return TRUE;
+}
+
+/** @return cpu time of this process in microseconds */
+static UINT64 driver_own_cpu(void) {
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) < 0) {
+		return 0;
+	}
+	return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ULL +
+		usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static int driver_compare_latency(const void *a, const void *b) {
+	UINT32 la = *(const UINT32 *)a;
+	UINT32 lb = *(const UINT32 *)b;
+
+	return (la > lb) - (la < lb);
+}
+
+static void driver_report(driver_session *sessions, UINT32 count, UINT64 measureTime,
+	UINT64 hostBusy, UINT64 hostTotal, UINT64 ownCpu)
+{
+	UINT32 i, connected = 0, failed = 0, dropped = 0, numLatencies = 0;
+	UINT64 frames = 0, lost = 0;
+	UINT32 *latencies = NULL;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	double hostCpu, driverCpu, serverCpu;
+
+	for (i = 0; i < count; i++) {
+		connected += sessions[i].connected ? 1 : 0;
+		failed += sessions[i].failed ? 1 : 0;
+		dropped += sessions[i].dropped ? 1 : 0;
+		frames += sessions[i].frames;
+		lost += sessions[i].lost;
+		numLatencies += sessions[i].numLatencies;
+	}
+
+	printf("sessions:      %"PRIu32" requested, %"PRIu32" connected, %"PRIu32" failed, %"PRIu32" dropped\n",
+		count, connected, failed, dropped);
+	if (!connected || !measureTime) {
+		return;
+	}
+
+	printf("frame rate:    %.1f fps per session\n", frames * 1000000.0 / measureTime / connected);
+
+	if (numLatencies && (latencies = malloc(numLatencies * sizeof(UINT32)))) {
+		UINT32 n = 0;
+
+		for (i = 0; i < count; i++) {
+			memcpy(latencies + n, sessions[i].latencies, sessions[i].numLatencies * sizeof(UINT32));
+			n += sessions[i].numLatencies;
+		}
+		qsort(latencies, numLatencies, sizeof(UINT32), driver_compare_latency);
+		printf("input latency: %"PRIu32" presses, p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms, %"PRIu64" lost\n",
+			numLatencies,
+			latencies[numLatencies / 2] / 1000.0,
+			latencies[(UINT64)numLatencies * 90 / 100] / 1000.0,
+			latencies[(UINT64)numLatencies * 99 / 100] / 1000.0,
+			latencies[numLatencies - 1] / 1000.0,
+			lost);
+		free(latencies);
+	} else {
+		printf("input latency: no presses measured, %"PRIu64" lost\n", lost);
+	}
+
+	if (hostTotal && (cpus > 0)) {
+		/* in percent of one cpu */
+		hostCpu = 100.0 * cpus * hostBusy / hostTotal;
+		driverCpu = 100.0 * ownCpu / measureTime;
+		serverCpu = hostCpu > driverCpu ? hostCpu - driverCpu : 0.0;
+		printf("host cpu:      %.1f%% of one cpu (%ld cpus), load driver %.1f%%\n", hostCpu, cpus, driverCpu);
+		printf("cpu/session:   %.2f%% of one cpu, without the load driver\n", serverCpu / connected);
+	}
+}
+
+static COMMAND_LINE_ARGUMENT_A driver_args[] = {
+	{ "help", COMMAND_LINE_VALUE_FLAG, "", NULL, NULL, -1, NULL, "show help screen" },
+	{ "host", COMMAND_LINE_VALUE_REQUIRED, "<host>", "localhost", NULL, -1, NULL, "rdp server" },
+	{ "port", COMMAND_LINE_VALUE_REQUIRED, "<port>", "3389", NULL, -1, NULL, "rdp server port" },
+	{ "user", COMMAND_LINE_VALUE_REQUIRED, "<name>", NULL, NULL, -1, NULL, "user name, %d is the session number" },
+	{ "password", COMMAND_LINE_VALUE_REQUIRED, "<password>", NULL, NULL, -1, NULL, "password of all users" },
+	{ "domain", COMMAND_LINE_VALUE_REQUIRED, "<domain>", NULL, NULL, -1, NULL, "domain of all users" },
+	{ "sessions", COMMAND_LINE_VALUE_REQUIRED, "<number>", "1", NULL, -1, NULL, "sessions to open" },
+	{ "size", COMMAND_LINE_VALUE_REQUIRED, "<width>x<height>", "1024x768", NULL, -1, NULL, "desktop size" },
+	{ "gfx", COMMAND_LINE_VALUE_FLAG, "", NULL, NULL, -1, NULL, "use the graphics pipeline" },
+	{ "ramp", COMMAND_LINE_VALUE_REQUIRED, "<ms>", "500", NULL, -1, NULL, "delay between connections" },
+	{ "warmup", COMMAND_LINE_VALUE_REQUIRED, "<s>", "5", NULL, -1, NULL, "wait after the last connection" },
+	{ "duration", COMMAND_LINE_VALUE_REQUIRED, "<s>", "60", NULL, -1, NULL, "length of the measurement" },
+	{ "key-interval", COMMAND_LINE_VALUE_REQUIRED, "<ms>", "1000", NULL, -1, NULL, "time between key presses" },
+	{ NULL, 0, NULL, NULL, NULL, -1, NULL, NULL }
+};
+
+static void printhelp(const char *bin) {
+	printf("Usage: %s --user=<name> [options]\n", bin);
+	printf("\nOptions:\n");
+	printf("    --host=<host>              rdp server, default localhost\n");
+	printf("    --port=<port>              rdp server port, default 3389\n");
+	printf("    --user=<name>              user name, a %%d is replaced by the session number\n");
+	printf("    --password=<password>      password of all users\n");
+	printf("    --domain=<domain>          domain of all users\n");
+	printf("    --sessions=<number>        sessions to open, default 1\n");
+	printf("    --size=<width>x<height>    desktop size, default 1024x768\n");
+	printf("    --gfx                      use the graphics pipeline\n");
+	printf("    --ramp=<ms>                delay between connections, default 500\n");
+	printf("    --warmup=<s>               wait after the last connection, default 5\n");
+	printf("    --duration=<s>             length of the measurement, default 60\n");
+	printf("    --key-interval=<ms>        time between key presses in a session, default 1000, 0 disables\n");
+	printf("    --help                     show this help screen\n");
+}
+
+int main(int argc, char **argv) {
+	driver_options options;
+	driver_session *sessions;
+	COMMAND_LINE_ARGUMENT_A *arg;
+	RDP_CLIENT_ENTRY_POINTS entryPoints;
+	UINT64 startBusy = 0, startTotal = 0, endBusy = 0, endTotal = 0;
+	UINT64 startOwn, ownCpu, start, measureTime;
+	BOOL haveCpu;
+	DWORD flags;
+	UINT32 i;
+	int status;
+
+	memset(&options, 0, sizeof(options));
+	options.host = "localhost";
+	options.port = 3389;
+	options.sessions = 1;
+	options.width = 1024;
+	options.height = 768;
+	options.rampMs = 500;
+	options.warmupSec = 5;
+	options.durationSec = 60;
+	options.keyIntervalMs = 1000;
+
+	flags = COMMAND_LINE_SEPARATOR_EQUAL | COMMAND_LINE_SIGIL_DOUBLE_DASH;
+	status = CommandLineParseArgumentsA(argc, argv, driver_args, flags, NULL, NULL, NULL);
+	if (status != 0) {
+		printhelp(argv[0]);
+		return 1;
+	}
+
+	arg = driver_args;
+	do {
+		if (!(arg->Flags & COMMAND_LINE_VALUE_PRESENT))
+			continue;
+
+		CommandLineSwitchStart(arg)
+
+		CommandLineSwitchCase(arg, "help") {
+			printhelp(argv[0]);
+			return 0;
+		}
+		CommandLineSwitchCase(arg, "host") {
+			options.host = arg->Value;
+		}
+		CommandLineSwitchCase(arg, "port") {
+			options.port = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchCase(arg, "user") {
+			options.user = arg->Value;
+		}
+		CommandLineSwitchCase(arg, "password") {
+			options.password = arg->Value;
+		}
+		CommandLineSwitchCase(arg, "domain") {
+			options.domain = arg->Value;
+		}
+		CommandLineSwitchCase(arg, "sessions") {
+			options.sessions = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchCase(arg, "size") {
+			if (sscanf(arg->Value, "%"SCNu32"x%"SCNu32"", &options.width, &options.height) != 2) {
+				options.width = 0;
+			}
+		}
+		CommandLineSwitchCase(arg, "gfx") {
+			options.gfx = TRUE;
+		}
+		CommandLineSwitchCase(arg, "ramp") {
+			options.rampMs = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchCase(arg, "warmup") {
+			options.warmupSec = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchCase(arg, "duration") {
+			options.durationSec = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchCase(arg, "key-interval") {
+			options.keyIntervalMs = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchEnd(arg)
+	}
+	while ((arg = CommandLineFindNextArgumentA(arg)) != NULL);
+
+	if (!options.user || !options.sessions || !options.width || !options.height || !options.durationSec) {
+		printhelp(argv[0]);
+		return 1;
+	}
+
+	WLog_SetLogLevel(WLog_GetRoot(), WLOG_ERROR);
+
+	if (!(sessions = calloc(options.sessions, sizeof(driver_session)))) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	memset(&entryPoints, 0, sizeof(entryPoints));
+	entryPoints.Version = RDP_CLIENT_INTERFACE_VERSION;
+	entryPoints.Size = sizeof(RDP_CLIENT_ENTRY_POINTS_V1);
+	entryPoints.ContextSize = sizeof(driverContext);
+	entryPoints.ClientNew = driver_client_new;
+
+	for (i = 0; i < options.sessions; i++) {
+		sessions[i].index = i;
+		sessions[i].options = &options;
+		InitializeCriticalSection(&sessions[i].lock);
+	}
+
+	for (i = 0; i < options.sessions; i++) {
+		driver_session *session = &sessions[i];
+
+		if (!(session->context = freerdp_client_context_new(&entryPoints))) {
+			fprintf(stderr, "session %"PRIu32": unable to create the client\n", i + 1);
+			break;
+		}
+		((driverContext *)session->context)->session = session;
+
+		if (!driver_configure(session, session->context->settings) ||
+			!(session->thread = CreateThread(NULL, 0, driver_session_thread, session, 0, NULL)))
+		{
+			fprintf(stderr, "session %"PRIu32": unable to start the client\n", i + 1);
+			break;
+		}
+
+		if (i + 1 < options.sessions) {
+			Sleep(options.rampMs);
+		}
+	}
+
+	driver_current_phase = DRIVER_PHASE_WARMUP;
+	printf("%"PRIu32" sessions started, warming up for %"PRIu32" s\n", i, options.warmupSec);
+	Sleep(options.warmupSec * 1000);
+
+	haveCpu = driver_host_cpu(&startBusy, &startTotal);
+	startOwn = driver_own_cpu();
+	start = frame_stats_now();
+	driver_current_phase = DRIVER_PHASE_MEASURE;
+	printf("measuring for %"PRIu32" s\n\n", options.durationSec);
+	Sleep(options.durationSec * 1000);
+
+	driver_current_phase = DRIVER_PHASE_STOP;
+	measureTime = frame_stats_now() - start;
+	ownCpu = driver_own_cpu() - startOwn;
+	haveCpu = haveCpu && driver_host_cpu(&endBusy, &endTotal);
+
+	for (i = 0; i < options.sessions; i++) {
+		if (sessions[i].thread) {
+			WaitForSingleObject(sessions[i].thread, INFINITE);
+			CloseHandle(sessions[i].thread);
+		}
+	}
+
+	driver_report(sessions, options.sessions, measureTime, haveCpu ? endBusy - startBusy : 0,
+		haveCpu ? endTotal - startTotal : 0, ownCpu);
+
+	for (i = 0; i < options.sessions; i++) {
+		driver_session *session = &sessions[i];
+
+		if (session->context) {
+			freerdp_client_context_free(session->context);
+		}
+		DeleteCriticalSection(&session->lock);
+		free(session->latencies);
+	}
+	free(sessions);
+	return 0;
+}
@@ -0,0 +1,42 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Load test
+ * Input latency probe shared by the synthetic backend and the load driver
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifndef _OGON_LOADTEST_PROBE_H_
+#define _OGON_LOADTEST_PROBE_H_
+
+/**
+ * The synthetic backend paints a square in the top left corner which
+ * alternates between two colors on every key or mouse button press. The load
+ * driver presses a key and waits until the client's framebuffer shows the
+ * other color: the time in between is the input latency of the whole chain
+ * (rdp server, backend, encoder, network and decoder).
+ */
+#define OGON_PROBE_X 0
+#define OGON_PROBE_Y 0
+#define OGON_PROBE_SIZE 16
+
+/* colors are XRGB, the codecs are lossy so they are far apart */
+#define OGON_PROBE_COLOR_RELEASED 0xFF00C000
+#define OGON_PROBE_COLOR_PRESSED 0xFFC000C0
+
+/** @return the color of the probe after a number of presses */
+#define OGON_PROBE_COLOR(presses) (((presses) & 1) ? OGON_PROBE_COLOR_PRESSED : OGON_PROBE_COLOR_RELEASED)
+
+#endif /* _OGON_LOADTEST_PROBE_H_ */
@@ -0,0 +1,958 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Load test
+ * Synthetic content provider
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+
+#include <winpr/cmdline.h>
+#include <winpr/sysinfo.h>
+#include <winpr/wlog.h>
+
+#include <ogon/backend.h>
+#include <ogon/service.h>
+#include <ogon/dmgbuf.h>
+#include <ogon/version.h>
+
+#include "../common/global.h"
+#include "../rdp-server/font8x8.h"
+#include "probe.h"
+
+#define TAG OGON_TAG("loadtest.backend")
+
+/**
+ * A backend without any real application behind it. It speaks the complete
+ * backend protocol and draws one of a few canned workloads, so the cost of
+ * the rdp server can be measured without the noise of X11 or weston. Like a
+ * real backend it only answers a sync request when something changed.
+ */
+
+typedef enum _synth_workload_type {
+	SYNTH_WORKLOAD_IDLE,
+	SYNTH_WORKLOAD_TYPING,   /* characters appear in a text area */
+	SYNTH_WORKLOAD_SCROLL,   /* a text area scrolls up continuously */
+	SYNTH_WORKLOAD_VIDEO,    /* the whole screen changes to random pixels every frame */
+	SYNTH_WORKLOAD_DRAG,     /* a window moves over the desktop */
+} synth_workload_type;
+
+typedef struct _synth_workload {
+	const char *name;
+	synth_workload_type type;
+	UINT32 defaultRate;
+	const char *rateUnit;
+} synth_workload;
+
+static const synth_workload synth_workloads[] = {
+	{ "idle", SYNTH_WORKLOAD_IDLE, 0, "" },
+	{ "typing", SYNTH_WORKLOAD_TYPING, 15, "characters/s" },
+	{ "scroll", SYNTH_WORKLOAD_SCROLL, 200, "pixels/s" },
+	{ "video", SYNTH_WORKLOAD_VIDEO, 0, "" },
+	{ "drag", SYNTH_WORKLOAD_DRAG, 300, "pixels/s" },
+	{ NULL, 0, 0, NULL }
+};
+
+#define SYNTH_MAX_DAMAGE 32
+#define SYNTH_MARGIN 40
+#define SYNTH_LINE_HEIGHT 10
+#define SYNTH_CELL_WIDTH 9
+#define SYNTH_WINDOW_WIDTH 320
+#define SYNTH_WINDOW_HEIGHT 200
+#define SYNTH_TITLE_HEIGHT 20
+#define SYNTH_POINTER_SIZE 32
+
+#define SYNTH_COLOR_TEXT 0xFF000000
+#define SYNTH_COLOR_PAPER 0xFFFFFFFF
+#define SYNTH_COLOR_TITLE 0xFF2050A0
+
+static const char synth_text[] =
+	"ogon is a free remote desktop services solution. The rdp server encodes what the "
+	"backend draws and sends it to the client, this backend draws a synthetic workload "
+	"so the server can be measured without a desktop behind it. The quick brown fox "
+	"jumps over the lazy dog 0123456789 ";
+
+typedef struct _synth_backend {
+	ogon_backend_service *service;
+	const synth_workload *workload;
+	UINT32 rate;
+
+	UINT32 width;
+	UINT32 height;
+	UINT32 scanline;
+	BYTE *framebuffer;
+	RDP_RECT area;             /* text area of the typing and scroll workloads */
+
+	void *damageBuffer;
+	INT32 bufferId;
+	INT32 pendingSync;         /* buffer id of an unanswered sync request, -1 if none */
+	BOOL fullRefresh;          /* the shared buffer has to be filled completely */
+	RDP_RECT damage[SYNTH_MAX_DAMAGE];
+	UINT32 numDamage;
+
+	UINT64 start;              /* milliseconds, the workload is a function of the time */
+	UINT64 progress;           /* characters typed or pixels scrolled */
+	UINT32 presses;
+	UINT32 seed;
+
+	INT32 windowX;
+	INT32 windowY;
+	BOOL dragging;             /* the window follows the mouse */
+	INT32 dragX;
+	INT32 dragY;
+} synth_backend;
+
+static UINT32 synth_background(UINT32 x, UINT32 y) {
+	/* a gradient so the codecs have something better than a solid color */
+	return 0xFF000000 | (((y >> 3) & 0x3F) + 0x20) << 16 | (((x >> 4) & 0x3F) + 0x40) << 8 | 0xA0;
+}
+
+static void synth_add_damage(synth_backend *synth, INT32 x, INT32 y, INT32 width, INT32 height) {
+	RDP_RECT *rect;
+	UINT32 i;
+	INT32 right, bottom;
+
+	if (x < 0) {
+		width += x;
+		x = 0;
+	}
+	if (y < 0) {
+		height += y;
+		y = 0;
+	}
+	if (x + width > (INT32)synth->width) {
+		width = synth->width - x;
+	}
+	if (y + height > (INT32)synth->height) {
+		height = synth->height - y;
+	}
+	if ((width <= 0) || (height <= 0)) {
+		return;
+	}
+
+	if (synth->numDamage < SYNTH_MAX_DAMAGE) {
+		rect = &synth->damage[synth->numDamage++];
+		rect->x = x;
+		rect->y = y;
+		rect->width = width;
+		rect->height = height;
+		return;
+	}
+
+	/* out of rectangles, fall back to the bounding box */
+	right = x + width;
+	bottom = y + height;
+	for (i = 0; i < synth->numDamage; i++) {
+		rect = &synth->damage[i];
+		right = MAX(right, rect->x + rect->width);
+		bottom = MAX(bottom, rect->y + rect->height);
+		x = MIN(x, rect->x);
+		y = MIN(y, rect->y);
+	}
+	rect = &synth->damage[0];
+	rect->x = x;
+	rect->y = y;
+	rect->width = right - x;
+	rect->height = bottom - y;
+	synth->numDamage = 1;
+}
+
+static void synth_fill(synth_backend *synth, INT32 x, INT32 y, INT32 width, INT32 height, UINT32 color) {
+	INT32 i, j;
+
+	for (j = MAX(y, 0); j < MIN(y + height, (INT32)synth->height); j++) {
+		UINT32 *line = (UINT32 *)(synth->framebuffer + j * synth->scanline);
+		for (i = MAX(x, 0); i < MIN(x + width, (INT32)synth->width); i++) {
+			line[i] = color;
+		}
+	}
+}
+
+static void synth_fill_background(synth_backend *synth, INT32 x, INT32 y, INT32 width, INT32 height) {
+	INT32 i, j;
+
+	for (j = MAX(y, 0); j < MIN(y + height, (INT32)synth->height); j++) {
+		UINT32 *line = (UINT32 *)(synth->framebuffer + j * synth->scanline);
+		for (i = MAX(x, 0); i < MIN(x + width, (INT32)synth->width); i++) {
+			line[i] = synth_background(i, j);
+		}
+	}
+}
+
+/** draws one pixel row of a text line, rows 8 and 9 are the space between lines */
+static void synth_draw_text_row(synth_backend *synth, INT32 x, INT32 y, UINT32 maxWidth,
+	const char *text, UINT32 length, UINT32 row)
+{
+	UINT32 *line = (UINT32 *)(synth->framebuffer + y * synth->scanline) + x;
+	UINT32 i, bit;
+
+	for (i = 0; i < maxWidth; i++) {
+		line[i] = SYNTH_COLOR_PAPER;
+	}
+	if (row >= 8) {
+		return;
+	}
+	for (i = 0; (i < length) && ((i + 1) * SYNTH_CELL_WIDTH <= maxWidth); i++) {
+		char glyph = font8x8[text[i] & 0x7F][row];
+		for (bit = 0; bit < 8; bit++) {
+			if (glyph & (1 << bit)) {
+				line[i * SYNTH_CELL_WIDTH + bit] = SYNTH_COLOR_TEXT;
+			}
+		}
+	}
+}
+
+static void synth_draw_char(synth_backend *synth, INT32 x, INT32 y, char c) {
+	UINT32 row;
+
+	for (row = 0; row < 8; row++) {
+		UINT32 *line = (UINT32 *)(synth->framebuffer + (y + row) * synth->scanline) + x;
+		char glyph = font8x8[c & 0x7F][row];
+		UINT32 bit;
+
+		for (bit = 0; bit < 8; bit++) {
+			line[bit] = (glyph & (1 << bit)) ? SYNTH_COLOR_TEXT : SYNTH_COLOR_PAPER;
+		}
+	}
+}
+
+/** @return the text of line n of the endless text the scroll workload shows */
+static const char *synth_scroll_line(UINT64 n, UINT32 *length) {
+	UINT32 total = sizeof(synth_text) - 1;
+	UINT32 offset = (UINT32)((n * 37) % total);
+
+	*length = total - offset;
+	return synth_text + offset;
+}
+
+static void synth_draw_probe(synth_backend *synth) {
+	synth_fill(synth, OGON_PROBE_X, OGON_PROBE_Y, OGON_PROBE_SIZE, OGON_PROBE_SIZE,
+		OGON_PROBE_COLOR(synth->presses));
+}
+
+static void synth_draw_window(synth_backend *synth, INT32 x, INT32 y) {
+	INT32 width = MIN(SYNTH_WINDOW_WIDTH, (INT32)synth->width);
+	INT32 height = MIN(SYNTH_WINDOW_HEIGHT, (INT32)synth->height);
+	UINT32 row, length = sizeof(synth_text) - 1;
+	INT32 j;
+
+	synth_fill(synth, x, y, width, SYNTH_TITLE_HEIGHT, SYNTH_COLOR_TITLE);
+	for (j = SYNTH_TITLE_HEIGHT; j < height; j++) {
+		if ((y + j < 0) || (y + j >= (INT32)synth->height)) {
+			continue;
+		}
+		row = (j - SYNTH_TITLE_HEIGHT) / SYNTH_LINE_HEIGHT;
+		if (x >= 0 && (x + width <= (INT32)synth->width)) {
+			const char *text = synth_text + (row * 29) % length;
+			synth_draw_text_row(synth, x, y + j, width, text, length - (text - synth_text),
+				(j - SYNTH_TITLE_HEIGHT) % SYNTH_LINE_HEIGHT);
+		} else {
+			synth_fill(synth, x, y + j, width, 1, SYNTH_COLOR_PAPER);
+		}
+	}
+}
+
+static void synth_window_position(synth_backend *synth, UINT64 now, INT32 *x, INT32 *y) {
+	INT32 rangeX = synth->width - MIN(SYNTH_WINDOW_WIDTH, synth->width);
+	INT32 rangeY = synth->height - MIN(SYNTH_WINDOW_HEIGHT, synth->height);
+	UINT64 distance = (now - synth->start) * synth->rate / 1000;
+
+	/* bounces between the screen edges, a bit slower vertically */
+	*x = rangeX ? (INT32)(distance % (2 * rangeX)) : 0;
+	*y = rangeY ? (INT32)((distance * 3 / 5) % (2 * rangeY)) : 0;
+	if (*x > rangeX) {
+		*x = 2 * rangeX - *x;
+	}
+	if (*y > rangeY) {
+		*y = 2 * rangeY - *y;
+	}
+}
+
+static void synth_move_window(synth_backend *synth, INT32 x, INT32 y) {
+	INT32 width = MIN(SYNTH_WINDOW_WIDTH, (INT32)synth->width);
+	INT32 height = MIN(SYNTH_WINDOW_HEIGHT, (INT32)synth->height);
+
+	if ((x == synth->windowX) && (y == synth->windowY)) {
+		return;
+	}
+
+	synth_fill_background(synth, synth->windowX, synth->windowY, width, height);
+	synth_add_damage(synth, synth->windowX, synth->windowY, width, height);
+	synth->windowX = x;
+	synth->windowY = y;
+	synth_draw_window(synth, x, y);
+	synth_add_damage(synth, x, y, width, height);
+}
+
+/** draws the initial screen of the workload */
+static void synth_reset(synth_backend *synth, UINT64 now) {
+	synth->start = now;
+	synth->progress = 0;
+	synth->numDamage = 0;
+	synth->dragging = FALSE;
+
+	synth->area.x = SYNTH_MARGIN;
+	synth->area.y = SYNTH_MARGIN;
+	synth->area.width = (synth->width > 4 * SYNTH_MARGIN) ? synth->width - 2 * SYNTH_MARGIN : synth->width;
+	synth->area.height = (synth->height > 4 * SYNTH_MARGIN) ? synth->height - 2 * SYNTH_MARGIN : synth->height;
+	if ((UINT32)synth->area.width == synth->width) {
+		synth->area.x = 0;
+	}
+	if ((UINT32)synth->area.height == synth->height) {
+		synth->area.y = 0;
+	}
+
+	synth_fill_background(synth, 0, 0, synth->width, synth->height);
+
+	switch (synth->workload->type) {
+		case SYNTH_WORKLOAD_TYPING:
+		case SYNTH_WORKLOAD_SCROLL:
+			synth_fill(synth, synth->area.x, synth->area.y, synth->area.width, synth->area.height,
+				SYNTH_COLOR_PAPER);
+			break;
+		case SYNTH_WORKLOAD_IDLE:
+		case SYNTH_WORKLOAD_DRAG:
+			synth_window_position(synth, now, &synth->windowX, &synth->windowY);
+			synth_draw_window(synth, synth->windowX, synth->windowY);
+			break;
+		default:
+			break;
+	}
+
+	synth_draw_probe(synth);
+	synth_add_damage(synth, 0, 0, synth->width, synth->height);
+}
+
+static void synth_advance_typing(synth_backend *synth, UINT64 target) {
+	UINT32 columns = synth->area.width / SYNTH_CELL_WIDTH;
+	UINT32 lines = synth->area.height / SYNTH_LINE_HEIGHT;
+	UINT32 length = sizeof(synth_text) - 1;
+
+	if (!columns || !lines) {
+		synth->progress = target;
+		return;
+	}
+
+	/* after a long pause only the last page is drawn */
+	if (target - synth->progress > columns * lines) {
+		synth->progress = target - target % (columns * lines);
+	}
+
+	for (; synth->progress < target; synth->progress++) {
+		UINT32 cell = synth->progress % (columns * lines);
+		INT32 x = synth->area.x + (cell % columns) * SYNTH_CELL_WIDTH;
+		INT32 y = synth->area.y + (cell / columns) * SYNTH_LINE_HEIGHT;
+
+		if (!cell) {
+			/* the page is full, start over with an empty one */
+			synth_fill(synth, synth->area.x, synth->area.y, synth->area.width, synth->area.height,
+				SYNTH_COLOR_PAPER);
+			synth_add_damage(synth, synth->area.x, synth->area.y, synth->area.width, synth->area.height);
+		}
+		synth_draw_char(synth, x, y, synth_text[synth->progress % length]);
+		synth_add_damage(synth, x, y, 8, 8);
+	}
+}
+
+static void synth_advance_scroll(synth_backend *synth, UINT64 target) {
+	UINT32 delta = (UINT32)MIN(target - synth->progress, (UINT64)synth->area.height);
+	UINT32 rowBytes = synth->area.width * 4;
+	UINT32 keep = synth->area.height - delta;
+	UINT32 j, length;
+	const char *text;
+	BYTE *dst;
+
+	if (!delta) {
+		return;
+	}
+
+	/* move the text up, then draw the rows which scrolled in at the bottom */
+	dst = synth->framebuffer + synth->area.y * synth->scanline + synth->area.x * 4;
+	for (j = 0; j < keep; j++, dst += synth->scanline) {
+		memmove(dst, dst + delta * synth->scanline, rowBytes);
+	}
+
+	for (j = 0; j < delta; j++) {
+		UINT64 row = target - delta + j + synth->area.height;
+		text = synth_scroll_line(row / SYNTH_LINE_HEIGHT, &length);
+		synth_draw_text_row(synth, synth->area.x, synth->area.y + keep + j, synth->area.width,
+			text, length, row % SYNTH_LINE_HEIGHT);
+	}
+
+	synth->progress = target;
+	synth_add_damage(synth, synth->area.x, synth->area.y, synth->area.width, synth->area.height);
+}
+
+static void synth_advance_video(synth_backend *synth) {
+	UINT32 x, y;
+	UINT32 seed = synth->seed ? synth->seed : 2463534242U;
+
+	for (y = 0; y < synth->height; y++) {
+		UINT32 *line = (UINT32 *)(synth->framebuffer + y * synth->scanline);
+		for (x = 0; x < synth->width; x++) {
+			seed ^= seed << 13;
+			seed ^= seed >> 17;
+			seed ^= seed << 5;
+			line[x] = seed | 0xFF000000;
+		}
+	}
+	synth->seed = seed;
+	synth_add_damage(synth, 0, 0, synth->width, synth->height);
+}
+
+/** renders everything which is due at the given time */
+static void synth_advance(synth_backend *synth, UINT64 now) {
+	UINT64 target = (now - synth->start) * synth->rate / 1000;
+	UINT32 i;
+	INT32 x, y;
+
+	switch (synth->workload->type) {
+		case SYNTH_WORKLOAD_TYPING:
+			synth_advance_typing(synth, target);
+			break;
+		case SYNTH_WORKLOAD_SCROLL:
+			synth_advance_scroll(synth, target);
+			break;
+		case SYNTH_WORKLOAD_VIDEO:
+			synth_advance_video(synth);
+			break;
+		case SYNTH_WORKLOAD_DRAG:
+			if (!synth->dragging) {
+				synth_window_position(synth, now, &x, &y);
+				synth_move_window(synth, x, y);
+			}
+			break;
+		default:
+			break;
+	}
+
+	/* the probe stays on top of everything */
+	for (i = 0; i < synth->numDamage; i++) {
+		if ((synth->damage[i].x < OGON_PROBE_X + OGON_PROBE_SIZE) &&
+			(synth->damage[i].y < OGON_PROBE_Y + OGON_PROBE_SIZE))
+		{
+			synth_draw_probe(synth);
+			break;
+		}
+	}
+}
+
+/** @return milliseconds until the workload changes the screen again, -1 if never */
+static int synth_next_change(synth_backend *synth, UINT64 now) {
+	UINT64 elapsed = now - synth->start;
+	UINT64 next;
+
+	switch (synth->workload->type) {
+		case SYNTH_WORKLOAD_VIDEO:
+			return 0;
+		case SYNTH_WORKLOAD_TYPING:
+		case SYNTH_WORKLOAD_SCROLL:
+		case SYNTH_WORKLOAD_DRAG:
+			if (!synth->rate || synth->dragging) {
+				return -1;
+			}
+			/* the time at which the progress reaches the next unit */
+			next = ((elapsed * synth->rate / 1000 + 1) * 1000 + synth->rate - 1) / synth->rate;
+			return (int)MIN(next - elapsed, 1000);
+		default:
+			return -1;
+	}
+}
+
+static void synth_press(synth_backend *synth) {
+	synth->presses++;
+	synth_draw_probe(synth);
+	synth_add_damage(synth, OGON_PROBE_X, OGON_PROBE_Y, OGON_PROBE_SIZE, OGON_PROBE_SIZE);
+}
+
+/** forgets the shared buffer of the rdp server connection */
+static void synth_detach(synth_backend *synth) {
+	if (synth->damageBuffer) {
+		ogon_dmgbuf_free(synth->damageBuffer);
+		synth->damageBuffer = NULL;
+	}
+	synth->bufferId = -1;
+	synth->pendingSync = -1;
+}
+
+static BOOL synth_resize(synth_backend *synth, UINT32 width, UINT32 height) {
+	UINT32 scanline = width * 4;
+	BYTE *framebuffer;
+
+	if (synth->framebuffer && (width == synth->width) && (height == synth->height)) {
+		return TRUE;
+	}
+
+	if (!(framebuffer = calloc(height, scanline))) {
+		WLog_ERR(TAG, "unable to allocate a %"PRIu32"x%"PRIu32" framebuffer", width, height);
+		return FALSE;
+	}
+
+	free(synth->framebuffer);
+	synth->framebuffer = framebuffer;
+	synth->width = width;
+	synth->height = height;
+	synth->scanline = scanline;
+
+	/* sync requests for the old buffer are ignored until the server created a new one */
+	synth_detach(synth);
+
+	synth_reset(synth, GetTickCount64());
+	return TRUE;
+}
+
+static BOOL synth_send_pointer(synth_backend *synth, UINT32 clientId) {
+	ogon_msg_set_pointer msg;
+	BYTE xorMask[SYNTH_POINTER_SIZE * SYNTH_POINTER_SIZE * 4];
+	BYTE andMask[SYNTH_POINTER_SIZE * SYNTH_POINTER_SIZE / 8];
+	UINT32 x, y;
+
+	/* an arrow, the alpha channel makes the rest transparent */
+	memset(xorMask, 0, sizeof(xorMask));
+	memset(andMask, 0, sizeof(andMask));
+	for (y = 0; y < 20; y++) {
+		UINT32 *line = (UINT32 *)xorMask + (SYNTH_POINTER_SIZE - 1 - y) * SYNTH_POINTER_SIZE;
+		for (x = 0; x <= y * 2 / 3; x++) {
+			BOOL border = (x == 0) || (x == y * 2 / 3) || (y == 19);
+			line[x] = border ? 0xFF000000 : 0xFFFFFFFF;
+		}
+	}
+
+	msg.xorBpp = 32;
+	msg.xPos = 0;
+	msg.yPos = 0;
+	msg.width = SYNTH_POINTER_SIZE;
+	msg.height = SYNTH_POINTER_SIZE;
+	msg.lengthXorMask = sizeof(xorMask);
+	msg.xorMaskData = xorMask;
+	msg.lengthAndMask = sizeof(andMask);
+	msg.andMaskData = andMask;
+	msg.clientId = clientId;
+
+	return ogon_service_write_message(synth->service, OGON_SERVER_SET_POINTER, (ogon_message *)&msg);
+}
+
+/**
+ * copies the damage to the shared buffer and answers a pending sync request
+ * @param force reply even if nothing changed
+ */
+static BOOL synth_flush(synth_backend *synth, BOOL force) {
+	ogon_msg_framebuffer_sync_reply msg;
+	RDP_RECT *rects;
+	BYTE *data;
+	UINT32 i, j, maxRects;
+
+	if ((synth->pendingSync < 0) || (!synth->numDamage && !synth->fullRefresh && !force)) {
+		return TRUE;
+	}
+
+	if (synth->fullRefresh) {
+		synth->numDamage = 0;
+		synth_add_damage(synth, 0, 0, synth->width, synth->height);
+		synth->fullRefresh = FALSE;
+	}
+
+	data = ogon_dmgbuf_get_data(synth->damageBuffer);
+	rects = ogon_dmgbuf_get_rects(synth->damageBuffer, NULL);
+	maxRects = ogon_dmgbuf_get_max_rects(synth->damageBuffer);
+	if (!data || !rects) {
+		return FALSE;
+	}
+
+	for (i = 0; i < synth->numDamage; i++) {
+		RDP_RECT *rect = &synth->damage[i];
+		UINT32 offset = rect->y * synth->scanline + rect->x * 4;
+
+		for (j = 0; j < (UINT32)rect->height; j++, offset += synth->scanline) {
+			memcpy(data + offset, synth->framebuffer + offset, rect->width * 4);
+		}
+	}
+
+	if (synth->numDamage > maxRects) {
+		synth->numDamage = 1;
+		synth->damage[0].x = 0;
+		synth->damage[0].y = 0;
+		synth->damage[0].width = synth->width;
+		synth->damage[0].height = synth->height;
+	}
+	memcpy(rects, synth->damage, synth->numDamage * sizeof(RDP_RECT));
+	ogon_dmgbuf_set_num_rects(synth->damageBuffer, synth->numDamage);
+	synth->numDamage = 0;
+
+	msg.bufferId = synth->pendingSync;
+	synth->pendingSync = -1;
+	return ogon_service_write_message(synth->service, OGON_SERVER_FRAMEBUFFER_SYNC_REPLY, (ogon_message *)&msg);
+}
+
+static BOOL synth_capabilities(void *backend, ogon_msg_capabilities *capabilities) {
+	synth_backend *synth = (synth_backend *)backend;
+	ogon_msg_framebuffer_info msg;
+
+	WLog_INFO(TAG, "client %"PRIu32": %"PRIu32"x%"PRIu32"", capabilities->clientId,
+		capabilities->desktopWidth, capabilities->desktopHeight);
+
+	if (!synth_resize(synth, capabilities->desktopWidth, capabilities->desktopHeight)) {
+		return FALSE;
+	}
+
+	/* the new client starts with an empty screen */
+	synth->fullRefresh = TRUE;
+
+	msg.version = OGON_PROTOCOL_VERSION_MAJOR;
+	msg.width = synth->width;
+	msg.height = synth->height;
+	msg.scanline = synth->scanline;
+	msg.bitsPerPixel = 32;
+	msg.bytesPerPixel = 4;
+	msg.userId = getuid();
+	msg.multiseatCapable = FALSE;
+
+	if (!ogon_service_write_message(synth->service, OGON_SERVER_FRAMEBUFFER_INFO, (ogon_message *)&msg)) {
+		return FALSE;
+	}
+	return synth_send_pointer(synth, capabilities->clientId);
+}
+
+static BOOL synth_handle_sync_request(synth_backend *synth, INT32 bufferId, BOOL immediate) {
+	if (bufferId != synth->bufferId) {
+		void *damageBuffer = ogon_dmgbuf_connect(bufferId);
+
+		if (!damageBuffer) {
+			WLog_ERR(TAG, "unable to attach to buffer %"PRId32"", bufferId);
+			return FALSE;
+		}
+		if (ogon_dmgbuf_get_fbsize(damageBuffer) != synth->scanline * synth->height) {
+			/* a request for the buffer of the previous size */
+			ogon_dmgbuf_free(damageBuffer);
+			return TRUE;
+		}
+		if (synth->damageBuffer) {
+			ogon_dmgbuf_free(synth->damageBuffer);
+		}
+		synth->damageBuffer = damageBuffer;
+		synth->bufferId = bufferId;
+		synth->fullRefresh = TRUE;
+	}
+
+	synth->pendingSync = bufferId;
+	synth_advance(synth, GetTickCount64());
+	return synth_flush(synth, immediate);
+}
+
+static BOOL synth_sync_request(void *backend, INT32 bufferId) {
+	return synth_handle_sync_request((synth_backend *)backend, bufferId, FALSE);
+}
+
+/* the server waits for the reply of an immediate request, nothing is delayed */
+static BOOL synth_immediate_sync_request(void *backend, INT32 bufferId) {
+	return synth_handle_sync_request((synth_backend *)backend, bufferId, TRUE);
+}
+
+static BOOL synth_synchronize_keyboard_event(void *backend, DWORD flags, UINT32 clientId) {
+	OGON_UNUSED(backend);
+	OGON_UNUSED(flags);
+	OGON_UNUSED(clientId);
+	return TRUE;
+}
+
+static BOOL synth_scancode_keyboard_event(void *backend, DWORD flags, DWORD code, DWORD keyboardType, UINT32 clientId) {
+	OGON_UNUSED(code);
+	OGON_UNUSED(keyboardType);
+	OGON_UNUSED(clientId);
+
+	if (!(flags & KBD_FLAGS_RELEASE)) {
+		synth_press((synth_backend *)backend);
+	}
+	return TRUE;
+}
+
+static BOOL synth_unicode_keyboard_event(void *backend, DWORD flags, DWORD code, UINT32 clientId) {
+	return synth_scancode_keyboard_event(backend, flags, code, 0, clientId);
+}
+
+static BOOL synth_mouse_event(void *backend, DWORD flags, DWORD x, DWORD y, UINT32 clientId) {
+	synth_backend *synth = (synth_backend *)backend;
+	OGON_UNUSED(clientId);
+
+	if ((flags & PTR_FLAGS_DOWN) && (flags & (PTR_FLAGS_BUTTON1 | PTR_FLAGS_BUTTON2 | PTR_FLAGS_BUTTON3))) {
+		synth_press(synth);
+	}
+
+	if (synth->workload->type != SYNTH_WORKLOAD_DRAG) {
+		return TRUE;
+	}
+
+	/* the window can be dragged by its title bar */
+	if (flags & PTR_FLAGS_BUTTON1) {
+		if ((flags & PTR_FLAGS_DOWN) && ((INT32)x >= synth->windowX) && ((INT32)y >= synth->windowY) &&
+			((INT32)x < synth->windowX + SYNTH_WINDOW_WIDTH) && ((INT32)y < synth->windowY + SYNTH_TITLE_HEIGHT))
+		{
+			synth->dragging = TRUE;
+			synth->dragX = x - synth->windowX;
+			synth->dragY = y - synth->windowY;
+		} else if (!(flags & PTR_FLAGS_DOWN)) {
+			synth->dragging = FALSE;
+		}
+	}
+
+	if (synth->dragging && (flags & PTR_FLAGS_MOVE)) {
+		synth_move_window(synth, (INT32)x - synth->dragX, (INT32)y - synth->dragY);
+	}
+	return TRUE;
+}
+
+static BOOL synth_extended_mouse_event(void *backend, DWORD flags, DWORD x, DWORD y, UINT32 clientId) {
+	OGON_UNUSED(x);
+	OGON_UNUSED(y);
+	OGON_UNUSED(clientId);
+
+	if ((flags & PTR_XFLAGS_DOWN) && (flags & (PTR_XFLAGS_BUTTON1 | PTR_XFLAGS_BUTTON2))) {
+		synth_press((synth_backend *)backend);
+	}
+	return TRUE;
+}
+
+static BOOL synth_sbp(void *backend, ogon_msg_sbp_reply *msg) {
+	OGON_UNUSED(backend);
+	OGON_UNUSED(msg);
+	return TRUE;
+}
+
+static BOOL synth_seat_new(void *backend, ogon_msg_seat_new *newSeat) {
+	OGON_UNUSED(backend);
+	OGON_UNUSED(newSeat);
+	return TRUE;
+}
+
+static BOOL synth_seat_removed(void *backend, UINT32 clientId) {
+	OGON_UNUSED(backend);
+	OGON_UNUSED(clientId);
+	return TRUE;
+}
+
+static BOOL synth_message(void *backend, ogon_msg_message *msg) {
+	synth_backend *synth = (synth_backend *)backend;
+	ogon_msg_message_reply reply;
+
+	/* nobody is there to read it, answer as if OK was clicked */
+	reply.message_id = msg->message_id;
+	reply.result = 1;
+	return ogon_service_write_message(synth->service, OGON_SERVER_MESSAGE_REPLY, (ogon_message *)&reply);
+}
+
+static ogon_client_interface synth_callbacks = {
+	synth_capabilities,
+	synth_synchronize_keyboard_event,
+	synth_scancode_keyboard_event,
+	synth_unicode_keyboard_event,
+	synth_mouse_event,
+	synth_extended_mouse_event,
+	synth_sync_request,
+	synth_sbp,
+	synth_immediate_sync_request,
+	synth_seat_new,
+	synth_seat_removed,
+	synth_message
+};
+
+static int synth_run(synth_backend *synth) {
+	for (;;) {
+		struct pollfd fds[2];
+		int timeout = -1, n = 1;
+
+		fds[0].fd = ogon_service_server_fd(synth->service);
+		fds[0].events = POLLIN;
+		fds[1].fd = ogon_service_client_fd(synth->service);
+		fds[1].events = POLLIN;
+		if (fds[1].fd >= 0) {
+			n = 2;
+		}
+
+		if (synth->pendingSync >= 0) {
+			timeout = synth_next_change(synth, GetTickCount64());
+		}
+
+		if (poll(fds, n, timeout) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			WLog_ERR(TAG, "poll failed: %s", strerror(errno));
+			return 1;
+		}
+
+		if (fds[0].revents & POLLIN) {
+			/* a new connection replaces the old one, e.g. on a reconnect */
+			if (ogon_service_accept(synth->service) == INVALID_HANDLE_VALUE) {
+				WLog_ERR(TAG, "unable to accept a connection");
+			} else {
+				synth_detach(synth);
+			}
+			continue;
+		}
+
+		if ((n == 2) && fds[1].revents) {
+			ogon_incoming_bytes_result result;
+
+			while ((result = ogon_service_incoming_bytes(synth->service, synth)) == OGON_INCOMING_BYTES_OK)
+				;
+			if (result != OGON_INCOMING_BYTES_WANT_MORE_DATA) {
+				WLog_INFO(TAG, "rdp server disconnected");
+				synth_detach(synth);
+				ogon_service_kill_client(synth->service);
+				continue;
+			}
+		}
+
+		/* input or the passing time may have changed the screen */
+		if (synth->pendingSync >= 0) {
+			synth_advance(synth, GetTickCount64());
+			if (!synth_flush(synth, FALSE)) {
+				WLog_ERR(TAG, "unable to write the sync reply");
+				synth_detach(synth);
+				ogon_service_kill_client(synth->service);
+			}
+		}
+	}
+}
+
+static COMMAND_LINE_ARGUMENT_A synth_args[] = {
+	{ "help", COMMAND_LINE_VALUE_FLAG, "", NULL, NULL, -1, NULL, "show help screen" },
+	{ "session-id", COMMAND_LINE_VALUE_REQUIRED, "<id>", NULL, NULL, -1, NULL, "session id of the endpoint" },
+	{ "workload", COMMAND_LINE_VALUE_REQUIRED, "<name>", "idle", NULL, -1, NULL, "what to draw" },
+	{ "rate", COMMAND_LINE_VALUE_REQUIRED, "<number>", NULL, NULL, -1, NULL, "speed of the workload" },
+	{ "width", COMMAND_LINE_VALUE_REQUIRED, "<pixels>", "1024", NULL, -1, NULL, "width until a client connects" },
+	{ "height", COMMAND_LINE_VALUE_REQUIRED, "<pixels>", "768", NULL, -1, NULL, "height until a client connects" },
+	{ NULL, 0, NULL, NULL, NULL, -1, NULL, NULL }
+};
+
+static void printhelp(const char *bin) {
+	const synth_workload *workload;
+
+	printf("Usage: %s [options]\n", bin);
+	printf("\nOptions:\n");
+	printf("    --session-id=<id>     session id of the endpoint (required)\n");
+	printf("    --workload=<name>     what to draw, default idle\n");
+	printf("    --rate=<number>       speed of the workload\n");
+	printf("    --width=<pixels>      width until a client connects, default 1024\n");
+	printf("    --height=<pixels>     height until a client connects, default 768\n");
+	printf("    --help                show this help screen\n");
+	printf("\nWorkloads:\n");
+	for (workload = synth_workloads; workload->name; workload++) {
+		if (workload->defaultRate) {
+			printf("    %-10s rate in %s, default %"PRIu32"\n", workload->name, workload->rateUnit,
+				workload->defaultRate);
+		} else {
+			printf("    %s\n", workload->name);
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	synth_backend synth;
+	COMMAND_LINE_ARGUMENT_A *arg;
+	const char *workloadName = "idle";
+	DWORD flags, sessionId = 0;
+	BOOL haveSessionId = FALSE;
+	UINT32 width = 1024, height = 768;
+	int status, rate = -1, ret;
+	HANDLE hPipe;
+
+	flags = COMMAND_LINE_SEPARATOR_EQUAL | COMMAND_LINE_SIGIL_DOUBLE_DASH;
+	status = CommandLineParseArgumentsA(argc, argv, synth_args, flags, NULL, NULL, NULL);
+	if (status != 0) {
+		printhelp(argv[0]);
+		return 1;
+	}
+
+	arg = synth_args;
+	do {
+		if (!(arg->Flags & COMMAND_LINE_VALUE_PRESENT))
+			continue;
+
+		CommandLineSwitchStart(arg)
+
+		CommandLineSwitchCase(arg, "help") {
+			printhelp(argv[0]);
+			return 0;
+		}
+		CommandLineSwitchCase(arg, "session-id") {
+			sessionId = strtoul(arg->Value, NULL, 0);
+			haveSessionId = TRUE;
+		}
+		CommandLineSwitchCase(arg, "workload") {
+			workloadName = arg->Value;
+		}
+		CommandLineSwitchCase(arg, "rate") {
+			rate = atoi(arg->Value);
+		}
+		CommandLineSwitchCase(arg, "width") {
+			width = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchCase(arg, "height") {
+			height = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchEnd(arg)
+	}
+	while ((arg = CommandLineFindNextArgumentA(arg)) != NULL);
+
+	memset(&synth, 0, sizeof(synth));
+	for (synth.workload = synth_workloads; synth.workload->name; synth.workload++) {
+		if (!strcmp(synth.workload->name, workloadName)) {
+			break;
+		}
+	}
+	if (!synth.workload->name || !haveSessionId || !width || !height) {
+		printhelp(argv[0]);
+		return 1;
+	}
+	synth.rate = (rate >= 0) ? (UINT32)rate : synth.workload->defaultRate;
+	synth.bufferId = -1;
+	synth.pendingSync = -1;
+
+	if (!synth_resize(&synth, width, height)) {
+		return 1;
+	}
+
+	if (!(synth.service = ogon_service_new(sessionId, "Synthetic"))) {
+		free(synth.framebuffer);
+		return 1;
+	}
+	ogon_service_set_callbacks(synth.service, &synth_callbacks);
+
+	hPipe = ogon_service_bind_endpoint(synth.service);
+	if (!hPipe || (hPipe == INVALID_HANDLE_VALUE)) {
+		WLog_ERR(TAG, "unable to bind the endpoint of session %"PRIu32"", sessionId);
+		ret = 1;
+		goto out;
+	}
+
+	WLog_INFO(TAG, "session %"PRIu32": %s workload, rate %"PRIu32"", sessionId, synth.workload->name, synth.rate);
+	ret = synth_run(&synth);
+
+out:
+	ogon_service_free(synth.service);
+	free(synth.framebuffer);
+	return ret;
+}
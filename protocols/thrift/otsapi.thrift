@@ -34,6 +34,7 @@ struct TReturnEnumerateSession {
 struct TReturnVirtualChannelOpen {
 	1: TSTRING pipeName;
 	2: TDWORD instance;
+	3: TDWORD supportedOptions;
 }
 
 struct TClientDisplay
@@ -63,6 +64,25 @@ struct TWTSINFO
 	16:TINT64 CurrentTime;
 }
 
+struct TFrameHistogram
+{
+	1:TINT32 metric;
+	2:TINT64 count;
+	3:TINT64 sum;
+	4:list<TINT64> buckets;
+}
+
+typedef list<TFrameHistogram> TFrameHistogramList
+
+struct TFrameStats
+{
+	1:TINT64 frames;
+	2:TINT64 suppressedFrames;
+	3:TINT64 bytesSent;
+	4:TINT32 codecMetric;
+	5:TFrameHistogramList histograms;
+}
+
 union TSessionInfoValue
 {
 	1:TBOOL boolValue;
@@ -72,6 +92,7 @@ union TSessionInfoValue
 	5:TClientDisplay displayValue;
 	6:TWTSINFO WTSINFO;
 	7:TINT64 int64Value;
+	8:TFrameStats frameStatsValue;
 }
 
 struct TReturnQuerySessionInformation
@@ -79,6 +100,39 @@ struct TReturnQuerySessionInformation
 	1:TBOOL returnValue;
 	2:TSessionInfoValue infoValue;
 }
+
+typedef list<TINT32> TInfoClassList
+typedef list<TReturnQuerySessionInformation> TSessionInfoValueList
+
+struct TSessionInfoEx
+{
+	1:TDWORD sessionId;
+	2:TDWORD connectState;
+	3:TSessionInfoValueList infoValues;
+}
+
+typedef list<TSessionInfoEx> TSessionListEx
+
+struct TReturnEnumerateSessionEx {
+	1: TBOOL returnValue;
+	2: TSessionListEx sessionInfoList;
+}
+
+struct TSessionEvent {
+	1: TINT64 sequence;
+	2: TDWORD reason;
+	3: TDWORD sessionId;
+}
+
+typedef list<TSessionEvent> TSessionEventList
+
+struct TReturnWaitSessionEvents {
+	1: TBOOL returnValue;
+	2: TINT64 lastSequence;
+	3: TBOOL eventsLost;
+	4: TSessionEventList events;
+}
+
 struct TReturnLogonConnection{
 	1:TBOOL success;
 	2:TSTRING authToken;
@@ -96,7 +150,9 @@ service otsapi {
 	bool logoffSession(1:TSTRING authToken,2:TDWORD sessionId, 3:TBOOL wait);
 	TReturnEnumerateSession enumerateSessions(1:TSTRING authToken,2:TDWORD Version);
 	TReturnQuerySessionInformation querySessionInformation(1:TSTRING authToken, 2:TDWORD sessionId, 3:TINT32 infoClass);
+	TReturnEnumerateSessionEx enumerateSessionsEx(1:TSTRING authToken, 2:TDWORD Version, 3:TInfoClassList infoClasses);
 	bool startRemoteControlSession(1:TSTRING authToken, 2:TDWORD sourceLogonId, 3:TDWORD targetLogonId, 4:TBYTE HotkeyVk, 5:TINT16 HotkeyModifiers, 6:TDWORD flags);
 	bool stopRemoteControlSession(1:TSTRING authToken, 2:TDWORD sourceLogonId, 3:TDWORD targetLogonId);
 	TDWORD sendMessage(1:TSTRING authToken, 2:TDWORD sessionId, 3:TSTRING title, 4:TSTRING message, 5:TDWORD style, 6:TDWORD timeout, 7:TBOOL wait);
+	TReturnWaitSessionEvents waitSessionEvents(1:TSTRING authToken, 2:TINT64 afterSequence, 3:TDWORD timeout);
 }
@@ -210,6 +210,7 @@ static BOOL backend_framebuffer_sync_request(ogon_backend_connection *backend, I
 		return FALSE;
 	}
 	backend->framebufferSyncRequest.bufferId = bufferId;
+	backend->syncRequestedAt = frame_stats_now();
 	return backend_write_rds_message(backend, OGON_CLIENT_FRAMEBUFFER_SYNC_REQUEST,
 			(ogon_message *)&backend->framebufferSyncRequest);
 }
@@ -219,6 +220,7 @@ static BOOL backend_immediate_sync_request(ogon_backend_connection *backend, INT
 		return FALSE;
 	}
 	backend->immediateSyncRequest.bufferId = bufferId;
+	backend->syncRequestedAt = frame_stats_now();
 	return backend_write_rds_message(backend, OGON_CLIENT_IMMEDIATE_SYNC_REQUEST,
 			(ogon_message *)&backend->immediateSyncRequest);
 }
@@ -46,6 +46,7 @@ struct _ogon_backend_connection {
 	RingBuffer xmitBuffer;
 	UINT32 backendVersion;
 	BOOL waitingSyncReply;
+	UINT64 syncRequestedAt;
 	ogon_screen_infos screenInfos;
 	UINT32 lastSetSystemPointer;
 	BOOL haveBackendPointer;
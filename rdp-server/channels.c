@@ -27,6 +27,10 @@
 #include "config.h"
 #endif
 
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
 #include <winpr/pipe.h>
 
 #include <freerdp/channels/wtsvc.h>
@@ -170,7 +174,26 @@ out_free:
 	return NULL;
 }
 
+static void vc_release_ring(registered_virtual_channel *channel) {
+	if (channel->ring.header) {
+		channel_ring_destroy(&channel->ring);
+	}
+	if (channel->ring_pdu) {
+		Stream_Free(channel->ring_pdu, TRUE);
+		channel->ring_pdu = NULL;
+	}
+	channel->ring_dvc_remaining = 0;
+	channel->ring_negotiable = FALSE;
+}
+
+static void vc_reset_read_state(registered_virtual_channel *channel) {
+	channel->pipe_expected_bytes = 4;
+	channel->pipe_waiting_length = TRUE;
+	channel->pipe_target_buffer = channel->header_buffer;
+}
+
 void vc_free(registered_virtual_channel *channel) {
+	vc_release_ring(channel);
 	ringbuffer_destroy(&channel->pipe_xmit_buffer);
 
 	if (channel->receive_data) {
@@ -389,6 +412,9 @@ static void vc_disconnect_client_part(registered_virtual_channel *channel) {
 		channel->pipe_client = INVALID_HANDLE_VALUE;
 	}
 
+	/* the next client starts with a fresh message */
+	vc_release_ring(channel);
+	vc_reset_read_state(channel);
 	ringbuffer_reset(&channel->pipe_xmit_buffer);
 	return;
 }
@@ -844,19 +870,331 @@ static int wts_write_variable_uint(wStream *stream, UINT32 val)
 	return cb;
 }
 
-static BOOL vc_handle_read(registered_virtual_channel *regVC, int readLimit) {
-	HANDLE handle = regVC->pipe_client;
-	DWORD bytesRead;
-	UINT32 payloadLen;
+/* forwards a complete packet from the application to the RDP peer */
+static BOOL vc_send_packet(registered_virtual_channel *regVC, BYTE *data, UINT32 length) {
+	UINT32 payloadLen = length;
 	BOOL first;
 	BYTE *writeBuffer, *buffer;
 	wStream *s;
-	int cbLen, cbChId, sendlength, totalRead;
+	int cbLen, cbChId, sendlength;
 	ULONG toWrite;
 
+	/* WLog_DBG(TAG, "packet with size %"PRIu32"", length); */
+	writeBuffer = data;
+
+	if (regVC->channel_type == RDP_PEER_CHANNEL_TYPE_DVC) {
+		if (regVC->vcm->drdynvc_state != DRDYNVC_STATE_READY)
+		{
+			WLog_ERR(TAG, "error: dynamic virtual channel is not ready");
+			return FALSE;
+		}
+
+		first = TRUE;
+		while (payloadLen > 0)
+		{
+			s = Stream_New(NULL, regVC->client->settings->VirtualChannelChunkSize);
+			if (!s) {
+				WLog_ERR(TAG, "failed to create Stream of size %"PRIu32"", regVC->client->settings->VirtualChannelChunkSize);
+				return FALSE;
+			}
+			buffer = Stream_Buffer(s);
+
+			Stream_Seek_UINT8(s);
+			cbChId = wts_write_variable_uint(s, regVC->channel_id);
+
+			if (first && (payloadLen > (UINT32) Stream_GetRemainingLength(s)))
+			{
+				cbLen = wts_write_variable_uint(s, payloadLen);
+				buffer[0] = (DATA_FIRST_PDU << 4) | (cbLen << 2) | cbChId;
+			}
+			else
+			{
+				buffer[0] = (DATA_PDU << 4) | cbChId;
+			}
+
+			first = FALSE;
+			toWrite = Stream_GetRemainingLength(s);
+
+			if (toWrite > payloadLen) {
+				toWrite = payloadLen;
+			}
+
+			Stream_Write(s, writeBuffer, toWrite);
+			sendlength = Stream_GetPosition(s);
+
+			if (!regVC->client->SendChannelData(regVC->client, regVC->vcm->drdynvc_channel_id, Stream_Buffer(s), sendlength))
+			{
+				WLog_ERR(TAG, "SendChannelData failed for dynamic virtual channel id %"PRIu32"", regVC->vcm->drdynvc_channel_id);
+				Stream_Free(s, TRUE);
+				return FALSE;
+			}
+
+			payloadLen -= toWrite;
+			writeBuffer += toWrite;
+
+			Stream_Free(s, TRUE);
+		}
+
+	} else {
+		if (!regVC->client->SendChannelData(regVC->client, regVC->channel_id, data, length))
+		{
+			WLog_ERR(TAG, "SendChannelData failed for static virtual channel id %"PRIu32"", regVC->channel_id);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * Reads the first header of a freshly connected client. Instead of a length
+ * it can be the setup message of a shared memory ring which comes with the
+ * memory file descriptor, that's why this can't go through ReadFile.
+ */
+static BOOL vc_read_first_header(registered_virtual_channel *regVC, DWORD *bytesRead) {
+	int fd = GetEventFileDescriptor(regVC->pipe_client);
+	union {
+		struct cmsghdr align;
+		char buffer[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	ssize_t ret;
+	int ringFd = -1;
+	UINT32 header;
+
+	if (fd < 0) {
+		SetLastError(ERROR_INVALID_HANDLE);
+		return FALSE;
+	}
+
+	iov.iov_base = regVC->pipe_target_buffer;
+	iov.iov_len = regVC->pipe_expected_bytes;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buffer;
+	msg.msg_controllen = sizeof(control.buffer);
+
+	do {
+		ret = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+	} while ((ret < 0) && (errno == EINTR));
+
+	if (ret <= 0) {
+		SetLastError(((ret < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) ? ERROR_NO_DATA : ERROR_BROKEN_PIPE);
+		return FALSE;
+	}
+	regVC->ring_negotiable = FALSE;
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS) &&
+			(cmsg->cmsg_len == CMSG_LEN(sizeof(int))))
+		{
+			memcpy(&ringFd, CMSG_DATA(cmsg), sizeof(int));
+		}
+	}
+
+	if (ringFd < 0) {
+		*bytesRead = ret;
+		return TRUE;
+	}
+
+	header = regVC->header_buffer[0] | (regVC->header_buffer[1] << 8) |
+			(regVC->header_buffer[2] << 16) | ((UINT32)regVC->header_buffer[3] << 24);
+	if ((ret != 4) || (header != OGON_CHANNEL_RING_SETUP)) {
+		WLog_ERR(TAG, "channel %s: unexpected file descriptor from the client", regVC->vc_name);
+		close(ringFd);
+		SetLastError(ERROR_INVALID_DATA);
+		return FALSE;
+	}
+
+	if (!channel_ring_attach(&regVC->ring, ringFd)) {
+		WLog_ERR(TAG, "channel %s: invalid shared memory ring", regVC->vc_name);
+		SetLastError(ERROR_INVALID_DATA);
+		return FALSE;
+	}
+
+	if (regVC->channel_type == RDP_PEER_CHANNEL_TYPE_DVC) {
+		regVC->ring_pdu = Stream_New(NULL, regVC->client->settings->VirtualChannelChunkSize);
+		if (!regVC->ring_pdu) {
+			WLog_ERR(TAG, "failed to create Stream of size %"PRIu32"", regVC->client->settings->VirtualChannelChunkSize);
+			vc_release_ring(regVC);
+			SetLastError(ERROR_OUTOFMEMORY);
+			return FALSE;
+		}
+	}
+
+	WLog_DBG(TAG, "channel %s: using a shared memory ring of %"PRIu32" bytes", regVC->vc_name,
+			regVC->ring.mask + 1);
+	vc_reset_read_state(regVC);
+	*bytesRead = 0;
+	return TRUE;
+}
+
+/**
+ * Sends the next DVC chunk of the current packet straight out of the ring,
+ * the payload is copied once into the PDU. Nothing is sent if the ring does
+ * not hold the whole chunk yet, pWanted tells how many bytes are needed.
+ */
+static BOOL vc_ring_send_dvc_chunk(registered_virtual_channel *regVC, UINT32 *pSent, UINT32 *pWanted) {
+	wStream *s = regVC->ring_pdu;
+	BYTE *buffer = Stream_Buffer(s);
+	UINT32 toWrite;
+	int cbLen, cbChId;
+
+	*pSent = 0;
+	Stream_SetPosition(s, 0);
+	Stream_Seek_UINT8(s);
+	cbChId = wts_write_variable_uint(s, regVC->channel_id);
+
+	if (regVC->ring_dvc_first && (regVC->ring_dvc_remaining > (UINT32) Stream_GetRemainingLength(s)))
+	{
+		cbLen = wts_write_variable_uint(s, regVC->ring_dvc_remaining);
+		buffer[0] = (DATA_FIRST_PDU << 4) | (cbLen << 2) | cbChId;
+	}
+	else
+	{
+		buffer[0] = (DATA_PDU << 4) | cbChId;
+	}
+
+	toWrite = Stream_GetRemainingLength(s);
+	if (toWrite > regVC->ring_dvc_remaining) {
+		toWrite = regVC->ring_dvc_remaining;
+	}
+	*pWanted = toWrite;
+
+	if (channel_ring_used(&regVC->ring) < toWrite) {
+		return TRUE;
+	}
+
+	channel_ring_read(&regVC->ring, Stream_Pointer(s), toWrite);
+	Stream_Seek(s, toWrite);
+
+	if (!regVC->client->SendChannelData(regVC->client, regVC->vcm->drdynvc_channel_id, Stream_Buffer(s),
+			Stream_GetPosition(s)))
+	{
+		WLog_ERR(TAG, "SendChannelData failed for dynamic virtual channel id %"PRIu32"", regVC->vcm->drdynvc_channel_id);
+		return FALSE;
+	}
+
+	regVC->ring_dvc_first = FALSE;
+	regVC->ring_dvc_remaining -= toWrite;
+	*pSent = toWrite;
+	return TRUE;
+}
+
+static BOOL vc_handle_ring_read(registered_virtual_channel *regVC, int readLimit) {
+	BYTE doorbells[256];
+	DWORD bytesRead;
+	UINT32 count, wanted;
+	BOOL closed = FALSE;
+	int totalRead = 0;
+
+	/* the pipe only carries doorbells now, a closed pipe still gets the ring drained */
+	if (!ReadFile(regVC->pipe_client, doorbells, sizeof(doorbells), &bytesRead, NULL) &&
+		(GetLastError() != ERROR_NO_DATA))
+	{
+		closed = TRUE;
+	}
+
+	wanted = 1;
+	while (totalRead < readLimit) {
+		if (regVC->ring_dvc_remaining) {
+			if (!vc_ring_send_dvc_chunk(regVC, &count, &wanted)) {
+				return FALSE;
+			}
+			if (!count) {
+				break;
+			}
+			totalRead += count;
+			wanted = 1;
+			continue;
+		}
+
+		if (regVC->pipe_expected_bytes) {
+			count = channel_ring_read(&regVC->ring, regVC->pipe_target_buffer, regVC->pipe_expected_bytes);
+			if (!count) {
+				break;
+			}
+			totalRead += count;
+			regVC->pipe_expected_bytes -= count;
+			regVC->pipe_target_buffer += count;
+			if (regVC->pipe_expected_bytes) {
+				continue;
+			}
+		}
+
+		if (regVC->pipe_waiting_length) {
+			regVC->pipe_current_packet_length = regVC->header_buffer[0] |
+					(regVC->header_buffer[1] << 8) |
+					(regVC->header_buffer[2] << 16) |
+					(regVC->header_buffer[3] << 24);
+
+			if (regVC->channel_type == RDP_PEER_CHANNEL_TYPE_DVC) {
+				if (regVC->vcm->drdynvc_state != DRDYNVC_STATE_READY) {
+					WLog_ERR(TAG, "error: dynamic virtual channel is not ready");
+					return FALSE;
+				}
+				/* DVC packets are chunked while they stream through the ring */
+				regVC->ring_dvc_remaining = regVC->pipe_current_packet_length;
+				regVC->ring_dvc_first = TRUE;
+				vc_reset_read_state(regVC);
+				continue;
+			}
+
+			/* static channels hand complete packets to FreeRDP */
+			if (!Stream_EnsureCapacity(regVC->pipe_input_buffer, regVC->pipe_current_packet_length)) {
+				WLog_ERR(TAG, "Stream re-allocation failed");
+				return FALSE;
+			}
+			regVC->pipe_expected_bytes = regVC->pipe_current_packet_length;
+			regVC->pipe_target_buffer = Stream_Buffer(regVC->pipe_input_buffer);
+			regVC->pipe_waiting_length = FALSE;
+			continue;
+		}
+
+		if (!vc_send_packet(regVC, Stream_Buffer(regVC->pipe_input_buffer), regVC->pipe_current_packet_length)) {
+			return FALSE;
+		}
+		vc_reset_read_state(regVC);
+	}
+
+	if (totalRead >= readLimit) {
+		return eventsource_reschedule_for_read(regVC->event_source_client);
+	}
+	if (closed) {
+		return FALSE;
+	}
+
+	/* go to sleep unless the application filled the ring in the meantime */
+	if (!channel_ring_prepare_wait(&regVC->ring, wanted)) {
+		return eventsource_reschedule_for_read(regVC->event_source_client);
+	}
+
+	return TRUE;
+}
+
+static BOOL vc_handle_read(registered_virtual_channel *regVC, int readLimit) {
+	HANDLE handle = regVC->pipe_client;
+	DWORD bytesRead;
+	int totalRead;
+
+	if (regVC->ring.header) {
+		return vc_handle_ring_read(regVC, readLimit);
+	}
+
 	totalRead = 0;
 	while (totalRead < readLimit) {
-		if (!ReadFile(handle, regVC->pipe_target_buffer, regVC->pipe_expected_bytes, &bytesRead, NULL))
+		if (regVC->ring_negotiable) {
+			if (!vc_read_first_header(regVC, &bytesRead)) {
+				return (GetLastError() == ERROR_NO_DATA);
+			}
+			if (regVC->ring.header) {
+				return vc_handle_ring_read(regVC, readLimit);
+			}
+		}
+		else if (!ReadFile(handle, regVC->pipe_target_buffer, regVC->pipe_expected_bytes, &bytesRead, NULL))
 		{
 			return (GetLastError() == ERROR_NO_DATA);
 		}
@@ -890,75 +1228,12 @@ static BOOL vc_handle_read(registered_virtual_channel *regVC, int readLimit) {
 		/* got the payload, forward the packet to the RDP peer and go back to
 		 * header reading.
 		 */
-		/* WLog_DBG(TAG, "packet with size %"PRIu32"", regVC->pipe_current_packet_length); */
-		payloadLen = regVC->pipe_current_packet_length;
-		writeBuffer = Stream_Buffer(regVC->pipe_input_buffer);
-
-		if (regVC->channel_type == RDP_PEER_CHANNEL_TYPE_DVC) {
-			if (regVC->vcm->drdynvc_state != DRDYNVC_STATE_READY)
-			{
-				WLog_ERR(TAG, "error: dynamic virtual channel is not ready");
-				return FALSE;
-			}
-
-			first = TRUE;
-			while (payloadLen > 0)
-			{
-				s = Stream_New(NULL, regVC->client->settings->VirtualChannelChunkSize);
-				if (!s) {
-					WLog_ERR(TAG, "failed to create Stream of size %"PRIu32"", regVC->client->settings->VirtualChannelChunkSize);
-					return FALSE;
-				}
-				buffer = Stream_Buffer(s);
-
-				Stream_Seek_UINT8(s);
-				cbChId = wts_write_variable_uint(s, regVC->channel_id);
-
-				if (first && (payloadLen > (UINT32) Stream_GetRemainingLength(s)))
-				{
-					cbLen = wts_write_variable_uint(s, payloadLen);
-					buffer[0] = (DATA_FIRST_PDU << 4) | (cbLen << 2) | cbChId;
-				}
-				else
-				{
-					buffer[0] = (DATA_PDU << 4) | cbChId;
-				}
-
-				first = FALSE;
-				toWrite = Stream_GetRemainingLength(s);
-
-				if (toWrite > payloadLen) {
-					toWrite = payloadLen;
-				}
-
-				Stream_Write(s, writeBuffer, toWrite);
-				sendlength = Stream_GetPosition(s);
-
-				if (!regVC->client->SendChannelData(regVC->client, regVC->vcm->drdynvc_channel_id, Stream_Buffer(s), sendlength))
-				{
-					WLog_ERR(TAG, "SendChannelData failed for dynamic virtual channel id %"PRIu32"", regVC->vcm->drdynvc_channel_id);
-					return FALSE;
-				}
-
-				payloadLen -= toWrite;
-				writeBuffer += toWrite;
-
-				Stream_Free(s, TRUE);
-			}
-
-		} else {
-			if (!regVC->client->SendChannelData(regVC->client, regVC->channel_id, Stream_Buffer(regVC->pipe_input_buffer),
-					regVC->pipe_current_packet_length))
-			{
-				WLog_ERR(TAG, "SendChannelData failed for static virtual channel id %"PRIu32"", regVC->channel_id);
-				return FALSE;
-			}
+		if (!vc_send_packet(regVC, Stream_Buffer(regVC->pipe_input_buffer), regVC->pipe_current_packet_length)) {
+			return FALSE;
 		}
 
 		/* reset to initial state */
-		regVC->pipe_expected_bytes = 4;
-		regVC->pipe_waiting_length = TRUE;
-		regVC->pipe_target_buffer = regVC->header_buffer;
+		vc_reset_read_state(regVC);
 	}
 
 	if (totalRead > readLimit) {
@@ -1038,6 +1313,9 @@ static int handle_vc_named_pipe_connect_event(int mask, int fd, HANDLE handle, v
 	// removing and closing old client
 	vc_disconnect_client_part(channel);
 
+	// the client may switch to a shared memory ring with its first message
+	channel->ring_negotiable = TRUE;
+
 	// adding new client
 	dwPipeMode = PIPE_NOWAIT;
 	if (!SetNamedPipeHandleState(handle, &dwPipeMode, NULL, NULL)) {
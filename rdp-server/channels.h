@@ -31,6 +31,7 @@
 
 #include "ogon.h"
 #include "eventloop.h"
+#include "../common/channelring.h"
 
 
 enum {
@@ -109,6 +110,12 @@ struct _registered_virtual_channel
 	UINT32 pipe_current_packet_length;
 	wStream *pipe_input_buffer;
 
+	BOOL ring_negotiable;        /* the next header may be the setup of a shared memory ring */
+	ogon_channel_ring ring;      /* replaces the pipe for incoming data if set up */
+	UINT32 ring_dvc_remaining;   /* payload bytes of the current DVC packet still in the ring */
+	BOOL ring_dvc_first;
+	wStream *ring_pdu;
+
 	internal_virtual_channel *internalChannel;
 
 	BYTE header_buffer[4];
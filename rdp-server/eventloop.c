@@ -25,6 +25,11 @@
 #include "config.h"
 #endif
 
+/* ogon-eventloop-bench-select builds the select() variant where epoll is available */
+#ifdef OGON_EVENTLOOP_SELECT
+#undef HAVE_EPOLL_H
+#endif
+
 #ifdef HAVE_EPOLL_H
 #include <sys/epoll.h>
 #else
@@ -587,7 +592,8 @@ int eventloop_dispatch_loop(ogon_event_loop *evloop, long timeout) {
 			status--;
 		}
 
-		if (mask) {
+		/* a callback may have removed the source after select() returned */
+		if (mask && !source->markedForRemove) {
 			source->callback(mask, source->fd, source->handle, source->data);
 			ret++;
 		}
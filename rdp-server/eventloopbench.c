@@ -0,0 +1,760 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * RDP Server
+ * Event loop benchmark
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+
+#include <winpr/crt.h>
+#include <winpr/cmdline.h>
+#include <winpr/wlog.h>
+
+#include "../common/global.h"
+#include "eventloop.h"
+
+/**
+ * Runs the event loop with 10 to 10000 sources the way the rdp server uses
+ * it: descriptors becoming readable, frame timers, sources rescheduled from
+ * their callbacks and sources removed while events for them are pending. The
+ * sources are eventfds, one descriptor each. Every scenario also checks that
+ * each callback ran as often as expected, so a failure in the select() build
+ * shows up as well as a slowdown.
+ *
+ * The same source is built against epoll (ogon-eventloop-bench) and select()
+ * (ogon-eventloop-bench-select, OGON_EVENTLOOP_SELECT is set for eventloop.c).
+ */
+
+#if defined(HAVE_EPOLL_H) && !defined(OGON_EVENTLOOP_SELECT)
+#define BENCH_BACKEND "epoll"
+#define BENCH_FD_LIMIT 0
+#else
+#define BENCH_BACKEND "select"
+#define BENCH_FD_LIMIT FD_SETSIZE
+#endif
+
+#define BENCH_MAX_SAMPLES (1024 * 1024)
+#define BENCH_DISPATCH_TIMEOUT 1000
+
+typedef struct _bench_context bench_context;
+
+typedef struct _bench_source {
+	int fd;
+	ogon_event_source *evsource;
+	bench_context *context;
+	UINT32 index;
+	BOOL removed;
+	UINT64 lastFire; /* timers only */
+} bench_source;
+
+/** @brief what a scenario measured, times in nanoseconds of the measured sections only */
+typedef struct _bench_result {
+	UINT64 operations;
+	UINT64 wallTime;
+	UINT64 cpuTime;
+	UINT64 *samples;
+	size_t numSamples;
+	const char *skipped;
+} bench_result;
+
+struct _bench_context {
+	ogon_event_loop *evloop;
+	bench_source *sources;
+	UINT32 count;
+	UINT64 period;        /* timers only */
+	UINT64 callbacks;
+	UINT64 wrongMasks;
+	UINT64 afterRemove;   /* callbacks of removed sources, must stay 0 */
+	UINT32 removedCount;
+	bench_result *result;
+
+	/* always writable, so a dispatch returns right after the rescheduled callbacks and cleanups */
+	int kickFd;
+	ogon_event_source *kickSource;
+};
+
+typedef struct _bench_clock {
+	UINT64 wallStart;
+	UINT64 cpuStart;
+} bench_clock;
+
+typedef BOOL (*bench_scenario_fn)(bench_context *context, bench_result *result);
+
+typedef struct _bench_scenario {
+	const char *name;
+	bench_scenario_fn run;
+	ogon_event_loop_cb callback; /* for the descriptors, NULL for the timers */
+	BOOL kick;                   /* add the always writable source */
+	const char *description;
+} bench_scenario;
+
+static UINT32 bench_fps = 20;
+static UINT32 bench_duration = 1000;
+
+static COMMAND_LINE_ARGUMENT_A bench_args[] = {
+	{ "help", COMMAND_LINE_VALUE_FLAG, "", NULL, NULL, -1, NULL, "show help screen" },
+	{ "scenarios", COMMAND_LINE_VALUE_REQUIRED, "<list>", NULL, NULL, -1, NULL, "scenarios to run" },
+	{ "sources", COMMAND_LINE_VALUE_REQUIRED, "<list>", "10,100,1000,10000", NULL, -1, NULL, "numbers of sources" },
+	{ "fps", COMMAND_LINE_VALUE_REQUIRED, "<number>", "20", NULL, -1, NULL, "frame rate of the timers" },
+	{ "duration", COMMAND_LINE_VALUE_REQUIRED, "<ms>", "1000", NULL, -1, NULL, "duration of the timer scenario" },
+	{ "max-ns", COMMAND_LINE_VALUE_REQUIRED, "<number>", "0", NULL, -1, NULL, "fail above this cpu time per operation" },
+	{ NULL, 0, NULL, NULL, NULL, -1, NULL, NULL }
+};
+
+static BOOL bench_dispatch_all(bench_context *context, bench_result *result);
+static BOOL bench_dispatch_one(bench_context *context, bench_result *result);
+static BOOL bench_timers(bench_context *context, bench_result *result);
+static BOOL bench_reschedule(bench_context *context, bench_result *result);
+static BOOL bench_remove(bench_context *context, bench_result *result);
+static int bench_read_cb(int mask, int fd, HANDLE handle, void *data);
+static int bench_reschedule_cb(int mask, int fd, HANDLE handle, void *data);
+static int bench_remove_cb(int mask, int fd, HANDLE handle, void *data);
+
+static const bench_scenario bench_scenarios[] = {
+	{ "dispatch-all", bench_dispatch_all, bench_read_cb, FALSE, "all sources readable, per callback" },
+	{ "dispatch-one", bench_dispatch_one, bench_read_cb, FALSE, "one readable source among idle ones, write to callback" },
+	{ "timers", bench_timers, NULL, FALSE, "a frame timer per source, deviation from the interval" },
+	{ "reschedule", bench_reschedule, bench_reschedule_cb, TRUE, "sources rescheduled for read and write, per callback" },
+	{ "remove", bench_remove, bench_remove_cb, TRUE, "readable sources removed by the callbacks, latency per dispatch" },
+	{ NULL, NULL, NULL, FALSE, NULL }
+};
+
+static void printhelp(const char *bin) {
+	const bench_scenario *scenario;
+
+	printf("Usage: %s [options]\n", bin);
+	printf("\noptions:\n\n");
+	printf("        %-20s %s\n", "--help", "print this help screen");
+	printf("        %-20s %s\n", "--scenarios=<list>", "comma separated scenarios to run (default: all)");
+	printf("        %-20s %s\n", "--sources=<list>", "comma separated numbers of sources (default: 10,100,1000,10000)");
+	printf("        %-20s %s\n", "--fps=<number>", "frame rate of the timers (default: 20)");
+	printf("        %-20s %s\n", "--duration=<ms>", "duration of the timer scenario per number of sources (default: 1000)");
+	printf("        %-20s %s\n", "--max-ns=<number>", "exit with an error if an operation takes more cpu time");
+	printf("\nscenarios:\n\n");
+	for (scenario = bench_scenarios; scenario->name; scenario++) {
+		printf("        %-20s %s\n", scenario->name, scenario->description);
+	}
+}
+
+static UINT64 bench_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (UINT64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static UINT64 bench_cpu_time(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (UINT64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void bench_clock_start(bench_clock *clock) {
+	clock->wallStart = bench_now();
+	clock->cpuStart = bench_cpu_time();
+}
+
+/** adds the time since bench_clock_start to the result, @return the elapsed wall time */
+static UINT64 bench_clock_stop(bench_clock *clock, bench_result *result) {
+	UINT64 wallTime = bench_now() - clock->wallStart;
+
+	result->cpuTime += bench_cpu_time() - clock->cpuStart;
+	result->wallTime += wallTime;
+	return wallTime;
+}
+
+static void bench_sample(bench_result *result, UINT64 value) {
+	if (result->numSamples < BENCH_MAX_SAMPLES) {
+		result->samples[result->numSamples++] = value;
+	}
+}
+
+static int bench_compare(const void *a, const void *b) {
+	UINT64 va = *(const UINT64 *)a;
+	UINT64 vb = *(const UINT64 *)b;
+
+	return (va > vb) - (va < vb);
+}
+
+/** @return the sample at the quantile, the samples must be sorted */
+static UINT64 bench_quantile(const bench_result *result, double quantile) {
+	size_t index;
+
+	if (!result->numSamples) {
+		return 0;
+	}
+	index = (size_t)(quantile * result->numSamples);
+	if (index >= result->numSamples) {
+		index = result->numSamples - 1;
+	}
+	return result->samples[index];
+}
+
+/** checks if select() could watch the descriptor, there is no limit with epoll */
+static BOOL bench_fd_usable(int fd) {
+	return !BENCH_FD_LIMIT || (fd < BENCH_FD_LIMIT);
+}
+
+static BOOL bench_signal(bench_source *source) {
+	UINT64 value = 1;
+
+	return write(source->fd, &value, sizeof(value)) == sizeof(value);
+}
+
+static void bench_drain(bench_source *source) {
+	UINT64 value;
+
+	if (read(source->fd, &value, sizeof(value)) < 0) {
+		source->context->wrongMasks++;
+	}
+}
+
+static int bench_kick_cb(int mask, int fd, HANDLE handle, void *data) {
+	OGON_UNUSED(mask);
+	OGON_UNUSED(fd);
+	OGON_UNUSED(handle);
+	OGON_UNUSED(data);
+	return 0;
+}
+
+static BOOL bench_kick_start(bench_context *context) {
+	if ((context->kickFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0 || !bench_fd_usable(context->kickFd)) {
+		return FALSE;
+	}
+	context->kickSource = eventloop_add_fd(context->evloop, OGON_EVENTLOOP_WRITE, context->kickFd,
+			bench_kick_cb, context);
+	return context->kickSource != NULL;
+}
+
+static int bench_read_cb(int mask, int fd, HANDLE handle, void *data) {
+	bench_source *source = (bench_source *)data;
+	bench_context *context = source->context;
+
+	OGON_UNUSED(fd);
+	OGON_UNUSED(handle);
+
+	if (source->removed) {
+		context->afterRemove++;
+		return 0;
+	}
+	if (!(mask & OGON_EVENTLOOP_READ)) {
+		context->wrongMasks++;
+	}
+	context->callbacks++;
+	bench_drain(source);
+	return 0;
+}
+
+/** adds an eventfd per source, skips the run if select() can't watch them */
+static BOOL bench_sources_open(bench_context *context, bench_result *result, ogon_event_loop_cb cb) {
+	UINT32 i;
+
+	for (i = 0; i < context->count; i++) {
+		bench_source *source = &context->sources[i];
+
+		if ((source->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+			result->skipped = "out of file descriptors, raise the limit with ulimit -n";
+			return FALSE;
+		}
+		if (!bench_fd_usable(source->fd)) {
+			result->skipped = "select() only watches descriptors below FD_SETSIZE";
+			return FALSE;
+		}
+		source->evsource = eventloop_add_fd(context->evloop, OGON_EVENTLOOP_READ, source->fd, cb, source);
+		if (!source->evsource) {
+			result->skipped = "unable to add the source";
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/** removes what is left of the sources, the event loop frees them on its destruction */
+static void bench_sources_close(bench_context *context) {
+	UINT32 i;
+
+	for (i = 0; i < context->count; i++) {
+		bench_source *source = &context->sources[i];
+
+		if (source->evsource) {
+			eventloop_remove_source(&source->evsource);
+		}
+		if (source->fd >= 0) {
+			close(source->fd);
+		}
+	}
+	if (context->kickSource) {
+		eventloop_remove_source(&context->kickSource);
+	}
+	if (context->kickFd >= 0) {
+		close(context->kickFd);
+	}
+}
+
+/** dispatches until the expected number of callbacks ran */
+static BOOL bench_dispatch_until(bench_context *context, UINT64 callbacks) {
+	while (context->callbacks < callbacks) {
+		if (eventloop_dispatch_loop(context->evloop, BENCH_DISPATCH_TIMEOUT) <= 0) {
+			fprintf(stderr, "dispatch returned without the expected events (%"PRIu64" of %"PRIu64")\n",
+					context->callbacks, callbacks);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+static BOOL bench_dispatch_all(bench_context *context, bench_result *result) {
+	UINT32 i, round, rounds;
+	bench_clock clock;
+
+	rounds = 200000 / context->count;
+	if (rounds < 10) {
+		rounds = 10;
+	}
+
+	for (round = 0; round < rounds; round++) {
+		UINT64 expected = context->callbacks + context->count;
+
+		for (i = 0; i < context->count; i++) {
+			if (!bench_signal(&context->sources[i])) {
+				return FALSE;
+			}
+		}
+
+		bench_clock_start(&clock);
+		if (!bench_dispatch_until(context, expected)) {
+			return FALSE;
+		}
+		bench_sample(result, bench_clock_stop(&clock, result) / context->count);
+		result->operations += context->count;
+	}
+	return TRUE;
+}
+
+static BOOL bench_dispatch_one(bench_context *context, bench_result *result) {
+	UINT32 i, iterations = 10000;
+	bench_clock clock;
+
+	for (i = 0; i < iterations; i++) {
+		/* spread the events over all sources, the position of a source matters for select() */
+		bench_source *source = &context->sources[((UINT64)i * 7919) % context->count];
+		UINT64 expected = context->callbacks + 1;
+
+		bench_clock_start(&clock);
+		if (!bench_signal(source) || !bench_dispatch_until(context, expected)) {
+			return FALSE;
+		}
+		bench_sample(result, bench_clock_stop(&clock, result));
+		result->operations++;
+	}
+	return TRUE;
+}
+
+static void bench_timer_cb(void *data) {
+	bench_source *source = (bench_source *)data;
+	bench_context *context = source->context;
+	UINT64 now = bench_now();
+
+	if (source->lastFire) {
+		UINT64 interval = now - source->lastFire;
+		bench_sample(context->result, (interval > context->period) ? interval - context->period :
+				context->period - interval);
+	}
+	source->lastFire = now;
+	context->result->operations++;
+}
+
+static BOOL bench_timers(bench_context *context, bench_result *result) {
+	UINT32 i, interval = 1000 / bench_fps;
+	UINT64 end, expected;
+	bench_clock clock;
+
+	context->period = (UINT64)interval * 1000000;
+	context->result = result;
+
+	for (i = 0; i < context->count; i++) {
+		bench_source *source = &context->sources[i];
+
+		source->evsource = eventloop_add_timer(context->evloop, interval, bench_timer_cb, source);
+		if (!source->evsource) {
+			result->skipped = "unable to add the timer, raise the limit with ulimit -n";
+			return FALSE;
+		}
+		if (!bench_fd_usable(eventsource_fd(source->evsource))) {
+			result->skipped = "select() only watches descriptors below FD_SETSIZE";
+			return FALSE;
+		}
+	}
+
+	bench_clock_start(&clock);
+	end = clock.wallStart + (UINT64)bench_duration * 1000000;
+	while (bench_now() < end) {
+		if (eventloop_dispatch_loop(context->evloop, interval) < 0) {
+			return FALSE;
+		}
+	}
+	bench_clock_stop(&clock, result);
+
+	/* the first expiration is right away, a loop which can't keep up misses the others */
+	expected = ((UINT64)bench_duration / interval) * context->count;
+	if (result->operations < expected) {
+		fprintf(stderr, "timers with %"PRIu32" sources: %"PRIu64" of %"PRIu64" expirations handled\n",
+				context->count, result->operations, expected);
+	}
+	return TRUE;
+}
+
+static int bench_reschedule_cb(int mask, int fd, HANDLE handle, void *data) {
+	bench_source *source = (bench_source *)data;
+	bench_context *context = source->context;
+
+	OGON_UNUSED(fd);
+	OGON_UNUSED(handle);
+
+	context->callbacks++;
+
+	/* the even sources were rescheduled for both, the masks are merged into one callback */
+	if ((source->index & 1) == 0) {
+		if (mask != (OGON_EVENTLOOP_READ | OGON_EVENTLOOP_WRITE)) {
+			context->wrongMasks++;
+		}
+		return 0;
+	}
+
+	/* the odd ones continue writing after reading, they are called again in the same dispatch */
+	if (mask == OGON_EVENTLOOP_READ) {
+		if (!eventsource_reschedule_for_write(source->evsource)) {
+			context->wrongMasks++;
+		}
+	} else if (mask != OGON_EVENTLOOP_WRITE) {
+		context->wrongMasks++;
+	}
+	return 0;
+}
+
+static BOOL bench_reschedule(bench_context *context, bench_result *result) {
+	UINT32 i, round, rounds, perRound;
+	bench_clock clock;
+
+	/* one callback for the even sources, two for the odd ones */
+	perRound = context->count + context->count / 2;
+	rounds = 200000 / perRound;
+	if (rounds < 10) {
+		rounds = 10;
+	}
+
+	for (round = 0; round < rounds; round++) {
+		UINT64 expected = context->callbacks + perRound;
+
+		bench_clock_start(&clock);
+		for (i = 0; i < context->count; i++) {
+			bench_source *source = &context->sources[i];
+			if (!eventsource_reschedule_for_read(source->evsource)) {
+				return FALSE;
+			}
+			if (((i & 1) == 0) && !eventsource_reschedule_for_write(source->evsource)) {
+				return FALSE;
+			}
+		}
+		if ((eventloop_dispatch_loop(context->evloop, BENCH_DISPATCH_TIMEOUT) <= 0) ||
+			(context->callbacks != expected))
+		{
+			fprintf(stderr, "reschedule: %"PRIu64" callbacks instead of %"PRIu64"\n",
+					context->callbacks, expected);
+			return FALSE;
+		}
+		bench_sample(result, bench_clock_stop(&clock, result) / perRound);
+		result->operations += perRound;
+	}
+	return TRUE;
+}
+
+static void bench_remove_source(bench_source *source) {
+	if (source->removed) {
+		return;
+	}
+	eventloop_remove_source(&source->evsource);
+	source->removed = TRUE;
+	source->context->removedCount++;
+}
+
+static int bench_remove_cb(int mask, int fd, HANDLE handle, void *data) {
+	bench_source *source = (bench_source *)data;
+	bench_context *context = source->context;
+	UINT32 neighbour = source->index ^ 1;
+
+	OGON_UNUSED(mask);
+	OGON_UNUSED(fd);
+	OGON_UNUSED(handle);
+
+	if (source->removed) {
+		context->afterRemove++;
+		return 0;
+	}
+	context->callbacks++;
+
+	/* a connection going away takes its neighbour along, whose event may be pending as well */
+	bench_remove_source(source);
+	if (neighbour < context->count) {
+		bench_remove_source(&context->sources[neighbour]);
+	}
+	return 0;
+}
+
+static BOOL bench_remove(bench_context *context, bench_result *result) {
+	UINT32 i, removedBefore;
+	bench_clock clock;
+
+	for (i = 0; i < context->count; i++) {
+		if (!bench_signal(&context->sources[i])) {
+			return FALSE;
+		}
+	}
+
+	/* the last dispatch frees the sources removed in the one before */
+	do {
+		removedBefore = context->removedCount;
+
+		bench_clock_start(&clock);
+		if (eventloop_dispatch_loop(context->evloop, BENCH_DISPATCH_TIMEOUT) <= 0) {
+			return FALSE;
+		}
+		bench_sample(result, bench_clock_stop(&clock, result));
+
+		if ((removedBefore == context->removedCount) && (removedBefore < context->count)) {
+			fprintf(stderr, "remove: %"PRIu32" of %"PRIu32" sources removed\n",
+					context->removedCount, context->count);
+			return FALSE;
+		}
+	} while (removedBefore < context->count);
+
+	result->operations = context->count;
+	return TRUE;
+}
+
+static BOOL bench_run(const bench_scenario *scenario, UINT32 count, bench_result *result) {
+	bench_context context;
+	UINT32 i;
+	BOOL ret = FALSE;
+
+	ZeroMemory(&context, sizeof(context));
+	ZeroMemory(result, sizeof(*result));
+	context.count = count;
+	context.kickFd = -1;
+
+	if (!(result->samples = calloc(BENCH_MAX_SAMPLES, sizeof(UINT64))) ||
+		!(context.sources = calloc(count, sizeof(bench_source))))
+	{
+		fprintf(stderr, "out of memory\n");
+		goto out;
+	}
+	for (i = 0; i < count; i++) {
+		context.sources[i].fd = -1;
+		context.sources[i].context = &context;
+		context.sources[i].index = i;
+	}
+
+	if (!(context.evloop = eventloop_create())) {
+		fprintf(stderr, "unable to create the event loop\n");
+		goto out;
+	}
+
+	if (scenario->kick && !bench_kick_start(&context)) {
+		result->skipped = "unable to add the writable source";
+		ret = TRUE;
+		goto out;
+	}
+	if (scenario->callback && !bench_sources_open(&context, result, scenario->callback)) {
+		ret = TRUE;
+		goto out;
+	}
+
+	ret = scenario->run(&context, result);
+
+	if (result->skipped) {
+		ret = TRUE;
+	} else if (context.wrongMasks || context.afterRemove) {
+		fprintf(stderr, "%s: %"PRIu64" callbacks with an unexpected mask, %"PRIu64" callbacks after the removal\n",
+				scenario->name, context.wrongMasks, context.afterRemove);
+		ret = FALSE;
+	}
+
+out:
+	if (context.sources) {
+		bench_sources_close(&context);
+	}
+	if (context.evloop) {
+		eventloop_destroy(&context.evloop);
+	}
+	free(context.sources);
+	return ret;
+}
+
+/** the numbers in a comma separated list, the list is changed */
+static BOOL bench_parse_sources(char *list, UINT32 *counts, size_t maxCounts, size_t *numCounts) {
+	char *token, *saveptr = NULL;
+
+	*numCounts = 0;
+	for (token = strtok_r(list, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr)) {
+		long count = strtol(token, NULL, 10);
+		if (count < 2 || *numCounts >= maxCounts) {
+			return FALSE;
+		}
+		counts[(*numCounts)++] = (UINT32)count;
+	}
+	return *numCounts > 0;
+}
+
+static BOOL bench_selected(const char *list, const char *name) {
+	size_t length = strlen(name);
+	const char *match = list;
+
+	if (!list) {
+		return TRUE;
+	}
+	while ((match = strstr(match, name))) {
+		if (((match == list) || (match[-1] == ',')) && ((match[length] == ',') || !match[length])) {
+			return TRUE;
+		}
+		match += length;
+	}
+	return FALSE;
+}
+
+static void bench_raise_fd_limit(void) {
+	struct rlimit limit;
+
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+}
+
+int main(int argc, char **argv) {
+	const bench_scenario *scenario;
+	const char *scenarios = NULL;
+	char sources[256] = "10,100,1000,10000";
+	UINT32 counts[16];
+	size_t numCounts, i;
+	COMMAND_LINE_ARGUMENT_A *arg;
+	DWORD flags;
+	UINT64 maxNs = 0;
+	int status, ret = 0;
+
+	flags = COMMAND_LINE_SEPARATOR_EQUAL | COMMAND_LINE_SIGIL_DOUBLE_DASH;
+	status = CommandLineParseArgumentsA(argc, argv, bench_args, flags, NULL, NULL, NULL);
+	if (status != 0) {
+		printhelp(argv[0]);
+		return 1;
+	}
+
+	arg = bench_args;
+	do {
+		if (!(arg->Flags & COMMAND_LINE_VALUE_PRESENT))
+			continue;
+
+		CommandLineSwitchStart(arg)
+
+		CommandLineSwitchCase(arg, "help") {
+			printhelp(argv[0]);
+			return 0;
+		}
+		CommandLineSwitchCase(arg, "scenarios") {
+			scenarios = arg->Value;
+		}
+		CommandLineSwitchCase(arg, "sources") {
+			strncpy(sources, arg->Value, sizeof(sources) - 1);
+		}
+		CommandLineSwitchCase(arg, "fps") {
+			bench_fps = (UINT32)strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchCase(arg, "duration") {
+			bench_duration = (UINT32)strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchCase(arg, "max-ns") {
+			maxNs = strtoull(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchEnd(arg)
+	}
+	while ((arg = CommandLineFindNextArgumentA(arg)) != NULL);
+
+	if (!bench_parse_sources(sources, counts, ARRAYSIZE(counts), &numCounts) ||
+		(bench_fps < 1) || (bench_fps > 1000) || (bench_duration < 1))
+	{
+		printhelp(argv[0]);
+		return 1;
+	}
+
+	WLog_SetLogLevel(WLog_GetRoot(), WLOG_ERROR);
+	bench_raise_fd_limit();
+
+	printf("event loop: %s, timers at %"PRIu32" fps\n\n", BENCH_BACKEND, bench_fps);
+	printf("%-14s %8s %10s %12s %10s %10s %10s\n", "scenario", "sources", "operations", "operations/s",
+		"cpu", "p50", "p99");
+	printf("%-14s %8s %10s %12s %10s %10s %10s\n", "", "", "", "", "ns/op", "us", "us");
+
+	for (scenario = bench_scenarios; scenario->name; scenario++) {
+		if (!bench_selected(scenarios, scenario->name)) {
+			continue;
+		}
+
+		for (i = 0; i < numCounts; i++) {
+			bench_result result;
+			UINT64 cpuPerOp;
+
+			if (!bench_run(scenario, counts[i], &result)) {
+				printf("%-14s %8"PRIu32" failed\n", scenario->name, counts[i]);
+				ret = 1;
+				free(result.samples);
+				continue;
+			}
+			if (result.skipped) {
+				printf("%-14s %8"PRIu32" skipped: %s\n", scenario->name, counts[i], result.skipped);
+				free(result.samples);
+				continue;
+			}
+
+			qsort(result.samples, result.numSamples, sizeof(UINT64), bench_compare);
+			cpuPerOp = result.operations ? result.cpuTime / result.operations : 0;
+
+			printf("%-14s %8"PRIu32" %10"PRIu64" %12.0f %10"PRIu64" %10.1f %10.1f\n", scenario->name, counts[i],
+				result.operations, result.wallTime ? result.operations * 1e9 / result.wallTime : 0.0, cpuPerOp,
+				bench_quantile(&result, 0.5) / 1000.0, bench_quantile(&result, 0.99) / 1000.0);
+
+			/* the timers sleep most of the time, their cpu time per expiration is the dispatch overhead too */
+			if (maxNs && (cpuPerOp > maxNs)) {
+				printf("%-14s %8"PRIu32" exceeds %"PRIu64" ns per operation\n", scenario->name, counts[i], maxNs);
+				ret = 1;
+			}
+			free(result.samples);
+		}
+	}
+
+	return ret;
+}
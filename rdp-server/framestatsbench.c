@@ -0,0 +1,192 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * RDP Server
+ * Measures the cost of the frame statistics
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <winpr/crt.h>
+#include <winpr/cmdline.h>
+
+#include "../common/global.h"
+#include "../common/framestats.h"
+
+/**
+ * Runs what the statistics add to every frame: the timestamps and histogram
+ * updates done by ogon_send_surface_bits and the frame acknowledge handling.
+ * The same loop without the statistics is the baseline, the difference is
+ * the overhead per frame. Every run is repeated and the median is reported,
+ * with --max-ns the benchmark fails above that overhead.
+ */
+
+#define BENCH_MAX_RUNS 1000
+
+static COMMAND_LINE_ARGUMENT_A bench_args[] = {
+	{ "help", COMMAND_LINE_VALUE_FLAG, "", NULL, NULL, -1, NULL, "show help screen" },
+	{ "frames", COMMAND_LINE_VALUE_REQUIRED, "<number>", "1000000", NULL, -1, NULL, "frames per run" },
+	{ "runs", COMMAND_LINE_VALUE_REQUIRED, "<number>", "11", NULL, -1, NULL, "repetitions" },
+	{ "max-ns", COMMAND_LINE_VALUE_REQUIRED, "<number>", "0", NULL, -1, NULL, "fail above this overhead per frame" },
+	{ NULL, 0, NULL, NULL, NULL, -1, NULL, NULL }
+};
+
+static void printhelp(const char *bin) {
+	printf("Usage: %s [options]\n", bin);
+	printf("\noptions:\n\n");
+	printf("        %-20s %s\n", "--help", "print this help screen");
+	printf("        %-20s %s\n", "--frames=<number>", "frames per run (default: 1000000)");
+	printf("        %-20s %s\n", "--runs=<number>", "repetitions, the median is reported (default: 11)");
+	printf("        %-20s %s\n", "--max-ns=<number>", "exit with an error above this overhead per frame");
+}
+
+static UINT64 bench_cpu_time(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (UINT64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int bench_compare(const void *a, const void *b) {
+	UINT64 va = *(const UINT64 *)a;
+	UINT64 vb = *(const UINT64 *)b;
+
+	return (va > vb) - (va < vb);
+}
+
+/* keeps the compiler from dropping the loops */
+static volatile UINT64 bench_sink;
+
+/** @return cpu nanoseconds for the frames, with or without the statistics */
+static UINT64 bench_frames(ogon_frame_stats *stats, UINT32 frames, BOOL instrumented) {
+	UINT64 start, t, sink = 0;
+	UINT32 i;
+
+	start = bench_cpu_time();
+	for (i = 0; i < frames; i++) {
+		/* what a frame computes anyway: the damage area, the queue depth and the bytes */
+		UINT64 area = (UINT64)(i & 0xFFFF) * 64;
+		UINT64 depth = i & 3;
+		UINT64 bytes = (UINT64)(i & 0xFFF) * 16;
+
+		if (instrumented) {
+			/* simplify, damage, queue depth, encode, bytes and the ack */
+			t = frame_stats_now();
+			frame_stats_record(stats, OGON_FRAME_METRIC_SIMPLIFY_TIME, frame_stats_now() - t);
+			frame_stats_record(stats, OGON_FRAME_METRIC_DAMAGE_AREA, area);
+			frame_stats_record(stats, OGON_FRAME_METRIC_QUEUE_DEPTH, depth);
+			t = frame_stats_now();
+			frame_stats_record(stats, OGON_FRAME_METRIC_ENCODE_RFX, frame_stats_now() - t);
+			frame_stats_record(stats, OGON_FRAME_METRIC_FRAME_BYTES, bytes);
+			t = frame_stats_now();
+			frame_stats_record(stats, OGON_FRAME_METRIC_ACK_RTT, t & 0x3F);
+			sink += t;
+		}
+		sink += area + depth + bytes;
+	}
+	bench_sink += sink;
+	return bench_cpu_time() - start;
+}
+
+/** @return cpu nanoseconds for frames histogram updates alone */
+static UINT64 bench_record(ogon_frame_stats *stats, UINT32 frames) {
+	UINT64 start = bench_cpu_time();
+	UINT32 i;
+
+	for (i = 0; i < frames; i++) {
+		frame_stats_record(stats, OGON_FRAME_METRIC_FRAME_BYTES, (UINT64)i * 7919);
+	}
+	return bench_cpu_time() - start;
+}
+
+int main(int argc, char *argv[]) {
+	COMMAND_LINE_ARGUMENT_A *arg;
+	UINT32 frames = 1000000, runs = 11, run;
+	UINT64 maxNs = 0;
+	UINT64 baseline[BENCH_MAX_RUNS], instrumented[BENCH_MAX_RUNS], record[BENCH_MAX_RUNS];
+	ogon_frame_stats stats;
+	double recordNs, baselineNs, instrumentedNs, overheadNs;
+	DWORD flags;
+	int status;
+
+	flags = COMMAND_LINE_SEPARATOR_EQUAL | COMMAND_LINE_SIGIL_DOUBLE_DASH;
+	status = CommandLineParseArgumentsA(argc, argv, bench_args, flags, NULL, NULL, NULL);
+	if (status != 0) {
+		printhelp(argv[0]);
+		return 1;
+	}
+
+	arg = bench_args;
+	do {
+		if (!(arg->Flags & COMMAND_LINE_VALUE_PRESENT))
+			continue;
+
+		CommandLineSwitchStart(arg)
+
+		CommandLineSwitchCase(arg, "help") {
+			printhelp(argv[0]);
+			return 0;
+		}
+		CommandLineSwitchCase(arg, "frames") {
+			frames = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchCase(arg, "runs") {
+			runs = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchCase(arg, "max-ns") {
+			maxNs = strtoull(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchEnd(arg)
+	}
+	while ((arg = CommandLineFindNextArgumentA(arg)) != NULL);
+
+	if (!frames || !runs || (runs > BENCH_MAX_RUNS)) {
+		printhelp(argv[0]);
+		return 1;
+	}
+
+	/* alternating the loops spreads frequency changes over both */
+	for (run = 0; run < runs; run++) {
+		memset(&stats, 0, sizeof(stats));
+		baseline[run] = bench_frames(&stats, frames, FALSE);
+		instrumented[run] = bench_frames(&stats, frames, TRUE);
+		record[run] = bench_record(&stats, frames);
+	}
+	qsort(baseline, runs, sizeof(UINT64), bench_compare);
+	qsort(instrumented, runs, sizeof(UINT64), bench_compare);
+	qsort(record, runs, sizeof(UINT64), bench_compare);
+
+	recordNs = (double)record[runs / 2] / frames;
+	baselineNs = (double)baseline[runs / 2] / frames;
+	instrumentedNs = (double)instrumented[runs / 2] / frames;
+	overheadNs = (instrumentedNs > baselineNs) ? instrumentedNs - baselineNs : 0.0;
+
+	printf("%-12s %12s %14s %14s %14s\n", "frames", "record ns", "baseline ns", "instrumented", "overhead ns");
+	printf("%-12" PRIu32 " %12.1f %14.1f %14.1f %14.1f\n", frames, recordNs, baselineNs, instrumentedNs, overheadNs);
+
+	if (maxNs && (overheadNs > maxNs)) {
+		printf("overhead exceeds %" PRIu64 " ns per frame\n", maxNs);
+		return 1;
+	}
+	return 0;
+}
@@ -29,6 +29,8 @@
 #endif
 
 #include <unistd.h>
+#include <limits.h>
+#include <time.h>
 
 #include <winpr/path.h>
 #include <winpr/input.h>
@@ -53,6 +55,7 @@
 #include "backend.h"
 #include "app_context.h"
 #include "bandwidth_mgmt.h"
+#include "trace.h"
 
 #define TAG OGON_TAG("core.frontend")
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
@@ -184,6 +187,7 @@ void handle_wait_timer_state(ogon_connection *conn) {
 				WLog_ERR(TAG, "error sending framebuffer sync request");
 				ogon_connection_close(conn);
 			}
+			OGON_TRACE3(sync_request, conn->id, front->nextFrameId, 0);
 			backend->waitingSyncReply = TRUE;
 		}
 	}
@@ -213,9 +217,103 @@ int frontend_handle_frame_sent(ogon_connection *conn) {
 
 int ogon_backend_consume_damage(ogon_connection *conn);
 
+/* the first frame completes the logon, hand the spans to the session manager */
+static void frontend_logon_trace_first_frame(ogon_connection *conn) {
+	ogon_front_connection *front = &conn->front;
+	char summary[512];
+
+	if (front->logonTraceSent || !logon_trace_end(&front->logonTrace, LOGON_PHASE_FIRST_FRAME)) {
+		return;
+	}
+
+	logon_trace_end(&front->logonTrace, LOGON_PHASE_TOTAL);
+	front->logonTraceSent = TRUE;
+
+	logon_trace_summary(&front->logonTrace, summary, sizeof(summary));
+	WLog_DBG(TAG, "connection %ld: logon trace %s", conn->id, summary);
+
+	if (ogon_icp_LogonTrace_async(conn->id, &front->logonTrace) != PBRPC_SUCCESS) {
+		WLog_DBG(TAG, "connection %ld: unable to send the logon trace", conn->id);
+	}
+}
+
+static void frontend_stop_recording(ogon_front_connection *front) {
+	frame_recorder_free(front->frameRecorder);
+	front->frameRecorder = NULL;
+	free(front->recordFramesDir);
+	front->recordFramesDir = NULL;
+}
+
+/* records the damage the backend delivered, a new file is started on every resize */
+static void frontend_record_frame(ogon_connection *conn) {
+	ogon_front_connection *front = &conn->front;
+	ogon_backend_connection *backend = conn->shadowing->backend;
+	ogon_screen_infos *screenInfos = &backend->screenInfos;
+	ogon_framerec_rect *recRects;
+	const RDP_RECT *rects;
+	UINT32 i, numRects = 0, numRecRects = 0;
+	BYTE *data;
+	char path[PATH_MAX];
+
+	rects = ogon_dmgbuf_get_rects(backend->damage, &numRects);
+	data = ogon_dmgbuf_get_data(backend->damage);
+	if (!rects || !numRects || !data) {
+		return;
+	}
+
+	if (front->frameRecorder && !frame_recorder_matches(front->frameRecorder, screenInfos->width, screenInfos->height)) {
+		frame_recorder_free(front->frameRecorder);
+		front->frameRecorder = NULL;
+	}
+
+	if (!front->frameRecorder) {
+		if (screenInfos->bytesPerPixel != 4) {
+			WLog_ERR(TAG, "connection %ld: frames with %"PRIu32" bytes per pixel can't be recorded",
+					 conn->id, screenInfos->bytesPerPixel);
+			frontend_stop_recording(front);
+			return;
+		}
+
+		/* the frame id keeps the files apart if the desktop is resized within a second */
+		snprintf(path, sizeof(path), "%s/ogon-%ld-%"PRIu64"-%"PRIu32".frec", front->recordFramesDir, conn->id,
+				 (UINT64)time(NULL), front->nextFrameId);
+		if (!(front->frameRecorder = frame_recorder_new(path, screenInfos->width, screenInfos->height))) {
+			WLog_ERR(TAG, "connection %ld: unable to create frame recording %s", conn->id, path);
+			frontend_stop_recording(front);
+			return;
+		}
+		WLog_INFO(TAG, "connection %ld: recording frames to %s", conn->id, path);
+	}
+
+	if (!(recRects = calloc(numRects, sizeof(ogon_framerec_rect)))) {
+		return;
+	}
+	for (i = 0; i < numRects; i++) {
+		if (rects[i].x < 0 || rects[i].y < 0 || rects[i].width < 1 || rects[i].height < 1) {
+			continue;
+		}
+		recRects[numRecRects].x = rects[i].x;
+		recRects[numRecRects].y = rects[i].y;
+		recRects[numRecRects].width = rects[i].width;
+		recRects[numRecRects].height = rects[i].height;
+		numRecRects++;
+	}
+
+	if (!frame_recorder_add_frame(front->frameRecorder, data, screenInfos->scanline, recRects, numRecRects)) {
+		WLog_ERR(TAG, "connection %ld: error writing the frame recording, recording stopped", conn->id);
+		frontend_stop_recording(front);
+	}
+	free(recRects);
+}
+
 int frontend_handle_sync_reply(ogon_connection *conn) {
+	ogon_backend_connection *backend = conn->shadowing->backend;
+	UINT64 now = frame_stats_now();
+	UINT32 numRects = 0;
+	BOOL damaged;
 
-	conn->shadowing->backend->waitingSyncReply = FALSE;
+	backend->waitingSyncReply = FALSE;
+	damaged = ogon_dmgbuf_get_rects(backend->damage, &numRects) && numRects;
 
 	LinkedList_Enumerator_Reset(conn->frontConnections);
 	while (LinkedList_Enumerator_MoveNext(conn->frontConnections)) {
@@ -223,11 +321,19 @@ int frontend_handle_sync_reply(ogon_connection *conn) {
 		ogon_front_connection *front = &c->front;
 		ogon_bitmap_encoder *encoder = front->encoder;
 
+		OGON_TRACE2(sync_reply, c->id, front->nextFrameId);
+
+		frame_stats_input_replied(&front->inputLatency, backend->syncRequestedAt, now, damaged);
+
 		if (ogon_backend_consume_damage(c) < 0) {
 			WLog_ERR(TAG, "error when treating backend damage for connection %ld", c->id);
 			return -1;
 		}
 
+		if (front->recordFramesDir) {
+			frontend_record_frame(c);
+		}
+
 		/* Don't handle the reply if we don't expecting one */
 		if (ogon_state_get(front->state) != OGON_STATE_WAITING_SYNC_REPLY){
 			continue;
@@ -248,6 +354,8 @@ int frontend_handle_sync_reply(ogon_connection *conn) {
 			WLog_ERR(TAG, "error sending surface bits");
 			return -1;
 		}
+
+		frontend_logon_trace_first_frame(c);
 	}
 
 	/**
@@ -316,6 +424,8 @@ static void handle_frame_timer_event(void *data) {
 		UINT32 current_time = GetTickCount();
 		BOOL bandwidthExceeded = FALSE;
 
+		OGON_TRACE2(frame_timer, c->id, front->nextFrameId);
+
 		if (stats->fps_measure_timestamp + 1000 < current_time) {
 			stats->fps_measure_timestamp = current_time;
 			stats->fps_measured = stats->fps_measure_currentfps;
@@ -328,6 +438,10 @@ static void handle_frame_timer_event(void *data) {
 			stats->bytes_sent_current = 0;
 		}
 
+		if (front->inputLatency.receivedAt) {
+			frame_stats_input_expire(&front->inputLatency, frame_stats_now());
+		}
+
 		ogon_state_set_event(front->state, OGON_EVENT_FRAME_TIMER);
 
 		if (front->codecMode == CODEC_MODE_H264) {
@@ -336,6 +450,7 @@ static void handle_frame_timer_event(void *data) {
 			if (ogon_bwmgmt_update_bucket(c) == 0) {
 				/* no space in the current bucket */
 				bandwidthExceeded = TRUE;
+				front->frameStats.suppressedFrames++;
 			}
 		}
 
@@ -374,6 +489,8 @@ static BOOL ogon_peer_post_connect(freerdp_peer *client)
 	ogon_front_connection *front = &conn->front;
 	int error_code;
 
+	logon_trace_end(&front->logonTrace, LOGON_PHASE_CONNECT);
+
 	WLog_DBG(TAG, "connection id %ld client hostname=[%s]", conn->id, client->hostname);
 
 	if (front->backendProps.serviceEndpoint) {
@@ -410,6 +527,7 @@ static BOOL ogon_peer_post_connect(freerdp_peer *client)
 	 * is reserved for future use and that it will always return a value of 0.
 	 */
 
+	logon_trace_begin(&front->logonTrace, LOGON_PHASE_LOGON_CALL);
 	error_code = ogon_icp_LogonUser((UINT32)(conn->id),
 			settings->Username, settings->Domain, settings->Password,
 			settings->ClientHostname, settings->ClientAddress,
@@ -426,8 +544,11 @@ static BOOL ogon_peer_post_connect(freerdp_peer *client)
 		return FALSE;
 	}
 
+	logon_trace_end(&front->logonTrace, LOGON_PHASE_LOGON_CALL);
+
 	WLog_DBG(TAG, "logon user call successful, service endpoint = [%s]", front->backendProps.serviceEndpoint);
 
+	logon_trace_begin(&front->logonTrace, LOGON_PHASE_ACTIVATION);
 	return TRUE;
 }
 
@@ -573,6 +694,7 @@ static BOOL ogon_peer_activate(freerdp_peer *client) {
 			 conn->id, front->activationCount,
 			 conn->backend ? "existing" : "no");
 
+	logon_trace_end(&front->logonTrace, LOGON_PHASE_ACTIVATION);
 	front->activationCount++;
 
 	/*
@@ -721,10 +843,13 @@ static BOOL ogon_peer_activate(freerdp_peer *client) {
 		return FALSE;
 	}
 
+	logon_trace_begin(&front->logonTrace, LOGON_PHASE_BACKEND_INIT);
 	if (!ogon_backend_initialize(conn, conn->backend, settings, settings->DesktopWidth, settings->DesktopHeight))	{
 		WLog_ERR(TAG, "error sending capabilities to backend [%s]", front->backendProps.serviceEndpoint);
 		goto out_fail;
 	}
+	logon_trace_end(&front->logonTrace, LOGON_PHASE_BACKEND_INIT);
+	logon_trace_begin(&front->logonTrace, LOGON_PHASE_FIRST_FRAME);
 
 	if (!ogon_frontend_install_frame_timer(conn)) {
 		WLog_ERR(TAG, "unable to add frame timer in eventloop");
@@ -758,6 +883,8 @@ static BOOL ogon_input_synchronize_event(rdpInput *input, UINT32 flags) {
 	ogon_backend_connection* backend = conn->shadowing->backend;
 	ogon_keyboard_indicator_state indicator_state = conn->front.indicators;
 
+	OGON_TRACE4(input_received, conn->id, conn->front.nextFrameId, "synchronize", flags);
+
 	/* synchronize keyboard packet means all keys up (including modifiers) */
 	conn->front.modifiers = 0;
 	conn->front.indicators = flags;
@@ -770,6 +897,8 @@ static BOOL ogon_input_synchronize_event(rdpInput *input, UINT32 flags) {
 
 	if (!backend->client.SynchronizeKeyboardEvent(backend, flags, conn->id)) {
 		ogon_connection_close(conn);
+	} else {
+		OGON_TRACE4(input_forwarded, conn->id, conn->front.nextFrameId, "synchronize", flags);
 	}
 
 	/* if the backend doesn't handle multi-seat, synchronize all other connections
@@ -860,6 +989,15 @@ static void ogon_update_keyboard_modifiers(ogon_connection *conn, UINT16 flags,
 	conn->front.modifiers |= orMask;
 }
 
+/**
+ * The input latency is measured from the oldest input the next frame follows.
+ * Key releases and plain pointer motion are skipped, they usually don't damage
+ * anything and would be attributed to an unrelated frame later on.
+ */
+static inline void frontend_input_forwarded(ogon_connection *conn) {
+	frame_stats_input_received(&conn->front.inputLatency, frame_stats_now());
+}
+
 static BOOL ogon_input_keyboard_event(rdpInput *input, UINT16 flags, UINT16 code) {
 	ogon_connection *conn = (ogon_connection *)input->context;
 	ogon_backend_connection* backend = conn->shadowing->backend;
@@ -867,6 +1005,8 @@ static BOOL ogon_input_keyboard_event(rdpInput *input, UINT16 flags, UINT16 code
 	UINT16 vkcode, scancode;
 	ogon_keyboard_indicator_state indicator_state = conn->front.indicators;
 
+	OGON_TRACE4(input_received, conn->id, conn->front.nextFrameId, "keyboard", flags);
+
 	scancode = code;
 	if (flags & KBD_FLAGS_EXTENDED) {
 		scancode |= KBD_FLAGS_EXTENDED;
@@ -962,6 +1102,10 @@ static BOOL ogon_input_keyboard_event(rdpInput *input, UINT16 flags, UINT16 code
 		ogon_connection_close(conn);
 		return TRUE;
 	}
+	OGON_TRACE4(input_forwarded, conn->id, conn->front.nextFrameId, "keyboard", flags);
+	if (!(flags & KBD_FLAGS_RELEASE)) {
+		frontend_input_forwarded(conn);
+	}
 
 	if (!backend->multiseatCapable && (indicator_state != conn->front.indicators)) {
 		ogon_connection *connection = conn->shadowing;
@@ -982,12 +1126,19 @@ static BOOL ogon_input_unicode_keyboard_event(rdpInput* input, UINT16 flags, UIN
 	ogon_connection *conn = (ogon_connection *)input->context;
 	ogon_backend_connection* backend = conn->shadowing->backend;
 
+	OGON_TRACE4(input_received, conn->id, conn->front.nextFrameId, "unicode", flags);
+
 	if ((conn->front.inputFilter & INPUT_FILTER_KEYBOARD) || !backend || !backend->client.UnicodeKeyboardEvent) {
 		return TRUE;
 	}
 
 	if (!backend->client.UnicodeKeyboardEvent(backend, flags, code, conn->id)) {
 		ogon_connection_close(conn);
+	} else {
+		OGON_TRACE4(input_forwarded, conn->id, conn->front.nextFrameId, "unicode", flags);
+		if (!(flags & KBD_FLAGS_RELEASE)) {
+			frontend_input_forwarded(conn);
+		}
 	}
 
 	return TRUE;
@@ -999,12 +1150,19 @@ static BOOL ogon_input_mouse_event(rdpInput* input, UINT16 flags, UINT16 x, UINT
 	ogon_connection *connection = conn->shadowing;
 	POINTER_POSITION_UPDATE pointerUpdate = { 0 };
 
+	OGON_TRACE4(input_received, conn->id, conn->front.nextFrameId, "mouse", flags);
+
 	if ((conn->front.inputFilter & INPUT_FILTER_MOUSE) || !backend || !backend->client.MouseEvent) {
 		return TRUE;
 	}
 
 	if (!backend->client.MouseEvent(backend, flags, x, y, conn->id)) {
 		ogon_connection_close(conn);
+	} else {
+		OGON_TRACE4(input_forwarded, conn->id, conn->front.nextFrameId, "mouse", flags);
+		if (flags & ~PTR_FLAGS_MOVE) {
+			frontend_input_forwarded(conn);
+		}
 	}
 
 	pointerUpdate.xPos = x;
@@ -1026,12 +1184,17 @@ static BOOL ogon_input_extended_mouse_event(rdpInput* input, UINT16 flags, UINT1
 	ogon_connection *conn = (ogon_connection*) input->context;
 	ogon_backend_connection* backend = (ogon_backend_connection *)conn->shadowing->backend;
 
+	OGON_TRACE4(input_received, conn->id, conn->front.nextFrameId, "extended_mouse", flags);
+
 	if ((conn->front.inputFilter & INPUT_FILTER_MOUSE) || !backend || !backend->client.ExtendedMouseEvent) {
 		return TRUE;
 	}
 
 	if (!backend->client.ExtendedMouseEvent(backend, flags, x, y, conn->id)) {
 		ogon_connection_close(conn);
+	} else {
+		OGON_TRACE4(input_forwarded, conn->id, conn->front.nextFrameId, "extended_mouse", flags);
+		frontend_input_forwarded(conn);
 	}
 
 	return TRUE;
@@ -1122,11 +1285,30 @@ static BOOL ogon_update_frame_acknowledge(rdpContext *context, UINT32 frameId)
 {
 	ogon_connection *connection = (ogon_connection*) context;
 	ogon_front_connection *frontend = (ogon_front_connection *)&connection->front;
+	UINT32 index;
+	UINT64 now = frame_stats_now();
 
 	/* WLog_DBG(TAG, "%s: frameId=%"PRIu32"", __FUNCTION__, frameId); */
+	OGON_TRACE2(frame_ack, connection->id, frameId);
 
 	frontend->lastAckFrame = frameId;
 
+	/* the client may acknowledge several frames at once */
+	for (index = 0; index < OGON_FRAME_SENT_HISTORY; index++) {
+		ogon_frame_sent *sent = &frontend->frameSent[index];
+		if (!sent->sentAt || sent->frameId > frameId) {
+			continue;
+		}
+		if (sent->frameId == frameId) {
+			frame_stats_record(&frontend->frameStats, OGON_FRAME_METRIC_ACK_RTT,
+					(now - sent->sentAt) / 1000);
+		}
+		if (sent->input) {
+			frame_stats_record(&frontend->frameStats, OGON_FRAME_METRIC_INPUT_NETWORK, now - sent->sentAt);
+		}
+		sent->sentAt = 0;
+	}
+
 	if (ogon_state_get(frontend->state) != OGON_STATE_WAITING_ACK)
 		return TRUE;
 
@@ -1396,6 +1578,7 @@ BOOL ogon_connection_init_front(ogon_connection *conn)
 	/*6*/	PROPERTY_ITEM_INIT_BOOL("ogon.disableGraphicsPipelineH264", FALSE),
 	/*7*/	PROPERTY_ITEM_INIT_BOOL("ogon.enableFullAVC444", FALSE),
 	/*8*/   PROPERTY_ITEM_INIT_BOOL("ogon.restrictAVC444", FALSE),
+	/*9*/	PROPERTY_ITEM_INIT_STRING("ogon.recordFrames"),
 		PROPERTY_ITEM_INIT_INT(NULL, 0), /* last one */
 	};
 
@@ -1408,10 +1591,13 @@ BOOL ogon_connection_init_front(ogon_connection *conn)
 		INDEX_BITRATE,
 		INDEX_NO_H264,
 		INDEX_AVC444,
-		INDEX_RESTRICT_AVC444
+		INDEX_RESTRICT_AVC444,
+		INDEX_RECORD_FRAMES
 	};
 
+	logon_trace_begin(&front->logonTrace, LOGON_PHASE_PROPERTIES);
 	res = ogon_icp_get_property_bulk(conn->id, reqs);
+	logon_trace_end(&front->logonTrace, LOGON_PHASE_PROPERTIES);
 	if (res != PBRPC_SUCCESS) {
 		WLog_ERR(TAG, "error retrieving properties by the bulk method (res=%d)", res);
 		ogon_PropertyItem_free(reqs);
@@ -1444,6 +1630,12 @@ BOOL ogon_connection_init_front(ogon_connection *conn)
 	front->showDebugInfo = reqs[INDEX_SHOW_DEBUG].v.boolValue;
 	front->rdpgfxForbidden = reqs[INDEX_NO_EGFX].v.boolValue;
 
+	if (reqs[INDEX_RECORD_FRAMES].success && reqs[INDEX_RECORD_FRAMES].v.stringValue &&
+		*reqs[INDEX_RECORD_FRAMES].v.stringValue)
+	{
+		front->recordFramesDir = strdup(reqs[INDEX_RECORD_FRAMES].v.stringValue);
+	}
+
 
 	peer->settings->NetworkAutoDetect = TRUE;
 	peer->autodetect->BandwidthMeasureResults = ogon_bwmgmt_client_bandwidth_measure_results;
@@ -1563,6 +1755,8 @@ void frontend_destroy(ogon_front_connection *front)
 		front->encoder = NULL;
 	}
 
+	frontend_stop_recording(front);
+
 	ogon_state_free(front->state);
 
 	if (front->pointerCache) {
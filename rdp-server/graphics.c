@@ -41,6 +41,7 @@
 #include "backend.h"
 #include "encoder.h"
 #include "font8x8.h"
+#include "trace.h"
 
 #define TAG OGON_TAG("core.graphics")
 
@@ -227,6 +228,7 @@ int ogon_send_gfx_rfx_progressive_bits(ogon_connection *conn, BYTE *data,
 			WLog_ERR(TAG, "%s: invalid rectangle: x=%"PRId16" y=%"PRId16"", __FUNCTION__, rects[i].x, rects[i].y);
 			return 0;
 		}
+		OGON_TRACE3(encode_start, conn->id, frontend->nextFrameId, "gfx_progressive");
 		if (!(message = rfx_encode_message(encoder->rfx_context, &r, 1,
 			data, encoder->desktopWidth, encoder->desktopHeight, encoder->scanLine)))
 		{
@@ -242,12 +244,15 @@ int ogon_send_gfx_rfx_progressive_bits(ogon_connection *conn, BYTE *data,
 
 		pdu.bitmapDataLength = Stream_GetPosition(s);
 		pdu.bitmapData = Stream_Buffer(s);
+		OGON_TRACE4(encode_end, conn->id, frontend->nextFrameId, "gfx_progressive", pdu.bitmapDataLength);
 
 		if (!ogon_bwmgmt_detect_bandwidth_start(conn)) {
 			return -1;
 		}
 
+		OGON_TRACE3(pdu_write_start, conn->id, frontend->nextFrameId, pdu.bitmapDataLength);
 		frontend->rdpgfx->WireToSurface2(frontend->rdpgfx, &pdu);
+		OGON_TRACE3(pdu_write_end, conn->id, frontend->nextFrameId, pdu.bitmapDataLength);
 
 		if (!ogon_bwmgmt_detect_bandwidth_stop(conn)) {
 			return -1;
@@ -294,6 +299,7 @@ int ogon_send_gfx_rfx_bits(ogon_connection *conn, BYTE *data, RDP_RECT *rects,
 			return 0;
 		}
 		buf = data + rects[i].y * encoder->scanLine + rects[i].x * encoder->bytesPerPixel;
+		OGON_TRACE3(encode_start, conn->id, frontend->nextFrameId, "gfx_rfx");
 		if (!(message = rfx_encode_message(encoder->rfx_context, &r, 1,
 			buf, r.width, r.height, encoder->scanLine)))
 		{
@@ -319,12 +325,15 @@ int ogon_send_gfx_rfx_bits(ogon_connection *conn, BYTE *data, RDP_RECT *rects,
 		pdu.destRect.bottom = pdu.destRect.top + rects[i].height;
 		pdu.bitmapDataLength = Stream_GetPosition(s);
 		pdu.bitmapData = Stream_Buffer(s);
+		OGON_TRACE4(encode_end, conn->id, frontend->nextFrameId, "gfx_rfx", pdu.bitmapDataLength);
 
 		if (!ogon_bwmgmt_detect_bandwidth_start(conn)) {
 			return -1;
 		}
 
+		OGON_TRACE3(pdu_write_start, conn->id, frontend->nextFrameId, pdu.bitmapDataLength);
 		frontend->rdpgfx->WireToSurface1(frontend->rdpgfx, &pdu);
+		OGON_TRACE3(pdu_write_end, conn->id, frontend->nextFrameId, pdu.bitmapDataLength);
 
 		if (!ogon_bwmgmt_detect_bandwidth_stop(conn)) {
 			return -1;
@@ -460,6 +469,7 @@ int ogon_send_gfx_h264_bits(ogon_connection *conn, BYTE *data, RDP_RECT *rects,
 		targetFrameSizeInBits /= 2;
 	}
 
+	OGON_TRACE3(encode_start, conn->id, frontend->nextFrameId, "h264");
 	STOPWATCH_START(encoder->swH264Compress);
 	rv = ogon_openh264_compress(encoder->h264_context, maxFrameRate,
 		                    targetFrameSizeInBits, data, &encodedData, &encodedSize,
@@ -533,12 +543,15 @@ int ogon_send_gfx_h264_bits(ogon_connection *conn, BYTE *data, RDP_RECT *rects,
 	pdu.destRect.bottom = encoder->desktopHeight;
 	pdu.bitmapDataLength = Stream_GetPosition(s);
 	pdu.bitmapData = Stream_Buffer(s);
+	OGON_TRACE4(encode_end, conn->id, frontend->nextFrameId, "h264", pdu.bitmapDataLength);
 
 	if (!ogon_bwmgmt_detect_bandwidth_start(conn)) {
 		return -1;
 	}
 
+	OGON_TRACE3(pdu_write_start, conn->id, frontend->nextFrameId, pdu.bitmapDataLength);
 	frontend->rdpgfx->WireToSurface1(frontend->rdpgfx, &pdu);
+	OGON_TRACE3(pdu_write_end, conn->id, frontend->nextFrameId, pdu.bitmapDataLength);
 
 	if (!ogon_bwmgmt_detect_bandwidth_stop(conn)) {
 		return -1;
@@ -607,6 +620,7 @@ int ogon_send_rdp_rfx_bits(ogon_connection *conn, BYTE *data, RDP_RECT *rects,
 
 	s = encoder->stream;
 
+	OGON_TRACE3(encode_start, conn->id, frontend->nextFrameId, "rfx");
 	if (!(message = rfx_encode_message(encoder->rfx_context,
 		(RFX_RECT*)rects, numRects, data, settings->DesktopWidth,
 		settings->DesktopHeight, encoder->scanLine)))
@@ -630,6 +644,7 @@ int ogon_send_rdp_rfx_bits(ogon_connection *conn, BYTE *data, RDP_RECT *rects,
 	cmd.bmp.bitmapDataLength = Stream_GetPosition(s);
 	cmd.bmp.bitmapData = Stream_Buffer(s);
 	messageSize = cmd.bmp.bitmapDataLength;
+	OGON_TRACE4(encode_end, conn->id, frontend->nextFrameId, "rfx", messageSize);
 
 	messageSize += 22; /* the size of the surface bits command header */
 
@@ -643,7 +658,9 @@ int ogon_send_rdp_rfx_bits(ogon_connection *conn, BYTE *data, RDP_RECT *rects,
 		return -1;
 	}
 
+	OGON_TRACE3(pdu_write_start, conn->id, frontend->nextFrameId, messageSize);
 	update->SurfaceBits(update->context, &cmd);
+	OGON_TRACE3(pdu_write_end, conn->id, frontend->nextFrameId, messageSize);
 
 	if (!ogon_bwmgmt_detect_bandwidth_stop(conn)) {
 		return -1;
@@ -682,6 +699,7 @@ int ogon_send_bitmap_bits(ogon_connection *conn, BYTE *data, RDP_RECT *rects,
 	numBitmaps = 0;
 
 	Stream_SetPosition(bmp->bs, 0);
+	OGON_TRACE3(encode_start, conn->id, conn->front.nextFrameId, "bitmap");
 
 	for (i = 0, pr = rects; i < numRects; i++, pr++)
 	{
@@ -819,6 +837,8 @@ int ogon_send_bitmap_bits(ogon_connection *conn, BYTE *data, RDP_RECT *rects,
 		}
 	}
 
+	OGON_TRACE4(encode_end, conn->id, conn->front.nextFrameId, "bitmap", Stream_GetPosition(bmp->bs));
+
 	bitmapUpdate.skipCompression = FALSE;
 	bitmapUpdate.rectangles = bmp->rects;
 	bitmapUpdate.count = 0;
@@ -848,12 +868,14 @@ int ogon_send_bitmap_bits(ogon_connection *conn, BYTE *data, RDP_RECT *rects,
 
 		if (!nextSize || updatePduSize + nextSize > maxDataSize) {
 			STOPWATCH_START(encoder->swSendBitmapUpdate);
+			OGON_TRACE3(pdu_write_start, conn->id, conn->front.nextFrameId, updatePduSize);
 
 			if (!update->BitmapUpdate(&conn->context, &bitmapUpdate)) {
 				STOPWATCH_STOP(encoder->swSendBitmapUpdate);
 				WLog_ERR(TAG, "BitmapUpdate call failed");
 				goto fail;
 			}
+			OGON_TRACE3(pdu_write_end, conn->id, conn->front.nextFrameId, updatePduSize);
 			STOPWATCH_STOP(encoder->swSendBitmapUpdate);
 			bitmapUpdate.rectangles += bitmapUpdate.count;
 			bitmapUpdate.count = 0;
@@ -1065,6 +1087,14 @@ static inline void ogon_send_frame_marker(ogon_connection *conn, BOOL begin) {
 	/* WLog_DBG(TAG, "%s: send frame %s frameId=%"PRIu32" lastAckFrame=%"PRIu32"", __FUNCTION__,
 		 begin ? "BEGIN" : "END", front->nextFrameId, front->lastAckFrame); */
 
+	if (!begin && front->frameAcknowledge) {
+		/* remember when the frame was completed for the acknowledge round trip */
+		ogon_frame_sent *sent = &front->frameSent[front->nextFrameId % OGON_FRAME_SENT_HISTORY];
+		sent->frameId = front->nextFrameId;
+		sent->sentAt = frame_stats_now();
+		sent->input = (front->inputLatency.repliedAt != 0);
+	}
+
 	if (front->rdpgfxConnected) {
 		/* under gfx frame markers must be supported */
 		if (begin) {
@@ -1233,6 +1263,9 @@ int ogon_send_surface_bits(ogon_connection *conn) {
 	ogon_bitmap_encoder *dstEncoder = front->encoder;
 
 	pfn_send_graphics_bits sendGraphicsBits = NULL;
+	ogon_frame_stats *stats = &front->frameStats;
+	UINT64 startTime;
+	UINT32 sentBefore, frameBytes;
 
 	STOPWATCH_START(dstEncoder->swSendSurfaceBits);
 
@@ -1262,19 +1295,24 @@ int ogon_send_surface_bits(ogon_connection *conn) {
 	switch (front->codecMode) {
 		case CODEC_MODE_RFX1:
 			sendGraphicsBits = ogon_send_rdp_rfx_bits;
+			stats->codecMetric = OGON_FRAME_METRIC_ENCODE_RFX;
 			break;
 		case CODEC_MODE_RFX2:
 			sendGraphicsBits = ogon_send_gfx_rfx_bits;
+			stats->codecMetric = OGON_FRAME_METRIC_ENCODE_GFX_RFX;
 			break;
 		case CODEC_MODE_RFX3:
 			sendGraphicsBits = ogon_send_gfx_rfx_progressive_bits;
+			stats->codecMetric = OGON_FRAME_METRIC_ENCODE_GFX_PROGRESSIVE;
 			break;
 		case CODEC_MODE_BMP:
 			sendGraphicsBits = ogon_send_bitmap_bits;
+			stats->codecMetric = OGON_FRAME_METRIC_ENCODE_BITMAP;
 			break;
 #ifdef WITH_OPENH264
 		case CODEC_MODE_H264:
 			sendGraphicsBits = ogon_send_gfx_h264_bits;
+			stats->codecMetric = OGON_FRAME_METRIC_ENCODE_H264;
 			debugInfoEmbedded = FALSE;
 			break;
 #endif
@@ -1297,6 +1335,8 @@ int ogon_send_surface_bits(ogon_connection *conn) {
 		tileSize = 64;
 	}
 
+	OGON_TRACE2(simplify_start, conn->id, front->nextFrameId);
+	startTime = frame_stats_now();
 	if (!simplify_damagedRegion(&damagedRegion, backend, dstEncoder,
 		&dstEncoder->accumulatedDamage, tileSize, tileSize,
 		damageFullTiles, &damagedSize))
@@ -1305,6 +1345,8 @@ int ogon_send_surface_bits(ogon_connection *conn) {
 		ret = -1;
 		goto out_release_damaged;
 	}
+	frame_stats_record(stats, OGON_FRAME_METRIC_SIMPLIFY_TIME, frame_stats_now() - startTime);
+	OGON_TRACE3(simplify_end, conn->id, front->nextFrameId, damagedSize);
 
 	if (region16_is_empty(&damagedRegion)) {
 		if (front->rdpgfxProgressiveTicks == 0) {
@@ -1330,10 +1372,26 @@ int ogon_send_surface_bits(ogon_connection *conn) {
 
 	nrects = ogon_update_encoder_rects(dstEncoder, &damagedRegion);
 
+	frame_stats_record(stats, OGON_FRAME_METRIC_DAMAGE_AREA, damagedSize);
+	if (front->frameAcknowledge) {
+		UINT32 index, pending = 0;
+		for (index = 0; index < OGON_FRAME_SENT_HISTORY; index++) {
+			if (front->frameSent[index].sentAt) {
+				pending++;
+			}
+		}
+		frame_stats_record(stats, OGON_FRAME_METRIC_QUEUE_DEPTH, pending);
+	}
+
+	/* the counter is only reset by the bandwidth management in the frame timer */
+	sentBefore = freerdp_get_transport_sent(&conn->context, FALSE);
+
 	ogon_send_frame_marker(conn, TRUE);
 
 	STOPWATCH_START(dstEncoder->swSendGraphicsBits);
+	startTime = frame_stats_now();
 	ret = sendGraphicsBits(conn, data, dstEncoder->rdpRects, nrects);
+	frame_stats_record(stats, stats->codecMetric, frame_stats_now() - startTime);
 	STOPWATCH_STOP(dstEncoder->swSendGraphicsBits);
 
 	front->statistics.fps_measure_currentfps++;
@@ -1344,6 +1402,15 @@ int ogon_send_surface_bits(ogon_connection *conn) {
 
 	ogon_send_frame_marker(conn, FALSE);
 
+	frameBytes = freerdp_get_transport_sent(&conn->context, FALSE) - sentBefore;
+	frame_stats_record(stats, OGON_FRAME_METRIC_FRAME_BYTES, frameBytes);
+	stats->bytesSent += frameBytes;
+	stats->frames++;
+
+	if (front->inputLatency.repliedAt) {
+		frame_stats_input_frame_sent(stats, &front->inputLatency, frame_stats_now());
+	}
+
 out_release_damaged:
 	region16_clear(&dstEncoder->accumulatedDamage);
 	region16_uninit(&damagedRegion);
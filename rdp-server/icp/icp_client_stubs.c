@@ -23,10 +23,13 @@
  */
 
 #include <winpr/crt.h>
+#include <ogon/framestats.h>
+#include <ogon/wtsapi.h>
 
 #include "../../common/global.h"
 #include "../../common/icp.h"
 #include "../ogon.h"
+#include "../app_context.h"
 #include "../backend.h"
 #include "../channels.h"
 
@@ -91,6 +94,22 @@ void dummyCallback(UINT32 reason, Ogon__Pbrpc__RPCBase* response, void *args) {
 	} \
 	free(pbrequest.data);
 
+#define ICP_CLIENT_STUB_CALL_CONNECTION_ASYNC(camel, expanded, connectionId, cb, cbdata) \
+	pbrequest.dataLen = ogon__icp__##expanded ##_request__get_packed_size(&request); \
+	if (!(pbrequest.data = malloc(pbrequest.dataLen))) \
+		return PBRPC_FAILED; \
+	ret = ogon__icp__##expanded ##_request__pack(&request, (uint8_t*) pbrequest.data); \
+	if (ret == pbrequest.dataLen) \
+	{ \
+		ret = ogon_icp_call_async(connectionId, type, pbrequest.data, pbrequest.dataLen, cb, cbdata) ? \
+			PBRPC_SUCCESS : PBRPC_FAILED; \
+	} \
+	else \
+	{ \
+		ret = PBRPC_BAD_REQUEST_DATA; \
+	} \
+	free(pbrequest.data);
+
 #define ICP_CLIENT_STUB_UNPACK_RESPONSE(camel, expanded) \
 	response = ogon__icp__##expanded ##_response__unpack(NULL, pbresponse->dataLen, (uint8_t*) pbresponse->data); \
 	pbrpc_free_payload(pbresponse);
@@ -116,6 +135,75 @@ void dummyCallback(UINT32 reason, Ogon__Pbrpc__RPCBase* response, void *args) {
 				ret = 0; \
 			}
 
+void ogon_icp_completion_free(ogon_icp_completion *completion) {
+	if (!completion) {
+		return;
+	}
+
+	free(completion->data);
+	free(completion);
+}
+
+/* runs on the pbrpc thread, hands the result over to the connection's event loop */
+static void icpCompletionCallback(UINT32 reason, Ogon__Pbrpc__RPCBase* response, void *args) {
+	ogon_icp_completion *completion = (ogon_icp_completion *)args;
+
+	completion->status = reason;
+	if (response) {
+		if (reason == PBRPC_SUCCESS) {
+			completion->status = response->status;
+		}
+
+		if (response->has_payload) {
+			completion->data = (char *)response->payload.data;
+			completion->dataLen = response->payload.len;
+			response->has_payload = 0;
+		}
+		pbrpc_message_free(response, TRUE);
+	}
+
+	if (!app_context_post_message_connection(completion->connectionId, NOTIFY_ICP_COMPLETION, completion, NULL)) {
+		WLog_DBG(TAG, "icp completion: connection %ld is gone, dropping result of call %"PRIu32"",
+				completion->connectionId, completion->type);
+		ogon_icp_completion_free(completion);
+	}
+}
+
+/**
+ * Issues an ICP call without blocking the calling thread. The completion
+ * callback is invoked in the event loop of the connection identified by
+ * connectionId, it is never invoked if that connection does not exist anymore.
+ */
+BOOL ogon_icp_call_async(long connectionId, UINT32 type, char *data, UINT32 dataLen,
+		ogon_icp_completion_cb cb, void *cbdata)
+{
+	pbRPCPayload pbrequest;
+	ogon_icp_completion *completion;
+	pbRPCContext* context = (pbRPCContext*) ogon_icp_get_context();
+
+	if (!context) {
+		return FALSE;
+	}
+
+	if (!(completion = calloc(1, sizeof(*completion)))) {
+		WLog_ERR(TAG, "unable to allocate icp completion");
+		return FALSE;
+	}
+
+	completion->connectionId = connectionId;
+	completion->type = type;
+	completion->cb = cb;
+	completion->cbdata = cbdata;
+
+	pbrequest.data = data;
+	pbrequest.dataLen = dataLen;
+	pbrequest.errorDescription = NULL;
+
+	/* on error the callback is invoked right away, so the completion is always delivered */
+	pbrcp_call_method_async(context, type, &pbrequest, icpCompletionCallback, completion);
+	return TRUE;
+}
+
 int ogon_icp_sendResponse(UINT32 tag, UINT32 type, UINT32 status, BOOL success, void *responseparam1)
 {
 	int rtype = 0;
@@ -151,6 +239,8 @@ int ogon_icp_sendResponse(UINT32 tag, UINT32 type, UINT32 status, BOOL success,
 			if (channel) {
 				response.connectionstring = channel->pipe_name;
 				response.instance = channel->channel_instance + 1;
+				response.has_supportedoptions = TRUE;
+				response.supportedoptions = OGON_CHANNEL_OPTION_SHM_RING;
 			} else {
 				response.connectionstring = "";
 				response.instance = 0;
@@ -186,6 +276,45 @@ int ogon_icp_sendResponse(UINT32 tag, UINT32 type, UINT32 status, BOOL success,
 			ICP_CLIENT_SEND_PACK(Message, message);
 			break;
 		}
+		case NOTIFY_FRAME_STATS: {
+			ogon_frame_stats *stats = (ogon_frame_stats *)responseparam1;
+			Ogon__Icp__FrameStatsHistogram histograms[OGON_FRAME_METRIC_COUNT];
+			Ogon__Icp__FrameStatsHistogram *histogramPtrs[OGON_FRAME_METRIC_COUNT];
+			UINT32 metric, buckets;
+
+			rtype = OGON__ICP__MSGTYPE__FrameStats;
+			ICP_CLIENT_SEND_PREPARE(FrameStats, frame_stats);
+			response.success = success && stats;
+			if (response.success) {
+				response.has_frames = response.has_suppressedframes = TRUE;
+				response.has_bytessent = response.has_codecmetric = TRUE;
+				response.frames = stats->frames;
+				response.suppressedframes = stats->suppressedFrames;
+				response.bytessent = stats->bytesSent;
+				response.codecmetric = stats->codecMetric;
+				response.histograms = histogramPtrs;
+
+				/* only used histograms and buckets are transferred */
+				for (metric = 0; metric < OGON_FRAME_METRIC_COUNT; metric++) {
+					ogon_frame_histogram *histogram = &stats->histograms[metric];
+					Ogon__Icp__FrameStatsHistogram *entry = &histograms[response.n_histograms];
+					if (!histogram->count) {
+						continue;
+					}
+					for (buckets = OGON_FRAME_STATS_BUCKETS; buckets && !histogram->buckets[buckets - 1]; buckets--);
+
+					ogon__icp__frame_stats_histogram__init(entry);
+					entry->metric = metric;
+					entry->count = histogram->count;
+					entry->sum = histogram->sum;
+					entry->n_buckets = buckets;
+					entry->buckets = histogram->buckets;
+					histogramPtrs[response.n_histograms++] = entry;
+				}
+			}
+			ICP_CLIENT_SEND_PACK(FrameStats, frame_stats);
+			break;
+		}
 
 		default:
 			/* type not found */
@@ -617,3 +746,70 @@ int ogon_icp_RemoteControlEnded(UINT32 spyId, UINT32 spiedId)
 	ICP_CLIENT_STUB_CLEANUP(RemoteControlEnded, remote_control_ended)
 	return retVal;
 }
+
+static void remoteControlEndedCompletion(ogon_connection *conn, ogon_icp_completion *completion)
+{
+	Ogon__Icp__RemoteControlEndedResponse *response = NULL;
+
+	if (completion->status == PBRPC_SUCCESS) {
+		response = ogon__icp__remote_control_ended_response__unpack(NULL, completion->dataLen,
+				(uint8_t*) completion->data);
+	}
+
+	if (!response || !response->success) {
+		WLog_ERR(TAG, "connection %ld: error notifying the end of shadowing (status %"PRIu32")",
+				conn->id, completion->status);
+	}
+
+	if (response) {
+		ogon__icp__remote_control_ended_response__free_unpacked(response, NULL);
+	}
+}
+
+int ogon_icp_RemoteControlEnded_async(UINT32 spyId, UINT32 spiedId)
+{
+	ICP_CLIENT_STUB_SETUP_ASYNC(RemoteControlEnded, remote_control_ended)
+
+	request.spyid = spyId;
+	request.spiedid = spiedId;
+
+	ICP_CLIENT_STUB_CALL_CONNECTION_ASYNC(RemoteControlEnded, remote_control_ended, spyId,
+			remoteControlEndedCompletion, NULL)
+
+	return ret;
+}
+
+int ogon_icp_LogonTrace_async(UINT32 connectionId, const logon_trace *trace)
+{
+	Ogon__Icp__LogonTracePhase phases[LOGON_PHASE_COUNT];
+	Ogon__Icp__LogonTracePhase *phasePtrs[LOGON_PHASE_COUNT];
+	UINT32 vmajor, vminor;
+	int phase;
+
+	ICP_CLIENT_STUB_SETUP_ASYNC(LogonTrace, logon_trace)
+
+	/* LogonTrace only available starting at 1.2 */
+	if (!ogon_icp_get_protocol_version(context, &vmajor, &vminor)) {
+		return PBRCP_TRANSPORT_ERROR;
+	}
+	if (vmajor * 1000 + vminor < 1002) {
+		return PBRPC_SUCCESS;
+	}
+
+	request.connectionid = connectionId;
+	request.phases = phasePtrs;
+	for (phase = 0; phase < LOGON_PHASE_COUNT; phase++) {
+		if (!logon_trace_has(trace, (LOGON_TRACE_PHASE)phase)) {
+			continue;
+		}
+		ogon__icp__logon_trace_phase__init(&phases[request.n_phases]);
+		phases[request.n_phases].phase = phase;
+		phases[request.n_phases].duration = logon_trace_duration(trace, (LOGON_TRACE_PHASE)phase);
+		phasePtrs[request.n_phases] = &phases[request.n_phases];
+		request.n_phases++;
+	}
+
+	ICP_CLIENT_STUB_CALL_ASYNC(LogonTrace, logon_trace)
+
+	return (ret == pbrequest.dataLen) ? PBRPC_SUCCESS : PBRPC_FAILED;
+}
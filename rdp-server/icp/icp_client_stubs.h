@@ -28,6 +28,7 @@
 #include <winpr/wtypes.h>
 
 #include "../commondefs.h"
+#include "../../common/logontrace.h"
 
 int ogon_icp_Ping(BOOL* pong);
 int ogon_icp_DisconnectUserSession(UINT32 connectionId, BOOL* disconnected);
@@ -42,6 +43,28 @@ int ogon_icp_get_property_bool(UINT32 connectionId, char *path, BOOL *value);
 int ogon_icp_get_property_number(UINT32 connectionId, char *path, INT32 *value);
 int ogon_icp_get_property_string(UINT32 connectionId, char *path, char **value);
 int ogon_icp_RemoteControlEnded(UINT32 spyId, UINT32 spiedId);
+int ogon_icp_RemoteControlEnded_async(UINT32 spyId, UINT32 spiedId);
+int ogon_icp_LogonTrace_async(UINT32 connectionId, const logon_trace *trace);
+
+typedef struct _ogon_icp_completion ogon_icp_completion;
+
+/** @brief invoked in the connection's event loop when an asynchronous call has completed */
+typedef void (*ogon_icp_completion_cb)(ogon_connection *conn, ogon_icp_completion *completion);
+
+/** @brief result of an asynchronous ICP call, posted to the connection as NOTIFY_ICP_COMPLETION */
+struct _ogon_icp_completion {
+	long connectionId;
+	UINT32 type;
+	UINT32 status;
+	char *data;
+	UINT32 dataLen;
+	ogon_icp_completion_cb cb;
+	void *cbdata;
+};
+
+BOOL ogon_icp_call_async(long connectionId, UINT32 type, char *data, UINT32 dataLen,
+		ogon_icp_completion_cb cb, void *cbdata);
+void ogon_icp_completion_free(ogon_icp_completion *completion);
 
 /** @brief the type of property */
 typedef enum {
@@ -334,3 +334,31 @@ out_fail:
 	ICP_SERVER_STUB_RESPOND(Message, message)
 	return PBRPC_SUCCESS;
 }
+
+int frameStats(LONG tag, pbRPCPayload *pbrequest, pbRPCPayload **pbresponse) {
+
+	ICP_SERVER_STUB_SETUP(FrameStats, frame_stats)
+
+	struct ogon_notification_frame_stats *msg = calloc(1, sizeof(struct ogon_notification_frame_stats));
+	if (!msg) {
+		goto out_fail;
+	}
+
+	msg->tag = tag;
+
+	if (app_context_post_message_connection(request->connectionid, NOTIFY_FRAME_STATS, (void*)msg, NULL)) {
+		ogon__icp__frame_stats_request__free_unpacked(request, NULL);
+		// the statistics are read by the connection thread which also sends the response
+		*pbresponse = NULL;
+		return 0;
+	} else {
+		WLog_ERR(TAG, "frame stats: no connection for %"PRIu32"", request->connectionid);
+		free(msg);
+	}
+
+out_fail:
+	response.success = FALSE;
+
+	ICP_SERVER_STUB_RESPOND(FrameStats, frame_stats)
+	return PBRPC_SUCCESS;
+}
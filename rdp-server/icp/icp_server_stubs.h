@@ -35,5 +35,6 @@ int otsapiVirtualChannelClose(LONG tag, pbRPCPayload* pbrequest, pbRPCPayload**
 int otsapiStartRemoteControl(LONG tag, pbRPCPayload* pbrequest, pbRPCPayload **pbresponse);
 int otsapiStopRemoteControl(LONG tag, pbRPCPayload* pbrequest, pbRPCPayload **pbresponse);
 int message(LONG tag, pbRPCPayload* pbrequest, pbRPCPayload** pbresponse);
+int frameStats(LONG tag, pbRPCPayload* pbrequest, pbRPCPayload** pbresponse);
 
 #endif /* _OGON_RDPSRV_ICPSERVERSTUBS_H_ */
@@ -54,10 +54,11 @@
 
 struct pbrpc_transaction
 {
+	UINT32 tag;
 	pbRpcResponseCallback responseCallback;
 	void *callbackArg;
+	pbRPCTransaction *next;
 };
-typedef struct pbrpc_transaction pbRPCTransaction;
 
 
 static pbRPCTransaction* pbrpc_transaction_new()
@@ -70,9 +71,60 @@ static void queue_item_free(void* obj)
 	pbrpc_message_free((Ogon__Pbrpc__RPCBase*)obj, TRUE);
 }
 
-static void list_dictionary_item_free(void* value)
+/**
+ * Outstanding transactions are kept in a table indexed by the low bits of
+ * their tag. Tags are handed out sequentially so the buckets are filled
+ * evenly and lookups stay O(1) with hundreds of calls in flight.
+ */
+static BOOL pbrpc_transaction_add(pbRPCContext* context, UINT32 tag, pbRPCTransaction* ta)
+{
+	pbRPCTransaction **bucket;
+
+	ta->tag = tag;
+
+	EnterCriticalSection(&context->transactionsLock);
+	bucket = &context->transactions[tag & (PBRPC_TRANSACTIONS_SIZE - 1)];
+	ta->next = *bucket;
+	*bucket = ta;
+	LeaveCriticalSection(&context->transactionsLock);
+	return TRUE;
+}
+
+static pbRPCTransaction* pbrpc_transaction_remove(pbRPCContext* context, UINT32 tag)
+{
+	pbRPCTransaction **pta;
+	pbRPCTransaction *ta = NULL;
+
+	EnterCriticalSection(&context->transactionsLock);
+	for (pta = &context->transactions[tag & (PBRPC_TRANSACTIONS_SIZE - 1)]; *pta; pta = &(*pta)->next) {
+		if ((*pta)->tag == tag) {
+			ta = *pta;
+			*pta = ta->next;
+			ta->next = NULL;
+			break;
+		}
+	}
+	LeaveCriticalSection(&context->transactionsLock);
+	return ta;
+}
+
+/* detaches all outstanding transactions and returns them as a single list */
+static pbRPCTransaction* pbrpc_transaction_remove_all(pbRPCContext* context)
 {
-	free(value);
+	pbRPCTransaction *list = NULL;
+	pbRPCTransaction *ta;
+	int i;
+
+	EnterCriticalSection(&context->transactionsLock);
+	for (i = 0; i < PBRPC_TRANSACTIONS_SIZE; i++) {
+		while ((ta = context->transactions[i])) {
+			context->transactions[i] = ta->next;
+			ta->next = list;
+			list = ta;
+		}
+	}
+	LeaveCriticalSection(&context->transactionsLock);
+	return list;
 }
 
 pbRPCContext* pbrpc_server_new(pbRPCTransportContext* transport, HANDLE shutdown)
@@ -88,21 +140,33 @@ pbRPCContext* pbrpc_server_new(pbRPCTransportContext* transport, HANDLE shutdown
 	}
 
 	context->transport = transport;
-	if (!(context->transactions = ListDictionary_New(TRUE))) {
+	if (!(context->transactions = calloc(PBRPC_TRANSACTIONS_SIZE, sizeof(pbRPCTransaction*)))) {
 		goto out_close_handle;
 	}
 
-	context->transactions->objectValue.fnObjectFree = list_dictionary_item_free;
-	if (!(context->writeQueue = Queue_New(TRUE, -1, -1))) {
+	if (!InitializeCriticalSectionAndSpinCount(&context->transactionsLock, 4000)) {
 		goto out_free_transactions;
 	}
 
+	if (!(context->writeQueue = Queue_New(TRUE, -1, -1))) {
+		goto out_delete_lock;
+	}
+
 	context->writeQueue->object.fnObjectFree = queue_item_free;
+
+	if (!(context->writeBatch = Stream_New(NULL, PBRPC_WRITE_BATCH_SIZE))) {
+		goto out_free_queue;
+	}
+
 	context->shutdown = shutdown;
 	return context;
 
+out_free_queue:
+	Queue_Free(context->writeQueue);
+out_delete_lock:
+	DeleteCriticalSection(&context->transactionsLock);
 out_free_transactions:
-	ListDictionary_Free(context->transactions);
+	free(context->transactions);
 out_close_handle:
 	CloseHandle(context->stopEvent);
 out_free:
@@ -112,13 +176,25 @@ out_free:
 
 void pbrpc_server_free(pbRPCContext* context)
 {
+	pbRPCTransaction *ta;
+
 	if (!context)
 		return;
 
 	CloseHandle(context->stopEvent);
 	CloseHandle(context->thread);
-	ListDictionary_Free(context->transactions);
+
+	ta = pbrpc_transaction_remove_all(context);
+	while (ta) {
+		pbRPCTransaction *next = ta->next;
+		free(ta);
+		ta = next;
+	}
+	free(context->transactions);
+	DeleteCriticalSection(&context->transactionsLock);
+
 	Queue_Free(context->writeQueue);
+	Stream_Free(context->writeBatch, TRUE);
 	free(context);
 }
 
@@ -173,7 +249,7 @@ static int pbrpc_process_response(pbRPCContext* context, Ogon__Pbrpc__RPCBase *r
 {
 	pbRPCTransaction *ta;
 
-	if (!(ta = ListDictionary_Remove(context->transactions, (void *)((UINT_PTR)rpcmessage->tag)))) {
+	if (!(ta = pbrpc_transaction_remove(context, rpcmessage->tag))) {
 		WLog_ERR(TAG, "Unsolicited response - ignoring (tag %"PRIu32")", rpcmessage->tag);
 		ogon__pbrpc__rpcbase__free_unpacked(rpcmessage, NULL);
 		return 1;
@@ -208,6 +284,45 @@ static int pbrpc_process_message_out(pbRPCContext* context, Ogon__Pbrpc__RPCBase
 	return ret;
 }
 
+/**
+ * Appends a message (length prefix and packed data) to the write batch. The
+ * batch is flushed to the transport in a single write once it grows beyond
+ * PBRPC_WRITE_BATCH_SIZE or when the write queue has been drained.
+ */
+static int pbrpc_batch_message_out(pbRPCContext* context, Ogon__Pbrpc__RPCBase *msg)
+{
+	size_t msgLen = ogon__pbrpc__rpcbase__get_packed_size(msg);
+	wStream *s = context->writeBatch;
+
+	if (!Stream_EnsureRemainingCapacity(s, msgLen + 4)) {
+		return -1;
+	}
+
+	Stream_Write_UINT32_BE(s, msgLen);
+	DEBUG_PBRPC("batching tag %"PRIu32", type %"PRIu32", response: %d", msg->tag, msg->msgtype, msg->isresponse);
+	if (ogon__pbrpc__rpcbase__pack(msg, Stream_Pointer(s)) != msgLen) {
+		/* packing failed, drop this message only */
+		Stream_Rewind(s, 4);
+		return 1;
+	}
+	Stream_Seek(s, msgLen);
+	return 0;
+}
+
+static int pbrpc_flush_batch(pbRPCContext* context)
+{
+	wStream *s = context->writeBatch;
+	size_t len = Stream_GetPosition(s);
+	int ret = 0;
+
+	if (len) {
+		ret = context->transport->write(context->transport, (char *)Stream_Buffer(s), len);
+		Stream_SetPosition(s, 0);
+	}
+
+	return (ret < 0) ? ret : 0;
+}
+
 static pbRPCCallback pbrpc_callback_find(pbRPCContext* context, UINT32 type)
 {
 	pbRPCMethod *cb = NULL;
@@ -493,10 +608,14 @@ static BOOL pbrpc_reconnect(pbRPCContext* context)
 	context->isConnected = FALSE;
 	context->transport->close(context->transport);
 	Queue_Clear(context->writeQueue);
+	Stream_SetPosition(context->writeBatch, 0);
 
-	while ((ta = ListDictionary_Remove_Head(context->transactions))) {
+	ta = pbrpc_transaction_remove_all(context);
+	while (ta) {
+		pbRPCTransaction *next = ta->next;
 		ta->responseCallback(PBRCP_TRANSPORT_ERROR, 0, ta->callbackArg);
 		free(ta);
+		ta = next;
 	}
 
 	while (context->runLoop && !pbrpc_connect(context, 2 * 1000)) {
@@ -576,16 +695,24 @@ static void pbrpc_mainloop(pbRPCContext* context)
 		if (WaitForSingleObject(Queue_Event(context->writeQueue), 0) == WAIT_OBJECT_0) {
 			Ogon__Pbrpc__RPCBase* msg = NULL;
 
+			status = 0;
 			while((msg = Queue_Dequeue(context->writeQueue)) && context->runLoop) {
-				status = pbrpc_process_message_out(context, msg);
+				status = pbrpc_batch_message_out(context, msg);
 				pbrpc_message_free(msg, TRUE);
 
+				if ((status >= 0) && (Stream_GetPosition(context->writeBatch) >= PBRPC_WRITE_BATCH_SIZE)) {
+					status = pbrpc_flush_batch(context);
+				}
+
 				if (status < 0)	{
-					WLog_ERR(TAG, "transport problem, reconnecting ...");
-					reconnect = TRUE;
 					break;
 				}
 			}
+
+			if ((status < 0) || (pbrpc_flush_batch(context) < 0)) {
+				WLog_ERR(TAG, "transport problem, reconnecting ...");
+				reconnect = TRUE;
+			}
 		}
 	}
 }
@@ -665,9 +792,9 @@ int pbrpc_call_method(pbRPCContext* context, UINT32 type, pbRPCPayload* request,
 	ta->responseCallback = pbrpc_response_local_cb;
 	ta->callbackArg = &local_context;
 
-	if (!ListDictionary_Add(context->transactions, (void*)((UINT_PTR)(message->tag)), ta)) {
-		WLog_ERR(TAG, "error adding transaction to dictionary");
-		goto fail_dictionary_add;
+	if (!pbrpc_transaction_add(context, tag, ta)) {
+		WLog_ERR(TAG, "error adding transaction to table");
+		goto fail_transaction_add;
 	}
 
 	if (!Queue_Enqueue(context->writeQueue, message)) {
@@ -678,7 +805,7 @@ int pbrpc_call_method(pbRPCContext* context, UINT32 type, pbRPCPayload* request,
 	wait_ret = WaitForSingleObject(local_context.event, PBRPC_TIMEOUT);
 	if (wait_ret != WAIT_OBJECT_0) {
 		pbRPCTransaction *fa;
-		if(!(fa = ListDictionary_Remove(context->transactions, (void*)((UINT_PTR)(tag))))) {
+		if(!(fa = pbrpc_transaction_remove(context, tag))) {
 			/**
 			 * timeout occurred but request is being processed by the pbrpc thread,
 			 * wait for the event to be notified so that we can safely close the
@@ -714,8 +841,8 @@ int pbrpc_call_method(pbRPCContext* context, UINT32 type, pbRPCPayload* request,
 	return ret;
 
 fail_queue_enqueue:
-	ListDictionary_Remove(context->transactions, (void*)((UINT_PTR)(message->tag)));
-fail_dictionary_add:
+	pbrpc_transaction_remove(context, tag);
+fail_transaction_add:
 	free(ta);
 fail_transaction_new:
 	CloseHandle(local_context.event);
@@ -776,8 +903,8 @@ void pbrcp_call_method_async(pbRPCContext* context, UINT32 type, pbRPCPayload* r
 	message->has_payload = 1;
 	message->msgtype = type;
 
-	if (!ListDictionary_Add(context->transactions, (void*)((UINT_PTR)(message->tag)), ta)) {
-		WLog_ERR(TAG, "error adding transaction to dictionary");
+	if (!pbrpc_transaction_add(context, message->tag, ta)) {
+		WLog_ERR(TAG, "error adding transaction to table");
 		err = PBRCP_OUTOFMEMORY;
 		goto fail_add_transaction;
 	}
@@ -790,7 +917,7 @@ void pbrcp_call_method_async(pbRPCContext* context, UINT32 type, pbRPCPayload* r
 	return;
 
 fail_queue_enqueue:
-	ListDictionary_Remove(context->transactions, (void*)((UINT_PTR)(message->tag)));
+	pbrpc_transaction_remove(context, message->tag);
 fail_add_transaction:
 	pbrpc_message_free(message, FALSE);
 fail_message_new:
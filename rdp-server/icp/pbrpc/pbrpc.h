@@ -26,6 +26,7 @@
 
 #include <winpr/synch.h>
 #include <winpr/wtypes.h>
+#include <winpr/stream.h>
 #include <winpr/collections.h>
 
 #include "../common/icp.h"
@@ -33,15 +34,24 @@
 
 #define PBRPC_TIMEOUT 10000
 
+/* number of buckets in the outstanding transactions table (must be a power of 2) */
+#define PBRPC_TRANSACTIONS_SIZE 1024
+
+/* queued messages are coalesced up to this size before hitting the transport */
+#define PBRPC_WRITE_BATCH_SIZE (64 * 1024)
+
 typedef struct pbrpc_method pbRPCMethod;
+typedef struct pbrpc_transaction pbRPCTransaction;
 
 struct  pbrpc_context
 {
 	HANDLE stopEvent;
 	HANDLE thread;
 	pbRPCTransportContext* transport;
-	wListDictionary* transactions;
+	pbRPCTransaction** transactions;
+	CRITICAL_SECTION transactionsLock;
 	wQueue* writeQueue;
+	wStream* writeBatch;
 	BOOL isConnected;
 	UINT32 localVersionMajor;
 	UINT32 localVersionMinor;
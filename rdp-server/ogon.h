@@ -103,6 +103,10 @@ struct ogon_notification_msg_message {
 	char* parameter5;
 };
 
+struct ogon_notification_frame_stats {
+	UINT32 tag;
+};
+
 struct ogon_notification_rewire_backend {
 	int rdpMask;
 	int rdpFd;
@@ -123,6 +127,8 @@ enum {
 	NOTIFY_UNWIRE_SPY,
 	NOTIFY_STOP_SHADOWING,
 	NOTIFY_USER_MESSAGE,
+	NOTIFY_ICP_COMPLETION,
+	NOTIFY_FRAME_STATS,
 };
 
 
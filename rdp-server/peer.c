@@ -51,6 +51,7 @@
 #include "app_context.h"
 #include "channels.h"
 #include "backend.h"
+#include "trace.h"
 
 
 #define TAG OGON_TAG("core.peer")
@@ -115,6 +116,8 @@ static BOOL process_switch_pipe(ogon_connection *conn, wMessage *msg) {
 		height = settings->DesktopHeight;
 	}
 
+	/* the sync request timestamps belong to the old backend */
+	frame_stats_input_reset(&front->inputLatency);
 	conn->backend = backend_new(conn, &notification->props);
 	ret = (conn->backend != NULL);
 
@@ -416,6 +419,7 @@ BOOL initiate_immediate_request(ogon_connection *conn, ogon_front_connection *fr
 		if (!backend->client.ImmediateSyncRequest(backend, ogon_dmgbuf_get_id(backend->damage))) {
 			WLog_ERR(TAG, "error sending immediateSync request");
 		}
+		OGON_TRACE3(sync_request, conn->id, front->nextFrameId, 1);
 		backend->waitingSyncReply = TRUE;
 		break;
 
@@ -514,6 +518,7 @@ static BOOL process_new_shadowing_frontend(ogon_connection *conn, wMessage *msg)
 	}
 
 	srcConn->shadowing = conn;
+	frame_stats_input_reset(&srcConn->front.inputLatency);
 	if (!LinkedList_AddLast(conn->frontConnections, srcConn)) {
 		WLog_ERR(TAG, "failed to append src connnection to front connections");
 		if (!eventloop_remove_source(&front->rdpEventSource)) {
@@ -608,6 +613,7 @@ static BOOL process_rewire_original_backend(ogon_connection *conn, wMessage *msg
 	}*/
 
 	conn->shadowing = conn;
+	frame_stats_input_reset(&front->inputLatency);
 	if (!notif->rewire) {
 		ret = TRUE;
 		conn->runThread = FALSE;
@@ -721,6 +727,19 @@ static void fillParameter(char *source, UINT32 *dest_len, char **dest) {
 	}
 }
 
+static BOOL process_frame_stats(ogon_connection *conn, wMessage *msg) {
+	struct ogon_notification_frame_stats *notification = (struct ogon_notification_frame_stats *) msg->wParam;
+	BOOL ret = TRUE;
+
+	if (ogon_icp_sendResponse(notification->tag, msg->id, 0, TRUE, &conn->front.frameStats) != 0) {
+		WLog_ERR(TAG, "error sending frame stats response");
+		ret = FALSE;
+	}
+
+	free(notification);
+	return ret;
+}
+
 static BOOL process_user_message(ogon_connection *conn, wMessage *msg) {
 	struct ogon_notification_msg_message *notification = (struct ogon_notification_msg_message *) msg->wParam;
 	BOOL ret = TRUE;
@@ -756,6 +775,16 @@ out_exit:
 	return ret;
 }
 
+static void process_icp_completion(ogon_connection *conn, wMessage *msg) {
+	ogon_icp_completion *completion = (ogon_icp_completion *)msg->wParam;
+
+	if (completion->cb) {
+		completion->cb(conn, completion);
+	}
+
+	ogon_icp_completion_free(completion);
+}
+
 /* event loop callback for the commands event */
 static int handle_command_queue_event(int mask, int fd, HANDLE handle, void *data) {
 	OGON_UNUSED(fd);
@@ -841,6 +870,16 @@ static int handle_command_queue_event(int mask, int fd, HANDLE handle, void *dat
 			}
 			break;
 
+		case NOTIFY_ICP_COMPLETION:
+			process_icp_completion(connection, &msg);
+			break;
+
+		case NOTIFY_FRAME_STATS:
+			if (!process_frame_stats(connection, &msg)) {
+				WLog_ERR(TAG, "error processing frame stats");
+			}
+			break;
+
 		default:
 			WLog_ERR(TAG, "unhandled message type %"PRIu32"", msg.id);
 			break;
@@ -1076,6 +1115,9 @@ static void ogon_connection_free(freerdp_peer *peer, rdpContext *context) {
 				case NOTIFY_SBP_REPLY:
 					free(msg.wParam);
 					continue;
+				case NOTIFY_ICP_COMPLETION:
+					ogon_icp_completion_free((ogon_icp_completion *)msg.wParam);
+					continue;
 				case NOTIFY_VC_CONNECT:
 				{
 					struct ogon_notification_vc_connect *notification = (struct ogon_notification_vc_connect *)msg.wParam;
@@ -1114,6 +1156,13 @@ static void ogon_connection_free(freerdp_peer *peer, rdpContext *context) {
 				}
 					break;
 
+				case NOTIFY_FRAME_STATS:
+				{
+					struct ogon_notification_frame_stats *notification = (struct ogon_notification_frame_stats *) msg.wParam;
+					tag = notification->tag;
+				}
+					break;
+
 				default:
 					WLog_ERR(TAG, "unhandled type %"PRIu32"", msg.id);
 			}
@@ -1356,6 +1405,9 @@ static BOOL ogon_connection_new(freerdp_peer *peer, rdpContext *context) {
 	ogon_front_connection *front;
 
 	conn->id = app_context_get_connectionid();
+	logon_trace_init(&conn->front.logonTrace);
+	logon_trace_begin(&conn->front.logonTrace, LOGON_PHASE_CONNECT);
+	logon_trace_begin(&conn->front.logonTrace, LOGON_PHASE_TOTAL);
 	conn->stopEvent = NULL;
 	conn->fps = 20;
 	conn->sendDisconnect = TRUE;
@@ -1478,7 +1530,7 @@ out:
 		ogon_icp_sendResponse(notification->tag, NOTIFY_STOP_SHADOWING, 0, returnValue, NULL);
 		free(notification);
 	} else {
-		if (returnValue && ogon_icp_RemoteControlEnded(conn->id, spiedId) != PBRPC_SUCCESS) {
+		if (returnValue && ogon_icp_RemoteControlEnded_async(conn->id, spiedId) != PBRPC_SUCCESS) {
 			WLog_ERR(TAG, "error notifying the end of shadowing");
 		}
 	}
@@ -46,6 +46,9 @@
 #include "state.h"
 #include "rdpgfx.h"
 #include "../backend/protocol.h"
+#include "../common/logontrace.h"
+#include "../common/framestats.h"
+#include "../common/framerec.h"
 
 #define OGON_MAX_STATISTIC 30
 
@@ -103,6 +106,15 @@ typedef struct _ogon_statistics {
 	UINT32 bytes_sent_current;
 }  ogon_statistics;
 
+/* frames whose end marker was sent, to measure the acknowledge round trip */
+#define OGON_FRAME_SENT_HISTORY 32
+
+typedef struct _ogon_frame_sent {
+	UINT32 frameId;
+	UINT64 sentAt;
+	BOOL input;     /* the frame is the first one following an input */
+} ogon_frame_sent;
+
 /** @brief holds data related to the front RDP connection */
 struct _ogon_front_connection {
 	ogon_event_source *rdpEventSource;
@@ -152,6 +164,17 @@ struct _ogon_front_connection {
 
 	ogon_statistics statistics;
 
+	/* frame pipeline statistics since the connection was established */
+	ogon_frame_stats frameStats;
+	ogon_frame_sent frameSent[OGON_FRAME_SENT_HISTORY];
+	ogon_input_latency inputLatency;
+
+	logon_trace logonTrace;
+	BOOL logonTraceSent;
+
+	/* directory the frames from the backend are recorded to (ogon.recordFrames) */
+	char *recordFramesDir;
+	ogon_frame_recorder *frameRecorder;
 };
 
 
@@ -0,0 +1,467 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * RDP Server
+ * Replays frame recordings through the encoders
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <winpr/cmdline.h>
+#include <winpr/wlog.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/peer.h>
+
+#include <ogon/dmgbuf.h>
+
+#include "../common/global.h"
+#include "../common/framerec.h"
+#include "../common/framestats.h"
+#include "commondefs.h"
+#include "peer.h"
+#include "backend.h"
+#include "encoder.h"
+#include "bandwidth_mgmt.h"
+#include "ogon.h"
+
+/**
+ * Feeds a recording made with ogon.recordFrames through the same functions
+ * the rdp server runs at a sync reply (ogon_backend_consume_damage and
+ * ogon_send_surface_bits) for every codec. The PDUs are counted and dropped
+ * instead of being written to a client, so the result only depends on the
+ * encoders.
+ */
+
+int ogon_backend_consume_damage(ogon_connection *conn);
+
+typedef struct _bench_codec {
+	const char *name;
+	ogon_codec_mode mode;
+	BOOL gfx;
+	BOOL avc444;
+} bench_codec;
+
+static const bench_codec bench_codecs[] = {
+	{ "bitmap", CODEC_MODE_BMP, FALSE, FALSE },
+	{ "rfx", CODEC_MODE_RFX1, FALSE, FALSE },
+	{ "gfx-rfx", CODEC_MODE_RFX2, TRUE, FALSE },
+	{ "progressive", CODEC_MODE_RFX3, TRUE, FALSE },
+#ifdef WITH_OPENH264
+	{ "h264", CODEC_MODE_H264, TRUE, FALSE },
+	{ "avc444", CODEC_MODE_H264, TRUE, TRUE },
+#endif
+	{ NULL, CODEC_MODE_BMP, FALSE, FALSE }
+};
+
+/** @brief what a run of one codec produced, times in microseconds */
+typedef struct _bench_result {
+	UINT64 frames;
+	UINT64 encodedFrames;
+	UINT64 bytes;
+	UINT64 wallTime;
+	UINT64 cpuConsume;
+	UINT64 cpuSend;
+	UINT64 simplifyTime;
+	UINT64 encodeTime;
+} bench_result;
+
+static UINT64 bench_bytes = 0;
+
+static COMMAND_LINE_ARGUMENT_A bench_args[] = {
+	{ "help", COMMAND_LINE_VALUE_FLAG, "", NULL, NULL, -1, NULL, "show help screen" },
+	{ "codecs", COMMAND_LINE_VALUE_REQUIRED, "<list>", NULL, NULL, -1, NULL, "codecs to run" },
+	{ "loops", COMMAND_LINE_VALUE_REQUIRED, "<number>", "1", NULL, -1, NULL, "replays per codec" },
+	{ "fps", COMMAND_LINE_VALUE_REQUIRED, "<number>", "20", NULL, -1, NULL, "frame rate for the H.264 rate control" },
+	{ "bitrate", COMMAND_LINE_VALUE_REQUIRED, "<number>", "0", NULL, -1, NULL, "H.264 bitrate" },
+	{ NULL, 0, NULL, NULL, NULL, -1, NULL, NULL }
+};
+
+static void printhelp(const char *bin) {
+	const bench_codec *codec;
+
+	printf("Usage: %s [options] <recording>\n", bin);
+	printf("\noptions:\n\n");
+	printf("        %-20s %s\n", "--help", "print this help screen");
+	printf("        %-20s %s\n", "--codecs=<list>", "comma separated codecs to run (default: all)");
+	printf("        %-20s %s\n", "--loops=<number>", "replays of the recording per codec (default: 1)");
+	printf("        %-20s %s\n", "--fps=<number>", "frame rate for the H.264 rate control (default: 20)");
+	printf("        %-20s %s\n", "--bitrate=<number>", "fixed H.264 bitrate, 0 for the bandwidth management default");
+	printf("\ncodecs:");
+	for (codec = bench_codecs; codec->name; codec++) {
+		printf(" %s", codec->name);
+	}
+	printf("\n");
+}
+
+static UINT64 bench_cpu_time(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (UINT64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static BOOL bench_surface_bits(rdpContext *context, const SURFACE_BITS_COMMAND *cmd) {
+	OGON_UNUSED(context);
+	bench_bytes += cmd->bmp.bitmapDataLength;
+	return TRUE;
+}
+
+static BOOL bench_bitmap_update(rdpContext *context, const BITMAP_UPDATE *bitmap) {
+	UINT32 i;
+
+	OGON_UNUSED(context);
+	for (i = 0; i < bitmap->number; i++) {
+		bench_bytes += bitmap->rectangles[i].bitmapLength;
+	}
+	return TRUE;
+}
+
+static BOOL bench_surface_frame_marker(rdpContext *context, const SURFACE_FRAME_MARKER *marker) {
+	OGON_UNUSED(context);
+	OGON_UNUSED(marker);
+	return TRUE;
+}
+
+static BOOL bench_wire_to_surface1(rdpgfx_server_context *context, RDPGFX_WIRE_TO_SURFACE_PDU_1 *pdu) {
+	OGON_UNUSED(context);
+	bench_bytes += pdu->bitmapDataLength;
+	return TRUE;
+}
+
+static BOOL bench_wire_to_surface2(rdpgfx_server_context *context, RDPGFX_WIRE_TO_SURFACE_PDU_2 *pdu) {
+	OGON_UNUSED(context);
+	bench_bytes += pdu->bitmapDataLength;
+	return TRUE;
+}
+
+static BOOL bench_start_frame(rdpgfx_server_context *context, RDPGFX_START_FRAME_PDU *pdu) {
+	OGON_UNUSED(context);
+	OGON_UNUSED(pdu);
+	return TRUE;
+}
+
+static BOOL bench_end_frame(rdpgfx_server_context *context, RDPGFX_END_FRAME_PDU *pdu) {
+	OGON_UNUSED(context);
+	OGON_UNUSED(pdu);
+	return TRUE;
+}
+
+/* hands a replayed frame to the rdp server like a backend would */
+static void bench_set_damage(void *damage, const ogon_frame_replay *replay,
+	const ogon_framerec_rect *rects, UINT32 numRects)
+{
+	BYTE *data = ogon_dmgbuf_get_data(damage);
+	UINT32 i, y, current, maxRects;
+	RDP_RECT *dst = ogon_dmgbuf_get_rects(damage, &current);
+
+	maxRects = ogon_dmgbuf_get_max_rects(damage);
+
+	for (i = 0; i < numRects; i++) {
+		const ogon_framerec_rect *r = &rects[i];
+		for (y = r->y; y < (UINT32)(r->y + r->height); y++) {
+			memcpy(data + y * replay->scanline + r->x * 4,
+				replay->framebuffer + y * replay->scanline + r->x * 4, r->width * 4);
+		}
+	}
+
+	if (numRects > maxRects) {
+		/* the same as a backend out of damage slots: everything */
+		dst[0].x = dst[0].y = 0;
+		dst[0].width = replay->width;
+		dst[0].height = replay->height;
+		ogon_dmgbuf_set_num_rects(damage, 1);
+		return;
+	}
+
+	for (i = 0; i < numRects; i++) {
+		dst[i].x = rects[i].x;
+		dst[i].y = rects[i].y;
+		dst[i].width = rects[i].width;
+		dst[i].height = rects[i].height;
+	}
+	ogon_dmgbuf_set_num_rects(damage, numRects);
+}
+
+static BOOL bench_run(const bench_codec *codec, ogon_frame_replay *replay, int fps, UINT32 bitrate,
+	bench_result *result)
+{
+	freerdp_peer *peer = NULL;
+	ogon_connection *conn;
+	ogon_front_connection *front;
+	ogon_backend_connection backend;
+	rdpgfx_server_context rdpgfx;
+	rdpSettings *settings;
+	const ogon_framerec_rect *rects;
+	ogon_frame_histogram *histogram;
+	UINT32 numRects;
+	UINT64 start, startCpu;
+	int fds[2], rc;
+	BOOL ret = FALSE;
+
+	memset(&backend, 0, sizeof(backend));
+	memset(&rdpgfx, 0, sizeof(rdpgfx));
+
+	/* the transport needs a socket, nothing is ever written to it */
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+		fprintf(stderr, "socketpair failed\n");
+		return FALSE;
+	}
+
+	if (!(peer = freerdp_peer_new(fds[0]))) {
+		close(fds[0]);
+		goto out_close;
+	}
+	peer->ContextSize = sizeof(ogon_connection);
+	if (!freerdp_peer_context_new(peer)) {
+		fprintf(stderr, "freerdp_peer_context_new failed\n");
+		goto out_peer;
+	}
+
+	conn = (ogon_connection *)peer->context;
+	front = &conn->front;
+	settings = conn->context.settings;
+
+	conn->id = 1;
+	conn->fps = fps;
+	conn->shadowing = conn;
+	conn->backend = &backend;
+
+	settings->DesktopWidth = replay->width;
+	settings->DesktopHeight = replay->height;
+	settings->ColorDepth = 32;
+	settings->SurfaceFrameMarkerEnabled = TRUE;
+	settings->RemoteFxCodec = TRUE;
+	settings->MultifragMaxRequestSize = 0x3F0000;
+
+	peer->update->SurfaceBits = bench_surface_bits;
+	peer->update->BitmapUpdate = bench_bitmap_update;
+	peer->update->SurfaceFrameMarker = bench_surface_frame_marker;
+
+	if (!(backend.damage = ogon_dmgbuf_new(replay->width, replay->height, replay->scanline))) {
+		fprintf(stderr, "unable to create the damage buffer\n");
+		goto out_context;
+	}
+	backend.screenInfos.width = replay->width;
+	backend.screenInfos.height = replay->height;
+	backend.screenInfos.scanline = replay->scanline;
+	backend.screenInfos.bpp = 32;
+	backend.screenInfos.bytesPerPixel = 4;
+
+	if (!(front->encoder = ogon_bitmap_encoder_new(replay->width, replay->height, 32, 4,
+		replay->scanline, settings->ColorDepth, settings->MultifragMaxRequestSize)))
+	{
+		goto out_damage;
+	}
+
+#ifdef WITH_OPENH264
+	if ((codec->mode == CODEC_MODE_H264) && !front->encoder->h264_context) {
+		fprintf(stderr, "%s: OpenH264 is not available\n", codec->name);
+		goto out_encoder;
+	}
+#endif
+
+	front->codecMode = codec->mode;
+	if (codec->gfx) {
+		rdpgfx.WireToSurface1 = bench_wire_to_surface1;
+		rdpgfx.WireToSurface2 = bench_wire_to_surface2;
+		rdpgfx.StartFrame = bench_start_frame;
+		rdpgfx.EndFrame = bench_end_frame;
+		rdpgfx.avc444Supported = rdpgfx.avc444v2Supported = codec->avc444;
+		front->rdpgfx = &rdpgfx;
+		front->rdpgfxConnected = TRUE;
+		front->rdpgfxOutputSurface = 1;
+		front->rdpgfxH264EnableFullAVC444 = codec->avc444;
+	}
+
+	front->bandwidthMgmt.configured_bitrate = bitrate;
+	ogon_bwmgmt_init_buckets(conn, bitrate);
+
+	frame_replay_rewind(replay);
+	bench_bytes = 0;
+	start = frame_stats_now();
+
+	while ((rc = frame_replay_next(replay, &rects, &numRects)) > 0) {
+		bench_set_damage(backend.damage, replay, rects, numRects);
+
+		startCpu = bench_cpu_time();
+		if (ogon_backend_consume_damage(conn) < 0) {
+			fprintf(stderr, "%s: consuming the damage of frame %"PRIu32" failed\n", codec->name, replay->frameIndex);
+			goto out_encoder;
+		}
+		result->cpuConsume += bench_cpu_time() - startCpu;
+
+		startCpu = bench_cpu_time();
+		if (ogon_send_surface_bits(conn) < 0) {
+			fprintf(stderr, "%s: encoding frame %"PRIu32" failed\n", codec->name, replay->frameIndex);
+			goto out_encoder;
+		}
+		result->cpuSend += bench_cpu_time() - startCpu;
+		result->frames++;
+	}
+	if (rc < 0) {
+		fprintf(stderr, "the recording is corrupt after frame %"PRIu32"\n", replay->frameIndex);
+		goto out_encoder;
+	}
+
+	result->wallTime += frame_stats_now() - start;
+	result->bytes += bench_bytes;
+	result->encodedFrames += front->frameStats.frames;
+	result->simplifyTime += front->frameStats.histograms[OGON_FRAME_METRIC_SIMPLIFY_TIME].sum;
+	histogram = &front->frameStats.histograms[front->frameStats.codecMetric];
+	result->encodeTime += histogram->sum;
+	ret = TRUE;
+
+out_encoder:
+	ogon_bitmap_encoder_free(front->encoder);
+	front->encoder = NULL;
+out_damage:
+	ogon_dmgbuf_free(backend.damage);
+out_context:
+	freerdp_peer_context_free(peer);
+out_peer:
+	freerdp_peer_free(peer);
+out_close:
+	/* the peer's transport closes the other end */
+	close(fds[1]);
+	return ret;
+}
+
+static void bench_print(const bench_codec *codec, const bench_result *result) {
+	double frames = result->frames ? (double)result->frames : 1.0;
+	double encoded = result->encodedFrames ? (double)result->encodedFrames : 1.0;
+
+	printf("%-12s %8"PRIu64" %8"PRIu64" %9.1f %12.0f %10.1f %10.1f %10.1f %10.1f\n",
+		codec->name, result->frames, result->encodedFrames,
+		result->wallTime ? result->frames * 1000000.0 / result->wallTime : 0.0,
+		result->bytes / encoded,
+		result->cpuConsume / frames,
+		result->simplifyTime / frames,
+		result->encodeTime / frames,
+		(result->cpuConsume + result->cpuSend) / frames);
+}
+
+int main(int argc, char **argv) {
+	const bench_codec *codec;
+	const char *codecs = NULL;
+	const char *path = NULL;
+	ogon_frame_replay replay;
+	COMMAND_LINE_ARGUMENT_A *arg;
+	DWORD flags;
+	int status, i, loops = 1, fps = 20, ret = 0;
+	UINT32 bitrate = 0;
+
+	flags = COMMAND_LINE_SEPARATOR_EQUAL | COMMAND_LINE_SIGIL_DOUBLE_DASH | COMMAND_LINE_IGN_UNKNOWN_KEYWORD;
+	status = CommandLineParseArgumentsA(argc, argv, bench_args, flags, NULL, NULL, NULL);
+	if (status != 0) {
+		printhelp(argv[0]);
+		return 1;
+	}
+
+	arg = bench_args;
+	do {
+		if (!(arg->Flags & COMMAND_LINE_VALUE_PRESENT))
+			continue;
+
+		CommandLineSwitchStart(arg)
+
+		CommandLineSwitchCase(arg, "help") {
+			printhelp(argv[0]);
+			return 0;
+		}
+		CommandLineSwitchCase(arg, "codecs") {
+			codecs = arg->Value;
+		}
+		CommandLineSwitchCase(arg, "loops") {
+			loops = atoi(arg->Value);
+		}
+		CommandLineSwitchCase(arg, "fps") {
+			fps = atoi(arg->Value);
+		}
+		CommandLineSwitchCase(arg, "bitrate") {
+			bitrate = (UINT32)strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchEnd(arg)
+	}
+	while ((arg = CommandLineFindNextArgumentA(arg)) != NULL);
+
+	/* the recording is the only argument which is not an option */
+	for (i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--", 2)) {
+			path = argv[i];
+		}
+	}
+	if (!path || (loops < 1) || (fps < 1)) {
+		printhelp(argv[0]);
+		return 1;
+	}
+
+	WLog_SetLogLevel(WLog_GetRoot(), WLOG_ERROR);
+
+	if (!frame_replay_open(&replay, path)) {
+		fprintf(stderr, "unable to open recording %s\n", path);
+		return 1;
+	}
+
+	printf("%s: %"PRIu32"x%"PRIu32", %"PRIu32" frames\n\n", path, replay.width, replay.height,
+		replay.frameCount);
+	printf("%-12s %8s %8s %9s %12s %10s %10s %10s %10s\n", "codec", "frames", "encoded", "fps",
+		"bytes/frame", "consume", "simplify", "encode", "cpu total");
+	printf("%-12s %8s %8s %9s %12s %10s %10s %10s %10s\n", "", "", "", "", "",
+		"us/frame", "us/frame", "us/frame", "us/frame");
+
+	for (codec = bench_codecs; codec->name; codec++) {
+		bench_result result;
+		size_t length = strlen(codec->name);
+		const char *match = codecs;
+
+		if (codecs) {
+			/* whole names of a comma separated list */
+			while ((match = strstr(match, codec->name))) {
+				if (((match == codecs) || (match[-1] == ',')) && ((match[length] == ',') || !match[length])) {
+					break;
+				}
+				match += length;
+			}
+			if (!match) {
+				continue;
+			}
+		}
+
+		memset(&result, 0, sizeof(result));
+		for (i = 0; i < loops; i++) {
+			if (!bench_run(codec, &replay, fps, bitrate, &result)) {
+				ret = 1;
+				break;
+			}
+		}
+		if (i == loops) {
+			bench_print(codec, &result);
+		}
+	}
+
+	frame_replay_close(&replay);
+	return ret;
+}
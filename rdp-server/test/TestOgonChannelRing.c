@@ -0,0 +1,336 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * RDP Server
+ * Channel ring Test
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <winpr/thread.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+
+#include "../common/global.h"
+#include "../../common/channelring.h"
+
+/* the amount of data streamed through both transports by the benchmark */
+#define BENCH_BYTES (256 * 1024 * 1024)
+#define BENCH_MESSAGE_SIZE (64 * 1024)
+#define BENCH_READ_SIZE (64 * 1024)
+
+typedef struct _bench_context {
+	ogon_channel_ring *ring;
+	int fd;
+	UINT64 checksum;
+	BOOL failed;
+} bench_context;
+
+static UINT64 checksum_update(UINT64 checksum, const BYTE *data, UINT32 length) {
+	UINT32 i;
+
+	for (i = 0; i < length; i++) {
+		checksum += data[i];
+	}
+	return checksum;
+}
+
+static void bench_fill_message(BYTE *message) {
+	UINT32 i;
+
+	message[0] = (BENCH_MESSAGE_SIZE - 4) & 0xFF;
+	message[1] = ((BENCH_MESSAGE_SIZE - 4) >> 8) & 0xFF;
+	message[2] = ((BENCH_MESSAGE_SIZE - 4) >> 16) & 0xFF;
+	message[3] = ((BENCH_MESSAGE_SIZE - 4) >> 24) & 0xFF;
+	for (i = 4; i < BENCH_MESSAGE_SIZE; i++) {
+		message[i] = (BYTE)i;
+	}
+}
+
+/* writes the messages like ogon_WTSVirtualChannelWrite does on a ring channel */
+static DWORD WINAPI ring_producer_thread(LPVOID arg) {
+	bench_context *context = (bench_context *)arg;
+	BYTE *message = malloc(BENCH_MESSAGE_SIZE);
+	UINT32 index, offset, written;
+
+	if (!message) {
+		context->failed = TRUE;
+		return 0;
+	}
+
+	bench_fill_message(message);
+	for (index = 0; index < BENCH_BYTES / BENCH_MESSAGE_SIZE; index++) {
+		context->checksum = checksum_update(context->checksum, message, BENCH_MESSAGE_SIZE);
+
+		offset = 0;
+		while (offset < BENCH_MESSAGE_SIZE) {
+			written = channel_ring_write(context->ring, message + offset, BENCH_MESSAGE_SIZE - offset);
+			if (!written) {
+				channel_ring_wait_writable(context->ring, INFINITE);
+				continue;
+			}
+			offset += written;
+			if (channel_ring_need_doorbell(context->ring) &&
+				(send(context->fd, "", 1, MSG_NOSIGNAL | MSG_DONTWAIT) < 0) && (errno != EAGAIN))
+			{
+				context->failed = TRUE;
+				break;
+			}
+		}
+	}
+
+	free(message);
+	close(context->fd);
+	return 0;
+}
+
+/* writes the messages like ogon_WTSVirtualChannelWrite does on a pipe channel */
+static DWORD WINAPI pipe_producer_thread(LPVOID arg) {
+	bench_context *context = (bench_context *)arg;
+	BYTE *message = malloc(BENCH_MESSAGE_SIZE);
+	UINT32 index, offset;
+	ssize_t written;
+
+	if (!message) {
+		context->failed = TRUE;
+		return 0;
+	}
+
+	bench_fill_message(message);
+	for (index = 0; index < BENCH_BYTES / BENCH_MESSAGE_SIZE; index++) {
+		context->checksum = checksum_update(context->checksum, message, BENCH_MESSAGE_SIZE);
+
+		offset = 0;
+		while (offset < BENCH_MESSAGE_SIZE) {
+			written = send(context->fd, message + offset, BENCH_MESSAGE_SIZE - offset, MSG_NOSIGNAL);
+			if (written < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				context->failed = TRUE;
+				break;
+			}
+			offset += written;
+		}
+	}
+
+	free(message);
+	close(context->fd);
+	return 0;
+}
+
+/* consumes like the rdp server: sleep on the doorbell, drain the ring */
+static UINT64 ring_consume(ogon_channel_ring *ring, int fd, BYTE *buffer, UINT64 *pChecksum) {
+	struct pollfd pfd;
+	BYTE doorbells[256];
+	UINT64 total = 0;
+	UINT32 count;
+	BOOL closed = FALSE;
+
+	for (;;) {
+		while ((count = channel_ring_read(ring, buffer, BENCH_READ_SIZE))) {
+			*pChecksum = checksum_update(*pChecksum, buffer, count);
+			total += count;
+		}
+		if (closed) {
+			return total;
+		}
+		if (!channel_ring_prepare_wait(ring, 1)) {
+			continue;
+		}
+
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if ((poll(&pfd, 1, -1) < 0) && (errno != EINTR)) {
+			return total;
+		}
+		if (read(fd, doorbells, sizeof(doorbells)) == 0) {
+			/* the producer is done, pick up what's left */
+			closed = TRUE;
+		}
+	}
+}
+
+static UINT64 pipe_consume(int fd, BYTE *buffer, UINT64 *pChecksum) {
+	UINT64 total = 0;
+	ssize_t count;
+
+	for (;;) {
+		count = read(fd, buffer, BENCH_READ_SIZE);
+		if (count < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return total;
+		}
+		if (!count) {
+			return total;
+		}
+		*pChecksum = checksum_update(*pChecksum, buffer, count);
+		total += count;
+	}
+}
+
+static int run_benchmark(BOOL useRing) {
+	bench_context context;
+	ogon_channel_ring ring;
+	HANDLE thread;
+	BYTE *buffer;
+	UINT64 start, duration, total, checksum = 0;
+	int fds[2];
+
+	memset(&context, 0, sizeof(context));
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+		return -1;
+	}
+	if (useRing) {
+		if (!channel_ring_create(&ring, OGON_CHANNEL_RING_DEFAULT_SIZE)) {
+			fprintf(stderr, "shared memory rings are not available, skipping\n");
+			close(fds[0]);
+			close(fds[1]);
+			return 0;
+		}
+		context.ring = &ring;
+	}
+	context.fd = fds[1];
+
+	if (!(buffer = malloc(BENCH_READ_SIZE))) {
+		return -1;
+	}
+
+	start = GetTickCount64();
+	thread = CreateThread(NULL, 0, useRing ? ring_producer_thread : pipe_producer_thread, &context, 0, NULL);
+	if (!thread) {
+		free(buffer);
+		return -1;
+	}
+
+	if (useRing) {
+		total = ring_consume(&ring, fds[0], buffer, &checksum);
+	} else {
+		total = pipe_consume(fds[0], buffer, &checksum);
+	}
+
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+	duration = GetTickCount64() - start;
+
+	close(fds[0]);
+	free(buffer);
+	if (useRing) {
+		channel_ring_destroy(&ring);
+	}
+
+	if (context.failed || (total != BENCH_BYTES) || (checksum != context.checksum)) {
+		fprintf(stderr, "%s: transferred %"PRIu64" of %d bytes\n", useRing ? "ring" : "pipe", total, BENCH_BYTES);
+		return -1;
+	}
+
+	fprintf(stderr, "%s: %d MB in %"PRIu64" ms (%"PRIu64" MB/s)\n", useRing ? "ring" : "pipe",
+			BENCH_BYTES / (1024 * 1024), duration,
+			duration ? ((UINT64)BENCH_BYTES / (1024 * 1024) * 1000) / duration : 0);
+	return 0;
+}
+
+int TestOgonChannelRing(int argc, char* argv[])
+{
+	OGON_UNUSED(argc);
+	OGON_UNUSED(argv);
+	ogon_channel_ring producer, consumer;
+	BYTE data[OGON_CHANNEL_RING_MIN_SIZE];
+	BYTE check[OGON_CHANNEL_RING_MIN_SIZE];
+	UINT32 i;
+	int fd;
+
+	if (!channel_ring_create(&producer, 1)) {
+		fprintf(stderr, "shared memory rings are not available, skipping\n");
+		return 0;
+	}
+
+	// sizes are rounded up to a power of two
+	if (producer.mask + 1 != OGON_CHANNEL_RING_MIN_SIZE)
+		return 1;
+
+	// the consumer maps the ring through the passed descriptor
+	if ((fd = dup(producer.fd)) < 0)
+		return 2;
+	if (!channel_ring_attach(&consumer, fd))
+		return 3;
+
+	for (i = 0; i < sizeof(data); i++) {
+		data[i] = (BYTE)(i * 7);
+	}
+
+	// an empty ring lets the consumer sleep, nobody asked for a doorbell yet
+	if (channel_ring_need_doorbell(&producer))
+		return 4;
+	if (!channel_ring_prepare_wait(&consumer, 1))
+		return 5;
+
+	// a full ring takes no more data
+	if (channel_ring_write(&producer, data, sizeof(data)) != sizeof(data))
+		return 6;
+	if (channel_ring_write(&producer, data, 1) != 0)
+		return 7;
+
+	// the waiting consumer gets exactly one doorbell
+	if (!channel_ring_need_doorbell(&producer) || channel_ring_need_doorbell(&producer))
+		return 8;
+
+	if (channel_ring_used(&consumer) != sizeof(data))
+		return 9;
+	if (channel_ring_prepare_wait(&consumer, 1))
+		return 10;
+
+	// wrap around the end of the ring
+	if (channel_ring_read(&consumer, check, 1000) != 1000 || memcmp(check, data, 1000))
+		return 11;
+	if (!channel_ring_wait_writable(&producer, 0))
+		return 12;
+	if (channel_ring_write(&producer, data, 1000) != 1000)
+		return 13;
+	if (channel_ring_read(&consumer, check, sizeof(check)) != sizeof(check))
+		return 14;
+	if (memcmp(check, data + 1000, sizeof(data) - 1000) || memcmp(check + sizeof(data) - 1000, data, 1000))
+		return 15;
+	if (channel_ring_used(&consumer) != 0 || channel_ring_read(&consumer, check, 1) != 0)
+		return 16;
+
+	// bogus indices from the other side never make the consumer read outside the ring
+	producer.header->head += 2 * sizeof(data);
+	if (channel_ring_used(&consumer) != 0)
+		return 17;
+
+	channel_ring_destroy(&consumer);
+	channel_ring_destroy(&producer);
+
+	// a descriptor that is not a sealed ring is refused
+	if ((fd = dup(STDERR_FILENO)) >= 0 && channel_ring_attach(&consumer, fd))
+		return 18;
+
+	if (run_benchmark(FALSE) < 0)
+		return 19;
+	if (run_benchmark(TRUE) < 0)
+		return 20;
+
+	return 0;
+}
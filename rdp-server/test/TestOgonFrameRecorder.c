@@ -0,0 +1,210 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * RDP Server
+ * Frame recorder Test
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "../common/global.h"
+#include "../../common/framerec.h"
+
+/* not a multiple of the tile size, the last tiles are partial */
+#define TEST_WIDTH 200
+#define TEST_HEIGHT 100
+#define TEST_SCANLINE (TEST_WIDTH * 4 + 32)
+#define TEST_FRAMES 20
+
+static void paint(BYTE *fb, const ogon_framerec_rect *r, UINT32 seed) {
+	UINT32 x, y;
+
+	for (y = r->y; y < (UINT32)(r->y + r->height); y++) {
+		UINT32 *line = (UINT32 *)(fb + y * TEST_SCANLINE);
+		for (x = r->x; x < (UINT32)(r->x + r->width); x++) {
+			/* some runs of equal pixels like text on a background */
+			line[x] = ((x + y + seed) % 7 < 3) ? 0xFF000000 | (seed * 2654435761U) : 0xFFFFFFFF;
+		}
+	}
+}
+
+static BOOL compare(const BYTE *fb, const ogon_frame_replay *replay) {
+	UINT32 y;
+
+	for (y = 0; y < TEST_HEIGHT; y++) {
+		if (memcmp(fb + y * TEST_SCANLINE, replay->framebuffer + y * replay->scanline, TEST_WIDTH * 4)) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+int TestOgonFrameRecorder(int argc, char* argv[])
+{
+	OGON_UNUSED(argc);
+	OGON_UNUSED(argv);
+	char dir[] = "/tmp/TestOgonFrameRecorder.XXXXXX";
+	char path[sizeof(dir) + 16];
+	ogon_framerec_rect outside;
+	BYTE *frames[TEST_FRAMES];
+	ogon_framerec_rect damage[TEST_FRAMES][2];
+	ogon_frame_recorder *recorder;
+	ogon_frame_replay replay;
+	const ogon_framerec_rect *rects;
+	UINT32 numRects;
+	BYTE *fb;
+	int fd, i, recorded = 0, ret = -1;
+
+	if (!mkdtemp(dir)) {
+		fprintf(stderr, "mkdtemp failed\n");
+		return -1;
+	}
+	snprintf(path, sizeof(path), "%s/test.frec", dir);
+
+	if (!(fb = calloc(TEST_HEIGHT, TEST_SCANLINE))) {
+		goto out_unlink;
+	}
+
+	/* an existing file or link is never written to */
+	if ((fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600)) < 0) {
+		goto out_free;
+	}
+	close(fd);
+	recorder = frame_recorder_new(path, TEST_WIDTH, TEST_HEIGHT);
+	unlink(path);
+	if (recorder) {
+		fprintf(stderr, "frame_recorder_new overwrote an existing file\n");
+		frame_recorder_free(recorder);
+		goto out_free;
+	}
+
+	if (!(recorder = frame_recorder_new(path, TEST_WIDTH, TEST_HEIGHT))) {
+		fprintf(stderr, "frame_recorder_new failed\n");
+		goto out_free;
+	}
+
+	for (i = 0; i < TEST_FRAMES; i++) {
+		/* a moving box and a rect which is reported but not changed */
+		damage[i][0].x = (i * 9) % (TEST_WIDTH - 70);
+		damage[i][0].y = (i * 5) % (TEST_HEIGHT - 40);
+		damage[i][0].width = 70;
+		damage[i][0].height = 40;
+		damage[i][1].x = TEST_WIDTH - 10;
+		damage[i][1].y = TEST_HEIGHT - 10;
+		damage[i][1].width = 10;
+		damage[i][1].height = 10;
+
+		paint(fb, &damage[i][0], i);
+
+		if (!(frames[i] = malloc(TEST_HEIGHT * TEST_SCANLINE))) {
+			goto out_free;
+		}
+		memcpy(frames[i], fb, TEST_HEIGHT * TEST_SCANLINE);
+		recorded++;
+
+		if (!frame_recorder_add_frame(recorder, fb, TEST_SCANLINE, damage[i], 2)) {
+			fprintf(stderr, "frame_recorder_add_frame failed\n");
+			frame_recorder_free(recorder);
+			goto out_free;
+		}
+	}
+	frame_recorder_free(recorder);
+
+	if (!frame_replay_open(&replay, path)) {
+		fprintf(stderr, "frame_replay_open failed\n");
+		goto out_free;
+	}
+
+	if ((replay.frameCount != TEST_FRAMES) || (replay.width != TEST_WIDTH) || (replay.height != TEST_HEIGHT)) {
+		fprintf(stderr, "unexpected header: %"PRIu32" frames %"PRIu32"x%"PRIu32"\n",
+				replay.frameCount, replay.width, replay.height);
+		goto out_close;
+	}
+
+	/* twice to check the rewind */
+	for (int pass = 0; pass < 2; pass++) {
+		for (i = 0; i < TEST_FRAMES; i++) {
+			if (frame_replay_next(&replay, &rects, &numRects) != 1) {
+				fprintf(stderr, "frame %d missing\n", i);
+				goto out_close;
+			}
+			if ((numRects != 2) || memcmp(rects, damage[i], sizeof(damage[i]))) {
+				fprintf(stderr, "damage of frame %d differs\n", i);
+				goto out_close;
+			}
+			if (!compare(frames[i], &replay)) {
+				fprintf(stderr, "framebuffer of frame %d differs\n", i);
+				goto out_close;
+			}
+		}
+		if (frame_replay_next(&replay, &rects, &numRects) != 0) {
+			fprintf(stderr, "end of recording not detected\n");
+			goto out_close;
+		}
+		frame_replay_rewind(&replay);
+	}
+
+	/* a damage rectangle reaching outside of the framebuffer makes the recording corrupt */
+	frame_replay_close(&replay);
+	outside = damage[0][1];
+	outside.width++;
+	if (((fd = open(path, O_WRONLY)) < 0) ||
+		(pwrite(fd, &outside, sizeof(outside), sizeof(ogon_framerec_header) + sizeof(ogon_framerec_frame) +
+			sizeof(ogon_framerec_rect)) != sizeof(outside)))
+	{
+		fprintf(stderr, "failed to modify the recording\n");
+		if (fd >= 0) {
+			close(fd);
+		}
+		goto out_free;
+	}
+	close(fd);
+	if (!frame_replay_open(&replay, path)) {
+		fprintf(stderr, "modified recording can't be opened\n");
+		goto out_free;
+	}
+	if (frame_replay_next(&replay, &rects, &numRects) != -1) {
+		fprintf(stderr, "damage outside of the framebuffer not detected\n");
+		goto out_close;
+	}
+
+	/* a recording cut off in the middle of a frame is usable up to the last complete frame */
+	frame_replay_close(&replay);
+	if ((truncate(path, sizeof(ogon_framerec_header) + 100) < 0) || !frame_replay_open(&replay, path)) {
+		fprintf(stderr, "truncated recording can't be opened\n");
+		goto out_free;
+	}
+	if (replay.frameCount >= TEST_FRAMES) {
+		fprintf(stderr, "truncated recording has %"PRIu32" frames\n", replay.frameCount);
+		goto out_close;
+	}
+
+	ret = 0;
+
+out_close:
+	frame_replay_close(&replay);
+out_free:
+	for (i = 0; i < recorded; i++) {
+		free(frames[i]);
+	}
+	free(fb);
+out_unlink:
+	unlink(path);
+	rmdir(dir);
+	return ret;
+}
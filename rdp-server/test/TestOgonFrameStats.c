@@ -0,0 +1,130 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * RDP Server
+ * Frame stats Test
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "../common/global.h"
+#include "../../common/framestats.h"
+
+int TestOgonFrameStats(int argc, char* argv[])
+{
+	OGON_UNUSED(argc);
+	OGON_UNUSED(argv);
+	ogon_frame_stats stats;
+	ogon_frame_histogram *histogram = &stats.histograms[OGON_FRAME_METRIC_FRAME_BYTES];
+	UINT64 start;
+	int i;
+
+	memset(&stats, 0, sizeof(stats));
+
+	// zero has its own bucket, then one bucket per power of two
+	frame_stats_record(&stats, OGON_FRAME_METRIC_FRAME_BYTES, 0);
+	frame_stats_record(&stats, OGON_FRAME_METRIC_FRAME_BYTES, 1);
+	frame_stats_record(&stats, OGON_FRAME_METRIC_FRAME_BYTES, 1023);
+	frame_stats_record(&stats, OGON_FRAME_METRIC_FRAME_BYTES, 1024);
+	if (histogram->buckets[0] != 1 || histogram->buckets[1] != 1 || histogram->buckets[10] != 1 || histogram->buckets[11] != 1)
+		return 1;
+
+	if (histogram->count != 4 || histogram->sum != 2048)
+		return 2;
+
+	// huge values end up in the last bucket
+	frame_stats_record(&stats, OGON_FRAME_METRIC_FRAME_BYTES, (UINT64)-1);
+	if (histogram->buckets[OGON_FRAME_STATS_BUCKETS - 1] != 1)
+		return 3;
+
+	// unknown metrics are ignored
+	frame_stats_record(&stats, OGON_FRAME_METRIC_COUNT, 1);
+	if (stats.histograms[OGON_FRAME_METRIC_DAMAGE_AREA].count)
+		return 4;
+
+	if (frame_stats_bucket_bound(0) != 0 || frame_stats_bucket_bound(11) != 2047)
+		return 5;
+
+	// the quantiles report the upper bound of the bucket
+	memset(&stats, 0, sizeof(stats));
+	for (i = 0; i < 99; i++) {
+		frame_stats_record(&stats, OGON_FRAME_METRIC_FRAME_BYTES, 100);
+	}
+	frame_stats_record(&stats, OGON_FRAME_METRIC_FRAME_BYTES, 5000);
+	if (frame_stats_quantile(histogram, 0.5) != 127 || frame_stats_quantile(histogram, 1.0) != 8191)
+		return 6;
+
+	if (frame_stats_quantile(&stats.histograms[OGON_FRAME_METRIC_ACK_RTT], 0.5) != 0)
+		return 7;
+
+	if (strcmp(frame_stats_metric_name(OGON_FRAME_METRIC_ACK_RTT), "ack_rtt") ||
+		strcmp(frame_stats_metric_name(OGON_FRAME_METRIC_INPUT_NETWORK), "input_network"))
+		return 8;
+
+	start = frame_stats_now();
+	if (frame_stats_now() < start)
+		return 9;
+
+	// the sums over connections add every counter and bucket
+	ogon_frame_stats total;
+	memset(&total, 0, sizeof(total));
+	total.codecMetric = OGON_FRAME_METRIC_ENCODE_RFX;
+	stats.frames = 3;
+	stats.bytesSent = 300;
+	stats.codecMetric = OGON_FRAME_METRIC_ENCODE_H264;
+	frame_stats_add(&total, &stats);
+	frame_stats_add(&total, &stats);
+	if (total.frames != 6 || total.bytesSent != 600 || total.codecMetric != OGON_FRAME_METRIC_ENCODE_RFX)
+		return 10;
+
+	if (total.histograms[OGON_FRAME_METRIC_FRAME_BYTES].count != 200 ||
+		total.histograms[OGON_FRAME_METRIC_FRAME_BYTES].sum != 2 * (99 * 100 + 5000) ||
+		total.histograms[OGON_FRAME_METRIC_FRAME_BYTES].buckets[7] != 198)
+		return 11;
+
+	// an input covered by a reply without damage isn't charged to a later frame
+	ogon_input_latency latency;
+	memset(&latency, 0, sizeof(latency));
+	memset(&stats, 0, sizeof(stats));
+	frame_stats_input_received(&latency, 100);
+	frame_stats_input_replied(&latency, 200, 300, FALSE);
+	frame_stats_input_received(&latency, 60000000);
+	frame_stats_input_replied(&latency, 60000100, 60000300, TRUE);
+	frame_stats_input_frame_sent(&stats, &latency, 60000400);
+	if (stats.histograms[OGON_FRAME_METRIC_INPUT_LATENCY].count != 1 ||
+		stats.histograms[OGON_FRAME_METRIC_INPUT_LATENCY].sum != 400 ||
+		stats.histograms[OGON_FRAME_METRIC_INPUT_QUEUE].sum != 100 ||
+		stats.histograms[OGON_FRAME_METRIC_INPUT_ENCODE].sum != 100 || latency.receivedAt)
+		return 12;
+
+	// a damaged reply keeps the input even if the next reply is empty
+	frame_stats_input_received(&latency, 1000);
+	frame_stats_input_replied(&latency, 1100, 1200, TRUE);
+	frame_stats_input_replied(&latency, 1300, 1400, FALSE);
+	if (latency.receivedAt != 1000 || latency.repliedAt != 1200)
+		return 13;
+
+	// without a frame the input expires
+	frame_stats_input_expire(&latency, 1000 + FRAME_STATS_INPUT_EXPIRY);
+	if (latency.receivedAt != 1000)
+		return 14;
+
+	frame_stats_input_expire(&latency, 1001 + FRAME_STATS_INPUT_EXPIRY);
+	frame_stats_input_frame_sent(&stats, &latency, 2000 + FRAME_STATS_INPUT_EXPIRY);
+	if (latency.receivedAt || stats.histograms[OGON_FRAME_METRIC_INPUT_LATENCY].count != 1)
+		return 15;
+
+	return 0;
+}
@@ -0,0 +1,93 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * RDP Server
+ * Logon trace Test
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+#include <string.h>
+#include "../common/global.h"
+#include "../../common/logontrace.h"
+
+int TestOgonLogonTrace(int argc, char* argv[])
+{
+	OGON_UNUSED(argc);
+	OGON_UNUSED(argv);
+	logon_trace trace;
+	char buffer[4096];
+	int len;
+
+	logon_trace_init(&trace);
+
+	// a phase that was never started can't end
+	if (logon_trace_end(&trace, LOGON_PHASE_CONNECT))
+		return 1;
+
+	logon_trace_begin(&trace, LOGON_PHASE_CONNECT);
+	if (logon_trace_has(&trace, LOGON_PHASE_CONNECT))
+		return 2;
+
+	if (!logon_trace_end(&trace, LOGON_PHASE_CONNECT))
+		return 3;
+
+	// a phase is only recorded once, i.e. on reactivation
+	if (logon_trace_end(&trace, LOGON_PHASE_CONNECT))
+		return 4;
+
+	logon_trace_set(&trace, LOGON_PHASE_MODULE_START, 1234);
+	if (logon_trace_duration(&trace, LOGON_PHASE_MODULE_START) != 1234)
+		return 5;
+
+	len = logon_trace_summary(&trace, buffer, sizeof(buffer));
+	if (len <= 0 || !strstr(buffer, "module_start=1234ms") || !strstr(buffer, "connect="))
+		return 6;
+
+	// truncated output stays terminated
+	len = logon_trace_summary(&trace, buffer, 8);
+	if (len != 7 || strlen(buffer) != 7)
+		return 7;
+
+	logon_trace_record(LOGON_PHASE_MODULE_START, 5);
+	logon_trace_record(LOGON_PHASE_MODULE_START, 1234);
+	logon_trace_record(LOGON_PHASE_MODULE_START, 60000);
+
+	len = logon_trace_format_metrics(NULL, 0);
+	if (len <= 0 || len >= (int)sizeof(buffer))
+		return 8;
+
+	if (logon_trace_format_metrics(buffer, sizeof(buffer)) != len)
+		return 9;
+
+	if (!strstr(buffer, "ogon_logon_phase_seconds_bucket{phase=\"module_start\",le=\"0.01\"} 1\n"))
+		return 10;
+
+	if (!strstr(buffer, "ogon_logon_phase_seconds_bucket{phase=\"module_start\",le=\"2.5\"} 2\n"))
+		return 11;
+
+	if (!strstr(buffer, "ogon_logon_phase_seconds_bucket{phase=\"module_start\",le=\"+Inf\"} 3\n"))
+		return 12;
+
+	if (!strstr(buffer, "ogon_logon_phase_seconds_sum{phase=\"module_start\"} 61.239\n"))
+		return 13;
+
+	if (!strstr(buffer, "ogon_logon_phase_seconds_count{phase=\"module_start\"} 3\n"))
+		return 14;
+
+	// phases without samples are not exported
+	if (strstr(buffer, "phase=\"connect\""))
+		return 15;
+
+	return 0;
+}
@@ -0,0 +1,60 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * RDP Server
+ * Static tracepoints of the frame pipeline
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifndef _OGON_RDPSRV_TRACE_H_
+#define _OGON_RDPSRV_TRACE_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/**
+ * USDT probes of the provider "ogon", usable with bpftrace, perf or
+ * systemtap without rebuilding (see misc/bpftrace). A probe which is not
+ * attached costs a single nop. The first two arguments are always the
+ * connection id and the frame id, the frame id being the id of the next
+ * frame sent to the client.
+ *
+ *  frame_timer(conn, frame)
+ *  sync_request(conn, frame, immediate)       sync request sent to the backend
+ *  sync_reply(conn, frame)                    backend finished a frame
+ *  simplify_start(conn, frame)
+ *  simplify_end(conn, frame, damagedPixels)
+ *  encode_start(conn, frame, codec)           codec is a string, e.g. "h264"
+ *  encode_end(conn, frame, codec, bytes)
+ *  pdu_write_start(conn, frame, bytes)
+ *  pdu_write_end(conn, frame, bytes)
+ *  frame_ack(conn, frame)                     frame is the acknowledged id
+ *  input_received(conn, frame, type, flags)   type is a string, e.g. "mouse"
+ *  input_forwarded(conn, frame, type, flags)  the event was sent to the backend
+ */
+#ifdef WITH_USDT
+#include <sys/sdt.h>
+
+#define OGON_TRACE2(name, a1, a2) DTRACE_PROBE2(ogon, name, a1, a2)
+#define OGON_TRACE3(name, a1, a2, a3) DTRACE_PROBE3(ogon, name, a1, a2, a3)
+#define OGON_TRACE4(name, a1, a2, a3, a4) DTRACE_PROBE4(ogon, name, a1, a2, a3, a4)
+#else
+#define OGON_TRACE2(name, a1, a2) do { } while (0)
+#define OGON_TRACE3(name, a1, a2, a3) do { } while (0)
+#define OGON_TRACE4(name, a1, a2, a3, a4) do { } while (0)
+#endif /* WITH_USDT */
+
+#endif /* _OGON_RDPSRV_TRACE_H_ */
@@ -35,9 +35,9 @@
 
 #include "ApplicationContext.h"
 
-#include <session/TaskSessionTimeout.h>
 #include <session/TaskDisconnect.h>
 #include <session/TaskEnd.h>
+#include <metrics/Collectors.h>
 
 #include <ogon/build-config.h>
 
@@ -51,6 +51,7 @@ namespace ogon { namespace sessionmanager {
 		initPaths();
 		configureExecutableSearchPath();
 
+		metricsNS::registerCollectors(&mMetricsRegistry);
 	}
 
 	ApplicationContext::~ApplicationContext() {
@@ -130,6 +131,14 @@ namespace ogon { namespace sessionmanager {
 		return &mSessionStore;
 	}
 
+	sessionNS::GreeterPool *ApplicationContext::getGreeterPool() {
+		return &mGreeterPool;
+	}
+
+	sessionNS::AuthWorkerPool *ApplicationContext::getAuthWorkerPool() {
+		return &mAuthWorkerPool;
+	}
+
 	sessionNS::SessionNotifier * ApplicationContext::getSessionNotifier(){
 		return &mSessionNotifier;
 	}
@@ -150,6 +159,18 @@ namespace ogon { namespace sessionmanager {
 		return &mProcessMonitor;
 	}
 
+	taskNS::TimerService *ApplicationContext::getTimerService() {
+		return &mTimerService;
+	}
+
+	taskNS::Executor *ApplicationContext::getTaskExecutor() {
+		return &mTaskExecutor;
+	}
+
+	metricsNS::MetricsRegistry *ApplicationContext::getMetricsRegistry() {
+		return &mMetricsRegistry;
+	}
+
 	pbRPC::RpcEngine *ApplicationContext::getIcpEngine() {
 		return &mRpcEngine;
 	}
@@ -262,15 +283,30 @@ namespace ogon { namespace sessionmanager {
 		return mTaskExecutor.stop();
 	}
 
-	void ApplicationContext::startSessionTimoutMonitor() {
-		sessionNS::TaskSessionTimeoutPtr task(new sessionNS::TaskSessionTimeout());
-		addTask(task);
+	bool ApplicationContext::startTimerService() {
+		return mTimerService.start();
+	}
+
+	bool ApplicationContext::stopTimerService() {
+		return mTimerService.stop();
+	}
+
+	bool ApplicationContext::startAuthWorkers() {
+		return mAuthWorkerPool.start();
+	}
+
+	bool ApplicationContext::stopAuthWorkers() {
+		return mAuthWorkerPool.stop();
 	}
 
 	bool ApplicationContext::addTask(taskNS::TaskPtr task) {
 		return mTaskExecutor.addTask(task);
 	}
 
+	taskNS::StrandPtr ApplicationContext::createStrand() {
+		return mTaskExecutor.createStrand();
+	}
+
 	void ApplicationContext::rpcDisconnected() {
 		// remove all connections
 		getConnectionStore()->reset();
@@ -286,6 +322,7 @@ namespace ogon { namespace sessionmanager {
 	}
 
 	void ApplicationContext::shutdown() {
+		mGreeterPool.stop();
 		std::list<sessionNS::SessionPtr> allSessions = getSessionStore()->getAllSessions();
 		std::list<sessionNS::SessionPtr>::iterator iterator;
 		for (iterator = allSessions.begin(); iterator != allSessions.end(); ++iterator) {
@@ -294,7 +331,7 @@ namespace ogon { namespace sessionmanager {
 			endTask->setSessionId(currentSession->getSessionID());
 			currentSession->addTask(endTask);
 			WaitForSingleObject(endTask->getHandle(), INFINITE);
-			currentSession->stopExecutorThread(true);
+			currentSession->stopExecutor(true);
 		}
 	}
 
@@ -323,6 +360,14 @@ namespace ogon { namespace sessionmanager {
 
 	}
 
+	bool ApplicationContext::startMetricsServer() {
+		return mMetricsServer.start();
+	}
+
+	bool ApplicationContext::stopMetricsServer() {
+		return mMetricsServer.stop();
+	}
+
 	bool ApplicationContext::loadConfig(const std::string &name) {
 		bool result;
 
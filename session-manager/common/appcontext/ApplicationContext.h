@@ -27,6 +27,8 @@
 #include <utils/SingletonBase.h>
 #include <utils/SignalingQueue.h>
 #include <session/SessionStore.h>
+#include <session/GreeterPool.h>
+#include <session/AuthWorkerPool.h>
 #include <session/ConnectionStore.h>
 #include <pbRPC/RpcEngine.h>
 #include <winpr/wlog.h>
@@ -35,9 +37,12 @@
 #include <config/PropertyManager.h>
 #include <otsapi/OTSApiServer.h>
 #include <task/Executor.h>
+#include <task/TimerService.h>
 #include <permission/PermissionManager.h>
 #include <session/SessionNotifier.h>
 #include <process/ProcessMonitor.h>
+#include <metrics/MetricsRegistry.h>
+#include <metrics/MetricsServer.h>
 
 #define APP_CONTEXT ogon::sessionmanager::ApplicationContext::instance()
 
@@ -51,6 +56,12 @@ namespace ogon { namespace sessionmanager {
 		/** @return the session store */
 		sessionNS::SessionStore *getSessionStore();
 
+		/** @return the pool of pre-started greeters */
+		sessionNS::GreeterPool *getGreeterPool();
+
+		/** @return the pool running authentications */
+		sessionNS::AuthWorkerPool *getAuthWorkerPool();
+
 		/** @return the session notifier */
 		sessionNS::SessionNotifier *getSessionNotifier();
 
@@ -69,6 +80,14 @@ namespace ogon { namespace sessionmanager {
 		/** @return the processs monitor */
 		processNS::ProcessMonitor *getProcessMonitor();
 
+		taskNS::TimerService *getTimerService();
+
+		/** @return the task executor */
+		taskNS::Executor *getTaskExecutor();
+
+		/** @return the registry of all exported metrics */
+		metricsNS::MetricsRegistry *getMetricsRegistry();
+
 		/** @return the ICP RPC engine */
 		pbRPC::RpcEngine *getIcpEngine();
 
@@ -86,8 +105,12 @@ namespace ogon { namespace sessionmanager {
 
 		bool startTaskExecutor();
 		bool stopTaskExecutor();
-		void startSessionTimoutMonitor();
+		bool startTimerService();
+		bool stopTimerService();
+		bool startAuthWorkers();
+		bool stopAuthWorkers();
 		bool addTask(taskNS::TaskPtr task);
+		taskNS::StrandPtr createStrand();
 
 		bool startSessionNotifier();
 		bool stopSessionNotifier();
@@ -95,6 +118,14 @@ namespace ogon { namespace sessionmanager {
 		bool startProcessMonitor();
 		bool stopProcessMonitor();
 
+		/**
+		 * starts serving the metrics if metrics.socket or metrics.httpPort
+		 * is configured
+		 * @return false if a configured endpoint could not be opened
+		 */
+		bool startMetricsServer();
+		bool stopMetricsServer();
+
 		std::string getLibraryPath() const;
 		std::string getExecutablePath() const;
 		std::string getSystemConfigPath() const;
@@ -130,8 +161,13 @@ namespace ogon { namespace sessionmanager {
 
 		bool mShutdown;
 
+		// first, everything else may hold pointers to metrics
+		metricsNS::MetricsRegistry mMetricsRegistry;
 		taskNS::Executor mTaskExecutor;
+		taskNS::TimerService mTimerService;
 		sessionNS::SessionStore mSessionStore;
+		sessionNS::GreeterPool mGreeterPool;
+		sessionNS::AuthWorkerPool mAuthWorkerPool;
 		sessionNS::SessionNotifier mSessionNotifier;
 		sessionNS::ConnectionStore mConnectionStore;
 
@@ -142,6 +178,7 @@ namespace ogon { namespace sessionmanager {
 		permissionNS::PermissionManager mPermissionManager;
 		otsapiNS::OTSApiServer mOTSApiServer;
 		processNS::ProcessMonitor mProcessMonitor;
+		metricsNS::MetricsServer mMetricsServer;
 		SINGLETON_ADD_INITIALISATION(ApplicationContext)
 	};
 
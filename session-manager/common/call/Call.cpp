@@ -31,7 +31,7 @@
 
 namespace ogon { namespace sessionmanager { namespace call {
 
-	Call::Call():mTag(0), mResult(0) {
+	Call::Call():mTag(0), mCreated(std::chrono::steady_clock::now()), mResult(0) {
 	}
 
 	Call::~Call() {
@@ -53,4 +53,9 @@ namespace ogon { namespace sessionmanager { namespace call {
 		return mErrorDescription;
 	}
 
+	uint64_t Call::getElapsedMicroseconds() const {
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - mCreated).count();
+	}
+
 } /*call*/ } /*sessionmanager*/ } /*call*/
@@ -27,6 +27,7 @@
 #include <string>
 #include <stdint.h>
 #include <memory>
+#include <chrono>
 
 namespace ogon { namespace sessionmanager { namespace call {
 
@@ -47,8 +48,12 @@ namespace ogon { namespace sessionmanager { namespace call {
 			mResult = -2;
 		}
 
+		/** @return microseconds since the call was created */
+		uint64_t getElapsedMicroseconds() const;
+
 	private:
 		uint32_t mTag;
+		std::chrono::steady_clock::time_point mCreated;
 	protected:
 		std::string mEncodedRequest;
 		std::string mEncodedResponse;
@@ -47,6 +47,21 @@ namespace ogon { namespace sessionmanager { namespace call {
 
 		virtual bool prepare() {return true;};
 		virtual bool doStuff() = 0;
+
+		/**
+		 * @return true if decoding and preparing this call may run on the
+		 * rpc dispatch pool, concurrently with other incoming calls. Calls
+		 * that depend on the order they were received in (for example the
+		 * ones queued into a session executor) must return false.
+		 */
+		virtual bool isDispatchable() const {return false;};
+
+		/**
+		 * @return the connection the decoded request refers to, 0 if none.
+		 * Calls for the same connection are prepared in the order they
+		 * were received in.
+		 */
+		virtual UINT32 getConnectionId() const {return 0;};
 	protected:
 		bool putInSessionExecutor_conId(UINT32 connectionId);
 		bool putInSessionExecutor_sesId(UINT32 sessionId);
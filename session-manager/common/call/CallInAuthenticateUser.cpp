@@ -27,6 +27,7 @@
 
 #include "CallInAuthenticateUser.h"
 #include "TaskAuthenticateUser.h"
+#include <appcontext/ApplicationContext.h>
 
 using ogon::sbp::AuthenticateUserRequest;
 using ogon::sbp::AuthenticateUserResponse;
@@ -34,7 +35,7 @@ using ogon::sbp::AuthenticateUserResponse;
 namespace ogon { namespace sessionmanager { namespace call {
 
 	CallInAuthenticateUser::CallInAuthenticateUser() : mAuthStatus(0),
-		mSessionId(0) {
+		mSessionId(0), mAuthenticated(false), mAuthResult(-1) {
 	}
 
 	CallInAuthenticateUser::~CallInAuthenticateUser() {
@@ -91,12 +92,33 @@ namespace ogon { namespace sessionmanager { namespace call {
 
 	bool CallInAuthenticateUser::doStuff() {
 		TaskAuthenticateUser authenticateTask(mUserName, mDomainName, mPassword, mSessionId);
+		if (mAuthenticated) {
+			authenticateTask.setAuthResult(mAuthResult, mDomainName);
+		}
 		authenticateTask.run();
 		mResult = authenticateTask.getResult(mAuthStatus);
 		return true;
 	}
 
 	bool CallInAuthenticateUser::prepare() {
+		sessionNS::SessionPtr session = APP_CONTEXT.getSessionStore()->getSession(mSessionId);
+		sessionNS::ConnectionPtr connection = APP_CONTEXT.getConnectionStore()->getConnectionForSessionId(mSessionId);
+
+		// run the authentication on the auth workers, so the session executor
+		// is not blocked by the auth module. Everything else including the
+		// error handling stays in TaskAuthenticateUser.
+		if (session && connection && session->isSBPVersionCompatible() &&
+				session->getConnectState() == WTSConnected) {
+			std::shared_ptr<CallInAuthenticateUser> self =
+				std::dynamic_pointer_cast<CallInAuthenticateUser>(shared_from_this());
+			if (APP_CONTEXT.getAuthWorkerPool()->authenticate(connection, mUserName, mDomainName,
+					mPassword, mSessionId, [self](int authStatus, const std::string &domainName) {
+						self->authenticated(authStatus, domainName);
+					})) {
+				return true;
+			}
+		}
+
 		if (!putInSessionExecutor_sesId(mSessionId)) {
 			mAuthStatus = 1;
 			return false;
@@ -104,4 +126,20 @@ namespace ogon { namespace sessionmanager { namespace call {
 		return true;
 	}
 
+	void CallInAuthenticateUser::authenticated(int authStatus, const std::string &domainName) {
+		if (authStatus == AUTH_WORKER_ABORTED) {
+			abort();
+			APP_CONTEXT.getRpcOutgoingQueue()->addElement(shared_from_this());
+			return;
+		}
+
+		mAuthenticated = true;
+		mAuthResult = authStatus;
+		mDomainName = domainName;
+		if (!putInSessionExecutor_sesId(mSessionId)) {
+			mAuthStatus = 1;
+			APP_CONTEXT.getRpcOutgoingQueue()->addElement(shared_from_this());
+		}
+	}
+
 } /*call*/ } /*sessionmanager*/ } /*ogon*/
@@ -48,6 +48,7 @@ namespace ogon { namespace sessionmanager { namespace call {
 		virtual bool doStuff();
 
 	private:
+		void authenticated(int authStatus, const std::string &domainName);
 
 		std::string mUserName;
 		std::string mDomainName;
@@ -56,6 +57,9 @@ namespace ogon { namespace sessionmanager { namespace call {
 		int mAuthStatus;
 		UINT32 mSessionId;
 		std::string mPipeName;
+
+		bool mAuthenticated;
+		int mAuthResult;
 	};
 
 	FACTORY_REGISTER_DWORD(CallFactory, CallInAuthenticateUser, ogon::sbp::AuthenticateUser);
@@ -44,6 +44,7 @@ namespace ogon { namespace sessionmanager { namespace call {
 		virtual bool decodeRequest();
 		virtual bool encodeResponse();
 		virtual bool prepare();
+		virtual UINT32 getConnectionId() const {return mConnectionId;};
 		virtual bool doStuff();
 
 	private:
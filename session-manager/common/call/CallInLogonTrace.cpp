@@ -0,0 +1,120 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Class for rpc call LogonTrace (ogon to session manager)
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "CallInLogonTrace.h"
+#include <appcontext/ApplicationContext.h>
+
+using ogon::icp::LogonTraceRequest;
+using ogon::icp::LogonTraceResponse;
+
+namespace ogon { namespace sessionmanager { namespace call {
+
+	static wLog *logger_CallInLogonTrace = WLog_Get("ogon.sessionmanager.call.callinlogontrace");
+
+	CallInLogonTrace::CallInLogonTrace() : mConnectionId(0) {
+		logon_trace_init(&mTrace);
+	}
+
+	CallInLogonTrace::~CallInLogonTrace() {
+	}
+
+	unsigned long CallInLogonTrace::getCallType() const {
+		return ogon::icp::LogonTrace;
+	}
+
+	bool CallInLogonTrace::decodeRequest() {
+		// decode protocol buffers
+		LogonTraceRequest req;
+
+		if (!req.ParseFromString(mEncodedRequest)) {
+			// failed to parse
+			mResult = 1;// will report error with answer
+			return false;
+		}
+
+		mConnectionId = req.connectionid();
+		for (int i = 0; i < req.phases_size(); i++) {
+			const ogon::icp::LogonTracePhase &phase = req.phases(i);
+			if (phase.phase() >= LOGON_PHASE_COUNT) {
+				// sent by a newer ogon
+				continue;
+			}
+			logon_trace_set(&mTrace, (LOGON_TRACE_PHASE)phase.phase(), phase.duration());
+		}
+		return true;
+	}
+
+	bool CallInLogonTrace::encodeResponse() {
+		// encode protocol buffers
+		LogonTraceResponse resp;
+		resp.set_success(mResult == 0);
+
+		if (!resp.SerializeToString(&mEncodedResponse)) {
+			// failed to serialize
+			mResult = 1;
+			return false;
+		}
+		return true;
+	}
+
+	bool CallInLogonTrace::prepare() {
+		doStuff();
+		APP_CONTEXT.getRpcOutgoingQueue()->addElement(CallIn::shared_from_this());
+		return true;
+	}
+
+	bool CallInLogonTrace::doStuff() {
+		logon_trace trace = mTrace;
+		std::string metricsFile;
+		char summary[512];
+
+		if (mResult != 0) {
+			return false;
+		}
+
+		for (int phase = 0; phase < LOGON_PHASE_COUNT; phase++) {
+			if (logon_trace_has(&mTrace, (LOGON_TRACE_PHASE)phase)) {
+				logon_trace_record((LOGON_TRACE_PHASE)phase,
+					logon_trace_duration(&mTrace, (LOGON_TRACE_PHASE)phase));
+			}
+		}
+
+		sessionNS::ConnectionPtr currentConnection = APP_CONTEXT.getConnectionStore()->getConnection(mConnectionId);
+		if (currentConnection) {
+			trace = currentConnection->mergeLogonTrace(mTrace);
+		}
+
+		logon_trace_summary(&trace, summary, sizeof(summary));
+		WLog_Print(logger_CallInLogonTrace, WLOG_INFO, "connection %" PRIu32 ": logon trace %s",
+			mConnectionId, summary);
+
+		if (APP_CONTEXT.getPropertyManager()->getPropertyString(0, "logon.trace.file", metricsFile) &&
+				!metricsFile.empty() && !logon_trace_write_metrics(metricsFile.c_str())) {
+			WLog_Print(logger_CallInLogonTrace, WLOG_WARN, "failed to write the logon metrics to %s",
+				metricsFile.c_str());
+		}
+		return true;
+	}
+
+} /*call*/ } /*sessionmanager*/ } /*ogon*/
@@ -0,0 +1,61 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Class for rpc call LogonTrace (ogon to session manager)
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifndef _OGON_SMGR_CALL_CALLINLOGONTRACE_H_
+#define _OGON_SMGR_CALL_CALLINLOGONTRACE_H_
+
+#include "CallFactory.h"
+#include "CallIn.h"
+#include <ICP.pb.h>
+
+#include "../../common/logontrace.h"
+
+namespace ogon { namespace sessionmanager { namespace call {
+
+	/**
+	 * @brief spans of a logon measured by ogon, sent once the first frame
+	 * went out. They are merged with the spans of the session manager for
+	 * the same connection.
+	 */
+	class CallInLogonTrace: public CallIn {
+	public:
+		CallInLogonTrace();
+		virtual ~CallInLogonTrace();
+
+		virtual unsigned long getCallType() const;
+		virtual bool decodeRequest();
+		virtual bool encodeResponse();
+		virtual bool prepare();
+		virtual UINT32 getConnectionId() const {return mConnectionId;};
+		virtual bool isDispatchable() const {return true;};
+		virtual bool doStuff();
+
+	private:
+		UINT32 mConnectionId;
+		logon_trace mTrace;
+	};
+
+	FACTORY_REGISTER_DWORD(CallFactory, CallInLogonTrace, ogon::icp::LogonTrace);
+
+} /*call*/ } /*sessionmanager*/ } /*ogon*/
+
+namespace callNS = ogon::sessionmanager::call;
+
+#endif /* _OGON_SMGR_CALL_CALLINLOGONTRACE_H_ */
@@ -108,6 +108,7 @@ namespace ogon { namespace sessionmanager { namespace call {
 	int CallInLogonUser::authenticateUser() {
 		sessionNS::ConnectionPtr currentConnection = APP_CONTEXT.getConnectionStore()->getOrCreateConnection(mConnectionId);
 		mAuthStatus = currentConnection->authenticateUser(mUserName, mDomainName, mPassword);
+		currentConnection->logonTraceEnd(LOGON_PHASE_AUTHENTICATE);
 		return mAuthStatus;
 	}
 
@@ -238,7 +239,16 @@ namespace ogon { namespace sessionmanager { namespace call {
 	int CallInLogonUser::getAuthSession() {
 		// authentication failed, start up greeter module
 		sessionNS::ConnectionPtr currentConnection = APP_CONTEXT.getConnectionStore()->getOrCreateConnection(mConnectionId);
-		sessionNS::SessionPtr currentSession = APP_CONTEXT.getSessionStore()->createSession();
+		std::string greeter;
+
+		if (!APP_CONTEXT.getPropertyManager()->getPropertyString(0, "auth.greeter", greeter, mUserName)) {
+			greeter = "Qt";
+		}
+
+		sessionNS::SessionPtr currentSession = APP_CONTEXT.getGreeterPool()->takeSession(greeter);
+		if (!currentSession) {
+			currentSession = APP_CONTEXT.getSessionStore()->createSession();
+		}
 
 		sessionNS::TaskLogonUserPtr logontask(new sessionNS::TaskLogonUser(
 			currentConnection->getConnectionId(), currentSession->getSessionID(),
@@ -258,6 +268,11 @@ namespace ogon { namespace sessionmanager { namespace call {
 		}
 
 		authenticateUser();
+		startSession();
+		return true;
+	}
+
+	void CallInLogonUser::startSession() {
 		if (mAuthStatus != 0) {
 			getAuthSession();
 		} else {
@@ -267,15 +282,45 @@ namespace ogon { namespace sessionmanager { namespace call {
 #endif
 			getUserSession();
 		}
-		return true;
 	}
 
 	bool CallInLogonUser::prepare() {
 		// create a new connection object, if it does not exist
 		sessionNS::ConnectionPtr currentConnection = APP_CONTEXT.getConnectionStore()->getOrCreateConnection(mConnectionId);
+		currentConnection->logonTraceBegin(LOGON_PHASE_LOGON_USER);
+		currentConnection->logonTraceBegin(LOGON_PHASE_AUTHENTICATE);
+
+		// authenticate on the auth workers, the dispatch pool is shared
+		// with all other incoming calls
+		if (!APP_CONTEXT.isShutdown()) {
+			std::shared_ptr<CallInLogonUser> self = shared_from_this();
+			if (APP_CONTEXT.getAuthWorkerPool()->authenticate(currentConnection, mUserName, mDomainName,
+					mPassword, 0, [self](int authStatus, const std::string &domainName) {
+						self->authenticated(authStatus, domainName);
+					})) {
+				return true;
+			}
+		}
 		return doStuff();
 	}
 
+	void CallInLogonUser::authenticated(int authStatus, const std::string &domainName) {
+		if (authStatus == AUTH_WORKER_ABORTED || APP_CONTEXT.isShutdown()) {
+			abort();
+			APP_CONTEXT.getRpcOutgoingQueue()->addElement(shared_from_this());
+			return;
+		}
+
+		sessionNS::ConnectionPtr currentConnection = APP_CONTEXT.getConnectionStore()->getConnection(mConnectionId);
+		if (currentConnection) {
+			currentConnection->logonTraceEnd(LOGON_PHASE_AUTHENTICATE);
+		}
+
+		mAuthStatus = authStatus;
+		mDomainName = domainName;
+		startSession();
+	}
+
 	std::shared_ptr<CallInLogonUser> CallInLogonUser::shared_from_this() {
 		CallPtr call = Call::shared_from_this();
 		return std::dynamic_pointer_cast<CallInLogonUser>(call);
@@ -46,6 +46,8 @@ namespace ogon { namespace sessionmanager { namespace call {
 		virtual bool decodeRequest();
 		virtual bool encodeResponse();
 		virtual bool prepare();
+		virtual UINT32 getConnectionId() const {return mConnectionId;};
+		virtual bool isDispatchable() const {return true;};
 		virtual bool doStuff();
 		std::shared_ptr<CallInLogonUser> shared_from_this();
 		void updateResult(uint32_t result, std::string pipeName, long maxHeight, long maxWidth, std::string backendCookie,
@@ -53,6 +55,8 @@ namespace ogon { namespace sessionmanager { namespace call {
 
 	private:
 		int authenticateUser();
+		void authenticated(int authStatus, const std::string &domainName);
+		void startSession();
 		int getAuthSession();
 		int getUserSession();
 		sessionNS::SessionPtr createNewUserSession();
@@ -45,6 +45,8 @@ namespace ogon { namespace sessionmanager { namespace call {
 		virtual bool decodeRequest();
 		virtual bool encodeResponse();
 		virtual bool prepare();
+		virtual UINT32 getConnectionId() const {return mConnectionId;};
+		virtual bool isDispatchable() const {return true;};
 		virtual bool doStuff();
 
 	private:
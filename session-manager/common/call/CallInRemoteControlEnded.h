@@ -43,6 +43,7 @@ class CallInRemoteControlEnded: public CallIn {
 		virtual unsigned long getCallType() const;
 		virtual bool decodeRequest();
 		virtual bool prepare();
+		virtual UINT32 getConnectionId() const {return mConnectionId;};
 		virtual bool doStuff();
 		virtual bool encodeResponse();
 	private:
@@ -0,0 +1,108 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Class for rpc call FrameStats (session manager to ogon)
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <call/CallOutFrameStats.h>
+#include <appcontext/ApplicationContext.h>
+
+using ogon::icp::FrameStatsRequest;
+using ogon::icp::FrameStatsResponse;
+using ogon::icp::FrameStatsHistogram;
+
+namespace ogon { namespace sessionmanager { namespace call {
+
+	CallOutFrameStats::CallOutFrameStats() {
+		mConnectionId = 0;
+		mSuccess = false;
+		memset(&mStats, 0, sizeof(mStats));
+	}
+
+	CallOutFrameStats::~CallOutFrameStats() {
+	}
+
+	unsigned long CallOutFrameStats::getCallType() const {
+		return ogon::icp::FrameStats;
+	}
+
+	bool CallOutFrameStats::encodeRequest() {
+		FrameStatsRequest req;
+		req.set_connectionid(mConnectionId);
+
+		if (!req.SerializeToString(&mEncodedRequest)) {
+			// failed to serialize
+			mResult = 1;
+			return false;
+		}
+		return true;
+	}
+
+	bool CallOutFrameStats::decodeResponse() {
+		FrameStatsResponse resp;
+
+		if (!resp.ParseFromString(mEncodedResponse)) {
+			// failed to parse
+			mResult = 1;
+			return false;
+		}
+
+		mSuccess = resp.success();
+		if (!mSuccess) {
+			return true;
+		}
+
+		mStats.frames = resp.frames();
+		mStats.suppressedFrames = resp.suppressedframes();
+		mStats.bytesSent = resp.bytessent();
+		mStats.codecMetric = resp.codecmetric();
+
+		for (int i = 0; i < resp.histograms_size(); i++) {
+			const FrameStatsHistogram &histogram = resp.histograms(i);
+			if (histogram.metric() >= OGON_FRAME_METRIC_COUNT) {
+				// sent by a newer rdp server
+				continue;
+			}
+
+			ogon_frame_histogram *dest = &mStats.histograms[histogram.metric()];
+			dest->count = histogram.count();
+			dest->sum = histogram.sum();
+			for (int bucket = 0; (bucket < histogram.buckets_size()) && (bucket < OGON_FRAME_STATS_BUCKETS); bucket++) {
+				dest->buckets[bucket] = histogram.buckets(bucket);
+			}
+		}
+		return true;
+	}
+
+	void CallOutFrameStats::setConnectionId(UINT32 connectionId) {
+		mConnectionId = connectionId;
+	}
+
+	bool CallOutFrameStats::isSuccess() const {
+		return mSuccess;
+	}
+
+	const ogon_frame_stats &CallOutFrameStats::getStats() const {
+		return mStats;
+	}
+
+} /*call*/ } /*sessionmanager*/ } /*ogon*/
@@ -0,0 +1,59 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Class for rpc call FrameStats (session manager to ogon)
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifndef _OGON_SMGR_CALL_CALLOUTFRAMESTATS_H_
+#define _OGON_SMGR_CALL_CALLOUTFRAMESTATS_H_
+
+#include <ogon/framestats.h>
+#include "CallOut.h"
+#include <ICP.pb.h>
+
+namespace ogon { namespace sessionmanager { namespace call {
+
+	/**
+	 * @brief queries the frame pipeline statistics of a connection
+	 */
+	class CallOutFrameStats: public CallOut {
+	public:
+		CallOutFrameStats();
+		virtual ~CallOutFrameStats();
+
+		virtual unsigned long getCallType() const;
+
+		virtual bool encodeRequest();
+		virtual bool decodeResponse();
+
+		void setConnectionId(UINT32 connectionId);
+		bool isSuccess() const;
+		const ogon_frame_stats &getStats() const;
+
+	private:
+		UINT32 mConnectionId;
+		bool mSuccess;
+		ogon_frame_stats mStats;
+	};
+
+	typedef std::shared_ptr<CallOutFrameStats> CallOutFrameStatsPtr;
+
+} /*call*/ } /*sessionmanager*/ } /*ogon*/
+
+namespace callNS = ogon::sessionmanager::call;
+
+#endif /* _OGON_SMGR_CALL_CALLOUTFRAMESTATS_H_ */
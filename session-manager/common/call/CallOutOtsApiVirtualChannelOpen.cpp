@@ -36,6 +36,7 @@ namespace ogon { namespace sessionmanager { namespace call {
 	CallOutOtsApiVirtualChannelOpen::CallOutOtsApiVirtualChannelOpen() {
 		mConnectionID = 0;
 		mInstance = 0;
+		mSupportedOptions = 0;
 		mDynamicChannel = false;
 		mFlags = 0;
 	}
@@ -73,6 +74,7 @@ namespace ogon { namespace sessionmanager { namespace call {
 		}
 		mConnectionString = resp.connectionstring();
 		mInstance = resp.instance();
+		mSupportedOptions = resp.supportedoptions();
 		return true;
 	}
 
@@ -92,6 +94,10 @@ namespace ogon { namespace sessionmanager { namespace call {
 		return mInstance;
 	}
 
+	DWORD CallOutOtsApiVirtualChannelOpen::getSupportedOptions() const {
+		return mSupportedOptions;
+	}
+
 	void CallOutOtsApiVirtualChannelOpen::setDynamicChannel(bool dynamic) {
 		mDynamicChannel = dynamic;
 	}
@@ -49,12 +49,14 @@ namespace ogon { namespace sessionmanager { namespace call {
 		void setFlags(DWORD flags);
 		std::string getConnectionString() const;
 		DWORD getInstance() const;
+		DWORD getSupportedOptions() const;
 
 	private:
 		UINT32 mConnectionID;
 		std::string mVirtualName;
 		std::string mConnectionString;
 		DWORD mInstance;
+		DWORD mSupportedOptions;
 		bool mDynamicChannel;
 		DWORD mFlags;
 	};
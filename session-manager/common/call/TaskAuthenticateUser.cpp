@@ -43,10 +43,17 @@ namespace ogon { namespace sessionmanager { namespace call {
 	TaskAuthenticateUser::TaskAuthenticateUser(const std::string &username,	const std::string &domainName,
 			const std::string &password, UINT32 sessionid) :
 		mUserName(username), mDomainName(domainName), mPassword(password),
-		mSessionId(sessionid), mAuthStatus(ogon::sbp::AuthenticateUserResponse_AUTH_STATUS_AUTH_UNKNOWN_ERROR), mResult(0)
+		mSessionId(sessionid), mAuthStatus(ogon::sbp::AuthenticateUserResponse_AUTH_STATUS_AUTH_UNKNOWN_ERROR), mResult(0),
+		mAuthenticated(false), mAuthResult(-1)
 	{
 	}
 
+	void TaskAuthenticateUser::setAuthResult(int authStatus, const std::string &domainName) {
+		mAuthenticated = true;
+		mAuthResult = authStatus;
+		mDomainName = domainName;
+	}
+
 	void TaskAuthenticateUser::run() {
 		if (authenticateUser() == ogon::sbp::AuthenticateUserResponse_AUTH_STATUS_AUTH_SUCCESSFUL) {
 			getUserSession();
@@ -87,7 +94,11 @@ namespace ogon { namespace sessionmanager { namespace call {
 			return -1;
 		}
 
-		mAuthStatus = currentConnection->authenticateUser(mUserName, mDomainName, mPassword);
+		if (mAuthenticated) {
+			mAuthStatus = mAuthResult;
+		} else {
+			mAuthStatus = currentConnection->authenticateUser(mUserName, mDomainName, mPassword);
+		}
 		if (mAuthStatus == -1) mAuthStatus = ogon::sbp::AuthenticateUserResponse_AUTH_STATUS_AUTH_BAD_CREDENTIALS;
 		return mAuthStatus;
 	}
@@ -106,7 +117,7 @@ namespace ogon { namespace sessionmanager { namespace call {
 		switchToCall->setMaxWidth(session->getMaxXRes());
 
 		APP_CONTEXT.getRpcOutgoingQueue()->addElement(switchToCall);
-		WaitForSingleObject(switchToCall->getAnswerHandle(), INFINITE);
+		taskNS::ThreadPool::blockingWait(switchToCall->getAnswerHandle(), INFINITE);
 
 		if (switchToCall->getResult() != 0) {
 			WLog_Print(logger_TaskAuthenticateUser, WLOG_ERROR, "s %" PRIu32 ": answer: RPC error %" PRIu32 "!",
@@ -168,7 +179,7 @@ namespace ogon { namespace sessionmanager { namespace call {
 								   mSessionId, connectionID);
 						otsapiNS::TaskDisconnectPtr disconnectTask(new otsapiNS::TaskDisconnect(currentSession->getSessionID(), TRUE, INFINITE));
 						currentSession->addTask(disconnectTask);
-						WaitForSingleObject(disconnectTask->getHandle(), INFINITE);
+						taskNS::ThreadPool::blockingWait(disconnectTask->getHandle(), INFINITE);
 					}
 				}
 			} else {
@@ -192,7 +203,7 @@ namespace ogon { namespace sessionmanager { namespace call {
 				sessionNS::TaskEndPtr shutdown(new sessionNS::TaskEnd());
 				shutdown->setSessionId(currentSession->getSessionID());
 				currentSession->addTask(shutdown);
-				WaitForSingleObject(shutdown->getHandle(), INFINITE);
+				taskNS::ThreadPool::blockingWait(shutdown->getHandle(), INFINITE);
 				currentSession.reset();
 			}
 		}
@@ -304,7 +315,7 @@ namespace ogon { namespace sessionmanager { namespace call {
 		UINT32 connectionId = connectionStore->getConnectionIdForSessionId(mSessionId);
 		sessionNS::TaskSwitchToPtr switchTo( new sessionNS::TaskSwitchTo(connectionId, currentSession->getSessionID()));
 		currentSession->addTask(switchTo);
-		WaitForSingleObject(switchTo->getHandle(), INFINITE);
+		taskNS::ThreadPool::blockingWait(switchTo->getHandle(), INFINITE);
 
 		bool success;
 		UINT32 result = switchTo->getResults(success);
@@ -43,6 +43,7 @@ namespace ogon { namespace sessionmanager { namespace call {
 			const std::string &password, UINT32 sessionid);
 		virtual void run();
 		int getResult(int &authStatus);
+		void setAuthResult(int authStatus, const std::string &domainName);
 
 	private:
 
@@ -57,6 +58,10 @@ namespace ogon { namespace sessionmanager { namespace call {
 
 		int mAuthStatus;
 		uint32_t mResult;
+
+		// authentication already done by the AuthWorkerPool
+		bool mAuthenticated;
+		int mAuthResult;
 	};
 
 	typedef std::shared_ptr<TaskAuthenticateUser> TaskAuthenticateUserPtr;
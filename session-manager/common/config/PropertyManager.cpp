@@ -43,7 +43,7 @@ namespace ogon { namespace sessionmanager { namespace config {
 
 	std::string gConnectionPrefix = "CURRENT.CONNECTION.";
 
-	PropertyManager::PropertyManager() {
+	PropertyManager::PropertyManager() : mSnapshot(new PropertySnapshot()), mLoading(false) {
 		if (!InitializeCriticalSectionAndSpinCount(&mCSection, 0x00000400)) {
 			WLog_Print(logger_PropertyManager, WLOG_FATAL,
 					"Failed to initialize property manager critical section");
@@ -69,40 +69,73 @@ namespace ogon { namespace sessionmanager { namespace config {
 		mPropertyGlobalMap.clear();
 	}
 
+	void PropertyManager::publishSnapshot() {
+		// called with mCSection held
+		std::shared_ptr<PropertySnapshot> snapshot(new PropertySnapshot());
+
+		snapshot->global.insert(mPropertyGlobalMap.begin(), mPropertyGlobalMap.end());
+
+		TPropertyPropertyMap::const_iterator iterPPMap;
+		for (iterPPMap = mPropertyUserMap.begin(); iterPPMap != mPropertyUserMap.end(); ++iterPPMap) {
+			TPropertyHashMap &userMap = snapshot->users[iterPPMap->first];
+			userMap = snapshot->global;
+
+			TPropertyMap::const_iterator iter;
+			for (iter = iterPPMap->second->begin(); iter != iterPPMap->second->end(); ++iter) {
+				userMap[iter->first] = iter->second;
+			}
+		}
+
+		std::atomic_store(&mSnapshot, std::shared_ptr<const PropertySnapshot>(snapshot));
+	}
+
+	size_t PropertyPathHash::operator()(const std::string &path) const {
+		// FNV-1a over the upper case characters
+		size_t hash = 2166136261u;
+		for (std::string::const_iterator it = path.begin(); it != path.end(); ++it) {
+			hash ^= (size_t) toupper((unsigned char) *it);
+			hash *= 16777619u;
+		}
+		return hash;
+	}
+
+	bool PropertyPathEqual::operator()(const std::string &path1, const std::string &path2) const {
+		if (path1.size() != path2.size()) {
+			return false;
+		}
+		return strncasecmp(path1.c_str(), path2.c_str(), path1.size()) == 0;
+	}
+
 	bool PropertyManager::getPropertyInternal(UINT32 sessionID, const std::string &path,
 		PROPERTY_STORE_HELPER &helper, const std::string &username) const {
 
-		// first try to resolve the sessionID
-		CSGuard guard(&mCSection);
-		std::string localPath = path;
-		boost::algorithm::to_upper(localPath);
+		std::shared_ptr<const PropertySnapshot> snapshot = std::atomic_load(&mSnapshot);
+		const TPropertyHashMap *propMap = &snapshot->global;
+		sessionNS::SessionPtr currentSession;
 
-		std::string currentUserName;
 		if (sessionID == 0) {
 			// for no session, use username if it's present
-			if (username.size() == 0) {
-				TPropertyMap::const_iterator it = mPropertyGlobalMap.find(localPath);
-				if (it != mPropertyGlobalMap.end()) {
-					helper = it->second;
-					return true;
+			if (username.size() != 0) {
+				TPropertyUserHashMap::const_iterator userIt = snapshot->users.find(username);
+				if (userIt != snapshot->users.end()) {
+					propMap = &userIt->second;
 				}
-				return false;
 			}
-			currentUserName = username;
 		} else {
 			// for a given sessionID we try to get the username from the sessionstore
-			sessionNS::SessionPtr session = APP_CONTEXT.getSessionStore()->getSession(sessionID);
-			if (!session) {
+			currentSession = APP_CONTEXT.getSessionStore()->getSession(sessionID);
+			if (!currentSession) {
 				return false;
 			}
-			currentUserName = session->getUserName();
+			TPropertyUserHashMap::const_iterator userIt = snapshot->users.find(currentSession->getUserName());
+			if (userIt != snapshot->users.end()) {
+				propMap = &userIt->second;
+			}
 		}
 
-		if (localPath.substr(0, gConnectionPrefix.size()) == gConnectionPrefix) {
+		if (strncasecmp(path.c_str(), gConnectionPrefix.c_str(), gConnectionPrefix.size()) == 0) {
 			// requesting session values
-			std::string actualPath = localPath.substr(gConnectionPrefix.size());
-			sessionNS::SessionPtr currentSession = APP_CONTEXT.getSessionStore()->getSession(sessionID);
-			if (NULL == currentSession) {
+			if (!currentSession) {
 				WLog_Print(logger_PropertyManager, WLOG_ERROR,
 					"Cannot get Session for sessionID %" PRIu32 "", sessionID);
 				return false;
@@ -122,25 +155,17 @@ namespace ogon { namespace sessionmanager { namespace config {
 					"Cannot get Connection for connectionId %" PRIu32 "", connectionID);
 				return false;
 			}
+			std::string actualPath = path.substr(gConnectionPrefix.size());
+			boost::algorithm::to_upper(actualPath);
 			return currentConnection->getProperty(actualPath, helper);
 		}
 
-		TPropertyPropertyMap::const_iterator propUserIt = mPropertyUserMap.find(currentUserName);
-		if (propUserIt != mPropertyUserMap.end()) {
-			TPropertyMap *uPropMap = propUserIt->second;
-			if (uPropMap->find(localPath) != uPropMap->end()) {
-				// we found the setting ...
-				helper = (*uPropMap)[localPath];
-				return true;
-			}
-		}
-
-		TPropertyMap::const_iterator globalPropIt = mPropertyGlobalMap.find(localPath);
-		if (globalPropIt != mPropertyGlobalMap.end()) {
-			helper = globalPropIt->second;
-			return true;
+		TPropertyHashMap::const_iterator it = propMap->find(path);
+		if (it == propMap->end()) {
+			return false;
 		}
-		return false;
+		helper = it->second;
+		return true;
 	}
 
 	bool PropertyManager::getPropertyBool(UINT32 sessionID, const std::string &path,
@@ -213,12 +238,16 @@ namespace ogon { namespace sessionmanager { namespace config {
 				(*uPropMap)[localPath] = helper;
 				mPropertyUserMap[currentUserName] = uPropMap;
 			}
-			return true;
 		} else if (level == Global) {
 			mPropertyGlobalMap[localPath]= helper;
-			return true;
+		} else {
+			return false;
 		}
-		return false;
+
+		if (!mLoading) {
+			publishSnapshot();
+		}
+		return true;
 	}
 
 	bool PropertyManager::setPropertyBool(PROPERTY_LEVEL level, UINT32 sessionID,
@@ -350,6 +379,9 @@ namespace ogon { namespace sessionmanager { namespace config {
 		boost::property_tree::ptree pt;
 		CSGuard guard(&mCSection);
 		clearMaps();
+
+		// collect all values first and publish them with a single snapshot
+		mLoading = true;
 		APP_CONTEXT.setupDefaultValues();
 
 		try {
@@ -361,6 +393,8 @@ namespace ogon { namespace sessionmanager { namespace config {
 			WLog_Print(logger_PropertyManager, WLOG_ERROR,
 					"Error while parsing config file: %s", e.what());
 		}
+		mLoading = false;
+		publishSnapshot();
 		return true;
 	}
 
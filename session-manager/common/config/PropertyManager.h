@@ -26,6 +26,8 @@
 
 #include <string>
 #include <map>
+#include <memory>
+#include <unordered_map>
 
 #include <boost/property_tree/ptree.hpp>
 
@@ -41,6 +43,33 @@ namespace ogon { namespace sessionmanager { namespace config {
 	typedef std::map<std::string, TPropertyMap *> TPropertyPropertyMap;
 	typedef std::pair<std::string, TPropertyMap *> TPropertyPropertyPair;
 
+	/**
+	 * @brief case insensitive hash and compare functors so that property
+	 * paths can be looked up without building an upper case copy first.
+	 */
+	struct PropertyPathHash {
+		size_t operator()(const std::string &path) const;
+	};
+
+	struct PropertyPathEqual {
+		bool operator()(const std::string &path1, const std::string &path2) const;
+	};
+
+	typedef std::unordered_map<std::string, PROPERTY_STORE_HELPER,
+			PropertyPathHash, PropertyPathEqual> TPropertyHashMap;
+	typedef std::unordered_map<std::string, TPropertyHashMap> TPropertyUserHashMap;
+
+	/**
+	 * @brief immutable read view of the configuration.
+	 *
+	 * The user maps already contain the global values overlaid with the user
+	 * specific ones, so a lookup is a single hash probe.
+	 */
+	struct PropertySnapshot {
+		TPropertyHashMap global;
+		TPropertyUserHashMap users;
+	};
+
 
 	/**
 	 * @brief
@@ -77,10 +106,18 @@ namespace ogon { namespace sessionmanager { namespace config {
 				const std::string &username) const;
 
 		void clearMaps();
+		void publishSnapshot();
 
 		TPropertyMap mPropertyGlobalMap;
 		TPropertyPropertyMap mPropertyUserMap;
 		mutable CRITICAL_SECTION mCSection;
+
+		// readers only ever take a reference with std::atomic_load, writers
+		// build a new snapshot under mCSection and swap it in with
+		// std::atomic_store. A replaced snapshot is freed once the last
+		// reader still using it dropped its reference.
+		std::shared_ptr<const PropertySnapshot> mSnapshot;
+		bool mLoading;
 	};
 } /*config*/ } /*sessionmanager*/ } /*ogon*/
 
@@ -0,0 +1,321 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Metrics read from the session manager state when scraped
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "Collectors.h"
+
+#include <appcontext/ApplicationContext.h>
+#include <call/CallOutFrameStats.h>
+
+#include <winpr/sysinfo.h>
+#include <winpr/wlog.h>
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string.h>
+
+#include "../../common/framestats.h"
+#include "../../common/logontrace.h"
+
+/* time all FrameStats calls of a scrape may take together */
+#define METRICS_FRAME_STATS_TIMEOUT 2*1000
+
+namespace ogon { namespace sessionmanager { namespace metrics {
+
+	static wLog *logger_Collectors = WLog_Get("ogon.sessionmanager.metrics.collectors");
+
+	/**
+	 * @brief the frame statistics summed over all connections.
+	 *
+	 * Labels per connection would add new series with every connection. The
+	 * last values of a connection are kept until it is gone from the
+	 * connection store and then added to mEnded, so the sums never go back.
+	 */
+	class FrameStatsTotals {
+	public:
+		FrameStatsTotals() {
+			memset(&mEnded, 0, sizeof(mEnded));
+		}
+
+		/**
+		 * @param live the connections which exist now
+		 * @param answered the statistics of the connections that answered,
+		 * the others are counted with their values of the last scrape
+		 */
+		void update(const std::set<UINT32> &live, const std::map<UINT32, ogon_frame_stats> &answered,
+			ogon_frame_stats &totals) {
+
+			std::lock_guard<std::mutex> lock(mMutex);
+			for (std::map<UINT32, ogon_frame_stats>::iterator it = mLast.begin(); it != mLast.end(); ) {
+				if (live.find(it->first) == live.end()) {
+					frame_stats_add(&mEnded, &it->second);
+					it = mLast.erase(it);
+				} else {
+					++it;
+				}
+			}
+			for (std::map<UINT32, ogon_frame_stats>::const_iterator it = answered.begin(); it != answered.end(); ++it) {
+				if (live.find(it->first) != live.end()) {
+					mLast[it->first] = it->second;
+				}
+			}
+
+			totals = mEnded;
+			for (std::map<UINT32, ogon_frame_stats>::const_iterator it = mLast.begin(); it != mLast.end(); ++it) {
+				frame_stats_add(&totals, &it->second);
+			}
+		}
+
+	private:
+		std::mutex mMutex;
+		std::map<UINT32, ogon_frame_stats> mLast;
+		ogon_frame_stats mEnded;
+	};
+
+	static FrameStatsTotals gFrameStatsTotals;
+
+	/* indexed by WTS_CONNECTSTATE_CLASS */
+	static const char *connectStateNames[WTSInit + 1] = {
+		"active",
+		"connected",
+		"connectquery",
+		"shadow",
+		"disconnected",
+		"idle",
+		"listen",
+		"reset",
+		"down",
+		"init"
+	};
+
+	static void collectSessions(std::string &out) {
+		std::list<sessionNS::SessionPtr> sessions = APP_CONTEXT.getSessionStore()->getAllSessions();
+		UINT64 counts[WTSInit + 1] = { 0 };
+
+		for (std::list<sessionNS::SessionPtr>::const_iterator it = sessions.begin(); it != sessions.end(); ++it) {
+			WTS_CONNECTSTATE_CLASS state = (*it)->getConnectState();
+			if ((state >= WTSActive) && (state <= WTSInit)) {
+				counts[state]++;
+			}
+		}
+
+		formatHeader(out, "ogon_sessions", "Sessions by connect state", "gauge");
+		for (int state = WTSActive; state <= WTSInit; state++) {
+			appendSample(out, "ogon_sessions", std::string("state=\"") + connectStateNames[state] + "\"");
+			appendScaled(out, counts[state], 1);
+			out.append("\n");
+		}
+	}
+
+	static void collectExecutor(std::string &out) {
+		taskNS::Executor *executor = APP_CONTEXT.getTaskExecutor();
+		taskNS::ThreadPoolStats pools[2] = { executor->getStats(), executor->getStrandStats() };
+		const char *labels[2] = { "pool=\"tasks\"", "pool=\"strands\"" };
+		int i;
+
+		formatHeader(out, "ogon_executor_workers", "Worker threads of the task executor", "gauge");
+		for (i = 0; i < 2; i++) {
+			appendSample(out, "ogon_executor_workers", labels[i]);
+			appendScaled(out, pools[i].workers, 1);
+			out.append("\n");
+		}
+		formatHeader(out, "ogon_executor_blocked_workers", "Worker threads waiting for another task or an answer", "gauge");
+		for (i = 0; i < 2; i++) {
+			appendSample(out, "ogon_executor_blocked_workers", labels[i]);
+			appendScaled(out, pools[i].blockedWorkers, 1);
+			out.append("\n");
+		}
+		formatHeader(out, "ogon_executor_queue_depth", "Tasks waiting for a worker", "gauge");
+		for (i = 0; i < 2; i++) {
+			appendSample(out, "ogon_executor_queue_depth", labels[i]);
+			appendScaled(out, pools[i].queueDepth, 1);
+			out.append("\n");
+		}
+		formatHeader(out, "ogon_executor_tasks_total", "Tasks executed", "counter");
+		for (i = 0; i < 2; i++) {
+			appendSample(out, "ogon_executor_tasks_total", labels[i]);
+			appendScaled(out, pools[i].tasksExecuted, 1);
+			out.append("\n");
+		}
+		formatHeader(out, "ogon_executor_stolen_tasks_total", "Tasks taken from the queue of another worker", "counter");
+		for (i = 0; i < 2; i++) {
+			appendSample(out, "ogon_executor_stolen_tasks_total", labels[i]);
+			appendScaled(out, pools[i].tasksStolen, 1);
+			out.append("\n");
+		}
+		formatHeader(out, "ogon_executor_queue_wait_average_seconds", "Average time tasks waited for a worker", "gauge");
+		for (i = 0; i < 2; i++) {
+			appendSample(out, "ogon_executor_queue_wait_average_seconds", labels[i]);
+			appendScaled(out, pools[i].averageLatency, 1000000);
+			out.append("\n");
+		}
+		formatHeader(out, "ogon_executor_queue_wait_max_seconds", "Longest time a task waited for a worker", "gauge");
+		for (i = 0; i < 2; i++) {
+			appendSample(out, "ogon_executor_queue_wait_max_seconds", labels[i]);
+			appendScaled(out, pools[i].maxLatency, 1000000);
+			out.append("\n");
+		}
+	}
+
+	static void collectLogonTrace(std::string &out) {
+		int size = logon_trace_format_metrics(NULL, 0);
+		if (size <= 0) {
+			return;
+		}
+
+		std::vector<char> buffer(size + 1);
+		if (logon_trace_format_metrics(buffer.data(), buffer.size()) < 0) {
+			return;
+		}
+		out.append(buffer.data());
+	}
+
+	/* the power of two buckets of the rdp server, up to the last one used */
+	static void formatFrameHistogram(std::string &out, const std::string &name, const std::string &labels,
+		const ogon_frame_histogram &histogram, UINT64 scale) {
+
+		UINT64 cumulative = 0;
+		int last = -1;
+		std::string bucketLabels = labels.empty() ? labels : labels + ",";
+
+		for (int bucket = 0; bucket < OGON_FRAME_STATS_BUCKETS - 1; bucket++) {
+			if (histogram.buckets[bucket]) {
+				last = bucket;
+			}
+		}
+
+		for (int bucket = 0; bucket <= last; bucket++) {
+			cumulative += histogram.buckets[bucket];
+			std::string le;
+			appendScaled(le, frame_stats_bucket_bound(bucket), scale);
+			appendSample(out, name + "_bucket", bucketLabels + "le=\"" + le + "\"");
+			appendScaled(out, cumulative, 1);
+			out.append("\n");
+		}
+		appendSample(out, name + "_bucket", bucketLabels + "le=\"+Inf\"");
+		appendScaled(out, histogram.count, 1);
+		out.append("\n");
+		appendSample(out, name + "_sum", labels);
+		appendScaled(out, histogram.sum, scale);
+		out.append("\n");
+		appendSample(out, name + "_count", labels);
+		appendScaled(out, histogram.count, 1);
+		out.append("\n");
+	}
+
+	static void fetchFrameStats(std::set<UINT32> &live, std::map<UINT32, ogon_frame_stats> &answered) {
+		std::list<sessionNS::ConnectionPtr> connections = APP_CONTEXT.getConnectionStore()->getAllConnections();
+		std::list<std::pair<UINT32, callNS::CallOutFrameStatsPtr> > calls;
+
+		// queue all calls first, the rdp server answers them one after another
+		for (std::list<sessionNS::ConnectionPtr>::const_iterator it = connections.begin(); it != connections.end(); ++it) {
+			callNS::CallOutFrameStatsPtr statsCall(new callNS::CallOutFrameStats());
+			statsCall->setConnectionId((*it)->getConnectionId());
+			APP_CONTEXT.getRpcOutgoingQueue()->addElement(statsCall);
+
+			live.insert((*it)->getConnectionId());
+			calls.push_back(std::make_pair((*it)->getConnectionId(), statsCall));
+		}
+
+		UINT64 deadline = GetTickCount64() + METRICS_FRAME_STATS_TIMEOUT;
+		for (std::list<std::pair<UINT32, callNS::CallOutFrameStatsPtr> >::const_iterator it = calls.begin();
+			it != calls.end(); ++it) {
+
+			UINT64 now = GetTickCount64();
+			DWORD timeout = (now < deadline) ? (DWORD)(deadline - now) : 0;
+			if (WaitForSingleObject(it->second->getAnswerHandle(), timeout) != WAIT_OBJECT_0) {
+				WLog_Print(logger_Collectors, WLOG_DEBUG, "frame stats query for connection %" PRIu32 " timed out",
+					it->first);
+				continue;
+			}
+			if ((it->second->getResult() != 0) || !it->second->isSuccess()) {
+				continue;
+			}
+			answered[it->first] = it->second->getStats();
+		}
+	}
+
+	static void collectConnections(std::string &out) {
+		std::set<UINT32> live;
+		std::map<UINT32, ogon_frame_stats> answered;
+		ogon_frame_stats stats;
+
+		fetchFrameStats(live, answered);
+		gFrameStatsTotals.update(live, answered, stats);
+
+		formatHeader(out, "ogon_connection_frames_total", "Frames sent to the clients", "counter");
+		appendSample(out, "ogon_connection_frames_total", "");
+		appendScaled(out, stats.frames, 1);
+		out.append("\n");
+		formatHeader(out, "ogon_connection_suppressed_frames_total",
+			"Frames skipped because the client did not keep up", "counter");
+		appendSample(out, "ogon_connection_suppressed_frames_total", "");
+		appendScaled(out, stats.suppressedFrames, 1);
+		out.append("\n");
+		formatHeader(out, "ogon_connection_sent_bytes_total", "Bytes of frame updates written to the clients", "counter");
+		appendSample(out, "ogon_connection_sent_bytes_total", "");
+		appendScaled(out, stats.bytesSent, 1);
+		out.append("\n");
+
+		formatHeader(out, "ogon_connection_encode_seconds", "Time spent encoding and sending a frame", "histogram");
+		for (int metric = OGON_FRAME_METRIC_ENCODE_BITMAP; metric <= OGON_FRAME_METRIC_ENCODE_H264; metric++) {
+			if (!stats.histograms[metric].count) {
+				continue;
+			}
+			// "encode_rfx" becomes codec="rfx"
+			const char *codec = frame_stats_metric_name((OGON_FRAME_METRIC)metric) + strlen("encode_");
+			formatFrameHistogram(out, "ogon_connection_encode_seconds",
+				std::string("codec=\"") + codec + "\"", stats.histograms[metric], 1000000);
+		}
+		formatHeader(out, "ogon_connection_simplify_seconds", "Time spent comparing and simplifying the damage", "histogram");
+		formatFrameHistogram(out, "ogon_connection_simplify_seconds", "",
+			stats.histograms[OGON_FRAME_METRIC_SIMPLIFY_TIME], 1000000);
+		formatHeader(out, "ogon_connection_ack_rtt_seconds", "Time until the client acknowledged a frame", "histogram");
+		formatFrameHistogram(out, "ogon_connection_ack_rtt_seconds", "",
+			stats.histograms[OGON_FRAME_METRIC_ACK_RTT], 1000);
+		formatHeader(out, "ogon_connection_queue_depth", "Unacknowledged frames when a frame is sent", "histogram");
+		formatFrameHistogram(out, "ogon_connection_queue_depth", "",
+			stats.histograms[OGON_FRAME_METRIC_QUEUE_DEPTH], 1);
+		formatHeader(out, "ogon_connection_input_latency_seconds", "Time from an input until the frame following it, per phase", "histogram");
+		for (int metric = OGON_FRAME_METRIC_INPUT_LATENCY; metric <= OGON_FRAME_METRIC_INPUT_NETWORK; metric++) {
+			if (!stats.histograms[metric].count) {
+				continue;
+			}
+			// "input_render" becomes phase="render", the whole latency is phase="total"
+			const char *phase = (metric == OGON_FRAME_METRIC_INPUT_LATENCY) ? "total" :
+				frame_stats_metric_name((OGON_FRAME_METRIC)metric) + strlen("input_");
+			formatFrameHistogram(out, "ogon_connection_input_latency_seconds",
+				std::string("phase=\"") + phase + "\"", stats.histograms[metric], 1000000);
+		}
+	}
+
+	void registerCollectors(MetricsRegistry *registry) {
+		registry->addCollector(collectSessions);
+		registry->addCollector(collectExecutor);
+		registry->addCollector(collectLogonTrace);
+		registry->addCollector(collectConnections);
+	}
+
+} /*metrics*/ } /*sessionmanager*/ } /*ogon*/
@@ -0,0 +1,39 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Metrics read from the session manager state when scraped
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifndef _OGON_SMGR_METRICSCOLLECTORS_H_
+#define _OGON_SMGR_METRICSCOLLECTORS_H_
+
+#include "MetricsRegistry.h"
+
+namespace ogon { namespace sessionmanager { namespace metrics {
+
+	/**
+	 * @brief adds the collectors for sessions, the task executor, the logon
+	 * trace and the frame pipeline summed over all connections.
+	 *
+	 * The frame statistics are kept by the rdp server and fetched with one
+	 * FrameStats ICP call per connection during the scrape.
+	 */
+	void registerCollectors(MetricsRegistry *registry);
+
+} /*metrics*/ } /*sessionmanager*/ } /*ogon*/
+
+#endif /* _OGON_SMGR_METRICSCOLLECTORS_H_ */
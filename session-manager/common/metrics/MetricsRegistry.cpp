@@ -0,0 +1,276 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Registry of counters, gauges and histograms in the Prometheus text format
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "MetricsRegistry.h"
+#include <inttypes.h>
+#include <stdio.h>
+
+namespace ogon { namespace sessionmanager { namespace metrics {
+
+	static std::atomic<size_t> gNextShard(0);
+
+	size_t currentShard() {
+		static thread_local size_t shard = gNextShard.fetch_add(1, std::memory_order_relaxed) % METRICS_SHARDS;
+		return shard;
+	}
+
+	static void appendUnsigned(std::string &out, UINT64 value) {
+		char buffer[24];
+		snprintf(buffer, sizeof(buffer), "%" PRIu64 "", value);
+		out.append(buffer);
+	}
+
+	void appendScaled(std::string &out, UINT64 value, UINT64 scale) {
+		char buffer[48];
+
+		if (scale <= 1) {
+			appendUnsigned(out, value);
+			return;
+		}
+
+		// integer formatting keeps large sums exact
+		UINT64 fraction = value % scale;
+		int digits = 0;
+		for (UINT64 s = scale; s > 1; s /= 10) {
+			digits++;
+		}
+		int len = snprintf(buffer, sizeof(buffer), "%" PRIu64 ".%0*" PRIu64 "", value / scale, digits, fraction);
+		while ((len > 0) && (buffer[len - 1] == '0')) {
+			buffer[--len] = 0;
+		}
+		if ((len > 0) && (buffer[len - 1] == '.')) {
+			buffer[--len] = 0;
+		}
+		out.append(buffer);
+	}
+
+	void appendSample(std::string &out, const std::string &name, const std::string &labels) {
+		out.append(name);
+		if (!labels.empty()) {
+			out.append("{");
+			out.append(labels);
+			out.append("}");
+		}
+		out.append(" ");
+	}
+
+	void formatHeader(std::string &out, const std::string &name, const std::string &help, const char *type) {
+		out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+		out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+	}
+
+	std::string escapeLabel(const std::string &value) {
+		std::string escaped;
+		escaped.reserve(value.size());
+		for (std::string::const_iterator it = value.begin(); it != value.end(); ++it) {
+			switch (*it) {
+				case '\\':
+					escaped.append("\\\\");
+					break;
+				case '"':
+					escaped.append("\\\"");
+					break;
+				case '\n':
+					escaped.append("\\n");
+					break;
+				default:
+					escaped.push_back(*it);
+					break;
+			}
+		}
+		return escaped;
+	}
+
+	std::vector<UINT64> exponentialBuckets(UINT64 first, UINT64 factor, size_t count) {
+		std::vector<UINT64> bounds;
+		UINT64 bound = first;
+		for (size_t i = 0; (i < count) && (i < METRICS_MAX_BUCKETS); i++) {
+			bounds.push_back(bound);
+			bound *= factor;
+		}
+		return bounds;
+	}
+
+	Counter::Counter() {
+		for (size_t i = 0; i < METRICS_SHARDS; i++) {
+			mShards[i].value = 0;
+		}
+	}
+
+	UINT64 Counter::getValue() const {
+		UINT64 value = 0;
+		for (size_t i = 0; i < METRICS_SHARDS; i++) {
+			value += mShards[i].value.load(std::memory_order_relaxed);
+		}
+		return value;
+	}
+
+	void Counter::format(std::string &out, const std::string &name, const std::string &labels) const {
+		appendSample(out, name, labels);
+		appendUnsigned(out, getValue());
+		out.append("\n");
+	}
+
+	Gauge::Gauge() : mValue(0) {
+	}
+
+	void Gauge::format(std::string &out, const std::string &name, const std::string &labels) const {
+		char buffer[24];
+		appendSample(out, name, labels);
+		snprintf(buffer, sizeof(buffer), "%" PRId64 "", getValue());
+		out.append(buffer);
+		out.append("\n");
+	}
+
+	Histogram::Histogram(const std::vector<UINT64> &bounds, UINT64 scale) : mBounds(bounds), mScale(scale) {
+		if (mBounds.size() > METRICS_MAX_BUCKETS) {
+			mBounds.resize(METRICS_MAX_BUCKETS);
+		}
+		for (size_t i = 0; i < METRICS_SHARDS; i++) {
+			mShards[i].count = 0;
+			mShards[i].sum = 0;
+			for (size_t bucket = 0; bucket <= METRICS_MAX_BUCKETS; bucket++) {
+				mShards[i].buckets[bucket] = 0;
+			}
+		}
+	}
+
+	void Histogram::observe(UINT64 value) {
+		Shard &shard = mShards[currentShard()];
+		size_t bucket = 0;
+
+		while ((bucket < mBounds.size()) && (value > mBounds[bucket])) {
+			bucket++;
+		}
+		shard.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+		shard.sum.fetch_add(value, std::memory_order_relaxed);
+		shard.count.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void Histogram::format(std::string &out, const std::string &name, const std::string &labels) const {
+		UINT64 buckets[METRICS_MAX_BUCKETS + 1] = { 0 };
+		UINT64 count = 0, sum = 0, cumulative = 0;
+		std::string prefix = labels.empty() ? std::string() : labels + ",";
+
+		for (size_t i = 0; i < METRICS_SHARDS; i++) {
+			count += mShards[i].count.load(std::memory_order_relaxed);
+			sum += mShards[i].sum.load(std::memory_order_relaxed);
+			for (size_t bucket = 0; bucket <= mBounds.size(); bucket++) {
+				buckets[bucket] += mShards[i].buckets[bucket].load(std::memory_order_relaxed);
+			}
+		}
+
+		for (size_t bucket = 0; bucket <= mBounds.size(); bucket++) {
+			std::string le;
+			cumulative += buckets[bucket];
+			if (bucket < mBounds.size()) {
+				appendScaled(le, mBounds[bucket], mScale);
+			} else {
+				le = "+Inf";
+			}
+			appendSample(out, name + "_bucket", prefix + "le=\"" + le + "\"");
+			appendUnsigned(out, cumulative);
+			out.append("\n");
+		}
+
+		appendSample(out, name + "_sum", labels);
+		appendScaled(out, sum, mScale);
+		out.append("\n");
+		appendSample(out, name + "_count", labels);
+		// the shards are read one after another, never report less than the buckets
+		appendUnsigned(out, count > cumulative ? count : cumulative);
+		out.append("\n");
+	}
+
+	MetricsRegistry::MetricsRegistry() {
+	}
+
+	MetricsRegistry::~MetricsRegistry() {
+	}
+
+	template<typename T> T *MetricsRegistry::getMetric(const std::string &name, const std::string &help,
+		const char *type, const std::string &labels, const std::function<T *()> &create) {
+
+		std::lock_guard<std::mutex> guard(mLock);
+
+		Family &family = mFamilies[name];
+		if (family.type.empty()) {
+			family.help = help;
+			family.type = type;
+		} else if (family.type != type) {
+			return NULL;
+		}
+
+		std::unique_ptr<Metric> &metric = family.metrics[labels];
+		if (!metric) {
+			metric.reset(create());
+		}
+		return dynamic_cast<T *>(metric.get());
+	}
+
+	Counter *MetricsRegistry::getCounter(const std::string &name, const std::string &help,
+		const std::string &labels) {
+		return getMetric<Counter>(name, help, "counter", labels, []() { return new Counter(); });
+	}
+
+	Gauge *MetricsRegistry::getGauge(const std::string &name, const std::string &help,
+		const std::string &labels) {
+		return getMetric<Gauge>(name, help, "gauge", labels, []() { return new Gauge(); });
+	}
+
+	Histogram *MetricsRegistry::getHistogram(const std::string &name, const std::string &help,
+		const std::vector<UINT64> &bounds, UINT64 scale, const std::string &labels) {
+		return getMetric<Histogram>(name, help, "histogram", labels,
+			[&bounds, scale]() { return new Histogram(bounds, scale); });
+	}
+
+	void MetricsRegistry::addCollector(const Collector &collector) {
+		std::lock_guard<std::mutex> guard(mLock);
+		mCollectors.push_back(collector);
+	}
+
+	std::string MetricsRegistry::format() {
+		std::string out;
+		std::vector<Collector> collectors;
+
+		{
+			std::lock_guard<std::mutex> guard(mLock);
+			for (std::map<std::string, Family>::const_iterator it = mFamilies.begin(); it != mFamilies.end(); ++it) {
+				formatHeader(out, it->first, it->second.help, it->second.type.c_str());
+				for (std::map<std::string, std::unique_ptr<Metric> >::const_iterator metric = it->second.metrics.begin();
+					metric != it->second.metrics.end(); ++metric) {
+					metric->second->format(out, it->first, metric->first);
+				}
+			}
+			collectors = mCollectors;
+		}
+
+		// collectors may block, e.g. on ICP calls, run them without the lock
+		for (std::vector<Collector>::const_iterator it = collectors.begin(); it != collectors.end(); ++it) {
+			(*it)(out);
+		}
+		return out;
+	}
+
+} /*metrics*/ } /*sessionmanager*/ } /*ogon*/
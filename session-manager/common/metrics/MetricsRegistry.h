@@ -0,0 +1,183 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Registry of counters, gauges and histograms in the Prometheus text format
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+
+#ifndef _OGON_SMGR_METRICSREGISTRY_H_
+#define _OGON_SMGR_METRICSREGISTRY_H_
+
+#include <winpr/wtypes.h>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* number of shards of a metric, updates from different threads rarely share one */
+#define METRICS_SHARDS 16
+/* maximum number of buckets of a histogram, without +Inf */
+#define METRICS_MAX_BUCKETS 16
+
+namespace ogon { namespace sessionmanager { namespace metrics {
+
+	/** @return the shard used by the calling thread */
+	size_t currentShard();
+
+	class Metric {
+	public:
+		virtual ~Metric() {}
+		virtual void format(std::string &out, const std::string &name, const std::string &labels) const = 0;
+	};
+
+	/**
+	 * @brief a monotonic counter.
+	 *
+	 * Every thread adds to its own cache line, reading sums up all shards.
+	 */
+	class Counter : public Metric {
+	public:
+		Counter();
+
+		void add(UINT64 value = 1) {
+			mShards[currentShard()].value.fetch_add(value, std::memory_order_relaxed);
+		}
+		UINT64 getValue() const;
+
+		virtual void format(std::string &out, const std::string &name, const std::string &labels) const;
+
+	private:
+		struct alignas(64) Shard {
+			std::atomic<UINT64> value;
+		};
+		Shard mShards[METRICS_SHARDS];
+	};
+
+	/** @brief a value which can go up and down */
+	class Gauge : public Metric {
+	public:
+		Gauge();
+
+		void set(INT64 value) {
+			mValue.store(value, std::memory_order_relaxed);
+		}
+		void add(INT64 value) {
+			mValue.fetch_add(value, std::memory_order_relaxed);
+		}
+		INT64 getValue() const {
+			return mValue.load(std::memory_order_relaxed);
+		}
+
+		virtual void format(std::string &out, const std::string &name, const std::string &labels) const;
+
+	private:
+		std::atomic<INT64> mValue;
+	};
+
+	/**
+	 * @brief a histogram with fixed buckets.
+	 *
+	 * Values are observed as integers, e.g. in microseconds, and divided by
+	 * the scale when formatted, so "_seconds" histograms use a scale of
+	 * 1000000.
+	 */
+	class Histogram : public Metric {
+	public:
+		Histogram(const std::vector<UINT64> &bounds, UINT64 scale);
+
+		void observe(UINT64 value);
+
+		virtual void format(std::string &out, const std::string &name, const std::string &labels) const;
+
+	private:
+		struct alignas(64) Shard {
+			std::atomic<UINT64> count;
+			std::atomic<UINT64> sum;
+			std::atomic<UINT64> buckets[METRICS_MAX_BUCKETS + 1];
+		};
+
+		std::vector<UINT64> mBounds;
+		UINT64 mScale;
+		Shard mShards[METRICS_SHARDS];
+	};
+
+	/** @return bounds growing by factor from first, at most METRICS_MAX_BUCKETS */
+	std::vector<UINT64> exponentialBuckets(UINT64 first, UINT64 factor, size_t count);
+
+	/** @brief appends a number divided by scale with up to six decimals */
+	void appendScaled(std::string &out, UINT64 value, UINT64 scale);
+
+	/**
+	 * @brief holds all metrics of the session manager.
+	 *
+	 * Metrics are created once, usually into a function local static, and
+	 * never removed, so the returned pointers stay valid and updating them
+	 * takes no lock. Values which are cheaper to read when scraped, like
+	 * the number of sessions, are added with a collector instead.
+	 */
+	class MetricsRegistry {
+	public:
+		typedef std::function<void(std::string &out)> Collector;
+
+		MetricsRegistry();
+		~MetricsRegistry();
+
+		Counter *getCounter(const std::string &name, const std::string &help,
+			const std::string &labels = std::string());
+		Gauge *getGauge(const std::string &name, const std::string &help,
+			const std::string &labels = std::string());
+		Histogram *getHistogram(const std::string &name, const std::string &help,
+			const std::vector<UINT64> &bounds, UINT64 scale, const std::string &labels = std::string());
+
+		/** @brief adds a function appending complete metric families when scraped */
+		void addCollector(const Collector &collector);
+
+		/** @return all metrics in the Prometheus text exposition format */
+		std::string format();
+
+	private:
+		struct Family {
+			std::string help;
+			std::string type;
+			std::map<std::string, std::unique_ptr<Metric> > metrics;
+		};
+
+		template<typename T> T *getMetric(const std::string &name, const std::string &help,
+			const char *type, const std::string &labels, const std::function<T *()> &create);
+
+		std::mutex mLock;
+		std::map<std::string, Family> mFamilies;
+		std::vector<Collector> mCollectors;
+	};
+
+	/** @brief appends the name and labels of a sample, the value follows */
+	void appendSample(std::string &out, const std::string &name, const std::string &labels);
+
+	/** @brief appends the HELP and TYPE lines of a metric family */
+	void formatHeader(std::string &out, const std::string &name, const std::string &help, const char *type);
+
+	/** @return a label value with backslashes, quotes and newlines escaped */
+	std::string escapeLabel(const std::string &value);
+
+} /*metrics*/ } /*sessionmanager*/ } /*ogon*/
+
+namespace metricsNS = ogon::sessionmanager::metrics;
+
+#endif /* _OGON_SMGR_METRICSREGISTRY_H_ */
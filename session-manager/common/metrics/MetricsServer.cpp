@@ -0,0 +1,421 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Serves the metrics on a unix socket and a local http port
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+
+#include <vector>
+
+#include "MetricsServer.h"
+
+#include <appcontext/ApplicationContext.h>
+
+#include <winpr/sysinfo.h>
+#include <winpr/thread.h>
+#include <winpr/wlog.h>
+
+/* time in ms a client gets to send its request and to read the whole response */
+#define METRICS_CLIENT_TIMEOUT 5000
+/* largest http request header accepted */
+#define METRICS_MAX_REQUEST 4096
+
+namespace ogon { namespace sessionmanager { namespace metrics {
+
+	static wLog *logger_MetricsServer = WLog_Get("ogon.sessionmanager.metrics.metricsserver");
+
+	static const char *CONTENT_TYPE = "text/plain; version=0.0.4; charset=utf-8";
+
+	MetricsServer::MetricsServer() : mhServerThread(NULL), mWakeFd(-1), mUnixFd(-1), mHttpFd(-1) {
+		if (!(mhStopEvent = CreateEvent(NULL, TRUE, FALSE, NULL))) {
+			WLog_Print(logger_MetricsServer, WLOG_FATAL,
+				"Failed to create metrics server stop event");
+			throw std::bad_alloc();
+		}
+	}
+
+	MetricsServer::~MetricsServer() {
+		closeListeners();
+		CloseHandle(mhStopEvent);
+	}
+
+	int MetricsServer::listenUnix(const std::string &path) {
+		struct sockaddr_un addr;
+		int fd;
+
+		// the socket is bound in a private directory, given its mode and then moved into place
+		std::vector<char> parent(path.begin(), path.end());
+		parent.push_back('\0');
+		std::string privateDir = std::string(dirname(parent.data())) + "/.ogon-metrics-XXXXXX";
+		std::string privatePath = privateDir + "/socket";
+
+		if (privatePath.size() >= sizeof(addr.sun_path)) {
+			WLog_Print(logger_MetricsServer, WLOG_ERROR, "metrics socket path %s is too long", path.c_str());
+			return -1;
+		}
+
+		if (!mkdtemp(&privateDir[0])) {
+			WLog_Print(logger_MetricsServer, WLOG_ERROR, "failed to create a directory next to %s (errno=%d)",
+				path.c_str(), errno);
+			return -1;
+		}
+		privatePath = privateDir + "/socket";
+
+		if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+			WLog_Print(logger_MetricsServer, WLOG_ERROR, "failed to create metrics socket (errno=%d)", errno);
+			rmdir(privateDir.c_str());
+			return -1;
+		}
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, privatePath.c_str(), sizeof(addr.sun_path) - 1);
+
+		// readable for the owner and group of the session manager only, before anyone can connect
+		if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (chmod(privatePath.c_str(), 0660) < 0) ||
+			(listen(fd, 8) < 0) || (rename(privatePath.c_str(), path.c_str()) < 0))
+		{
+			WLog_Print(logger_MetricsServer, WLOG_ERROR, "failed to listen on metrics socket %s (errno=%d)",
+				path.c_str(), errno);
+			close(fd);
+			unlink(privatePath.c_str());
+			rmdir(privateDir.c_str());
+			return -1;
+		}
+
+		// rename replaced a stale socket of a previous run
+		rmdir(privateDir.c_str());
+		return fd;
+	}
+
+	int MetricsServer::listenHttp(long port) {
+		struct sockaddr_in addr;
+		int fd, reuse = 1;
+
+		if ((port <= 0) || (port > 65535)) {
+			WLog_Print(logger_MetricsServer, WLOG_ERROR, "invalid metrics http port %ld", port);
+			return -1;
+		}
+
+		if ((fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+			WLog_Print(logger_MetricsServer, WLOG_ERROR, "failed to create metrics http socket (errno=%d)", errno);
+			return -1;
+		}
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons((uint16_t)port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(fd, 8) < 0)) {
+			WLog_Print(logger_MetricsServer, WLOG_ERROR, "failed to listen on 127.0.0.1:%ld (errno=%d)",
+				port, errno);
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	void MetricsServer::closeListeners() {
+		if (mUnixFd >= 0) {
+			close(mUnixFd);
+			unlink(mSocketPath.c_str());
+			mUnixFd = -1;
+		}
+		if (mHttpFd >= 0) {
+			close(mHttpFd);
+			mHttpFd = -1;
+		}
+		if (mWakeFd >= 0) {
+			close(mWakeFd);
+			mWakeFd = -1;
+		}
+	}
+
+	bool MetricsServer::start() {
+		configNS::PropertyManager *propertyManager = APP_CONTEXT.getPropertyManager();
+		long port = 0;
+
+		if (mhServerThread) {
+			WLog_Print(logger_MetricsServer, WLOG_ERROR, "Metrics server already started!");
+			return false;
+		}
+
+		mSocketPath.clear();
+		propertyManager->getPropertyString(0, "metrics.socket", mSocketPath);
+		propertyManager->getPropertyNumber(0, "metrics.httpPort", port);
+
+		// any local user can connect to the http port, it has to be asked for explicitly
+		bool unauthenticated = false;
+		propertyManager->getPropertyBool(0, "metrics.httpUnauthenticated", unauthenticated);
+		if (port && !unauthenticated) {
+			WLog_Print(logger_MetricsServer, WLOG_WARN,
+				"metrics.httpPort is ignored, the http endpoint also needs metrics.httpUnauthenticated");
+			port = 0;
+		}
+
+		if (mSocketPath.empty() && !port) {
+			WLog_Print(logger_MetricsServer, WLOG_DEBUG, "metrics are not exposed");
+			return true;
+		}
+
+		if (!mSocketPath.empty() && ((mUnixFd = listenUnix(mSocketPath)) < 0)) {
+			closeListeners();
+			return false;
+		}
+		if (port && ((mHttpFd = listenHttp(port)) < 0)) {
+			closeListeners();
+			return false;
+		}
+		if ((mWakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+			WLog_Print(logger_MetricsServer, WLOG_ERROR,
+				"Failed to create metrics server wakeup fd (errno=%d)", errno);
+			closeListeners();
+			return false;
+		}
+
+		ResetEvent(mhStopEvent);
+		if (!(mhServerThread = CreateThread(NULL, 0,
+				(LPTHREAD_START_ROUTINE) MetricsServer::execThread, (void*) this,
+				0, NULL)))
+		{
+			WLog_Print(logger_MetricsServer, WLOG_ERROR, "failed to create thread");
+			closeListeners();
+			return false;
+		}
+		return true;
+	}
+
+	bool MetricsServer::stop() {
+		if (!mhServerThread) {
+			// nothing to do if the metrics are not exposed
+			return true;
+		}
+
+		SetEvent(mhStopEvent);
+		wakeup();
+		WaitForSingleObject(mhServerThread, INFINITE);
+		CloseHandle(mhServerThread);
+		mhServerThread = NULL;
+		closeListeners();
+		return true;
+	}
+
+	void MetricsServer::wakeup() {
+		UINT64 value = 1;
+		if (write(mWakeFd, &value, sizeof(value)) != sizeof(value)) {
+			WLog_Print(logger_MetricsServer, WLOG_ERROR,
+				"failed to signal metrics server thread (errno=%d)", errno);
+		}
+	}
+
+	bool MetricsServer::waitClient(int fd, short events, UINT64 deadline) {
+		struct pollfd fds[2];
+
+		fds[0].fd = fd;
+		fds[0].events = events;
+		fds[1].fd = mWakeFd;
+		fds[1].events = POLLIN;
+
+		for (;;) {
+			UINT64 now = GetTickCount64();
+			if (now >= deadline) {
+				errno = ETIMEDOUT;
+				return false;
+			}
+
+			fds[0].revents = 0;
+			fds[1].revents = 0;
+			if (poll(fds, 2, (int)(deadline - now)) < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return false;
+			}
+
+			// the wakeup fd is only signalled to stop the server
+			if (fds[1].revents & POLLIN) {
+				errno = ECANCELED;
+				return false;
+			}
+			if (fds[0].revents) {
+				// errors and hangups are reported by the following recv or send
+				return true;
+			}
+		}
+	}
+
+	bool MetricsServer::sendAll(int fd, const char *data, size_t length, UINT64 deadline) {
+		while (length) {
+			if (!waitClient(fd, POLLOUT, deadline)) {
+				return false;
+			}
+			ssize_t written = send(fd, data, length, MSG_NOSIGNAL);
+			if (written < 0) {
+				if ((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+					continue;
+				}
+				return false;
+			}
+			data += written;
+			length -= written;
+		}
+		return true;
+	}
+
+	void MetricsServer::sendHttpResponse(int fd, UINT64 deadline, const char *status, const char *contentType,
+		const std::string &body)
+	{
+		std::string response = std::string("HTTP/1.0 ") + status + "\r\n"
+			"Content-Type: " + contentType + "\r\n"
+			"Content-Length: " + std::to_string(body.size()) + "\r\n"
+			"Connection: close\r\n\r\n" + body;
+
+		if (!sendAll(fd, response.data(), response.size(), deadline)) {
+			WLog_Print(logger_MetricsServer, WLOG_DEBUG, "failed to send http response (errno=%d)", errno);
+		}
+	}
+
+	void MetricsServer::serveUnix(int fd, UINT64 deadline) {
+		std::string text = APP_CONTEXT.getMetricsRegistry()->format();
+
+		if (!sendAll(fd, text.data(), text.size(), deadline)) {
+			WLog_Print(logger_MetricsServer, WLOG_DEBUG, "failed to send metrics (errno=%d)", errno);
+		}
+	}
+
+	void MetricsServer::serveHttp(int fd, UINT64 deadline) {
+		char buffer[METRICS_MAX_REQUEST];
+		size_t length = 0;
+		ssize_t count;
+
+		// the body of a GET is ignored, only the request line matters
+		while (length < sizeof(buffer) - 1) {
+			if (!waitClient(fd, POLLIN, deadline)) {
+				WLog_Print(logger_MetricsServer, WLOG_DEBUG, "no complete http request (errno=%d)", errno);
+				return;
+			}
+			count = recv(fd, buffer + length, sizeof(buffer) - 1 - length, 0);
+			if (count < 0 && ((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+				continue;
+			}
+			if (count <= 0) {
+				return;
+			}
+			length += count;
+			buffer[length] = '\0';
+			if (strstr(buffer, "\r\n\r\n") || strstr(buffer, "\n\n")) {
+				break;
+			}
+		}
+		buffer[length] = '\0';
+
+		char *method = buffer;
+		char *path = strchr(method, ' ');
+		if (!path) {
+			sendHttpResponse(fd, deadline, "400 Bad Request", "text/plain", "bad request\n");
+			return;
+		}
+		*path++ = '\0';
+		path[strcspn(path, " ?\r\n")] = '\0';
+
+		if (strcmp(method, "GET")) {
+			sendHttpResponse(fd, deadline, "405 Method Not Allowed", "text/plain", "method not allowed\n");
+			return;
+		}
+		if (strcmp(path, "/metrics") && strcmp(path, "/")) {
+			sendHttpResponse(fd, deadline, "404 Not Found", "text/plain", "not found\n");
+			return;
+		}
+
+		sendHttpResponse(fd, deadline, "200 OK", CONTENT_TYPE, APP_CONTEXT.getMetricsRegistry()->format());
+	}
+
+	void MetricsServer::run() {
+		struct pollfd fds[3];
+
+		fds[0].fd = mWakeFd;
+		fds[1].fd = mUnixFd;
+		fds[2].fd = mHttpFd;
+
+		while (WaitForSingleObject(mhStopEvent, 0) != WAIT_OBJECT_0) {
+			for (int i = 0; i < 3; i++) {
+				// negative descriptors are ignored by poll
+				fds[i].events = POLLIN;
+				fds[i].revents = 0;
+			}
+
+			if (poll(fds, 3, -1) < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				WLog_Print(logger_MetricsServer, WLOG_ERROR, "poll failed (errno=%d)", errno);
+				break;
+			}
+
+			for (int i = 1; i < 3; i++) {
+				if (!(fds[i].revents & POLLIN)) {
+					continue;
+				}
+
+				int client = accept4(fds[i].fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+				if (client < 0) {
+					continue;
+				}
+				// one deadline for the whole exchange, a client trickling bytes can't keep the thread
+				UINT64 deadline = GetTickCount64() + METRICS_CLIENT_TIMEOUT;
+				if (fds[i].fd == mUnixFd) {
+					serveUnix(client, deadline);
+				} else {
+					serveHttp(client, deadline);
+				}
+				close(client);
+			}
+		}
+	}
+
+	void* MetricsServer::execThread(void *arg) {
+		MetricsServer *server = (MetricsServer *) arg;
+
+		WLog_Print(logger_MetricsServer, WLOG_INFO, "started MetricsServer thread");
+
+		server->run();
+
+		WLog_Print(logger_MetricsServer, WLOG_INFO, "stopped MetricsServer thread");
+		return NULL;
+	}
+
+} /*metrics*/ } /*sessionmanager*/ } /*ogon*/
@@ -0,0 +1,77 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Serves the metrics on a unix socket and a local http port
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifndef _OGON_SMGR_METRICSSERVER_H_
+#define _OGON_SMGR_METRICSSERVER_H_
+
+#include <winpr/wtypes.h>
+#include <winpr/synch.h>
+#include <string>
+
+namespace ogon { namespace sessionmanager { namespace metrics {
+
+	/**
+	 * @brief exposes the MetricsRegistry to a scraper.
+	 *
+	 * Both endpoints are disabled by default. A client connecting to the
+	 * unix socket (metrics.socket) gets the text and the connection is
+	 * closed. The http endpoint (metrics.httpPort) only listens on the
+	 * loopback interface and answers GET /metrics, without authentication,
+	 * so it also needs metrics.httpUnauthenticated. Clients are served one
+	 * after the other on a single thread, scrapes are rare. Each one gets
+	 * 5 seconds for the request and the response together and is dropped
+	 * when that passes or the server stops.
+	 */
+	class MetricsServer {
+	public:
+		MetricsServer();
+		~MetricsServer();
+
+		bool start();
+		bool stop();
+
+		void run();
+
+	private:
+		static void* execThread(void *arg);
+
+		int listenUnix(const std::string &path);
+		int listenHttp(long port);
+		bool waitClient(int fd, short events, UINT64 deadline);
+		bool sendAll(int fd, const char *data, size_t length, UINT64 deadline);
+		void sendHttpResponse(int fd, UINT64 deadline, const char *status, const char *contentType,
+			const std::string &body);
+		void serveUnix(int fd, UINT64 deadline);
+		void serveHttp(int fd, UINT64 deadline);
+		void wakeup();
+		void closeListeners();
+
+	private:
+		HANDLE mhStopEvent;
+		HANDLE mhServerThread;
+		int mWakeFd;
+		int mUnixFd;
+		int mHttpFd;
+		std::string mSocketPath;
+	};
+
+} /*metrics*/ } /*sessionmanager*/ } /*ogon*/
+
+#endif /* _OGON_SMGR_METRICSSERVER_H_ */
@@ -97,6 +97,7 @@ namespace ogon { namespace sessionmanager { namespace module {
 		std::string encodedRequest;
 		ogon::module::ModuleExitRequest request;
 		std::string moduleStartReturn;
+		UINT32 callID = 0;
 
 		if (!remoteModule->launcherStarted) {
 			goto exit;
@@ -108,15 +109,14 @@ namespace ogon { namespace sessionmanager { namespace module {
 			goto exit_out;
 		}
 
-		remoteModule->context->mCurrentCallID = getNextCallID();
-
-		if (writepbRpc(*remoteModule->context, encodedRequest, remoteModule->context->mCurrentCallID,
+		callID = getNextCallID();
+		if (writepbRpc(*remoteModule->context, encodedRequest, callID,
 					   ogon::module::ModuleExit, false, true )) {
 			WLog_Print(logger_RemoteModule, WLOG_ERROR , "write failed!");
 			goto exit_out;
 		}
 
-		serveOneRemoteCall(remoteModule, NULL);
+		serveOneRemoteCall(remoteModule, callID, NULL);
 
 	exit_out:
 		CloseHandle(remoteModule->context->mhRead);
@@ -166,9 +166,8 @@ namespace ogon { namespace sessionmanager { namespace module {
 			return std::string();
 		}
 
-		remoteModule->context->mCurrentCallID = getNextCallID();
-
-		if (writepbRpc(*remoteModule->context, encodedRequest, remoteModule->context->mCurrentCallID,
+		UINT32 callID = getNextCallID();
+		if (writepbRpc(*remoteModule->context, encodedRequest, callID,
 					   ogon::module::ModuleStart, false, true )) {
 			WLog_Print(logger_RemoteModule, WLOG_ERROR , "write failed!");
 			return std::string();
@@ -176,7 +175,7 @@ namespace ogon { namespace sessionmanager { namespace module {
 
 		std::string moduleStartReturn;
 
-		error = serveOneRemoteCall(remoteModule, &moduleStartReturn);
+		error = serveOneRemoteCall(remoteModule, callID, &moduleStartReturn);
 		if (error == REMOTE_CLIENT_SUCCESS) {
 			return moduleStartReturn;
 		}
@@ -201,9 +200,8 @@ namespace ogon { namespace sessionmanager { namespace module {
 			return REMOTE_CLIENT_ERROR;
 		}
 
-		remoteModule->context->mCurrentCallID = getNextCallID();
-
-		if (writepbRpc(*remoteModule->context, encodedRequest, remoteModule->context->mCurrentCallID,
+		UINT32 callID = getNextCallID();
+		if (writepbRpc(*remoteModule->context, encodedRequest, callID,
 					   ogon::module::ModuleStop, false, true )) {
 			WLog_Print(logger_RemoteModule, WLOG_ERROR , "write failed!");
 			return REMOTE_CLIENT_ERROR;
@@ -211,7 +209,7 @@ namespace ogon { namespace sessionmanager { namespace module {
 
 		int moduleStopReturn;
 
-		error = serveOneRemoteCall(remoteModule, &moduleStopReturn);
+		error = serveOneRemoteCall(remoteModule, callID, &moduleStopReturn);
 		if (error == REMOTE_CLIENT_SUCCESS) {
 			return moduleStopReturn;
 		}
@@ -236,9 +234,8 @@ namespace ogon { namespace sessionmanager { namespace module {
 			return REMOTE_CLIENT_ERROR;
 		}
 
-		remoteModule->context->mCurrentCallID = getNextCallID();
-
-		if (writepbRpc(*remoteModule->context, encodedRequest, remoteModule->context->mCurrentCallID,
+		UINT32 callID = getNextCallID();
+		if (writepbRpc(*remoteModule->context, encodedRequest, callID,
 					   ogon::module::ModuleConnect, false, true )) {
 			WLog_Print(logger_RemoteModule, WLOG_ERROR , "write failed!");
 			return REMOTE_CLIENT_ERROR;
@@ -246,7 +243,7 @@ namespace ogon { namespace sessionmanager { namespace module {
 
 		int moduleConnectReturn;
 
-		error = serveOneRemoteCall(remoteModule, &moduleConnectReturn);
+		error = serveOneRemoteCall(remoteModule, callID, &moduleConnectReturn);
 		if (error == REMOTE_CLIENT_SUCCESS) {
 			return moduleConnectReturn;
 		}
@@ -271,9 +268,8 @@ namespace ogon { namespace sessionmanager { namespace module {
 			return REMOTE_CLIENT_ERROR;
 		}
 
-		remoteModule->context->mCurrentCallID = getNextCallID();
-
-		if (writepbRpc(*remoteModule->context, encodedRequest, remoteModule->context->mCurrentCallID,
+		UINT32 callID = getNextCallID();
+		if (writepbRpc(*remoteModule->context, encodedRequest, callID,
 					   ogon::module::ModuleDisconnect, false, true )) {
 			WLog_Print(logger_RemoteModule, WLOG_ERROR , "write failed!");
 			return REMOTE_CLIENT_ERROR;
@@ -281,7 +277,7 @@ namespace ogon { namespace sessionmanager { namespace module {
 
 		int moduleDisconnectReturn;
 
-		error = serveOneRemoteCall(remoteModule, &moduleDisconnectReturn);
+		error = serveOneRemoteCall(remoteModule, callID, &moduleDisconnectReturn);
 		if (error == REMOTE_CLIENT_SUCCESS) {
 			return moduleDisconnectReturn;
 		}
@@ -306,9 +302,8 @@ namespace ogon { namespace sessionmanager { namespace module {
 			return NULL;
 		}
 
-		remoteModule->context->mCurrentCallID = getNextCallID();
-
-		if (writepbRpc(*remoteModule->context, encodedRequest, remoteModule->context->mCurrentCallID,
+		UINT32 callID = getNextCallID();
+		if (writepbRpc(*remoteModule->context, encodedRequest, callID,
 					   ogon::module::ModuleGetCustomInfo, false, true )) {
 			WLog_Print(logger_RemoteModule, WLOG_ERROR , "write failed!");
 			return NULL;
@@ -316,7 +311,7 @@ namespace ogon { namespace sessionmanager { namespace module {
 
 		std::string moduleGetCustomInfoReturn;
 
-		serveOneRemoteCall(remoteModule, &moduleGetCustomInfoReturn);
+		serveOneRemoteCall(remoteModule, callID, &moduleGetCustomInfoReturn);
 
 		if (moduleGetCustomInfoReturn.size() == 0) {
 			return getName() + ":";
@@ -651,8 +646,8 @@ namespace ogon { namespace sessionmanager { namespace module {
 	UINT RemoteModule::processCall(RemoteModuleTransportContext &context, const UINT32 callID, const UINT32 callType,
 							 const bool isResponse, const std::string &payload, void* customData) {
 
-		UINT32 currentCallID = context.mCurrentCallID;
-
+		// the transport only passes on the answer of the call waited for,
+		// so customData always belongs to its call type
 		switch (callType)
 		{
 			case ogon::module::ModuleStart :
@@ -660,10 +655,6 @@ namespace ogon { namespace sessionmanager { namespace module {
 					WLog_Print(logger_RemoteModule, WLOG_ERROR , "ModuleStart does only expect answer!");
 					return REMOTE_CLIENT_ERROR;
 				}
-				if (currentCallID != callID) {
-					WLog_Print(logger_RemoteModule, WLOG_ERROR , "wrong answer Id! Expected %" PRIu32 ", but got %" PRIu32 "", currentCallID, callID);
-					return REMOTE_CLIENT_ERROR;
-				}
 				return processModuleStart(payload, customData);
 
 			case ogon::module::ModuleStop :
@@ -671,10 +662,6 @@ namespace ogon { namespace sessionmanager { namespace module {
 					WLog_Print(logger_RemoteModule, WLOG_ERROR , "ModuleStop does only expect answer!");
 					return REMOTE_CLIENT_ERROR;
 				}
-				if (currentCallID != callID) {
-					WLog_Print(logger_RemoteModule, WLOG_ERROR , "wrong answer Id! Expected %" PRIu32 ", but got %" PRIu32 "", currentCallID, callID);
-					return REMOTE_CLIENT_ERROR;
-				}
 				return processModuleStop(payload, customData);
 
 			case ogon::module::ModuleGetCustomInfo :
@@ -682,10 +669,6 @@ namespace ogon { namespace sessionmanager { namespace module {
 					WLog_Print(logger_RemoteModule, WLOG_ERROR , "ModuleGetCustomInfo does only expect answer!");
 					return REMOTE_CLIENT_ERROR;
 				}
-				if (currentCallID != callID) {
-					WLog_Print(logger_RemoteModule, WLOG_ERROR , "wrong answer Id! Expected %" PRIu32 ", but got %" PRIu32 "", currentCallID, callID);
-					return REMOTE_CLIENT_ERROR;
-				}
 				return processModuleGetCustomInfo(payload, customData);
 
 			case ogon::module::ModuleConnect :
@@ -693,10 +676,6 @@ namespace ogon { namespace sessionmanager { namespace module {
 					WLog_Print(logger_RemoteModule, WLOG_ERROR , "ModuleConnect does only expect answer!");
 					return REMOTE_CLIENT_ERROR;
 				}
-				if (currentCallID != callID) {
-					WLog_Print(logger_RemoteModule, WLOG_ERROR , "wrong answer Id! Expected %" PRIu32 ", but got %" PRIu32 "", currentCallID, callID);
-					return REMOTE_CLIENT_ERROR;
-				}
 				return processModuleConnect(payload, customData);
 
 			case ogon::module::ModuleDisconnect :
@@ -704,10 +683,6 @@ namespace ogon { namespace sessionmanager { namespace module {
 					WLog_Print(logger_RemoteModule, WLOG_ERROR , "ModuleDisconnect does only expect answer!");
 					return REMOTE_CLIENT_ERROR;
 				}
-				if (currentCallID != callID) {
-					WLog_Print(logger_RemoteModule, WLOG_ERROR , "wrong answer Id! Expected %" PRIu32 ", but got %" PRIu32 "", currentCallID, callID);
-					return REMOTE_CLIENT_ERROR;
-				}
 				return processModuleDisconnect(payload, customData);
 
 			case ogon::module::PropertyBool :
@@ -744,8 +719,8 @@ namespace ogon { namespace sessionmanager { namespace module {
 	}
 
 
-	UINT RemoteModule::serveOneRemoteCall(REMOTE_MODULE *context, void *customData) {
-		UINT result = serveOneCall(*(context->context), customData, REMOTE_TIMEOUT);
+	UINT RemoteModule::serveOneRemoteCall(REMOTE_MODULE *context, UINT32 callID, void *customData) {
+		UINT result = serveOneCall(*(context->context), callID, customData, REMOTE_TIMEOUT);
 
 		if (result == REMOTE_CLIENT_ERROR_TIMEOUT) {
 			// stop launcher process
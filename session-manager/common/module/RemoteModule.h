@@ -75,7 +75,7 @@ namespace ogon { namespace sessionmanager { namespace module {
 
 	private:
 
-		UINT serveOneRemoteCall(REMOTE_MODULE *context, void *customData);
+		UINT serveOneRemoteCall(REMOTE_MODULE *context, UINT32 callID, void *customData);
 
 		BOOL startLauncher(REMOTE_MODULE *context);
 		BOOL stopLauncher(REMOTE_MODULE *context);
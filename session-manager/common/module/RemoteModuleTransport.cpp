@@ -28,6 +28,7 @@
 #include "RemoteModuleTransport.h"
 #include <winpr/wlog.h>
 #include <winpr/pipe.h>
+#include <winpr/sysinfo.h>
 #include <netinet/in.h>
 
 #define BUF_SIZE 4096
@@ -39,10 +40,10 @@ namespace ogon { namespace sessionmanager { namespace module {
 	RemoteModuleTransportContext::RemoteModuleTransportContext() {
 		mhRead = NULL;
 		mhWrite = NULL;
-		mHeaderRead = 0;
+		mReadStart = 0;
+		mReadEnd = 0;
 		mPacktLength = 0;
 		mPayloadRead = 0;
-		mCurrentCallID = 0;
 		mState = READ_HEADER;
 		mLauncherpid = 0;
 	};
@@ -54,10 +55,18 @@ namespace ogon { namespace sessionmanager { namespace module {
 	RemoteModuleTransport::~RemoteModuleTransport() {
 	}
 
-	UINT RemoteModuleTransport::readHeader(RemoteModuleTransportContext &context, DWORD timeout) {
+	UINT RemoteModuleTransport::fillBuffer(RemoteModuleTransportContext &context, DWORD timeout) {
 		BOOL fSuccess;
 		DWORD lpNumberOfBytesRead = 0;
 
+		// move a partial message to the front to make room for the rest
+		if (context.mReadStart) {
+			memmove(context.mReadBuffer, context.mReadBuffer + context.mReadStart,
+					context.mReadEnd - context.mReadStart);
+			context.mReadEnd -= context.mReadStart;
+			context.mReadStart = 0;
+		}
+
 		DWORD result = WaitForSingleObject(context.mhRead, timeout);
 
 		switch (result) {
@@ -74,108 +83,90 @@ namespace ogon { namespace sessionmanager { namespace module {
 				return REMOTE_CLIENT_ERROR;
 		}
 
-		fSuccess = ReadFile(context.mhRead, context.mHeaderBuffer + context.mHeaderRead,
-							4 - context.mHeaderRead, &lpNumberOfBytesRead, NULL);
+		// the pipe is readable, so this returns whatever is available
+		// without blocking
+		fSuccess = ReadFile(context.mhRead, context.mReadBuffer + context.mReadEnd,
+							REMOTE_CLIENT_READ_BUFFER_SIZE - context.mReadEnd, &lpNumberOfBytesRead, NULL);
 
 		if (!fSuccess || lpNumberOfBytesRead == 0) {
-			WLog_Print(logger_RemoteModuleTransport, WLOG_DEBUG, "error reading header (read: %" PRIu32 " fSuccess: %" PRId32 ")",
+			WLog_Print(logger_RemoteModuleTransport, WLOG_DEBUG, "error reading data (read: %" PRIu32 " fSuccess: %" PRId32 ")",
 					   lpNumberOfBytesRead, fSuccess);
 			context.mState = ERROR_TRANSPORT;
 			return REMOTE_CLIENT_ERROR;
 		}
 
-		context.mHeaderRead += lpNumberOfBytesRead;
+		context.mReadEnd += lpNumberOfBytesRead;
+		return REMOTE_CLIENT_SUCCESS;
+	}
+
+	UINT RemoteModuleTransport::extractFrame(RemoteModuleTransportContext &context) {
+		UINT available = context.mReadEnd - context.mReadStart;
 
-		if (context.mHeaderRead == 4) {
-			context.mPacktLength = ntohl(*(DWORD*)context.mHeaderBuffer);
+		if (context.mState == READ_HEADER) {
+			if (available < 4) {
+				return REMOTE_CLIENT_NEEDS_MORE_DATA;
+			}
+			context.mPacktLength = ntohl(*(DWORD*)(context.mReadBuffer + context.mReadStart));
 			if (context.mPacktLength > REMOTE_CLIENT_BUFFER_SIZE) {
 				WLog_Print(logger_RemoteModuleTransport, WLOG_ERROR, "packet length (%" PRIu32 ") exceeds maxbuffer size of %lu", context.mPacktLength, (unsigned long) REMOTE_CLIENT_BUFFER_SIZE);
+				context.mState = ERROR_TRANSPORT;
 				return REMOTE_CLIENT_ERROR;
 			}
 			/* WLog_Print(logger_RemoteModuleTransport, WLOG_TRACE, "header read, packet size %" PRIu32 "", context.mPacktLength); */
+			context.mReadStart += 4;
+			available -= 4;
 			context.mState = READ_PAYLOAD;
-			return REMOTE_CLIENT_SUCCESS;
-		}
-
-		return REMOTE_CLIENT_NEEDS_MORE_DATA;
-	}
-
-	UINT RemoteModuleTransport::readPayload(RemoteModuleTransportContext &context, DWORD timeout) {
-		BOOL fSuccess;
-		DWORD lpNumberOfBytesRead = 0;
-
-		DWORD result = WaitForSingleObject(context.mhRead, timeout);
-
-		switch (result) {
-			case WAIT_OBJECT_0:
-				break;
-			case WAIT_TIMEOUT:
-				WLog_Print(logger_RemoteModuleTransport, WLOG_ERROR,
-						   "waiting for data failed, timed out!");
-				return REMOTE_CLIENT_ERROR_TIMEOUT;
-			case WAIT_FAILED:
-			default:
-				WLog_Print(logger_RemoteModuleTransport, WLOG_ERROR,
-						   "waiting for data failed, aborting remot communication!");
-				return REMOTE_CLIENT_ERROR;
 		}
 
-		fSuccess = ReadFile(context.mhRead, context.mPayloadBuffer + context.mPayloadRead,
-							context.mPacktLength - context.mPayloadRead, &lpNumberOfBytesRead, NULL);
-
-		if (!fSuccess || lpNumberOfBytesRead == 0) {
-			WLog_Print(logger_RemoteModuleTransport, WLOG_DEBUG, "error reading payload");
-			context.mState = ERROR_TRANSPORT;
-			return REMOTE_CLIENT_ERROR;
-		}
-
-		context.mPayloadRead += lpNumberOfBytesRead;
-		if (context.mPayloadRead == context.mPacktLength) {
+		if (context.mState == READ_PAYLOAD) {
+			if (available < context.mPacktLength) {
+				return REMOTE_CLIENT_NEEDS_MORE_DATA;
+			}
+			memcpy(context.mPayloadBuffer, context.mReadBuffer + context.mReadStart, context.mPacktLength);
+			context.mPayloadRead = context.mPacktLength;
+			context.mReadStart += context.mPacktLength;
+			if (context.mReadStart == context.mReadEnd) {
+				context.mReadStart = context.mReadEnd = 0;
+			}
 			//WLog_Print(logger_RemoteModuleTransport, WLOG_TRACE, "payload read");
 			context.mState = PROCESS_PAYLOAD;
 			return REMOTE_CLIENT_SUCCESS;
 		}
 
-		return REMOTE_CLIENT_NEEDS_MORE_DATA;
+		return REMOTE_CLIENT_ERROR;
 	}
 
 	UINT RemoteModuleTransport::read(RemoteModuleTransportContext &context, DWORD timeout) {
-		UINT error;
+		UINT64 deadline = 0;
 
-		error = readHeader(context, timeout);
-		while (error ==  REMOTE_CLIENT_NEEDS_MORE_DATA)
-		{
-			error = readHeader(context, timeout);
-			if (error == REMOTE_CLIENT_ERROR) {
-				WLog_Print(logger_RemoteModuleTransport, WLOG_DEBUG, "read header failed!");
-				return REMOTE_CLIENT_ERROR;
-			}
-			if (error == REMOTE_CLIENT_NEEDS_MORE_DATA) {
-				Sleep(10);
-			}
+		if (timeout != INFINITE) {
+			deadline = GetTickCount64() + timeout;
 		}
 
-		if (error != REMOTE_CLIENT_SUCCESS) {
-			return error;
-		}
+		while (1) {
+			UINT error = extractFrame(context);
+			if (error != REMOTE_CLIENT_NEEDS_MORE_DATA) {
+				if (error == REMOTE_CLIENT_ERROR) {
+					WLog_Print(logger_RemoteModuleTransport, WLOG_DEBUG, "read message failed!");
+				}
+				return error;
+			}
 
-		error = readPayload(context, timeout);
-		while (error ==  REMOTE_CLIENT_NEEDS_MORE_DATA)
-		{
-			error = readPayload(context, timeout);
-			if (error == REMOTE_CLIENT_ERROR) {
-				WLog_Print(logger_RemoteModuleTransport, WLOG_DEBUG, "read payload failed!");
-				return REMOTE_CLIENT_ERROR;
+			// the timeout applies to the whole message, not to every read
+			DWORD remaining = INFINITE;
+			if (timeout != INFINITE) {
+				UINT64 now = GetTickCount64();
+				remaining = (now < deadline) ? (DWORD)(deadline - now) : 0;
 			}
-			if (error == REMOTE_CLIENT_NEEDS_MORE_DATA) {
-				Sleep(10);
+
+			error = fillBuffer(context, remaining);
+			if (error != REMOTE_CLIENT_SUCCESS) {
+				return error;
 			}
 		}
-
-		return error;
 	}
 
-	UINT RemoteModuleTransport::process(RemoteModuleTransportContext &context, void* customData) {
+	UINT RemoteModuleTransport::process(RemoteModuleTransportContext &context, UINT32 waitingCallID, void* customData) {
 		ogon::pbrpc::RPCBase mpbRPC;
 		UINT result = REMOTE_CLIENT_ERROR;
 
@@ -183,8 +174,32 @@ namespace ogon { namespace sessionmanager { namespace module {
 
 		uint32_t callID = mpbRPC.tag();
 		uint32_t callType = mpbRPC.msgtype();
+
+		if (mpbRPC.isresponse()) {
+			std::map<UINT32, UINT32>::iterator it = context.mPendingCalls.find(callID);
+			if (callID != waitingCallID) {
+				// customData belongs to the call waited for, an answer of a
+				// call that already timed out must not be written into it
+				WLog_Print(logger_RemoteModuleTransport, WLOG_WARN, "dropping answer %" PRIu32 " with id %" PRIu32 ", waiting for id %" PRIu32 "",
+						   callType, callID, waitingCallID);
+				if (it != context.mPendingCalls.end()) {
+					context.mPendingCalls.erase(it);
+				}
+				context.mPayloadRead = 0;
+				context.mState = READ_HEADER;
+				return REMOTE_CLIENT_CONTINUE;
+			}
+			if (it == context.mPendingCalls.end() || it->second != callType) {
+				WLog_Print(logger_RemoteModuleTransport, WLOG_ERROR, "unexpected answer %" PRIu32 " with id %" PRIu32 "",
+						   callType, callID);
+				context.mPayloadRead = 0;
+				context.mState = READ_HEADER;
+				return REMOTE_CLIENT_ERROR;
+			}
+			context.mPendingCalls.erase(it);
+		}
+
 		if (mpbRPC.status() == ogon::pbrpc::RPCBase_RPCSTATUS_SUCCESS) {
-			context.mHeaderRead = 0;
 			context.mPayloadRead = 0;
 			context.mState = READ_HEADER;
 			/* WLog_Print(logger_RemoteModuleTransport, WLOG_TRACE, "received %s %" PRIu32 " with id %" PRIu32 "", mpbRPC.isresponse() ? "answer" : "request", callType, callID); */
@@ -198,41 +213,43 @@ namespace ogon { namespace sessionmanager { namespace module {
 	}
 
 	UINT RemoteModuleTransport::serveOneRead(RemoteModuleTransportContext &context, void* customData, DWORD timeout) {
-		UINT error = REMOTE_CLIENT_ERROR;
+		UINT error;
 
 		if (context.mState == ERROR_TRANSPORT) {
 			return REMOTE_CLIENT_ERROR;
 		}
 
-		if (context.mState == READ_HEADER) {
-			error = readHeader(context, timeout);
-			if (error != REMOTE_CLIENT_NEEDS_MORE_DATA && error != REMOTE_CLIENT_SUCCESS) {
+		// serve a message that is already buffered before waiting for more
+		error = extractFrame(context);
+		if (error == REMOTE_CLIENT_NEEDS_MORE_DATA) {
+			error = fillBuffer(context, timeout);
+			if (error != REMOTE_CLIENT_SUCCESS) {
 				WLog_Print(logger_RemoteModuleTransport, WLOG_DEBUG, "error while reading!");
 				return error;
 			}
+			error = extractFrame(context);
 		}
 
-		if (context.mState == READ_PAYLOAD) {
-			error = readPayload(context, timeout);
-			if (error != REMOTE_CLIENT_NEEDS_MORE_DATA && error != REMOTE_CLIENT_SUCCESS) {
+		if (error != REMOTE_CLIENT_SUCCESS) {
+			if (error != REMOTE_CLIENT_NEEDS_MORE_DATA) {
 				WLog_Print(logger_RemoteModuleTransport, WLOG_DEBUG, "error while reading!");
-				return error;
 			}
+			return error;
 		}
 
-		if (context.mState == PROCESS_PAYLOAD) {
-			if ((error = process(context, customData)))
-				WLog_Print(logger_RemoteModuleTransport, WLOG_DEBUG, "error while processing!");
-		}
+		if ((error = process(context, 0, customData)))
+			WLog_Print(logger_RemoteModuleTransport, WLOG_DEBUG, "error while processing!");
 
 		return error;
 	}
 
 
-	UINT RemoteModuleTransport::serveOneCall(RemoteModuleTransportContext &context, void* customData, DWORD timeout) {
+	UINT RemoteModuleTransport::serveOneCall(RemoteModuleTransportContext &context, UINT32 waitingCallID,
+											 void* customData, DWORD timeout) {
 		UINT error;
 
 		if (context.mState == ERROR_TRANSPORT) {
+			context.mPendingCalls.erase(waitingCallID);
 			return REMOTE_CLIENT_ERROR;
 		}
 
@@ -240,14 +257,16 @@ namespace ogon { namespace sessionmanager { namespace module {
 			error = read(context, timeout);
 			if (error && error != REMOTE_CLIENT_CONTINUE) {
 				WLog_Print(logger_RemoteModuleTransport, WLOG_DEBUG, "error while reading!");
-				return error;
+				break;
 			}
 
-			if ((error = process(context, customData)) && error != REMOTE_CLIENT_CONTINUE && error < 1000)
+			if ((error = process(context, waitingCallID, customData)) && error != REMOTE_CLIENT_CONTINUE && error < 1000)
 				WLog_Print(logger_RemoteModuleTransport, WLOG_DEBUG, "error while processing!");
 
 		} while (error == REMOTE_CLIENT_CONTINUE);
 
+		// answered or given up, a late answer is dropped by process
+		context.mPendingCalls.erase(waitingCallID);
 		return error;
 	}
 
@@ -259,9 +278,13 @@ namespace ogon { namespace sessionmanager { namespace module {
 			return REMOTE_CLIENT_ERROR;
 		}
 
+		if (!callID) {
+			callID = getNextCallID();
+		}
+
 		ogon::pbrpc::RPCBase mpbRPC;
 		mpbRPC.Clear();
-		mpbRPC.set_tag(callID ? callID : getNextCallID());
+		mpbRPC.set_tag(callID);
 		mpbRPC.set_isresponse(isResponse);
 		mpbRPC.set_status(success ? ogon::pbrpc::RPCBase_RPCSTATUS_SUCCESS : ogon::pbrpc::RPCBase_RPCSTATUS_FAILED);
 		mpbRPC.set_msgtype(callType);
@@ -275,7 +298,17 @@ namespace ogon { namespace sessionmanager { namespace module {
 			return REMOTE_CLIENT_ERROR;
 		}
 
-		return writeInternal(context, encodedRequest);
+		// remember requests so the answer can be matched, several calls
+		// might be outstanding at the same time
+		if (!isResponse) {
+			context.mPendingCalls[callID] = callType;
+		}
+
+		UINT error = writeInternal(context, encodedRequest);
+		if (error && !isResponse) {
+			context.mPendingCalls.erase(callID);
+		}
+		return error;
 	}
 
 	UINT RemoteModuleTransport::writeInternal(RemoteModuleTransportContext &context, const std::string &data) {
@@ -287,32 +320,35 @@ namespace ogon { namespace sessionmanager { namespace module {
 			return REMOTE_CLIENT_ERROR;
 		}
 
-		fSuccess = WriteFile(context.mhWrite, &messageSize,
-							 4, &lpNumberOfBytesWritten, NULL);
-
-		if (!fSuccess || (lpNumberOfBytesWritten == 0)) {
-			WLog_Print(logger_RemoteModuleTransport, WLOG_DEBUG, "error writing header data");
-			context.mState = ERROR_TRANSPORT;
-			return REMOTE_CLIENT_ERROR;
-		}
-
-		fSuccess = WriteFile(context.mhWrite, data.data(),
-							 data.size(), &lpNumberOfBytesWritten, NULL);
-
-		if (!fSuccess || (lpNumberOfBytesWritten == 0)) {
-			WLog_Print(logger_RemoteModuleTransport, WLOG_DEBUG, "error writing payload data");
-			context.mState = ERROR_TRANSPORT;
-			return REMOTE_CLIENT_ERROR;
+		// header and payload go out with a single write
+		std::string frame;
+		frame.reserve(4 + data.size());
+		frame.append((const char *) &messageSize, 4);
+		frame.append(data);
+
+		size_t written = 0;
+		while (written < frame.size()) {
+			fSuccess = WriteFile(context.mhWrite, frame.data() + written,
+								 frame.size() - written, &lpNumberOfBytesWritten, NULL);
+
+			if (!fSuccess || (lpNumberOfBytesWritten == 0)) {
+				WLog_Print(logger_RemoteModuleTransport, WLOG_DEBUG, "error writing %s data",
+						   written < 4 ? "header" : "payload");
+				context.mState = ERROR_TRANSPORT;
+				return REMOTE_CLIENT_ERROR;
+			}
+			written += lpNumberOfBytesWritten;
 		}
 
 		return REMOTE_CLIENT_SUCCESS;
 	}
 
 	UINT32 RemoteModuleTransport::getNextCallID() {
-		mNextCallID++;
-		if (mNextCallID == 0)
-			mNextCallID++;
-		return mNextCallID;
+		// shared by all contexts of a module, which are used concurrently
+		UINT32 callID = ++mNextCallID;
+		if (callID == 0)
+			callID = ++mNextCallID;
+		return callID;
 	}
 
 } /*module*/ } /*sessionmanager*/ } /*ogon*/
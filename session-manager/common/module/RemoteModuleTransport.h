@@ -26,6 +26,8 @@
 
 #include "Module.h"
 #include <string.h>
+#include <atomic>
+#include <map>
 #include <pbRPC.pb.h>
 #include <winpr/synch.h>
 
@@ -37,6 +39,7 @@ namespace ogon { namespace sessionmanager { namespace module {
 	 */
 
 	#define REMOTE_CLIENT_BUFFER_SIZE	0xFFFF
+	#define REMOTE_CLIENT_READ_BUFFER_SIZE	(REMOTE_CLIENT_BUFFER_SIZE + 4)
 
 
 	#define REMOTE_CLIENT_SUCCESS 0
@@ -53,17 +56,28 @@ namespace ogon { namespace sessionmanager { namespace module {
 	};
 
 
+	/**
+	 * @brief state of one pipe connection.
+	 *
+	 * mReadBuffer holds everything read from the pipe that was not framed
+	 * yet (mReadStart to mReadEnd), a single read can return several
+	 * messages. mPendingCalls maps the call ids of all requests sent and
+	 * not answered yet to their call type. Only the answer of the call a
+	 * caller waits for in serveOneCall is processed, answers arriving after
+	 * their call timed out are dropped.
+	 */
 	class RemoteModuleTransportContext {
 	public:
 		RemoteModuleTransportContext();
 		HANDLE mhRead;
 		HANDLE mhWrite;
-		BYTE mHeaderBuffer[4];
-		UINT mHeaderRead;
+		BYTE mReadBuffer[REMOTE_CLIENT_READ_BUFFER_SIZE];
+		UINT mReadStart;
+		UINT mReadEnd;
 		UINT mPacktLength;
 		BYTE mPayloadBuffer[REMOTE_CLIENT_BUFFER_SIZE];
 		UINT mPayloadRead;
-		UINT32 mCurrentCallID;
+		std::map<UINT32, UINT32> mPendingCalls;
 		TRANSPORT_STATE mState;
 		DWORD mLauncherpid;
 	};
@@ -76,14 +90,15 @@ namespace ogon { namespace sessionmanager { namespace module {
 
 	protected:
 
-		UINT readHeader(RemoteModuleTransportContext &context, DWORD timeout = INFINITE);
-		UINT readPayload(RemoteModuleTransportContext &context, DWORD timeout = INFINITE);
+		UINT fillBuffer(RemoteModuleTransportContext &context, DWORD timeout = INFINITE);
+		UINT extractFrame(RemoteModuleTransportContext &context);
 		UINT read(RemoteModuleTransportContext &context, DWORD timeout = INFINITE);
-		UINT process(RemoteModuleTransportContext &context, void* customData);
+		UINT process(RemoteModuleTransportContext &context, UINT32 waitingCallID, void* customData);
 		virtual UINT processCall(RemoteModuleTransportContext &context, const UINT32 callID, const UINT32 callType,
 			const bool isResponse, const std::string &payload, void* customData) = 0;
 
-		UINT serveOneCall(RemoteModuleTransportContext &context, void* customData, DWORD timeout = INFINITE);
+		UINT serveOneCall(RemoteModuleTransportContext &context, UINT32 waitingCallID, void* customData,
+			DWORD timeout = INFINITE);
 		UINT serveOneRead(RemoteModuleTransportContext &context, void* customData, DWORD timeout = INFINITE);
 		UINT writepbRpc(RemoteModuleTransportContext &context, const std::string &data, uint32_t callID, uint32_t callType, bool isResponse, bool success);
 		UINT writeInternal(RemoteModuleTransportContext &context, const std::string &data);
@@ -91,7 +106,7 @@ namespace ogon { namespace sessionmanager { namespace module {
 		UINT32 getNextCallID();
 
 	private:
-		UINT32 mNextCallID;
+		std::atomic<UINT32> mNextCallID;
 
 	};
 
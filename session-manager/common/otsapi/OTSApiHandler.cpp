@@ -32,6 +32,7 @@
 #include <call/CallOutLogOffUserSession.h>
 #include <call/CallOutDisconnectUserSession.h>
 #include <call/CallOutMessage.h>
+#include <call/CallOutFrameStats.h>
 #include <permission/permission.h>
 #include <boost/algorithm/string/predicate.hpp>
 #include <call/CallOutOtsApiStartRemoteControl.h>
@@ -42,6 +43,7 @@
 #include <winpr/sysinfo.h>
 #include "../../common/global.h"
 #include <ogon/version.h>
+#include <ogon/wtsapi.h>
 #include <otsapi/OTSApiHandler.h>
 #include <otsapi/TaskDisconnect.h>
 #include <otsapi/TaskLogoff.h>
@@ -49,6 +51,9 @@
 #include <otsapi/TaskStopRemoteControl.h>
 
 #define OTSAPI_TIMEOUT 10*1000
+#define OTSAPI_FRAME_STATS_TIMEOUT 2*1000
+/* upper limit for a single waitSessionEvents call, clients simply call again */
+#define OTSAPI_MAX_EVENT_WAIT 60*1000
 
 namespace ogon{ namespace sessionmanager{ namespace otsapi {
 
@@ -127,6 +132,7 @@ namespace ogon{ namespace sessionmanager{ namespace otsapi {
 				sessionId, openCall->getConnectionString().c_str());
 			_return.__set_pipeName(openCall->getConnectionString());
 			_return.__set_instance(openCall->getInstance());
+			_return.__set_supportedOptions(openCall->getSupportedOptions());
 			return;
 		}
 
@@ -274,6 +280,70 @@ namespace ogon{ namespace sessionmanager{ namespace otsapi {
 			return;
 		}
 
+		fillSessionInformation(_return, session, infoClass);
+	}
+
+	void OTSApiHandler::enumerateSessionsEx(TReturnEnumerateSessionEx &_return,
+		const TSTRING &authToken, const TDWORD Version, const TInfoClassList &infoClasses) {
+
+		OGON_UNUSED(Version);
+
+		_return.__set_returnValue(false);
+
+		// resolve the caller once instead of once per session and class
+		sessionNS::SessionPtr current = APP_CONTEXT.getPermissionManager()->getSessionForToken(authToken);
+		permissionNS::LogonPermissionPtr permission;
+		bool queryOthers;
+
+		if (current) {
+			queryOthers = current->checkPermission(WTS_PERM_FLAGS_QUERY_INFORMATION);
+		} else {
+			permission = APP_CONTEXT.getPermissionManager()->getPermissionForLogon(authToken);
+			if (permission == NULL) {
+				WLog_Print(logger_OTSApiHandler, WLOG_ERROR, "Logon Permission not found!");
+				return;
+			}
+			queryOthers = ((permission->getPermission() & WTS_PERM_FLAGS_QUERY_INFORMATION) == WTS_PERM_FLAGS_QUERY_INFORMATION);
+		}
+
+		std::list<sessionNS::SessionPtr> sessions = APP_CONTEXT.getSessionStore()->getAllSessions();
+		TSessionListEx list;
+		list.reserve(sessions.size());
+
+		for (std::list<sessionNS::SessionPtr>::iterator it = sessions.begin(); it != sessions.end(); ++it) {
+			sessionNS::SessionPtr session = *it;
+
+			// same rules as getSessionAndCheckForPerm, sessions the caller may not query are left out
+			if (!queryOthers) {
+				if (current) {
+					if (current->getSessionID() != session->getSessionID()) {
+						continue;
+					}
+				} else if ((session->getDomain() != permission->getDomain()) ||
+						(session->getUserName() != permission->getUsername())) {
+					continue;
+				}
+			}
+
+			TSessionInfoEx info;
+			info.__set_sessionId(session->getSessionID());
+			info.__set_connectState(session->getConnectState());
+			info.infoValues.resize(infoClasses.size());
+			for (size_t index = 0; index < infoClasses.size(); index++) {
+				fillSessionInformation(info.infoValues[index], session, infoClasses[index]);
+			}
+			list.push_back(info);
+		}
+
+		_return.__set_sessionInfoList(list);
+		_return.__set_returnValue(true);
+	}
+
+	void OTSApiHandler::fillSessionInformation(TReturnQuerySessionInformation &_return,
+		sessionNS::SessionPtr session, const TINT32 infoClass) {
+
+		_return.__set_returnValue(false);
+
 		if (infoClass == WTSSessionInfo) {
 			TWTSINFO wtsinfo;
 			wtsinfo.__set_State(session->getConnectState());
@@ -367,7 +437,12 @@ namespace ogon{ namespace sessionmanager{ namespace otsapi {
 		sessionNS::ConnectionPtr connection = APP_CONTEXT.getConnectionStore()->getConnectionForSessionId(session->getSessionID());
 
 		if (!connection) {
-			WLog_Print(logger_OTSApiHandler, WLOG_ERROR, "s %" PRIu32 ": no client connection found to query values!", sessionId);
+			WLog_Print(logger_OTSApiHandler, WLOG_DEBUG, "s %" PRIu32 ": no client connection found to query values!", session->getSessionID());
+			return;
+		}
+
+		if (infoClass == OGON_WTS_INFO_FRAME_STATS) {
+			fillFrameStats(_return, session, connection->getConnectionId());
 			return;
 		}
 
@@ -404,6 +479,52 @@ namespace ogon{ namespace sessionmanager{ namespace otsapi {
 		}
 	}
 
+	void OTSApiHandler::fillFrameStats(TReturnQuerySessionInformation &_return,
+		sessionNS::SessionPtr session, UINT32 connectionId) {
+
+		callNS::CallOutFrameStatsPtr statsCall(new callNS::CallOutFrameStats());
+		statsCall->setConnectionId(connectionId);
+
+		APP_CONTEXT.getRpcOutgoingQueue()->addElement(statsCall);
+		if (WaitForSingleObject(statsCall->getAnswerHandle(), OTSAPI_FRAME_STATS_TIMEOUT) == WAIT_TIMEOUT) {
+			WLog_Print(logger_OTSApiHandler, WLOG_WARN, "s %" PRIu32 ": frame stats query timed out", session->getSessionID());
+			return;
+		}
+
+		if ((statsCall->getResult() != 0) || !statsCall->isSuccess()) {
+			WLog_Print(logger_OTSApiHandler, WLOG_DEBUG, "s %" PRIu32 ": no frame stats for connection %" PRIu32 "",
+				session->getSessionID(), connectionId);
+			return;
+		}
+
+		const ogon_frame_stats &stats = statsCall->getStats();
+		TFrameStats frameStats;
+		frameStats.__set_frames(stats.frames);
+		frameStats.__set_suppressedFrames(stats.suppressedFrames);
+		frameStats.__set_bytesSent(stats.bytesSent);
+		frameStats.__set_codecMetric(stats.codecMetric);
+
+		TFrameHistogramList histograms;
+		for (UINT32 metric = 0; metric < OGON_FRAME_METRIC_COUNT; metric++) {
+			const ogon_frame_histogram &histogram = stats.histograms[metric];
+			if (!histogram.count) {
+				continue;
+			}
+
+			TFrameHistogram entry;
+			entry.__set_metric(metric);
+			entry.__set_count(histogram.count);
+			entry.__set_sum(histogram.sum);
+			entry.buckets.assign(histogram.buckets, histogram.buckets + OGON_FRAME_STATS_BUCKETS);
+			entry.__isset.buckets = true;
+			histograms.push_back(entry);
+		}
+		frameStats.__set_histograms(histograms);
+
+		_return.__set_returnValue(true);
+		_return.infoValue.__set_frameStatsValue(frameStats);
+	}
+
 	sessionNS::SessionPtr OTSApiHandler::getSessionAndCheckForPerm(
 		const TSTRING &authToken, UINT32 sessionId, DWORD requestedPermission) {
 
@@ -593,4 +714,87 @@ namespace ogon{ namespace sessionmanager{ namespace otsapi {
 		return messageCall->getResult();
 	}
 
+	void OTSApiHandler::waitSessionEvents(TReturnWaitSessionEvents &_return,
+		const TSTRING &authToken, const TINT64 afterSequence, const TDWORD timeout) {
+
+		_return.__set_returnValue(false);
+
+		sessionNS::SessionPtr current = APP_CONTEXT.getPermissionManager()->getSessionForToken(authToken);
+		permissionNS::LogonPermissionPtr permission;
+		bool queryOthers;
+
+		if (current) {
+			queryOthers = current->checkPermission(WTS_PERM_FLAGS_QUERY_INFORMATION);
+		} else {
+			permission = APP_CONTEXT.getPermissionManager()->getPermissionForLogon(authToken);
+			if (permission == NULL) {
+				WLog_Print(logger_OTSApiHandler, WLOG_ERROR, "Logon Permission not found!");
+				return;
+			}
+			queryOthers = ((permission->getPermission() & WTS_PERM_FLAGS_QUERY_INFORMATION) == WTS_PERM_FLAGS_QUERY_INFORMATION);
+		}
+
+		sessionNS::SessionNotifier *notifier = APP_CONTEXT.getSessionNotifier();
+
+		// a new subscriber only learns where to start from
+		if (afterSequence < 0) {
+			_return.__set_lastSequence(notifier->getLastSequence());
+			_return.__set_eventsLost(false);
+			_return.__set_returnValue(true);
+			return;
+		}
+
+		DWORD remaining = ((DWORD)timeout > OTSAPI_MAX_EVENT_WAIT) ? OTSAPI_MAX_EVENT_WAIT : (DWORD)timeout;
+		UINT64 deadline = GetTickCount64() + remaining;
+		UINT64 sequence = (UINT64)afterSequence;
+		bool eventsLost = false;
+		TSessionEventList list;
+
+		for (;;) {
+			sessionNS::SessionEventList events;
+			UINT64 lastSequence;
+
+			if (!notifier->waitForEvents(sequence, remaining, events, lastSequence)) {
+				eventsLost = true;
+			}
+			sequence = lastSequence;
+
+			for (sessionNS::SessionEventList::iterator it = events.begin(); it != events.end(); ++it) {
+				// same rules as enumerateSessionsEx, changes of foreign sessions are left out
+				if (!queryOthers) {
+					if (current) {
+						if (current->getSessionID() != it->sessionId) {
+							continue;
+						}
+					} else if ((it->domain != permission->getDomain()) ||
+							(it->userName != permission->getUsername())) {
+						continue;
+					}
+				}
+
+				TSessionEvent event;
+				event.__set_sequence(it->sequence);
+				event.__set_reason(it->reason);
+				event.__set_sessionId(it->sessionId);
+				list.push_back(event);
+			}
+
+			if (eventsLost || !list.empty()) {
+				break;
+			}
+
+			// everything was filtered out, keep waiting for the rest of the time
+			UINT64 now = GetTickCount64();
+			if (events.empty() || (now >= deadline)) {
+				break;
+			}
+			remaining = (DWORD)(deadline - now);
+		}
+
+		_return.__set_lastSequence(sequence);
+		_return.__set_eventsLost(eventsLost);
+		_return.__set_events(list);
+		_return.__set_returnValue(true);
+	}
+
 } /*otsapi*/ } /*sessionmanager*/ } /*ogon*/
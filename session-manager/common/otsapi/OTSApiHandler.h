@@ -55,6 +55,8 @@ namespace ogon{ namespace sessionmanager{ namespace otsapi {
 			const TSTRING &authToken, const TDWORD Version);
 		virtual void querySessionInformation(TReturnQuerySessionInformation &_return,
 			const TSTRING &authToken, const TDWORD sessionId, const TINT32 infoClass);
+		virtual void enumerateSessionsEx(TReturnEnumerateSessionEx &_return,
+			const TSTRING &authToken, const TDWORD Version, const TInfoClassList &infoClasses);
 		virtual bool startRemoteControlSession(const TSTRING& authToken, const TDWORD sourceLogonId,
 			const TDWORD targetLogonId, const TBYTE HotkeyVk,
 			const TINT16 HotkeyModifiers, TDWORD flags);
@@ -63,10 +65,16 @@ namespace ogon{ namespace sessionmanager{ namespace otsapi {
 		virtual TDWORD sendMessage(const TSTRING &authToken, const TDWORD sessionId,
 			const TSTRING &title, const TSTRING &message, const TDWORD style,
 			const TDWORD timeout, const TBOOL wait);
+		virtual void waitSessionEvents(TReturnWaitSessionEvents &_return,
+			const TSTRING &authToken, const TINT64 afterSequence, const TDWORD timeout);
 
 	 private:
 		sessionNS::SessionPtr getSessionAndCheckForPerm(const TSTRING &authToken,
 			UINT32 sessionId, DWORD requestedPermission);
+		void fillSessionInformation(TReturnQuerySessionInformation &_return,
+			sessionNS::SessionPtr session, const TINT32 infoClass);
+		void fillFrameStats(TReturnQuerySessionInformation &_return,
+			sessionNS::SessionPtr session, UINT32 connectionId);
 	};
 } /*otsapi*/ } /*sessionmanager*/ } /*ogon*/
 
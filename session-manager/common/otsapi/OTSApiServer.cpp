@@ -32,11 +32,14 @@
 #include <thrift/transport/TSSLServerSocket.h>
 #include <thrift/transport/TBufferTransports.h>
 #include <thrift/server/TThreadedServer.h>
+#include <thrift/TProcessor.h>
 
 #include <winpr/platform.h>
 #include <winpr/thread.h>
 #include <winpr/wlog.h>
 
+#include "../../common/global.h"
+
 #ifdef __linux__
 #include <signal.h>
 #endif
@@ -48,10 +51,52 @@ using namespace apache::thrift::server;
 
 using std::shared_ptr;
 
+#define OTSAPI_MAX_CONNECTIONS 1024
+#define OTSAPI_IDLE_TIMEOUT 300
+
 namespace ogon{ namespace sessionmanager{ namespace otsapi {
 
 	static wLog *logger_OTSApiServer = WLog_Get("ogon.sessionmanager.otsapiserver");
 
+	/**
+	 * @brief limits the number of calls running at the same time, independent
+	 * of the number of connected clients.
+	 *
+	 * waitSessionEvents only blocks until a session event arrives and is not
+	 * counted, otherwise a few waiting clients could use up all slots.
+	 */
+	class OTSApiCallLimiter : public TProcessorEventHandler {
+	public:
+		OTSApiCallLimiter(long calls) {
+			if (!(mhSlots = CreateSemaphore(NULL, calls, calls, NULL))) {
+				throw std::bad_alloc();
+			}
+		}
+
+		virtual ~OTSApiCallLimiter() {
+			CloseHandle(mhSlots);
+		}
+
+		virtual void *getContext(const char *fn_name, void *serverContext) {
+			OGON_UNUSED(serverContext);
+			if (!strcmp(fn_name, "otsapi.waitSessionEvents")) {
+				return NULL;
+			}
+			WaitForSingleObject(mhSlots, INFINITE);
+			return this;
+		}
+
+		virtual void freeContext(void *ctx, const char *fn_name) {
+			OGON_UNUSED(fn_name);
+			if (ctx) {
+				ReleaseSemaphore(mhSlots, 1, NULL);
+			}
+		}
+
+	private:
+		HANDLE mhSlots;
+	};
+
 	OTSApiServer::OTSApiServer() {
 		if (!InitializeCriticalSectionAndSpinCount(&mCSection, 0x00000400) ) {
 			WLog_Print(logger_OTSApiServer, WLOG_FATAL,
@@ -107,8 +152,15 @@ namespace ogon{ namespace sessionmanager{ namespace otsapi {
 		std::string keyFile;
 		configNS::PropertyManager *propertyManager = APP_CONTEXT.getPropertyManager();
 
+		long workers = 0;
+		long maxConnections = OTSAPI_MAX_CONNECTIONS;
+		long idleTimeout = OTSAPI_IDLE_TIMEOUT;
+
 		propertyManager->getPropertyString(0, "ssl.certificate", certFile);
 		propertyManager->getPropertyString(0, "ssl.key", keyFile);
+		propertyManager->getPropertyNumber(0, "otsapi.workers", workers);
+		propertyManager->getPropertyNumber(0, "otsapi.maxConnections", maxConnections);
+		propertyManager->getPropertyNumber(0, "otsapi.idleTimeout", idleTimeout);
 
 		if (ogon_generate_certificate(certFile, keyFile) < 0) {
 			WLog_Print(logger_OTSApiServer, WLOG_INFO, "Error ensuring certificate file");
@@ -122,13 +174,33 @@ namespace ogon{ namespace sessionmanager{ namespace otsapi {
 			shared_ptr<OTSApiHandler> handler(new OTSApiHandler());
 			shared_ptr<TProcessor> processor(new otsapiProcessor(handler));
 			shared_ptr<TSSLSocketFactory> sslfactory = getSSLSocketFactory(certFile, keyFile);
-			shared_ptr<TServerTransport> serverTransport(new TSSLServerSocket(server->getPort(), sslfactory));
+			shared_ptr<TSSLServerSocket> serverSocket(new TSSLServerSocket(server->getPort(), sslfactory));
 			shared_ptr<TTransportFactory> transportFactory(new TFramedTransportFactory());
 
-			shared_ptr<TServer> thriftServer(new TThreadedServer(processor, serverTransport, transportFactory, protocolFactory));
+			if (idleTimeout > 0) {
+				// a client waiting longer than this for its next call is disconnected,
+				// the client library reconnects on its next call
+				serverSocket->setRecvTimeout(idleTimeout * 1000);
+			}
+
+			if (workers > 0) {
+				// an idle connection must not hold a worker, so the workers only
+				// limit the calls running at the same time and every connection
+				// keeps its own (mostly blocked) thread
+				processor->setEventHandler(shared_ptr<TProcessorEventHandler>(new OTSApiCallLimiter(workers)));
+			}
+
+			shared_ptr<TServerFramework> thriftServer(new TThreadedServer(processor, serverSocket,
+				transportFactory, protocolFactory));
+			if (maxConnections > 0) {
+				// further clients wait in the listen backlog until a connection is closed
+				thriftServer->setConcurrentClientLimit(maxConnections);
+			}
+
 			server->setServer(thriftServer);
 			server->setSuccess(true);
-			WLog_Print(logger_OTSApiServer, WLOG_INFO, "OTSApiServer started on port %" PRIu32 "", server->getPort());
+			WLog_Print(logger_OTSApiServer, WLOG_INFO, "OTSApiServer started on port %" PRIu32 " (workers %ld, max connections %ld, idle timeout %lds)",
+				server->getPort(), workers, maxConnections, idleTimeout);
 			thriftServer->serve();
 			WLog_Print(logger_OTSApiServer, WLOG_INFO, "OTSApiServer stopped.");
 		} catch (const TException &tx) {
@@ -166,6 +238,8 @@ namespace ogon{ namespace sessionmanager{ namespace otsapi {
 		CSGuard guard(&mCSection);
 		if (mServer != NULL) {
 			WLog_Print(logger_OTSApiServer, WLOG_INFO, "Stopping OTSApiServer ...");
+			// release the clients blocked in waitSessionEvents, the server waits for them
+			APP_CONTEXT.getSessionNotifier()->cancelWaits();
 			mServer->stop();
 			WaitForSingleObject(mServerThread,INFINITE);
 			CloseHandle(mServerThread);
@@ -78,7 +78,7 @@ namespace ogon { namespace sessionmanager { namespace otsapi {
 		APP_CONTEXT.getRpcOutgoingQueue()->addElement(disconnectCall);
 
 		if (mWait) {
-			DWORD status = WaitForSingleObject(disconnectCall->getAnswerHandle(), mTimeout);
+			DWORD status = taskNS::ThreadPool::blockingWait(disconnectCall->getAnswerHandle(), mTimeout);
 			if (status == WAIT_TIMEOUT) {
 				WLog_Print(logger_TaskDisconnect, WLOG_DEBUG, "s %" PRIu32 ": timed out", mSessionId);
 				return false;
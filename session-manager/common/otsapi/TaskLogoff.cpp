@@ -73,7 +73,7 @@ namespace ogon { namespace sessionmanager { namespace otsapi {
 			APP_CONTEXT.getRpcOutgoingQueue()->addElement(logoffCall);
 
 			if (mWait) {
-				DWORD status = WaitForSingleObject(logoffCall->getAnswerHandle(), mTimeout);
+				DWORD status = taskNS::ThreadPool::blockingWait(logoffCall->getAnswerHandle(), mTimeout);
 				if (status == WAIT_TIMEOUT) {
 					WLog_Print(logger_TaskLogoff, WLOG_TRACE, "s %" PRIu32 ": LogOffUserSession timed out", mSessionId);
 					result = FALSE;
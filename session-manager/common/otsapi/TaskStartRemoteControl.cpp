@@ -76,7 +76,7 @@ BOOL TaskStartRemoteControl::startMessaging() {
 		return false;
 	}
 
-	WaitForSingleObject(mMessagingStarted, INFINITE);
+	taskNS::ThreadPool::blockingWait(mMessagingStarted, INFINITE);
 	return TRUE;
 }
 
@@ -128,7 +128,7 @@ void TaskStartRemoteControl::sendRemoteControlMessage() {
 
 	APP_CONTEXT.getRpcOutgoingQueue()->addElement(messageCall);
 
-	status = WaitForSingleObject(messageCall->getAnswerHandle(), 31 * 1000);
+	status = taskNS::ThreadPool::blockingWait(messageCall->getAnswerHandle(), 31 * 1000);
 	if (status == WAIT_TIMEOUT) {
 		WLog_Print(logger_taskStartRemoteControl, WLOG_TRACE, "s %" PRIu32 ": Message timed out", mSessionID);
 		mMessageResult = IDTIMEOUT;
@@ -226,7 +226,7 @@ void TaskStartRemoteControl::run() {
 
 	APP_CONTEXT.getRpcOutgoingQueue()->addElement(remoteControl);
 
-	DWORD status = WaitForSingleObject(remoteControl->getAnswerHandle(), mTimeout);
+	DWORD status = taskNS::ThreadPool::blockingWait(remoteControl->getAnswerHandle(), mTimeout);
 	if (status == WAIT_TIMEOUT) {
 		WLog_Print(logger_taskStartRemoteControl, WLOG_TRACE, "s %" PRIu32 ": OtsStartRemoteControl timed out", mSessionID);
 		return;
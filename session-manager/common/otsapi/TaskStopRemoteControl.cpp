@@ -72,7 +72,7 @@ namespace ogon { namespace sessionmanager { namespace otsapi {
 		callNS::CallOutOtsApiStopRemoteControlPtr stopRemoteControlCall(new callNS::CallOutOtsApiStopRemoteControl());
 		stopRemoteControlCall->setConnectionId(connectionId);
 		APP_CONTEXT.getRpcOutgoingQueue()->addElement(stopRemoteControlCall);
-		DWORD status = WaitForSingleObject(stopRemoteControlCall->getAnswerHandle(), mTimeOut);
+		DWORD status = taskNS::ThreadPool::blockingWait(stopRemoteControlCall->getAnswerHandle(), mTimeOut);
 		if (status == WAIT_TIMEOUT) {
 			WLog_Print(logger_taskStopRemoteControl, WLOG_TRACE, "s %" PRIu32 ": OtsApiStopRemoteContro timed out", mSessionId);
 		} else {
@@ -40,6 +40,8 @@
 #include <winpr/wlog.h>
 
 #include <ogon/version.h>
+#include <ICP.pb.h>
+#include <SBP.pb.h>
 
 #include <arpa/inet.h>
 
@@ -55,9 +57,36 @@ static wLog *logger_RPCEngine = WLog_Get("ogon.pbrpc.rpcengine");
 namespace ogon { namespace pbrpc {
 
 
+	/**
+	 * @brief prepares a decoded incoming call on the dispatch pool
+	 */
+	class TaskDispatchCallIn: public taskNS::Task {
+	public:
+		TaskDispatchCallIn(callNS::CallInPtr call, RpcEngine *engine)
+			: mCall(call), mEngine(engine) {}
+		virtual ~TaskDispatchCallIn() {}
+
+		virtual void run() {
+			if (!mCall->prepare()) {
+				//error could not prepare, sending error response
+				APP_CONTEXT.getRpcOutgoingQueue()->addElement(mCall);
+			}
+			mEngine->callInDispatched(mCall->getConnectionId());
+		}
+
+		virtual void abortTask() {
+			mEngine->callInDispatched(mCall->getConnectionId());
+		}
+
+	private:
+		callNS::CallInPtr mCall;
+		RpcEngine *mEngine;
+	};
+
 	RpcEngine::RpcEngine() : mhClientPipe(INVALID_HANDLE_VALUE),
 		mhServerPipe(INVALID_HANDLE_VALUE), mhServerThread(INVALID_HANDLE_VALUE),
-		mPacktLength(0), mHeaderRead(0), mFirstPacket(TRUE), mPayloadRead(0), mNextOutCall(1)
+		mPacktLength(0), mHeaderRead(0), mFirstPacket(TRUE), mPayloadRead(0),
+		mDispatchPool("rpc dispatch"), mNextOutCall(1)
 	{
 		if (!InitializeCriticalSectionAndSpinCount(&mCSection, 0x00000400)) {
 			WLog_Print(logger_RPCEngine, WLOG_ERROR,
@@ -65,6 +94,12 @@ namespace ogon { namespace pbrpc {
 			throw std::bad_alloc();
 		}
 
+		if (!InitializeCriticalSectionAndSpinCount(&mDispatchCSection, 0x00000400)) {
+			WLog_Print(logger_RPCEngine, WLOG_ERROR,
+				"Failed to initialize rpc dispatch critical section");
+			throw std::bad_alloc();
+		}
+
 		if (!(mhStopEvent = CreateEvent(NULL, TRUE, FALSE, NULL))) {
 			WLog_Print(logger_RPCEngine, WLOG_ERROR,
 				"Failed to create rpc engine stop event");
@@ -73,6 +108,7 @@ namespace ogon { namespace pbrpc {
 	}
 
 	RpcEngine::~RpcEngine() {
+		DeleteCriticalSection(&mDispatchCSection);
 		DeleteCriticalSection(&mCSection);
 		CloseHandle(mhStopEvent);
 		google::protobuf::ShutdownProtobufLibrary();
@@ -100,11 +136,17 @@ namespace ogon { namespace pbrpc {
 
 		CSGuard guard(&mCSection);
 
+		if (!mDispatchPool.start(RPC_DISPATCH_THREADS)) {
+			WLog_Print(logger_RPCEngine, WLOG_ERROR, "failed to start dispatch pool");
+			return false;
+		}
+
 		if (!(mhServerThread = CreateThread(NULL, 0,
 				(LPTHREAD_START_ROUTINE) RpcEngine::listenerThread, (void*)this,
 				0, NULL)))
 		{
 			WLog_Print(logger_RPCEngine, WLOG_ERROR, "failed to create thread");
+			mDispatchPool.stop();
 			return false;
 		}
 		return true;
@@ -117,6 +159,9 @@ namespace ogon { namespace pbrpc {
 			WaitForSingleObject(mhServerThread, INFINITE);
 			CloseHandle(mhServerThread);
 			mhServerThread = NULL;
+			mDispatchPool.stop();
+			CSGuard dispatchGuard(&mDispatchCSection);
+			mDispatchStrands.clear();
 		}
 		return true;
 	}
@@ -155,21 +200,25 @@ namespace ogon { namespace pbrpc {
 			}
 			engine->resetStatus();
 			APP_CONTEXT.rpcDisconnected();
-
-			if (engine->mAnswerWaitingQueue.size()) {
-				WLog_Print(logger_RPCEngine, WLOG_WARN, "answer waiting queue not empty, discarding entries!");
-				std::list<callNS::CallOutPtr>::iterator it;
-				for ( it = engine->mAnswerWaitingQueue.begin(); it != engine->mAnswerWaitingQueue.end(); ++it) {
-					callNS::CallOutPtr currentCallOut = (callNS::CallOutPtr)(*it);
-					currentCallOut->setResult(2);
-				}
-				engine->mAnswerWaitingQueue.clear();
-			}
+			engine->abortWaitingCalls();
 		}
 		WLog_Print(logger_RPCEngine, WLOG_TRACE, "stopped RPC listener thread");
 		return;
 	}
 
+	void RpcEngine::abortWaitingCalls() {
+		if (mAnswerWaitingCalls.empty()) {
+			return;
+		}
+
+		WLog_Print(logger_RPCEngine, WLOG_WARN, "answer waiting queue not empty, discarding entries!");
+		std::unordered_map<uint32_t, callNS::CallOutPtr>::iterator it;
+		for (it = mAnswerWaitingCalls.begin(); it != mAnswerWaitingCalls.end(); ++it) {
+			it->second->setResult(2);
+		}
+		mAnswerWaitingCalls.clear();
+	}
+
 	HANDLE RpcEngine::acceptClient() {
 		DWORD nCount;
 		HANDLE events[2];
@@ -285,16 +334,11 @@ namespace ogon { namespace pbrpc {
 			// search the stored call to fill back answer
 
 			callNS::CallOutPtr foundCallOut;
-			std::list<callNS::CallOutPtr>::iterator it;
-
-			for ( it = mAnswerWaitingQueue.begin(); it != mAnswerWaitingQueue.end(); it++) {
-				callNS::CallOutPtr currentCallOut = (callNS::CallOutPtr)(*it);
+			std::unordered_map<uint32_t, callNS::CallOutPtr>::iterator it = mAnswerWaitingCalls.find(callID);
 
-				if (currentCallOut->getTag() == callID) {
-					foundCallOut = currentCallOut;
-					mAnswerWaitingQueue.remove(foundCallOut);
-					break;
-				}
+			if (it != mAnswerWaitingCalls.end()) {
+				foundCallOut = it->second;
+				mAnswerWaitingCalls.erase(it);
 			}
 
 			if (foundCallOut == NULL) {
@@ -315,6 +359,7 @@ namespace ogon { namespace pbrpc {
 			} else if (mpbRPC.status() == RPCBase_RPCSTATUS_NOTFOUND) {
 				foundCallOut->setResult(2);
 			}
+			observeLatency(true, callType, foundCallOut->getElapsedMicroseconds());
 			return CLIENT_SUCCESS;
 		}
 
@@ -365,11 +410,7 @@ namespace ogon { namespace pbrpc {
 			WLog_Print(logger_RPCEngine, WLOG_TRACE, "call upacked for callType=%" PRIu32 " and callID=%" PRIu32 "",
 				callType, callID);
 
-			createdCallIn->decodeRequest();
-			if (!createdCallIn->prepare()) {
-				//error could not prepare, sending error response
-				APP_CONTEXT.getRpcOutgoingQueue()->addElement(createdCallIn);
-			}
+			dispatchCallIn(createdCallIn);
 			return CLIENT_SUCCESS;
 		}
 
@@ -379,6 +420,56 @@ namespace ogon { namespace pbrpc {
 		return CLIENT_ERROR;
 	}
 
+	void RpcEngine::dispatchCallIn(callNS::CallInPtr call) {
+		call->decodeRequest();
+
+		UINT32 connectionId = call->getConnectionId();
+		if (call->isDispatchable() && !connectionId) {
+			if (mDispatchPool.addTask(taskNS::TaskPtr(new TaskDispatchCallIn(call, this)))) {
+				return;
+			}
+			WLog_Print(logger_RPCEngine, WLOG_WARN,
+				"dispatch pool not available, preparing callID=%" PRIu32 " inline", call->getTag());
+		} else if (connectionId) {
+			// Dispatchable calls may block (authentication, property lookups),
+			// don't stall the pipe. Calls for a connection are prepared in
+			// order, so once one of them went to the pool, the following ones
+			// are queued on the same strand until it ran empty.
+			CSGuard guard(&mDispatchCSection);
+			std::unordered_map<UINT32, DispatchStrand>::iterator it = mDispatchStrands.find(connectionId);
+			if (call->isDispatchable() || it != mDispatchStrands.end()) {
+				if (it == mDispatchStrands.end()) {
+					taskNS::StrandPtr strand(new taskNS::Strand(mDispatchPool));
+					it = mDispatchStrands.insert(std::make_pair(connectionId, DispatchStrand(strand, 0))).first;
+				}
+				taskNS::StrandPtr strand = it->second.first;
+				it->second.second++;
+				if (strand->addTask(taskNS::TaskPtr(new TaskDispatchCallIn(call, this)))) {
+					return;
+				}
+				guard.leaveGuard();
+				WLog_Print(logger_RPCEngine, WLOG_WARN,
+					"dispatch pool not available, preparing callID=%" PRIu32 " inline", call->getTag());
+			}
+		}
+
+		if (!call->prepare()) {
+			//error could not prepare, sending error response
+			APP_CONTEXT.getRpcOutgoingQueue()->addElement(call);
+		}
+	}
+
+	void RpcEngine::callInDispatched(UINT32 connectionId) {
+		CSGuard guard(&mDispatchCSection);
+		std::unordered_map<UINT32, DispatchStrand>::iterator it = mDispatchStrands.find(connectionId);
+		if (it == mDispatchStrands.end()) {
+			return;
+		}
+		if (--it->second.second == 0) {
+			mDispatchStrands.erase(it);
+		}
+	}
+
 	int RpcEngine::send(ogon::sessionmanager::call::CallPtr call) {
 		std::string serialized;
 
@@ -411,6 +502,7 @@ namespace ogon { namespace pbrpc {
 			}
 
 			mpbRPC.SerializeToString(&serialized);
+			observeLatency(false, callIn->getCallType(), callIn->getElapsedMicroseconds());
 			return sendInternal(serialized);
 		}
 
@@ -546,6 +638,32 @@ namespace ogon { namespace pbrpc {
 		return retValue;
 	}
 
+	void RpcEngine::observeLatency(bool outgoing, uint32_t callType, uint64_t microseconds) {
+		std::pair<bool, uint32_t> key(outgoing, callType);
+		std::map<std::pair<bool, uint32_t>, metricsNS::Histogram *>::iterator it = mLatencyHistograms.find(key);
+
+		if (it == mLatencyHistograms.end()) {
+			// only called from the engine thread, the lookup in the registry happens once per type
+			std::string type;
+			if (ogon::icp::MSGTYPE_IsValid(callType)) {
+				type = ogon::icp::MSGTYPE_Name((ogon::icp::MSGTYPE)callType);
+			} else if (ogon::sbp::MSGTYPE_IsValid(callType)) {
+				type = ogon::sbp::MSGTYPE_Name((ogon::sbp::MSGTYPE)callType);
+			} else {
+				type = std::to_string(callType);
+			}
+
+			std::string labels = std::string("direction=\"") + (outgoing ? "out" : "in") +
+				"\",type=\"" + metricsNS::escapeLabel(type) + "\"";
+			metricsNS::Histogram *histogram = APP_CONTEXT.getMetricsRegistry()->getHistogram(
+				"ogon_icp_call_seconds", "Time from creating an ICP call until its response",
+				metricsNS::exponentialBuckets(100, 4, 10), 1000000, labels);
+			it = mLatencyHistograms.insert(std::make_pair(key, histogram)).first;
+		}
+
+		it->second->observe(microseconds);
+	}
+
 	int RpcEngine::processOutgoingCall(ogon::sessionmanager::call::CallPtr call) {
 		int retVal;
 
@@ -556,7 +674,7 @@ namespace ogon { namespace pbrpc {
 			callOut->setTag(mNextOutCall++);
 
 			if ((retVal = send(call)) == CLIENT_SUCCESS) {
-				mAnswerWaitingQueue.push_back(callOut);
+				mAnswerWaitingCalls[callOut->getTag()] = callOut;
 				return retVal;
 			}
 
@@ -28,9 +28,15 @@
 #include <pbRPC.pb.h>
 #include <call/Call.h>
 #include <call/CallOut.h>
-#include <list>
+#include <call/CallIn.h>
+#include <task/ThreadPool.h>
+#include <task/Strand.h>
+#include <metrics/MetricsRegistry.h>
+#include <map>
+#include <unordered_map>
 
 #define PIPE_BUFFER_SIZE	0xFFFF
+#define RPC_DISPATCH_THREADS	4
 
 namespace ogon { namespace pbrpc {
 
@@ -44,10 +50,13 @@ namespace ogon { namespace pbrpc {
 		uid_t uid;
 	} PeerCredentials;
 
+	class TaskDispatchCallIn;
+
 	/**
 	 * @brief
 	 */
 	class RpcEngine {
+		friend class TaskDispatchCallIn;
 	public:
 		RpcEngine();
 		~RpcEngine();
@@ -72,6 +81,10 @@ namespace ogon { namespace pbrpc {
 		int sendError(uint32_t callID, uint32_t callType);
 		int sendInternal(const std::string &data);
 		int processOutgoingCall(ogon::sessionmanager::call::CallPtr call);
+		void dispatchCallIn(callNS::CallInPtr call);
+		void callInDispatched(UINT32 connectionId);
+		void abortWaitingCalls();
+		void observeLatency(bool outgoing, uint32_t callType, uint64_t microseconds);
 
 	private:
 		CRITICAL_SECTION mCSection;
@@ -92,7 +105,14 @@ namespace ogon { namespace pbrpc {
 		BYTE mPayloadBuffer[PIPE_BUFFER_SIZE];
 
 		RPCBase mpbRPC;
-		std::list<callNS::CallOutPtr> mAnswerWaitingQueue;
+		std::unordered_map<uint32_t, callNS::CallOutPtr> mAnswerWaitingCalls;
+		taskNS::ThreadPool mDispatchPool;
+
+		// per connection strand and number of calls still queued on it
+		typedef std::pair<taskNS::StrandPtr, size_t> DispatchStrand;
+		std::unordered_map<UINT32, DispatchStrand> mDispatchStrands;
+		CRITICAL_SECTION mDispatchCSection;
+		std::map<std::pair<bool, uint32_t>, metricsNS::Histogram *> mLatencyHistograms;
 
 		long mNextOutCall;
 	};
@@ -30,12 +30,23 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include <errno.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
 #endif
 
 
 #include "ProcessMonitor.h"
 
+#include <list>
+
 #include <appcontext/ApplicationContext.h>
 #include <utils/CSGuard.h>
 
@@ -43,13 +54,11 @@
 #include <winpr/thread.h>
 #include <winpr/wlog.h>
 
-#include <session/TaskEnd.h>
-
 namespace ogon { namespace sessionmanager { namespace process {
 
 	static wLog *logger_ProcessMonitor = WLog_Get("ogon.sessionmanager.process.processmonitor");
 
-	ProcessMonitor::ProcessMonitor() {
+	ProcessMonitor::ProcessMonitor() : mEpollFd(-1), mWakeFd(-1), mSignalFd(-1) {
 		if (!(mhStopEvent = CreateEvent(NULL, TRUE, FALSE, NULL))) {
 			WLog_Print(logger_ProcessMonitor, WLOG_FATAL,
 				"Failed to create process monitor stop event");
@@ -60,11 +69,51 @@ namespace ogon { namespace sessionmanager { namespace process {
 				"Failed to initialize process monitor critical section");
 			throw std::bad_alloc();
 		}
+#ifdef __linux__
+		struct epoll_event event;
+		sigset_t set;
+
+		if ((mEpollFd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+			WLog_Print(logger_ProcessMonitor, WLOG_FATAL,
+				"Failed to create process monitor epoll set (errno=%d)", errno);
+			throw std::bad_alloc();
+		}
+		if ((mWakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+			WLog_Print(logger_ProcessMonitor, WLOG_FATAL,
+				"Failed to create process monitor wakeup fd (errno=%d)", errno);
+			throw std::bad_alloc();
+		}
+
+		// SIGCHLD is blocked in all threads, see main()
+		sigemptyset(&set);
+		sigaddset(&set, SIGCHLD);
+		if ((mSignalFd = signalfd(-1, &set, SFD_CLOEXEC | SFD_NONBLOCK)) < 0) {
+			WLog_Print(logger_ProcessMonitor, WLOG_FATAL,
+				"Failed to create process monitor signal fd (errno=%d)", errno);
+			throw std::bad_alloc();
+		}
+
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.u64 = 0;
+		epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeFd, &event);
+		event.data.u64 = 1;
+		epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mSignalFd, &event);
+#endif
 		mhServerThread = NULL;
 		mRunning = false;
 	}
 
 	ProcessMonitor::~ProcessMonitor() {
+		std::map<DWORD, RDS_PROCESS_INFO>::iterator iter;
+		for (iter = mProcessInfos.begin(); iter != mProcessInfos.end(); ++iter) {
+			closeWatch(iter->second);
+		}
+#ifdef __linux__
+		close(mSignalFd);
+		close(mWakeFd);
+		close(mEpollFd);
+#endif
 		DeleteCriticalSection(&mCSection);
 		CloseHandle(mhStopEvent);
 	}
@@ -95,6 +144,8 @@ namespace ogon { namespace sessionmanager { namespace process {
 		mRunning = false;
 		if (mhServerThread) {
 			SetEvent(mhStopEvent);
+			wakeup();
+			guard.leaveGuard();
 			WaitForSingleObject(mhServerThread, INFINITE);
 			CloseHandle(mhServerThread);
 			mhServerThread = NULL;
@@ -106,72 +157,157 @@ namespace ogon { namespace sessionmanager { namespace process {
 		return true;
 	}
 
-	void ProcessMonitor::run() {
-		int status;
-		bool erase;
-		pid_t w;
-		std::list<RDS_PROCESS_INFO>::iterator iter;
-		std::map<UINT32, sessionNS::TaskEndPtr> endSessions;
+	void ProcessMonitor::wakeup() {
+#ifdef __linux__
+		UINT64 value = 1;
+		if (write(mWakeFd, &value, sizeof(value)) != sizeof(value)) {
+			WLog_Print(logger_ProcessMonitor, WLOG_ERROR,
+				"failed to signal process monitor thread (errno=%d)", errno);
+		}
+#endif
+	}
 
-		while (1) {
-			EnterCriticalSection(&mCSection);
-			iter = mProcessInfos.begin();
-
-			while (iter != mProcessInfos.end()) {
-				RDS_PROCESS_INFO info = *iter;
-				erase = false;
-				w = waitpid((pid_t) info.processId, &status, WNOHANG);
-
-				if (w > 0) {
-					WLog_Print(logger_ProcessMonitor, WLOG_TRACE, "Registered process %" PRIu32 " exited (status: %d)", info.processId, status);
-					erase = true;
-					if (info.terminateSessionOnExit) {
-						// shutdown the session
-						sessionNS::SessionPtr session = APP_CONTEXT.getSessionStore()->getSession(info.sessionId);
-						if (session) {
-							if (!session->isCurrentModule(info.context)) {
-								WLog_Print(logger_ProcessMonitor, WLOG_TRACE, "Shutdown was for previous module");
-							} else {
-								WLog_Print(logger_ProcessMonitor, WLOG_INFO, "s %" PRIu32 ": Process %" PRIu32 " exited, creating TaskEnd for session", info.sessionId, info.processId);
-								sessionNS::TaskEndPtr end(new sessionNS::TaskEnd());
-								end->setSessionId(info.sessionId);
-								endSessions[info.sessionId] = end;
-							}
-						}
+	void ProcessMonitor::closeWatch(RDS_PROCESS_INFO &info) {
+#ifdef __linux__
+		if (info.pidfd >= 0) {
+			epoll_ctl(mEpollFd, EPOLL_CTL_DEL, info.pidfd, NULL);
+			close(info.pidfd);
+			info.pidfd = -1;
+		}
+#endif
+	}
+
+	void ProcessMonitor::checkProcess(DWORD processId) {
+		// called with mCSection held
+		int status = 0;
+		bool erase = false;
+
+		std::map<DWORD, RDS_PROCESS_INFO>::iterator iter = mProcessInfos.find(processId);
+		if (iter == mProcessInfos.end()) {
+			return;
+		}
+		RDS_PROCESS_INFO &info = iter->second;
+
+		pid_t w = waitpid((pid_t) info.processId, &status, WNOHANG);
+
+		if (w > 0) {
+			WLog_Print(logger_ProcessMonitor, WLOG_TRACE, "Registered process %" PRIu32 " exited (status: %d)", info.processId, status);
+			erase = true;
+			if (info.terminateSessionOnExit) {
+				// shutdown the session
+				sessionNS::SessionPtr session = APP_CONTEXT.getSessionStore()->getSession(info.sessionId);
+				if (session) {
+					if (!session->isCurrentModule(info.context)) {
+						WLog_Print(logger_ProcessMonitor, WLOG_TRACE, "Shutdown was for previous module");
+					} else {
+						WLog_Print(logger_ProcessMonitor, WLOG_INFO, "s %" PRIu32 ": Process %" PRIu32 " exited, creating TaskEnd for session", info.sessionId, info.processId);
+						sessionNS::TaskEndPtr end(new sessionNS::TaskEnd());
+						end->setSessionId(info.sessionId);
+						mEndSessions[info.sessionId] = end;
 					}
-				} else if (w == -1 && errno == ECHILD) {
-					WLog_Print(logger_ProcessMonitor, WLOG_ERROR, "waitpid(%" PRIu32 ") failed (status: %d, errno=ECHILD) ", info.processId, status);
-					erase = true;
 				}
+			}
+		} else if (w == -1 && errno == ECHILD) {
+			WLog_Print(logger_ProcessMonitor, WLOG_ERROR, "waitpid(%" PRIu32 ") failed (status: %d, errno=ECHILD) ", info.processId, status);
+			erase = true;
+		}
+
+		if (erase) {
+			closeWatch(info);
+			mProcessInfos.erase(iter);
+		}
+	}
+
+	void ProcessMonitor::checkUnwatchedProcesses() {
+		// called with mCSection held
+		std::list<DWORD> processIds;
+		std::map<DWORD, RDS_PROCESS_INFO>::iterator iter;
 
-				if (erase) {
-					mProcessInfos.erase(iter++);
-				} else {
-					++iter;
+		for (iter = mProcessInfos.begin(); iter != mProcessInfos.end(); ++iter) {
+			if (iter->second.pidfd < 0) {
+				processIds.push_back(iter->first);
+			}
+		}
+
+		for (std::list<DWORD>::iterator it = processIds.begin(); it != processIds.end(); ++it) {
+			checkProcess(*it);
+		}
+	}
+
+	void ProcessMonitor::endSessions() {
+		std::map<UINT32, sessionNS::TaskEndPtr> endSessions;
+		{
+			CSGuard guard(&mCSection);
+			endSessions.swap(mEndSessions);
+		}
+
+		std::map<UINT32, sessionNS::TaskEndPtr>::iterator endSessionsIt;
+		for (endSessionsIt = endSessions.begin(); endSessionsIt != endSessions.end(); ++endSessionsIt) {
+			WLog_Print(logger_ProcessMonitor, WLOG_TRACE, "adding end task for session %" PRIu32, endSessionsIt->first);
+			sessionNS::SessionPtr session = APP_CONTEXT.getSessionStore()->getSession(endSessionsIt->first);
+			if (session) {
+				session->addTask(endSessionsIt->second);
+			} else {
+				WLog_Print(logger_ProcessMonitor, WLOG_INFO, "session object for s %" PRIu32 " not found - ignoring", endSessionsIt->first);
+			}
+		}
+	}
+
+#ifdef __linux__
+	void ProcessMonitor::run() {
+		struct epoll_event events[32];
+		struct signalfd_siginfo siginfo;
+		UINT64 value;
+
+		while (1) {
+			int count = epoll_wait(mEpollFd, events, 32, -1);
+			if (count < 0) {
+				if (errno == EINTR) {
+					continue;
 				}
+				WLog_Print(logger_ProcessMonitor, WLOG_ERROR, "epoll_wait failed (errno=%d)", errno);
+				break;
 			}
 
-			LeaveCriticalSection(&mCSection);
+			if (WaitForSingleObject(mhStopEvent, 0) == WAIT_OBJECT_0) {
+				break;
+			}
 
-			std::map<UINT32, sessionNS::TaskEndPtr>::iterator endSessionsIt;
-			endSessionsIt = endSessions.begin();
-			while (endSessionsIt != endSessions.end()) {
-				WLog_Print(logger_ProcessMonitor, WLOG_TRACE, "adding end task for session %" PRIu32, endSessionsIt->first);
-				sessionNS::SessionPtr session = APP_CONTEXT.getSessionStore()->getSession(endSessionsIt->first);
-				if (session) {
-					session->addTask(endSessionsIt->second);
-				} else {
-					WLog_Print(logger_ProcessMonitor, WLOG_INFO, "session object for s %" PRIu32 " not found - ignoring", endSessionsIt->first);
+			{
+				CSGuard guard(&mCSection);
+				for (int i = 0; i < count; i++) {
+					if (events[i].data.u64 == 0) {
+						// wakeup, sessions to end were queued by addProcess
+						while (read(mWakeFd, &value, sizeof(value)) == sizeof(value));
+					} else if (events[i].data.u64 == 1) {
+						// SIGCHLD, drain the signalfd and check processes without pidfd
+						while (read(mSignalFd, &siginfo, sizeof(siginfo)) == sizeof(siginfo));
+						checkUnwatchedProcesses();
+					} else if (events[i].data.u64 > 1) {
+						checkProcess((DWORD) (events[i].data.u64 >> 32));
+					}
 				}
-				++endSessionsIt;
 			}
-			endSessions.clear();
+
+			endSessions();
+		}
+	}
+#else
+	void ProcessMonitor::run() {
+		while (1) {
+			{
+				CSGuard guard(&mCSection);
+				checkUnwatchedProcesses();
+			}
+
+			endSessions();
 
 			if (WaitForSingleObject(mhStopEvent, 200) == WAIT_OBJECT_0) {
 				break;
 			}
 		}
 	}
+#endif
 
 	void ProcessMonitor::addProcess(DWORD processId, UINT32 sessionId, bool terminateSessionOnExit, RDS_MODULE_COMMON *context) {
 		CSGuard guard(&mCSection);
@@ -180,19 +316,51 @@ namespace ogon { namespace sessionmanager { namespace process {
 		info.sessionId = sessionId;
 		info.terminateSessionOnExit = terminateSessionOnExit;
 		info.context = context;
-		mProcessInfos.push_back(info);
+		info.pidfd = -1;
+
+		std::map<DWORD, RDS_PROCESS_INFO>::iterator iter = mProcessInfos.find(processId);
+		if (iter != mProcessInfos.end()) {
+			closeWatch(iter->second);
+		}
+
+#ifdef __linux__
+		int pidfd = (int) syscall(SYS_pidfd_open, (pid_t) processId, 0);
+		if (pidfd >= 0) {
+			struct epoll_event event;
+			memset(&event, 0, sizeof(event));
+			event.events = EPOLLIN;
+			// the upper half identifies the process, 0 and 1 are reserved
+			event.data.u64 = ((UINT64) processId << 32) | 2;
+			if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, pidfd, &event) == 0) {
+				info.pidfd = pidfd;
+			} else {
+				close(pidfd);
+			}
+		} else if (errno != ENOSYS) {
+			WLog_Print(logger_ProcessMonitor, WLOG_DEBUG,
+				"pidfd_open(%" PRIu32 ") failed (errno=%d), falling back to SIGCHLD", processId, errno);
+		}
+#endif
+		mProcessInfos[processId] = info;
+
+		if (info.pidfd < 0) {
+			// the process might have exited before we were watching
+			checkProcess(processId);
+			if (!mEndSessions.empty()) {
+				wakeup();
+			}
+		}
 	}
 
 	bool ProcessMonitor::removeProcess(DWORD processId) {
 		CSGuard guard(&mCSection);
-		std::list<RDS_PROCESS_INFO>::iterator iter;
-		for(iter = mProcessInfos.begin(); iter != mProcessInfos.end(); iter++) {
-			if ((*iter).processId == processId) {
-				mProcessInfos.erase(iter);
-				return true;
-			}
+		std::map<DWORD, RDS_PROCESS_INFO>::iterator iter = mProcessInfos.find(processId);
+		if (iter == mProcessInfos.end()) {
+			return false;
 		}
-		return false;
+		closeWatch(iter->second);
+		mProcessInfos.erase(iter);
+		return true;
 	}
 
 	void* ProcessMonitor::execThread(void *arg) {
@@ -25,9 +25,10 @@
 #define _OGON_SMGR_PROCESSMONITOR_H_
 
 #include <ogon/module.h>
+#include <session/TaskEnd.h>
 #include <winpr/wtypes.h>
 #include <winpr/synch.h>
-#include <list>
+#include <map>
 
 namespace ogon { namespace sessionmanager { namespace process {
 
@@ -39,12 +40,18 @@ namespace ogon { namespace sessionmanager { namespace process {
 		UINT32 sessionId;
 		bool terminateSessionOnExit;
 		RDS_MODULE_COMMON *context;
+		int pidfd;
 	};
 
 	typedef struct _RDS_PROCESS_INFO RDS_PROCESS_INFO;
 
 	/**
-	 * @brief
+	 * @brief waits for registered child processes to exit.
+	 *
+	 * On Linux every process is watched by a pidfd in an epoll set, so exits
+	 * are handled immediately. If pidfds are not supported by the kernel
+	 * SIGCHLD is received with a signalfd instead and only then all processes
+	 * without a pidfd are checked. Other platforms poll.
 	 */
 	class ProcessMonitor {
 	public:
@@ -63,12 +70,22 @@ namespace ogon { namespace sessionmanager { namespace process {
 	private:
 		static void* execThread(void *arg);
 
+		void checkProcess(DWORD processId);
+		void checkUnwatchedProcesses();
+		void closeWatch(RDS_PROCESS_INFO &info);
+		void wakeup();
+		void endSessions();
+
 	private:
 		CRITICAL_SECTION mCSection;
 		HANDLE mhStopEvent;
 		HANDLE mhServerThread;
 		bool mRunning;
-		std::list<RDS_PROCESS_INFO> mProcessInfos;
+		std::map<DWORD, RDS_PROCESS_INFO> mProcessInfos;
+		std::map<UINT32, sessionNS::TaskEndPtr> mEndSessions;
+		int mEpollFd;
+		int mWakeFd;
+		int mSignalFd;
 	};
 
 } /*process*/ } /*sessionmanager*/ } /*ogon*/
@@ -0,0 +1,249 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Worker pool running the authentication of connections
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "AuthWorkerPool.h"
+
+#include <appcontext/ApplicationContext.h>
+#include <utils/CSGuard.h>
+#include <winpr/wlog.h>
+
+namespace ogon { namespace sessionmanager { namespace session {
+
+	static wLog *logger_AuthWorkerPool = WLog_Get("ogon.sessionmanager.session.authworkerpool");
+
+	/**
+	 * @brief pool task running one authentication request.
+	 */
+	class TaskAuthenticate : public taskNS::Task {
+	public:
+		TaskAuthenticate(AuthWorkerPool *pool, AuthWorkerPool::AuthRequestPtr request)
+			: mPool(pool), mRequest(request) {}
+
+		virtual void run() {
+			mPool->runRequest(mRequest);
+		}
+
+		virtual void abortTask() {
+			mPool->finishRequest(mRequest, AUTH_WORKER_ABORTED);
+		}
+
+	private:
+		AuthWorkerPool *mPool;
+		AuthWorkerPool::AuthRequestPtr mRequest;
+	};
+
+	AuthWorkerPool::AuthWorkerPool() : mPool("auth"), mRunning(false), mQueueDepth(0),
+		mMaxQueueDepth(0), mInFlight(0), mCompleted(0), mSerialized(0),
+		mTotalLatency(0), mMaxLatency(0) {
+		if (!InitializeCriticalSectionAndSpinCount(&mCSection, 0x00000400)) {
+			WLog_Print(logger_AuthWorkerPool, WLOG_FATAL,
+				"Failed to initialize auth worker pool critical section");
+			throw std::bad_alloc();
+		}
+	}
+
+	AuthWorkerPool::~AuthWorkerPool() {
+		DeleteCriticalSection(&mCSection);
+	}
+
+	bool AuthWorkerPool::start() {
+		long workers = AUTH_WORKER_THREADS;
+		APP_CONTEXT.getPropertyManager()->getPropertyNumber(0, "auth.workers", workers);
+		if (workers < 1) {
+			workers = 1;
+		}
+
+		CSGuard guard(&mCSection);
+		if (mRunning) {
+			WLog_Print(logger_AuthWorkerPool, WLOG_ERROR, "auth worker pool already started!");
+			return false;
+		}
+		if (!mPool.start(workers)) {
+			WLog_Print(logger_AuthWorkerPool, WLOG_ERROR, "failed to start auth worker pool");
+			return false;
+		}
+		mRunning = true;
+		return true;
+	}
+
+	bool AuthWorkerPool::stop() {
+		TUserQueueMap queues;
+		{
+			CSGuard guard(&mCSection);
+			if (!mRunning) {
+				WLog_Print(logger_AuthWorkerPool, WLOG_ERROR, "auth worker pool was not started before.");
+				return false;
+			}
+			mRunning = false;
+		}
+
+		// aborts the requests queued on the pool
+		mPool.stop();
+
+		{
+			CSGuard guard(&mCSection);
+			queues.swap(mUserQueues);
+			mQueueDepth = 0;
+		}
+
+		// the workers are gone, so whatever is left was never started
+		for (TUserQueueMap::iterator it = queues.begin(); it != queues.end(); ++it) {
+			std::list<AuthRequestPtr>::iterator requestIt;
+			for (requestIt = it->second.begin(); requestIt != it->second.end(); ++requestIt) {
+				(*requestIt)->callback(AUTH_WORKER_ABORTED, (*requestIt)->domain);
+			}
+		}
+
+		AuthWorkerPoolStats stats = getStats();
+		WLog_Print(logger_AuthWorkerPool, WLOG_DEBUG,
+			"completed %" PRIu64 " authentications (%" PRIu64 " serialized), max queue depth %" PRIuz ", average latency %" PRIu64 "us, max latency %" PRIu64 "us",
+			stats.completed, stats.serialized, stats.maxQueueDepth, stats.averageLatency, stats.maxLatency);
+		return true;
+	}
+
+	bool AuthWorkerPool::authenticate(ConnectionPtr connection, const std::string &username,
+			const std::string &domain, const std::string &password, UINT32 sessionId,
+			AuthCallback callback) {
+		AuthRequestPtr request(new AuthRequest());
+		request->key = TUserKey(username, domain);
+		// all anonymous requests would share a single key
+		request->serialized = !username.empty();
+		request->connection = connection;
+		request->username = username;
+		request->domain = domain;
+		request->password = password;
+		request->sessionId = sessionId;
+		request->callback = callback;
+		request->queued = std::chrono::steady_clock::now();
+
+		CSGuard guard(&mCSection);
+		if (!mRunning) {
+			return false;
+		}
+
+		mQueueDepth++;
+		if (mQueueDepth > mMaxQueueDepth) {
+			mMaxQueueDepth = mQueueDepth;
+		}
+
+		if (!request->serialized) {
+			if (!schedule(request)) {
+				mQueueDepth--;
+				return false;
+			}
+			return true;
+		}
+
+		std::list<AuthRequestPtr> &queue = mUserQueues[request->key];
+		queue.push_back(request);
+
+		if (queue.size() > 1) {
+			// another request of this user is in flight
+			mSerialized++;
+			return true;
+		}
+
+		if (!schedule(request)) {
+			queue.pop_back();
+			mUserQueues.erase(request->key);
+			mQueueDepth--;
+			return false;
+		}
+		return true;
+	}
+
+	bool AuthWorkerPool::schedule(AuthRequestPtr request) {
+		return mPool.addTask(taskNS::TaskPtr(new TaskAuthenticate(this, request)));
+	}
+
+	void AuthWorkerPool::runRequest(AuthRequestPtr request) {
+		{
+			CSGuard guard(&mCSection);
+			UINT64 latency = std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - request->queued).count();
+			mTotalLatency += latency;
+			if (latency > mMaxLatency) {
+				mMaxLatency = latency;
+			}
+			mQueueDepth--;
+			mInFlight++;
+		}
+
+		int authStatus = request->connection->authenticateUser(request->username, request->domain,
+				request->password, request->sessionId);
+
+		{
+			CSGuard guard(&mCSection);
+			mInFlight--;
+			mCompleted++;
+		}
+		finishRequest(request, authStatus);
+	}
+
+	void AuthWorkerPool::finishRequest(AuthRequestPtr request, int authStatus) {
+		std::list<AuthRequestPtr> aborted;
+		{
+			CSGuard guard(&mCSection);
+			if (authStatus == AUTH_WORKER_ABORTED) {
+				mQueueDepth--;
+			}
+
+			TUserQueueMap::iterator it = mUserQueues.find(request->key);
+			if (request->serialized && it != mUserQueues.end() && !it->second.empty() &&
+					it->second.front() == request) {
+				it->second.pop_front();
+
+				// the next request of this user goes to the pool
+				if (!it->second.empty() && (!mRunning || !schedule(it->second.front()))) {
+					aborted.swap(it->second);
+					mQueueDepth -= aborted.size();
+				}
+				if (it->second.empty()) {
+					mUserQueues.erase(it);
+				}
+			}
+		}
+
+		request->callback(authStatus, request->domain);
+		for (std::list<AuthRequestPtr>::iterator it = aborted.begin(); it != aborted.end(); ++it) {
+			(*it)->callback(AUTH_WORKER_ABORTED, (*it)->domain);
+		}
+	}
+
+	AuthWorkerPoolStats AuthWorkerPool::getStats() const {
+		AuthWorkerPoolStats stats;
+		stats.workers = mPool.getStats().workers;
+
+		CSGuard guard(&mCSection);
+		stats.queueDepth = mQueueDepth;
+		stats.maxQueueDepth = mMaxQueueDepth;
+		stats.inFlight = mInFlight;
+		stats.completed = mCompleted;
+		stats.serialized = mSerialized;
+		stats.averageLatency = mCompleted ? mTotalLatency / mCompleted : 0;
+		stats.maxLatency = mMaxLatency;
+		return stats;
+	}
+
+} /*session*/ } /*sessionmanager*/ } /*ogon*/
@@ -0,0 +1,127 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Worker pool running the authentication of connections
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifndef _OGON_SMGR_SESSION_AUTHWORKERPOOL_H_
+#define _OGON_SMGR_SESSION_AUTHWORKERPOOL_H_
+
+#include <session/Connection.h>
+#include <task/ThreadPool.h>
+
+#include <string>
+#include <list>
+#include <map>
+#include <memory>
+#include <functional>
+#include <chrono>
+#include <winpr/synch.h>
+
+#define AUTH_WORKER_THREADS	8
+#define AUTH_WORKER_ABORTED	(-2)
+
+namespace ogon { namespace sessionmanager { namespace session {
+
+	/**
+	 * @brief called with the result of Connection::authenticateUser and
+	 * the domain as modified by the auth module, or with
+	 * AUTH_WORKER_ABORTED if the request was dropped.
+	 */
+	typedef std::function<void(int authStatus, const std::string &domain)> AuthCallback;
+
+	/**
+	 * @brief counters of the AuthWorkerPool, latencies are in microseconds
+	 * and measured from authenticate until the request is started.
+	 */
+	struct AuthWorkerPoolStats {
+		size_t workers;
+		size_t queueDepth;
+		size_t maxQueueDepth;
+		size_t inFlight;
+		UINT64 completed;
+		UINT64 serialized;
+		UINT64 averageLatency;
+		UINT64 maxLatency;
+	};
+
+	/**
+	 * @brief runs the (possibly slow) authentication module conversation
+	 * on a fixed number of workers instead of the session executors.
+	 *
+	 * Requests for the same user and domain are run one after another, a
+	 * request waits until the one in flight is done. Requests without a
+	 * user name (e.g. an empty logon screen) are not serialized. The result is passed
+	 * to the callback on the worker thread.
+	 */
+	class AuthWorkerPool {
+		typedef std::pair<std::string, std::string> TUserKey;
+
+	public:
+		AuthWorkerPool();
+		~AuthWorkerPool();
+
+		bool start();
+		bool stop();
+
+		bool authenticate(ConnectionPtr connection, const std::string &username,
+				const std::string &domain, const std::string &password, UINT32 sessionId,
+				AuthCallback callback);
+
+		AuthWorkerPoolStats getStats() const;
+
+	private:
+		struct AuthRequest {
+			TUserKey key;
+			bool serialized;
+			ConnectionPtr connection;
+			std::string username;
+			std::string domain;
+			std::string password;
+			UINT32 sessionId;
+			AuthCallback callback;
+			std::chrono::steady_clock::time_point queued;
+		};
+		typedef std::shared_ptr<AuthRequest> AuthRequestPtr;
+		typedef std::map<TUserKey, std::list<AuthRequestPtr> > TUserQueueMap;
+
+		friend class TaskAuthenticate;
+		void runRequest(AuthRequestPtr request);
+		void finishRequest(AuthRequestPtr request, int authStatus);
+		bool schedule(AuthRequestPtr request);
+
+		taskNS::ThreadPool mPool;
+		bool mRunning;
+
+		// per user, the first request is queued or running on the pool
+		TUserQueueMap mUserQueues;
+		mutable CRITICAL_SECTION mCSection;
+
+		size_t mQueueDepth;
+		size_t mMaxQueueDepth;
+		size_t mInFlight;
+		UINT64 mCompleted;
+		UINT64 mSerialized;
+		UINT64 mTotalLatency;
+		UINT64 mMaxLatency;
+	};
+
+} /*session*/ } /*sessionmanager*/ } /*ogon*/
+
+namespace sessionNS = ogon::sessionmanager::session;
+
+#endif /* _OGON_SMGR_SESSION_AUTHWORKERPOOL_H_ */
@@ -57,6 +57,13 @@ namespace ogon { namespace sessionmanager { namespace session {
 			throw std::bad_alloc();
 		}
 
+		if (!InitializeCriticalSectionAndSpinCount(&mCSectionTrace, 0x00000400)) {
+			WLog_Print(logger_Connection, WLOG_FATAL,
+				"Failed to initialize connection critical section (mCSectionTrace)");
+			throw std::bad_alloc();
+		}
+		logon_trace_init(&mLogonTrace);
+
 		mClientInformation.clientBuildNumber = 0;
 		mClientInformation.clientHardwareId = 0;
 		mClientInformation.clientProductId = 0;
@@ -71,6 +78,7 @@ namespace ogon { namespace sessionmanager { namespace session {
 	Connection::~Connection() {
 		DeleteCriticalSection(&mCSection);
 		DeleteCriticalSection(&mCSectionQueue);
+		DeleteCriticalSection(&mCSectionTrace);
 	}
 
 	std::string Connection::getDomain() {
@@ -83,6 +91,7 @@ namespace ogon { namespace sessionmanager { namespace session {
 
 	void Connection::setSessionId(UINT32 sessionId) {
 		mSessionId = sessionId;
+		APP_CONTEXT.getConnectionStore()->updateSessionIndex(mConnectionId, sessionId);
 		WLog_Print(logger_Connection, WLOG_DEBUG, "Session %" PRIu32 " bound to connection %" PRIu32 "\n", mSessionId, mConnectionId);
 	}
 
@@ -235,4 +244,27 @@ namespace ogon { namespace sessionmanager { namespace session {
 		return tempList;
 	}
 
+	void Connection::logonTraceBegin(LOGON_TRACE_PHASE phase) {
+		CSGuard guard(&mCSectionTrace);
+		logon_trace_begin(&mLogonTrace, phase);
+	}
+
+	void Connection::logonTraceEnd(LOGON_TRACE_PHASE phase) {
+		CSGuard guard(&mCSectionTrace);
+		if (logon_trace_end(&mLogonTrace, phase)) {
+			logon_trace_record(phase, logon_trace_duration(&mLogonTrace, phase));
+		}
+	}
+
+	logon_trace Connection::mergeLogonTrace(const logon_trace &remote) {
+		CSGuard guard(&mCSectionTrace);
+		for (int phase = 0; phase < LOGON_PHASE_COUNT; phase++) {
+			if (logon_trace_has(&remote, (LOGON_TRACE_PHASE)phase)) {
+				logon_trace_set(&mLogonTrace, (LOGON_TRACE_PHASE)phase,
+					logon_trace_duration(&remote, (LOGON_TRACE_PHASE)phase));
+			}
+		}
+		return mLogonTrace;
+	}
+
 } /*session*/ } /*sessionmanager*/ } /*ogon*/
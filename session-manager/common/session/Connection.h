@@ -31,6 +31,7 @@
 #include <memory>
 #include <config/PropertyLevel.h>
 #include <call/CallIn.h>
+#include "../../common/logontrace.h"
 
 namespace ogon { namespace sessionmanager { namespace session {
 
@@ -83,6 +84,16 @@ namespace ogon { namespace sessionmanager { namespace session {
 		bool tryQueueCall(callNS::CallInPtr call);
 		std::list<callNS::CallInPtr> setStatusGetList(CONNECTION_STATE state);
 
+		/** starts a span of the logon of this connection */
+		void logonTraceBegin(LOGON_TRACE_PHASE phase);
+		/** ends a span and adds its duration to the logon histograms */
+		void logonTraceEnd(LOGON_TRACE_PHASE phase);
+		/**
+		 * adds the spans measured by ogon to the ones of the session manager
+		 * @return the combined trace of this connection
+		 */
+		logon_trace mergeLogonTrace(const logon_trace &remote);
+
 	private:
 		UINT32 mConnectionId;
 		UINT32 mSessionId;
@@ -98,6 +109,8 @@ namespace ogon { namespace sessionmanager { namespace session {
 		CRITICAL_SECTION mCSection;
 		CRITICAL_SECTION mCSectionQueue;
 		std::list<callNS::CallInPtr> mQueuedCalls;
+		CRITICAL_SECTION mCSectionTrace;
+		logon_trace mLogonTrace;
 	};
 
 	typedef std::shared_ptr<Connection> ConnectionPtr;
@@ -27,37 +27,57 @@
 
 #include "ConnectionStore.h"
 #include <winpr/wlog.h>
-#include <utils/CSGuard.h>
 
 namespace ogon { namespace sessionmanager { namespace session {
 
 	static wLog *logger_ConnectionStore = WLog_Get("ogon.sessionmanager.session.connectionstore");
 
 	ConnectionStore::ConnectionStore() {
-		if (!InitializeCriticalSectionAndSpinCount(&mCSection, 0x00000400)) {
-			WLog_Print(logger_ConnectionStore, WLOG_FATAL,
-				"Failed to initialize connection store critical section");
-			throw std::bad_alloc();
-		}
 	}
 
 	ConnectionStore::~ConnectionStore() {
-		DeleteCriticalSection(&mCSection);
 	}
 
 	ConnectionPtr ConnectionStore::getOrCreateConnection(UINT32 connectionID) {
-		CSGuard guard(&mCSection);
-		if (mConnectionMap.find(connectionID) != mConnectionMap.end()) {
-			return mConnectionMap[connectionID];
+		{
+			std::shared_lock<std::shared_mutex> guard(mLock);
+			TConnectionMap::const_iterator iter = mConnectionMap.find(connectionID);
+			if (iter != mConnectionMap.end()) {
+				return iter->second;
+			}
+		}
+
+		std::unique_lock<std::shared_mutex> guard(mLock);
+		TConnectionMap::const_iterator iter = mConnectionMap.find(connectionID);
+		if (iter != mConnectionMap.end()) {
+			return iter->second;
 		}
 
 		ConnectionPtr connection = ConnectionPtr(new Connection(connectionID));
 		mConnectionMap[connectionID] = connection;
+		mSessionIndex[connection->getSessionId()].insert(connectionID);
+		mIndexedSessionIds[connectionID] = connection->getSessionId();
 		return connection;
 	}
 
+	void ConnectionStore::removeFromIndex(UINT32 connectionID) {
+		std::map<UINT32, UINT32>::iterator iter = mIndexedSessionIds.find(connectionID);
+		if (iter == mIndexedSessionIds.end()) {
+			return;
+		}
+
+		TSessionConnectionIndex::iterator indexIter = mSessionIndex.find(iter->second);
+		if (indexIter != mSessionIndex.end()) {
+			indexIter->second.erase(connectionID);
+			if (indexIter->second.empty()) {
+				mSessionIndex.erase(indexIter);
+			}
+		}
+		mIndexedSessionIds.erase(iter);
+	}
+
 	ConnectionPtr ConnectionStore::getConnection(UINT32 connectionId) {
-		CSGuard guard(&mCSection);
+		std::shared_lock<std::shared_mutex> guard(mLock);
 		TConnectionMap::const_iterator iter = mConnectionMap.find(connectionId);
 		if (iter != mConnectionMap.end()) {
 			return iter->second;
@@ -66,46 +86,62 @@ namespace ogon { namespace sessionmanager { namespace session {
 	}
 
 	ConnectionPtr ConnectionStore::getConnectionForSessionId(UINT32 mSessionId) {
+		std::shared_lock<std::shared_mutex> guard(mLock);
 
-		CSGuard guard(&mCSection);
-		ConnectionPtr connection;
-		TConnectionMap::iterator iter;
+		TSessionConnectionIndex::const_iterator iter = mSessionIndex.find(mSessionId);
+		if (iter == mSessionIndex.end() || iter->second.empty()) {
+			return ConnectionPtr();
+		}
 
-		for (iter = mConnectionMap.begin(); iter != mConnectionMap.end(); iter++) {
-			if((iter->second->getSessionId() == mSessionId)) {
-				connection = iter->second;
-				break;
-			}
+		TConnectionMap::const_iterator connIter = mConnectionMap.find(*iter->second.begin());
+		if (connIter == mConnectionMap.end()) {
+			return ConnectionPtr();
 		}
-		return connection;
+		return connIter->second;
 	}
 
-
-
 	int ConnectionStore::removeConnection(UINT32 connectionID) {
-		CSGuard guard(&mCSection);
+		std::unique_lock<std::shared_mutex> guard(mLock);
 		mConnectionMap.erase(connectionID);
+		removeFromIndex(connectionID);
 		return 0;
 	}
 
 	UINT32 ConnectionStore::getConnectionIdForSessionId(UINT32 mSessionId) {
-		CSGuard guard(&mCSection);
-		UINT32 connectionId = 0;
+		std::shared_lock<std::shared_mutex> guard(mLock);
+
+		TSessionConnectionIndex::const_iterator iter = mSessionIndex.find(mSessionId);
+		if (iter == mSessionIndex.end() || iter->second.empty()) {
+			return 0;
+		}
+		return *iter->second.begin();
+	}
 
-		TConnectionMap::iterator iter;
+	std::list<ConnectionPtr> ConnectionStore::getAllConnections() {
+		std::shared_lock<std::shared_mutex> guard(mLock);
+		std::list<ConnectionPtr> list;
+		for (TConnectionMap::const_iterator it = mConnectionMap.begin(); it != mConnectionMap.end(); ++it) {
+			list.push_back(it->second);
+		}
+		return list;
+	}
 
-		for (iter = mConnectionMap.begin(); iter != mConnectionMap.end(); iter++) {
-			if((iter->second->getSessionId() == mSessionId)) {
-				connectionId = iter->first;
-				break;
-			}
+	void ConnectionStore::updateSessionIndex(UINT32 connectionID, UINT32 sessionId) {
+		std::unique_lock<std::shared_mutex> guard(mLock);
+		if (mConnectionMap.find(connectionID) == mConnectionMap.end()) {
+			return;
 		}
-		return connectionId;
+
+		removeFromIndex(connectionID);
+		mSessionIndex[sessionId].insert(connectionID);
+		mIndexedSessionIds[connectionID] = sessionId;
 	}
 
 	void ConnectionStore::reset() {
-		CSGuard guard(&mCSection);
+		std::unique_lock<std::shared_mutex> guard(mLock);
 		mConnectionMap.clear();
+		mSessionIndex.clear();
+		mIndexedSessionIds.clear();
 	}
 
 } /*session*/ } /*sessionmanager*/ } /*ogon*/
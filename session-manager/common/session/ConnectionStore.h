@@ -29,12 +29,17 @@
 
 #include <string>
 #include <winpr/synch.h>
+#include <list>
 #include <map>
+#include <set>
+#include <mutex>
+#include <shared_mutex>
 
 namespace ogon { namespace sessionmanager { namespace session {
 
 	typedef std::map<UINT32 , ConnectionPtr> TConnectionMap;
 	typedef std::pair<UINT32, ConnectionPtr> TConnectionPair;
+	typedef std::map<UINT32, std::set<UINT32> > TSessionConnectionIndex;
 
 
 	/**
@@ -51,12 +56,26 @@ namespace ogon { namespace sessionmanager { namespace session {
 		int removeConnection(UINT32 connectionID);
 
 		UINT32 getConnectionIdForSessionId(UINT32 mSessionId);
+		std::list<ConnectionPtr> getAllConnections();
 
 		void reset();
 
+		/**
+		 * @brief moves the connection to another session in the session
+		 * index. Called by Connection::setSessionId.
+		 */
+		void updateSessionIndex(UINT32 connectionID, UINT32 sessionId);
+
 	private:
+		void removeFromIndex(UINT32 connectionID);
+
 		TConnectionMap mConnectionMap;
-		CRITICAL_SECTION mCSection;
+		// connection ids by session id, ordered like mConnectionMap.
+		// mIndexedSessionIds remembers the session each connection was
+		// indexed with.
+		TSessionConnectionIndex mSessionIndex;
+		std::map<UINT32, UINT32> mIndexedSessionIds;
+		std::shared_mutex mLock;
 	};
 
 } /*session*/ } /*sessionmanager*/ } /*ogon*/
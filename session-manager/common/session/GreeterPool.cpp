@@ -0,0 +1,140 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Pool of pre-started greeter sessions
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "GreeterPool.h"
+#include "TaskStartGreeter.h"
+
+#include <appcontext/ApplicationContext.h>
+#include <utils/CSGuard.h>
+#include <winpr/wlog.h>
+
+namespace ogon { namespace sessionmanager { namespace session {
+
+	static wLog *logger_GreeterPool = WLog_Get("ogon.sessionmanager.session.greeterpool");
+
+	GreeterPool::GreeterPool() : mStarting(0), mStopped(false) {
+		if (!InitializeCriticalSectionAndSpinCount(&mCSection, 0x00000400)) {
+			WLog_Print(logger_GreeterPool, WLOG_FATAL,
+				"Failed to initialize greeter pool critical section");
+			throw std::bad_alloc();
+		}
+	}
+
+	GreeterPool::~GreeterPool() {
+		DeleteCriticalSection(&mCSection);
+	}
+
+	void GreeterPool::fill() {
+		configNS::PropertyManager *propertyManager = APP_CONTEXT.getPropertyManager();
+		long size = 0;
+		std::string greeter;
+		std::list<UINT32> outdated;
+		long missing;
+
+		propertyManager->getPropertyNumber(0, "auth.greeter.pool", size);
+		if (!propertyManager->getPropertyString(0, "auth.greeter", greeter)) {
+			greeter = "Qt";
+		}
+
+		{
+			CSGuard guard(&mCSection);
+			if (mStopped) {
+				return;
+			}
+
+			// greeters of a previous configuration are of no use anymore
+			if (greeter != mGreeter) {
+				outdated.swap(mReady);
+				mGreeter = greeter;
+			}
+
+			missing = size - (long)(mReady.size() + mStarting);
+			if (missing > 0) {
+				mStarting += missing;
+			}
+		}
+
+		SessionStore *sessionStore = APP_CONTEXT.getSessionStore();
+		for (std::list<UINT32>::iterator it = outdated.begin(); it != outdated.end(); ++it) {
+			sessionStore->removeSession(*it);
+		}
+
+		for (long i = 0; i < missing; i++) {
+			SessionPtr session = sessionStore->createSession();
+			WLog_Print(logger_GreeterPool, WLOG_DEBUG,
+				"s %" PRIu32 ": starting greeter %s for the pool", session->getSessionID(), greeter.c_str());
+			session->addTask(TaskStartGreeterPtr(new TaskStartGreeter(session->getSessionID(), greeter)));
+		}
+	}
+
+	void GreeterPool::stop() {
+		CSGuard guard(&mCSection);
+		// the sessions themselves are ended with all others on shutdown
+		mStopped = true;
+		mReady.clear();
+	}
+
+	SessionPtr GreeterPool::takeSession(const std::string &greeter) {
+		SessionStore *sessionStore = APP_CONTEXT.getSessionStore();
+		SessionPtr session;
+		{
+			CSGuard guard(&mCSection);
+			if (mStopped || greeter != mGreeter) {
+				return SessionPtr();
+			}
+
+			// skip greeters which ended in the meantime
+			while (!session && !mReady.empty()) {
+				session = sessionStore->getSession(mReady.front());
+				mReady.pop_front();
+				if (session && (session->getConnectState() != WTSInit || !session->isModuleStarted())) {
+					session.reset();
+				}
+			}
+		}
+
+		if (session) {
+			WLog_Print(logger_GreeterPool, WLOG_DEBUG,
+				"s %" PRIu32 ": using pre-started greeter", session->getSessionID());
+			fill();
+		}
+		return session;
+	}
+
+	void GreeterPool::greeterStarted(UINT32 sessionId, const std::string &greeter, bool success) {
+		{
+			CSGuard guard(&mCSection);
+			mStarting--;
+			if (success && !mStopped && greeter == mGreeter) {
+				mReady.push_back(sessionId);
+				return;
+			}
+		}
+
+		WLog_Print(logger_GreeterPool, WLOG_DEBUG,
+			"s %" PRIu32 ": greeter %s is not added to the pool", sessionId, greeter.c_str());
+		APP_CONTEXT.getSessionStore()->removeSession(sessionId);
+	}
+
+} /*session*/ } /*sessionmanager*/ } /*ogon*/
@@ -0,0 +1,64 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Pool of pre-started greeter sessions
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifndef _OGON_SMGR_SESSION_GREETERPOOL_H_
+#define _OGON_SMGR_SESSION_GREETERPOOL_H_
+
+#include <session/Session.h>
+
+#include <string>
+#include <list>
+#include <winpr/synch.h>
+
+namespace ogon { namespace sessionmanager { namespace session {
+
+	/**
+	 * @brief keeps auth.greeter.pool sessions with an already started
+	 * greeter backend, so a connection which needs a greeter doesn't have
+	 * to wait for the backend to come up.
+	 *
+	 * The greeters are started without a user or client, so they don't
+	 * get OGON_USER, OGON_DOMAIN and the client name and address in their
+	 * environment. Taken greeters are replaced in the background.
+	 */
+	class GreeterPool {
+	public:
+		GreeterPool();
+		~GreeterPool();
+
+		void fill();
+		void stop();
+
+		SessionPtr takeSession(const std::string &greeter);
+		void greeterStarted(UINT32 sessionId, const std::string &greeter, bool success);
+
+	private:
+		std::list<UINT32> mReady;
+		size_t mStarting;
+		std::string mGreeter;
+		bool mStopped;
+		CRITICAL_SECTION mCSection;
+	};
+
+} /*session*/ } /*sessionmanager*/ } /*ogon*/
+
+namespace sessionNS = ogon::sessionmanager::session;
+
+#endif /* _OGON_SMGR_SESSION_GREETERPOOL_H_ */
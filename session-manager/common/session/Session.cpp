@@ -44,6 +44,7 @@
 #include <boost/lexical_cast.hpp>
 #include <session/TaskEnd.h>
 #include <session/TaskShutdown.h>
+#include <session/TaskSessionTimeout.h>
 
 #include "Session.h"
 
@@ -56,11 +57,8 @@ namespace ogon { namespace sessionmanager { namespace session {
 	Session::Session(UINT32 sessionID) : mSessionID(sessionID),
 		mSessionStarted(false), mPermissions(0), mMaxXRes(0), mMaxYRes(0),
 		mUserToken(NULL), mpEnvBlock(NULL), mCurrentModuleContext(NULL),
-		mAuthModuleContext(NULL), mCurrentState(WTSInit), mUserUID(0),
+		mAuthModuleContext(NULL), mCurrentState(WTSInit), mTimeoutTimer(0), mUserUID(0),
 		mGroupUID(0), mAllowedChannelsParsed(false),
-		mhExecutorStopEvent(INVALID_HANDLE_VALUE),
-		mhExecutorThreadStartedEvent(INVALID_HANDLE_VALUE),
-		mhExecutorThread(NULL), mExecutorRunning(false),
 		mSBPVersionCompatible(false), mCurrentModule(NULL)
 	{
 		if (!InitializeCriticalSectionAndSpinCount(&mCSection, 0x00000400)) {
@@ -75,18 +73,6 @@ namespace ogon { namespace sessionmanager { namespace session {
 			throw std::bad_alloc();
 		}
 
-		if (!(mhExecutorStopEvent = CreateEvent(NULL, TRUE, FALSE, NULL))) {
-			WLog_Print(logger_Session, WLOG_FATAL,
-				"Failed to create session executor stop event");
-			throw std::bad_alloc();
-		}
-
-		if (!(mhExecutorThreadStartedEvent = CreateEvent(NULL, TRUE, FALSE, NULL))) {
-			WLog_Print(logger_Session, WLOG_FATAL,
-				"Failed to create session executor thread started event");
-			throw std::bad_alloc();
-		}
-
 		mLogonTime = boost::date_time::not_a_date_time;
 		mConnectTime = boost::date_time::not_a_date_time;
 		mDisconnectTime = boost::date_time::not_a_date_time;
@@ -97,17 +83,11 @@ namespace ogon { namespace sessionmanager { namespace session {
 	}
 
 	Session::~Session() {
-		if (!stopExecutorThread()) {
+		if (!stopExecutor()) {
 			 WLog_Print(logger_Session, WLOG_FATAL,
-				"stop of Executor Thread failed!");
+				"stop of Executor failed!");
 		}
 
-		if (mhExecutorThread) {
-			CloseHandle(mhExecutorThread);
-			mhExecutorThread = NULL;
-		}
-		CloseHandle(mhExecutorStopEvent);
-		CloseHandle(mhExecutorThreadStartedEvent);
 		DeleteCriticalSection(&mCSection);
 		DeleteCriticalSection(&mCSectionState);
 
@@ -157,6 +137,7 @@ namespace ogon { namespace sessionmanager { namespace session {
 
 	void Session::setDomain(const std::string &domainName) {
 		mDomain = domainName;
+		APP_CONTEXT.getSessionStore()->updateSessionIndex(mSessionID);
 	}
 
 	std::string Session::getUserName() const {
@@ -165,6 +146,7 @@ namespace ogon { namespace sessionmanager { namespace session {
 
 	void Session::setUserName(const std::string &username) {
 		mUsername = username;
+		APP_CONTEXT.getSessionStore()->updateSessionIndex(mSessionID);
 	}
 
 	UINT32 Session::getSessionID() const {
@@ -182,6 +164,7 @@ namespace ogon { namespace sessionmanager { namespace session {
 
 	void Session::setClientHostName(const std::string &clientHostName) {
 		mClientHostName = clientHostName;
+		APP_CONTEXT.getSessionStore()->updateSessionIndex(mSessionID);
 	}
 
 	bool Session::generateUserToken() {
@@ -657,6 +640,11 @@ namespace ogon { namespace sessionmanager { namespace session {
 		return mPipeName;
 	}
 
+	bool Session::isModuleStarted() const {
+		CSGuard guard(&mCSection);
+		return mSessionStarted;
+	}
+
 	WTS_CONNECTSTATE_CLASS Session::getConnectState() const {
 		CSGuard guard(&mCSectionState);
 		return mCurrentState;
@@ -731,7 +719,7 @@ namespace ogon { namespace sessionmanager { namespace session {
 				}
 				mCurrentState = state;
 				mConnectTime = mCurrentStateChangeTime;
-				sessionNotifier->notify(WTS_REMOTE_CONNECT, mSessionID);
+				sessionNotifier->notify(WTS_REMOTE_CONNECT, mSessionID, mUsername, mDomain);
 				guard.leaveGuard();
 				connectModule();
 				break;
@@ -750,19 +738,19 @@ namespace ogon { namespace sessionmanager { namespace session {
 					}
 
 					if (saveState == WTSConnected) {
-						sessionNotifier->notify(WTS_SESSION_LOGON, mSessionID);
+						sessionNotifier->notify(WTS_SESSION_LOGON, mSessionID, mUsername, mDomain);
 					} else if (saveState == WTSDisconnected) {
-						sessionNotifier->notify(WTS_REMOTE_CONNECT, mSessionID);
+						sessionNotifier->notify(WTS_REMOTE_CONNECT, mSessionID, mUsername, mDomain);
 						guard.leaveGuard();
 						mConnectTime = mCurrentStateChangeTime;
 						connectModule();
 					} else if (saveState == WTSConnectQuery) {
-						sessionNotifier->notify(WTS_REMOTE_CONNECT, mSessionID);
+						sessionNotifier->notify(WTS_REMOTE_CONNECT, mSessionID, mUsername, mDomain);
 						guard.leaveGuard();
 						mConnectTime = mCurrentStateChangeTime;
 						connectModule();
 					} else if (saveState == WTSShadow) {
-						sessionNotifier->notify(WTS_SESSION_REMOTE_CONTROL, mSessionID);
+						sessionNotifier->notify(WTS_SESSION_REMOTE_CONTROL, mSessionID, mUsername, mDomain);
 					}
 				}
 
@@ -773,7 +761,7 @@ namespace ogon { namespace sessionmanager { namespace session {
 						"s %" PRIu32 ": wrong state transition, state WTSDisconnected should only be set if state was WTSActive but was %s",
 						mSessionID, sessionStateToString(mCurrentState));
 				}
-				sessionNotifier->notify(WTS_REMOTE_DISCONNECT, mSessionID);
+				sessionNotifier->notify(WTS_REMOTE_DISCONNECT, mSessionID, mUsername, mDomain);
 				mCurrentState = state;
 				mDisconnectTime = mCurrentStateChangeTime;
 				guard.leaveGuard();
@@ -787,9 +775,9 @@ namespace ogon { namespace sessionmanager { namespace session {
 				}
 
 				if (mCurrentState == WTSConnected) {
-					sessionNotifier->notify(WTS_REMOTE_DISCONNECT, mSessionID);
+					sessionNotifier->notify(WTS_REMOTE_DISCONNECT, mSessionID, mUsername, mDomain);
 				} else {
-					sessionNotifier->notify(WTS_SESSION_LOGOFF, mSessionID);
+					sessionNotifier->notify(WTS_SESSION_LOGOFF, mSessionID, mUsername, mDomain);
 				}
 
 				mCurrentState = state;
@@ -803,13 +791,56 @@ namespace ogon { namespace sessionmanager { namespace session {
 						"s %" PRIu32 ": wrong state transition, state WTSShadow should only be set if state was WTSActive but was %s",
 						mSessionID, sessionStateToString(mCurrentState));
 				}
-				sessionNotifier->notify(WTS_SESSION_REMOTE_CONTROL, mSessionID);
+				sessionNotifier->notify(WTS_SESSION_REMOTE_CONTROL, mSessionID, mUsername, mDomain);
 				mCurrentState = state;
 				break;
 			default:
 				WLog_Print(logger_Session, WLOG_ERROR, "s %" PRIu32 ": wrong state %d", mSessionID, mCurrentState);
 				break;
 		}
+
+		updateTimeoutTimer(state);
+	}
+
+	bool Session::claimDisconnected() {
+		{
+			CSGuard guard(&mCSectionState);
+			if (mCurrentState != WTSDisconnected) {
+				return false;
+			}
+			mCurrentStateChangeTime = boost::date_time::second_clock<boost::posix_time::ptime>::universal_time();
+			mCurrentState = WTSConnectQuery;
+		}
+		updateTimeoutTimer(WTSConnectQuery);
+		return true;
+	}
+
+	void Session::updateTimeoutTimer(WTS_CONNECTSTATE_CLASS state) {
+		CSGuard guard(&mCSectionState);
+		taskNS::TimerService *timerService = APP_CONTEXT.getTimerService();
+
+		if (mTimeoutTimer) {
+			timerService->cancelTimer(mTimeoutTimer);
+			mTimeoutTimer = 0;
+		}
+
+		if (state != WTSDisconnected) {
+			return;
+		}
+
+		long timeout;
+		if (!APP_CONTEXT.getPropertyManager()->getPropertyNumber(0, "session.timeout", timeout, mUsername)) {
+			WLog_Print(logger_Session, WLOG_INFO,
+				"s %" PRIu32 ": session.timeout was not found, using value of 0", mSessionID);
+			timeout = 0;
+		}
+		if (timeout < 0) {
+			// keep disconnected sessions forever
+			return;
+		}
+
+		taskNS::TaskPtr task(new TaskSessionTimeout(mSessionID, timeout));
+		mTimeoutTimer = timerService->addTimer((UINT64) timeout * 60 * 1000, task);
 	}
 
 	boost::posix_time::ptime Session::getConnectStateChangeTime() const {
@@ -870,8 +901,8 @@ namespace ogon { namespace sessionmanager { namespace session {
 	void Session::init() {
 		registerSessionAndGetToken();
 		applyAuthToken();
-		if(!startExecutorThread()) {
-			 WLog_Print(logger_Session, WLOG_FATAL,	"s %" PRIu32 ": start of Executor Thread failed!", mSessionID);
+		if(!startExecutor()) {
+			 WLog_Print(logger_Session, WLOG_FATAL,	"s %" PRIu32 ": start of Executor failed!", mSessionID);
 		}
 	}
 
@@ -1053,116 +1084,55 @@ namespace ogon { namespace sessionmanager { namespace session {
 		return mLogonTime;
 	}
 
-	bool Session::startExecutorThread() {
+	bool Session::startExecutor() {
 
 		CSGuard guard(&mCSection);
 
-		if (mExecutorRunning) {
+		if (mStrand) {
 			WLog_Print(logger_Session, WLOG_ERROR,
-				"s %" PRIu32 ": Executor Thread already running!", mSessionID);
+				"s %" PRIu32 ": Executor already running!", mSessionID);
 			return false;
 		}
 
-		SessionPtr currentSession = shared_from_this();
-
-		if (!(mhExecutorThread = CreateThread(NULL, 0,
-				(LPTHREAD_START_ROUTINE) Session::executorThread, (void*) &currentSession,
-				0, NULL)))
-		{
-			WLog_Print(logger_Session, WLOG_ERROR, "s %" PRIu32 ": faile to create thread", mSessionID);
+		try {
+			mStrand = APP_CONTEXT.createStrand();
+		} catch (const std::bad_alloc &) {
+			WLog_Print(logger_Session, WLOG_ERROR, "s %" PRIu32 ": failed to create strand", mSessionID);
 			return false;
 		}
-
-		WaitForSingleObject(mhExecutorThreadStartedEvent, INFINITE);
-		ResetEvent(mhExecutorThreadStartedEvent);
-		mExecutorRunning = true;
 		return true;
 	}
 
-	bool Session::stopExecutorThread(bool wait) {
-		if (!mExecutorRunning) {
+	bool Session::stopExecutor(bool wait) {
+		taskNS::StrandPtr strand;
+		{
+			CSGuard guard(&mCSection);
+			strand = mStrand;
+		}
+		if (!strand) {
 			return true;
 		}
 
-		if (mhExecutorThread) {
-			SetEvent(mhExecutorStopEvent);
-			if (wait) {
-				WaitForSingleObject(mhExecutorThread, INFINITE);
-			}
+		// queued tasks are aborted, a task that is currently executed
+		// finishes. Waiting from within a session task returns immediately.
+		strand->abortTasks();
+		if (wait) {
+			strand->waitIdle();
 		}
 		return true;
 	}
 
-	void Session::endExecutorThread() {
-		CSGuard guard(&mCSection);
-
-		mExecutorRunning = false;
-		// Abort all outstanding tasks
-		std::list<taskNS::TaskPtr> currentTasks = mTasks.getAllElements();
-		std::list<taskNS::TaskPtr>::const_iterator iter;
-		for(iter = currentTasks.begin(); iter != currentTasks.end(); ++iter) {
-			taskNS::TaskPtr currentTask = *iter;
-			currentTask->abortTask();
-			currentTask.reset();
-		}
-		return;
-	}
-
-
-	DWORD Session::executorThread(void* arg) {
-		SessionPtr session = (*(SessionPtr *) arg);
-		WLog_Print(logger_Session, WLOG_INFO, "s %" PRIu32 ": started Executor thread", session->getSessionID());
-
-		session->runExecutor();
-		session->endExecutorThread();
-
-		WLog_Print(logger_Session, WLOG_INFO, "s %" PRIu32 ": stopped Executor thread", session->getSessionID());
-		return 0;
-	}
-
-	void Session::runExecutor() {
-
-		SetEvent(mhExecutorThreadStartedEvent);
-
-		DWORD nCount;
-		HANDLE queueHandle = mTasks.getSignalHandle();
-		HANDLE events[2];
-
-		nCount = 0;
-		events[nCount++] = mhExecutorStopEvent;
-		events[nCount++] = queueHandle;
-
-		while (1) {
-
-			WaitForMultipleObjects(nCount, events, FALSE, INFINITE);
-
-			if (WaitForSingleObject(mhExecutorStopEvent, 0) == WAIT_OBJECT_0) {
-				break;
-			}
-
-			if (WaitForSingleObject(queueHandle, 0) == WAIT_OBJECT_0) {
-				std::list<taskNS::TaskPtr> currentTasks = mTasks.getAllElements();
-				std::list<taskNS::TaskPtr>::const_iterator iter;
-				for(iter = currentTasks.begin(); iter != currentTasks.end(); ++iter) {
-					taskNS::TaskPtr currentTask = *iter;
-					currentTask->preProcess();
-					currentTask->run();
-					currentTask->postProcess();
-					currentTask.reset();
-				}
-			}
-		}
-	}
-
 	bool Session::addTask(taskNS::TaskPtr task) {
-		CSGuard guard(&mCSection);
-		if (mExecutorRunning) {
-			mTasks.addElement(task);
-			return true;
-		} else {
+		taskNS::StrandPtr strand;
+		{
+			CSGuard guard(&mCSection);
+			strand = mStrand;
+		}
+		if (!strand) {
 			task->abortTask();
 			return false;
 		}
+		return strand->addTask(task);
 	}
 
 	void Session::startRemoteControl() {
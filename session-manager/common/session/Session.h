@@ -27,8 +27,9 @@
 #include <string>
 #include <list>
 
-#include <utils/SignalingQueue.h>
 #include <task/Task.h>
+#include <task/Strand.h>
+#include <task/TimerService.h>
 
 #include <winpr/handle.h>
 #include <winpr/wtsapi.h>
@@ -69,6 +70,7 @@ namespace ogon { namespace sessionmanager { namespace session {
 		std::string getAuthDomain() const;
 		UINT32 getSessionID() const;
 		std::string getPipeName() const;
+		bool isModuleStarted() const;
 		std::string getClientHostName() const;
 		long getMaxXRes() const;
 		long getMaxYRes() const;
@@ -86,7 +88,7 @@ namespace ogon { namespace sessionmanager { namespace session {
 		std::string getWinStationName() const;
 		bool addTask(taskNS::TaskPtr task);
 
-		bool stopExecutorThread(bool wait = false);
+		bool stopExecutor(bool wait = false);
 
 		boost::posix_time::ptime getConnectTime() const;
 		boost::posix_time::ptime getDisconnectTime() const;
@@ -122,6 +124,11 @@ namespace ogon { namespace sessionmanager { namespace session {
 		bool disconnectModule();
 		bool stopModule();
 		void setConnectState(WTS_CONNECTSTATE_CLASS state);
+		/**
+		 * @brief moves a disconnected session to WTSConnectQuery.
+		 * @return false if the session wasn't disconnected (anymore)
+		 */
+		bool claimDisconnected();
 
 		bool markBackendAsAuth();
 		void destroyAuthBackend();
@@ -151,11 +158,9 @@ namespace ogon { namespace sessionmanager { namespace session {
 		void freeModuleContext(RDS_MODULE_COMMON *context);
 
 		void parseAllowedChannels();
+		void updateTimeoutTimer(WTS_CONNECTSTATE_CLASS state);
 
-		bool startExecutorThread();
-		static DWORD executorThread(void* arg);
-		void endExecutorThread();
-		void runExecutor();
+		bool startExecutor();
 
 
 		UINT32	mSessionID;
@@ -186,6 +191,7 @@ namespace ogon { namespace sessionmanager { namespace session {
 		RDS_MODULE_COMMON	*mAuthModuleContext;
 		WTS_CONNECTSTATE_CLASS	mCurrentState;
 		boost::posix_time::ptime	mCurrentStateChangeTime;
+		taskNS::TimerId	mTimeoutTimer;
 		mutable CRITICAL_SECTION mCSection;
 		mutable CRITICAL_SECTION mCSectionState;
 		std::string	mAuthToken;
@@ -198,12 +204,8 @@ namespace ogon { namespace sessionmanager { namespace session {
 		bool mAllowedChannelsParsed;
 		std::string mWinStationName;
 
-		// task executer
-		HANDLE mhExecutorStopEvent;
-		HANDLE mhExecutorThreadStartedEvent;
-		HANDLE mhExecutorThread;
-		SignalingQueue<taskNS::TaskPtr> mTasks;
-		bool mExecutorRunning;
+		// serializes the session tasks on the shared executor pool
+		taskNS::StrandPtr mStrand;
 
 		std::list<UINT32> mShadowedBy;
 		bool mSBPVersionCompatible;
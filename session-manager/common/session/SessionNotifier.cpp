@@ -28,12 +28,16 @@
 #include "SessionNotifier.h"
 #include <utils/CSGuard.h>
 #include <winpr/wlog.h>
+#include <chrono>
+
+/* number of events kept for waitForEvents */
+#define SESSION_EVENT_JOURNAL_SIZE 256
 
 namespace ogon { namespace sessionmanager { namespace session {
 
 	static wLog *logger_SessionNotifier = WLog_Get("ogon.sessionmanager.session.sessionnotifier");
 
-	SessionNotifier::SessionNotifier() : mDBusConn(NULL) {
+	SessionNotifier::SessionNotifier() : mDBusConn(NULL), mSequence(0), mWaitsCancelled(false) {
 		if (!InitializeCriticalSectionAndSpinCount(&mCSection, 0x00000400)) {
 			WLog_Print(logger_SessionNotifier, WLOG_FATAL,
 				"Failed to initialize session notifier critical section");
@@ -77,6 +81,7 @@ namespace ogon { namespace sessionmanager { namespace session {
 	}
 
 	bool SessionNotifier::shutdown() {
+		cancelWaits();
 		return true;
 	}
 
@@ -85,7 +90,24 @@ namespace ogon { namespace sessionmanager { namespace session {
 		DeleteCriticalSection(&mCSection);
 	}
 
-	bool SessionNotifier::notify(DWORD reason, UINT32 sessionId) {
+	bool SessionNotifier::notify(DWORD reason, UINT32 sessionId,
+		const std::string &userName, const std::string &domain) {
+
+		{
+			std::lock_guard<std::mutex> lock(mJournalMutex);
+			SessionEvent event;
+			event.sequence = ++mSequence;
+			event.reason = reason;
+			event.sessionId = sessionId;
+			event.userName = userName;
+			event.domain = domain;
+			mJournal.push_back(event);
+			if (mJournal.size() > SESSION_EVENT_JOURNAL_SIZE) {
+				mJournal.pop_front();
+			}
+		}
+		mJournalCondition.notify_all();
+
 		if (!mDBusConn) {
 			return false;
 		}
@@ -132,6 +154,43 @@ namespace ogon { namespace sessionmanager { namespace session {
 		return true;
 	}
 
+	bool SessionNotifier::waitForEvents(UINT64 afterSequence, DWORD timeout,
+		SessionEventList &events, UINT64 &lastSequence) {
+
+		std::unique_lock<std::mutex> lock(mJournalMutex);
+
+		// a sequence from before a restart of the session manager
+		if (afterSequence > mSequence) {
+			lastSequence = mSequence;
+			return false;
+		}
+
+		mJournalCondition.wait_for(lock, std::chrono::milliseconds(timeout), [&] {
+			return mWaitsCancelled || (mSequence > afterSequence);
+		});
+
+		lastSequence = mSequence;
+		for (std::deque<SessionEvent>::const_iterator it = mJournal.begin(); it != mJournal.end(); ++it) {
+			if (it->sequence > afterSequence) {
+				events.push_back(*it);
+			}
+		}
+		return mJournal.empty() || (mJournal.front().sequence <= afterSequence + 1);
+	}
+
+	UINT64 SessionNotifier::getLastSequence() {
+		std::lock_guard<std::mutex> lock(mJournalMutex);
+		return mSequence;
+	}
+
+	void SessionNotifier::cancelWaits() {
+		{
+			std::lock_guard<std::mutex> lock(mJournalMutex);
+			mWaitsCancelled = true;
+		}
+		mJournalCondition.notify_all();
+	}
+
 	const char * SessionNotifier::wtsNotificationToString(int signal) {
 		switch (signal) {
 			case 0x1:
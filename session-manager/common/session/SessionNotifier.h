@@ -28,25 +28,64 @@
 #include "Connection.h"
 
 #include <string>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
 #include <winpr/synch.h>
 
 #include <dbus/dbus.h>
 
 namespace ogon { namespace sessionmanager { namespace session {
 
+	/** @brief a session change as published by SessionNotifier::notify */
+	struct SessionEvent {
+		UINT64 sequence;
+		DWORD reason;
+		UINT32 sessionId;
+		std::string userName;
+		std::string domain;
+	};
+
+	typedef std::vector<SessionEvent> SessionEventList;
+
 	class SessionNotifier {
 	public:
 		SessionNotifier();
 		~SessionNotifier();
 
 		bool init();
-		bool notify(DWORD reason, UINT32 sessionId);
+		bool notify(DWORD reason, UINT32 sessionId,
+			const std::string &userName = std::string(), const std::string &domain = std::string());
 		bool shutdown();
 
+		/**
+		 * Waits until events newer than afterSequence were published. The last
+		 * events are kept in a journal, so nothing gets lost between two calls
+		 * unless a caller falls back by more than the journal size.
+		 * @param timeout in milliseconds
+		 * @param lastSequence receives the sequence to continue with
+		 * @return false if events after afterSequence were dropped from the journal
+		 */
+		bool waitForEvents(UINT64 afterSequence, DWORD timeout,
+			SessionEventList &events, UINT64 &lastSequence);
+
+		/** @return the sequence number of the last published event */
+		UINT64 getLastSequence();
+
+		/** lets all current and future waitForEvents calls return immediately */
+		void cancelWaits();
+
 	private:
 		const char *wtsNotificationToString(int signal);
 		DBusConnection *mDBusConn;
 		CRITICAL_SECTION mCSection;
+
+		std::mutex mJournalMutex;
+		std::condition_variable mJournalCondition;
+		std::deque<SessionEvent> mJournal;
+		UINT64 mSequence;
+		bool mWaitsCancelled;
 	};
 
 } /*session*/ } /*sessionmanager*/ } /*ogon*/
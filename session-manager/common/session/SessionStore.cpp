@@ -27,188 +27,204 @@
 
 #include "SessionStore.h"
 #include <winpr/wlog.h>
-#include <utils/CSGuard.h>
 
 namespace ogon { namespace sessionmanager { namespace session {
 
 	static wLog *logger_SessionStore = WLog_Get("ogon.sessionmanager.session.sessionstore");
 
 	SessionStore::SessionStore() {
-		if (!InitializeCriticalSectionAndSpinCount(&mCSection, 0x00000400)) {
-			WLog_Print(logger_SessionStore, WLOG_FATAL,
-				"Failed to initialize session store critical section");
-			throw std::bad_alloc();
-		}
 		mNextSessionId = 1;
 	}
 
 	SessionStore::~SessionStore() {
-		DeleteCriticalSection(&mCSection);
 	}
 
 	SessionPtr SessionStore::getSession(UINT32 sessionId) {
-		CSGuard guard(&mCSection);
-		if (mSessionMap.find(sessionId) != mSessionMap.end()) {
-			return mSessionMap[sessionId];
+		std::shared_lock<std::shared_mutex> guard(mLock);
+		TSessionMap::const_iterator iter = mSessionMap.find(sessionId);
+		if (iter != mSessionMap.end()) {
+			return iter->second;
 		}
 		return SessionPtr();
 	}
 
 	SessionPtr SessionStore::createSession() {
-		CSGuard guard(&mCSection);
-
-		do {
-			mNextSessionId++;
-			if (mNextSessionId == 0) {
+		UINT32 sessionId;
+		{
+			std::unique_lock<std::shared_mutex> guard(mLock);
+			do {
 				mNextSessionId++;
-			}
-		} while (mSessionMap.find(mNextSessionId) != mSessionMap.end());
-		SessionPtr session(new Session(mNextSessionId));
+				if (mNextSessionId == 0) {
+					mNextSessionId++;
+				}
+			} while ((mSessionMap.find(mNextSessionId) != mSessionMap.end()) ||
+					(mReservedSessionIds.find(mNextSessionId) != mReservedSessionIds.end()));
+			sessionId = mNextSessionId;
+			mReservedSessionIds.insert(sessionId);
+		}
+
+		// init() registers the session and starts its executor, don't block
+		// the store meanwhile
+		SessionPtr session(new Session(sessionId));
 		session->init();
-		mSessionMap[session->getSessionID()] = session;
+
+		std::unique_lock<std::shared_mutex> guard(mLock);
+		mReservedSessionIds.erase(sessionId);
+		mSessionMap[sessionId] = session;
+		addToIndex(session);
 		return session;
 	}
 
-	SessionPtr SessionStore::getFirstSession(const std::string &username, const std::string &domain) {
-		CSGuard guard(&mCSection);
+	void SessionStore::addToIndex(const SessionPtr &session) {
+		TUserDomainHostKey key(session->getUserName(), session->getDomain(),
+			session->getClientHostName());
+		UINT32 sessionId = session->getSessionID();
 
-		SessionPtr session;
-		TSessionMap::iterator iter;
+		mUserDomainIndex[TUserDomainKey(std::get<0>(key), std::get<1>(key))][sessionId] = session;
+		mUserDomainHostIndex[key][sessionId] = session;
+		mIndexKeys[sessionId] = key;
+	}
 
-		for (iter = mSessionMap.begin(); iter != mSessionMap.end(); iter++) {
-			if((iter->second->getUserName().compare(username) == 0) &&
-					(iter->second->getDomain().compare(domain) == 0)) {
-				session = iter->second;
-				break;
+	void SessionStore::removeFromIndex(UINT32 sessionId) {
+		std::map<UINT32, TUserDomainHostKey>::iterator keyIter = mIndexKeys.find(sessionId);
+		if (keyIter == mIndexKeys.end()) {
+			return;
+		}
+		const TUserDomainHostKey &key = keyIter->second;
+
+		TUserDomainIndex::iterator udIter = mUserDomainIndex.find(
+			TUserDomainKey(std::get<0>(key), std::get<1>(key)));
+		if (udIter != mUserDomainIndex.end()) {
+			udIter->second.erase(sessionId);
+			if (udIter->second.empty()) {
+				mUserDomainIndex.erase(udIter);
 			}
 		}
-		return session;
-	}
 
-	SessionPtr SessionStore::getFirstSession(const std::string &username,
-		const std::string &domain, const std::string &clientHostName) {
-
-		CSGuard guard(&mCSection);
-
-		SessionPtr session;
-		TSessionMap::iterator iter;
-
-		for (iter = mSessionMap.begin(); iter != mSessionMap.end(); iter++) {
-			if((iter->second->getUserName().compare(username) == 0) &&
-					(iter->second->getDomain().compare(domain) == 0)) {
-				if (clientHostName.compare(iter->second->getClientHostName()) == 0) {
-					session = iter->second;
-					break;
-				}
+		TUserDomainHostIndex::iterator udhIter = mUserDomainHostIndex.find(key);
+		if (udhIter != mUserDomainHostIndex.end()) {
+			udhIter->second.erase(sessionId);
+			if (udhIter->second.empty()) {
+				mUserDomainHostIndex.erase(udhIter);
 			}
 		}
-		return session;
+		mIndexKeys.erase(keyIter);
 	}
 
-	SessionPtr SessionStore::getFirstDisconnectedSession(const std::string &username,
-		const std::string &domain) {
-
-		CSGuard guard(&mCSection);
-
-		SessionPtr session;
-		TSessionMap::iterator iter;
-
-		for (iter = mSessionMap.begin(); iter != mSessionMap.end(); iter++) {
-			if((iter->second->getUserName().compare(username) == 0) &&
-					(iter->second->getDomain().compare(domain) == 0)) {
-				if (iter->second->getConnectState() == WTSDisconnected) {
-					iter->second->setConnectState(WTSConnectQuery);
-					session = iter->second;
-					break;
-				}
-			}
+	void SessionStore::updateSessionIndex(UINT32 sessionId) {
+		std::unique_lock<std::shared_mutex> guard(mLock);
+		TSessionMap::const_iterator iter = mSessionMap.find(sessionId);
+		if (iter == mSessionMap.end()) {
+			return;
 		}
-		return session;
+		removeFromIndex(sessionId);
+		addToIndex(iter->second);
 	}
 
-	SessionPtr SessionStore::getFirstDisconnectedSession(const std::string &username,
-		const std::string &domain, const std::string &clientHostName) {
-
-		CSGuard guard(&mCSection);
+	void SessionStore::getIndexedSessions(const std::string &username, const std::string &domain,
+		const std::string *clientHostName, std::vector<SessionPtr> &sessions) {
 
-		SessionPtr session;
-		TSessionMap::iterator iter;
-
-		for (iter = mSessionMap.begin(); iter != mSessionMap.end(); iter++) {
-			if((iter->second->getUserName().compare(username) == 0) &&
-					(iter->second->getDomain().compare(domain) == 0)) {
-				if ((iter->second->getConnectState() == WTSDisconnected)
-						&& (clientHostName.compare(iter->second->getClientHostName())==0)) {
-					iter->second->setConnectState(WTSConnectQuery);
-					session = iter->second;
-					break;
-				}
+		std::shared_lock<std::shared_mutex> guard(mLock);
+		const TSessionMap *indexed;
+		if (clientHostName) {
+			TUserDomainHostIndex::const_iterator iter = mUserDomainHostIndex.find(
+				TUserDomainHostKey(username, domain, *clientHostName));
+			if (iter == mUserDomainHostIndex.end()) {
+				return;
 			}
+			indexed = &iter->second;
+		} else {
+			TUserDomainIndex::const_iterator iter = mUserDomainIndex.find(
+				TUserDomainKey(username, domain));
+			if (iter == mUserDomainIndex.end()) {
+				return;
+			}
+			indexed = &iter->second;
+		}
+
+		sessions.reserve(indexed->size());
+		for (TSessionMap::const_iterator iter = indexed->begin(); iter != indexed->end(); iter++) {
+			sessions.push_back(iter->second);
 		}
-		return session;
 	}
 
-	SessionPtr SessionStore::getFirstLoggedInSession(const std::string &username,
-													 const std::string &domain) {
+	SessionPtr SessionStore::findInIndex(const std::string &username, const std::string &domain,
+		const std::string *clientHostName, bool loggedIn, bool claimDisconnected) {
 
-		CSGuard guard(&mCSection);
+		// the states are checked (and a disconnected session is claimed)
+		// without holding mLock, a state change notifies and updates timers
+		std::vector<SessionPtr> sessions;
+		getIndexedSessions(username, domain, clientHostName, sessions);
 
-		SessionPtr session;
-		TSessionMap::iterator iter;
-		WTS_CONNECTSTATE_CLASS state;
+		std::vector<SessionPtr>::const_iterator iter;
+		for (iter = sessions.begin(); iter != sessions.end(); iter++) {
+			if (claimDisconnected) {
+				if ((*iter)->claimDisconnected()) {
+					return *iter;
+				}
+				continue;
+			}
 
-		for (iter = mSessionMap.begin(); iter != mSessionMap.end(); iter++) {
-			if((iter->second->getUserName().compare(username) == 0) &&
-					(iter->second->getDomain().compare(domain) == 0)) {
-				state = iter->second->getConnectState();
+			WTS_CONNECTSTATE_CLASS state = (*iter)->getConnectState();
+			if (loggedIn) {
 				if ((state == WTSDisconnected) ||
 					(state == WTSActive) ||
 					(state == WTSInit) ||
 					(state == WTSShadow)) {
-					session = iter->second;
-					break;
+					return *iter;
 				}
+			} else {
+				return *iter;
 			}
 		}
-		return session;
+		return SessionPtr();
+	}
+
+	SessionPtr SessionStore::getFirstSession(const std::string &username, const std::string &domain) {
+		return findInIndex(username, domain, NULL, false, false);
+	}
+
+	SessionPtr SessionStore::getFirstSession(const std::string &username,
+		const std::string &domain, const std::string &clientHostName) {
+
+		return findInIndex(username, domain, &clientHostName, false, false);
+	}
+
+	SessionPtr SessionStore::getFirstDisconnectedSession(const std::string &username,
+		const std::string &domain) {
+
+		return findInIndex(username, domain, NULL, false, true);
+	}
+
+	SessionPtr SessionStore::getFirstDisconnectedSession(const std::string &username,
+		const std::string &domain, const std::string &clientHostName) {
+
+		return findInIndex(username, domain, &clientHostName, false, true);
 	}
 
 	SessionPtr SessionStore::getFirstLoggedInSession(const std::string &username,
-													 const std::string &domain, const std::string &clientHostName){
+													 const std::string &domain) {
 
-		CSGuard guard(&mCSection);
+		return findInIndex(username, domain, NULL, true, false);
+	}
 
-		SessionPtr session;
-		TSessionMap::iterator iter;
-		WTS_CONNECTSTATE_CLASS state;
+	SessionPtr SessionStore::getFirstLoggedInSession(const std::string &username,
+													 const std::string &domain, const std::string &clientHostName){
 
-		for (iter = mSessionMap.begin(); iter != mSessionMap.end(); iter++) {
-			if((iter->second->getUserName().compare(username) == 0) &&
-					(iter->second->getDomain().compare(domain) == 0)) {
-				state = iter->second->getConnectState();
-				if ((state == WTSDisconnected) ||
-					(state == WTSActive) ||
-					(state == WTSInit) ||
-					(state == WTSShadow)) {
-					if ((clientHostName.compare(iter->second->getClientHostName()) == 0)) {
-						session = iter->second;
-						break;
-					}
-				}
-			}
-		}
-		return session;
+		return findInIndex(username, domain, &clientHostName, true, false);
 	}
 
 	int SessionStore::removeSession(UINT32 sessionId) {
 		SessionPtr session;
-		EnterCriticalSection(&mCSection);
-		TSessionMap::const_iterator iter = mSessionMap.find(sessionId);
-		if (iter != mSessionMap.end()) {
-			session = iter->second;
+		{
+			std::unique_lock<std::shared_mutex> guard(mLock);
+			TSessionMap::const_iterator iter = mSessionMap.find(sessionId);
+			if (iter != mSessionMap.end()) {
+				session = iter->second;
+			}
+			mSessionMap.erase(sessionId);
+			removeFromIndex(sessionId);
 		}
-		mSessionMap.erase(sessionId);
-		LeaveCriticalSection(&mCSection);
 		if (session) {
 			session->shutdown();
 		}
@@ -216,7 +232,7 @@ namespace ogon { namespace sessionmanager { namespace session {
 	}
 
 	std::list<SessionPtr> SessionStore::getAllSessions() {
-		CSGuard guard(&mCSection);
+		std::shared_lock<std::shared_mutex> guard(mLock);
 		std::list<SessionPtr> list;
 		for (TSessionMap::const_iterator it = mSessionMap.begin(); it != mSessionMap.end(); ++it) {
 			list.push_back( it->second );
@@ -30,12 +30,22 @@
 #include <list>
 #include <winpr/synch.h>
 #include <map>
+#include <set>
+#include <tuple>
+#include <vector>
+#include <mutex>
+#include <shared_mutex>
 
 namespace ogon { namespace sessionmanager { namespace session {
 
 	typedef std::map<UINT32 , SessionPtr> TSessionMap;
 	typedef std::pair<UINT32, SessionPtr> TSessionPair;
 
+	typedef std::pair<std::string, std::string> TUserDomainKey;
+	typedef std::tuple<std::string, std::string, std::string> TUserDomainHostKey;
+	typedef std::map<TUserDomainKey, TSessionMap> TUserDomainIndex;
+	typedef std::map<TUserDomainHostKey, TSessionMap> TUserDomainHostIndex;
+
 	/**
 	 * @brief
 	 */
@@ -59,10 +69,33 @@ namespace ogon { namespace sessionmanager { namespace session {
 		std::list<SessionPtr> getAllSessions();
 		int removeSession(UINT32 sessionId);
 
+		/**
+		 * @brief re-reads user name, domain and client host name of the
+		 * session and updates the lookup indexes. Called by the Session
+		 * setters whenever one of these values changes.
+		 */
+		void updateSessionIndex(UINT32 sessionId);
+
 	private:
+		void addToIndex(const SessionPtr &session);
+		void removeFromIndex(UINT32 sessionId);
+		void getIndexedSessions(const std::string &username, const std::string &domain,
+				const std::string *clientHostName, std::vector<SessionPtr> &sessions);
+		SessionPtr findInIndex(const std::string &username, const std::string &domain,
+				const std::string *clientHostName, bool loggedIn, bool claimDisconnected);
+
 		TSessionMap mSessionMap;
 		UINT32 mNextSessionId;
-		CRITICAL_SECTION mCSection;
+		// ids handed out by createSession() whose session is still initializing
+		std::set<UINT32> mReservedSessionIds;
+
+		// sessions by (user, domain) and (user, domain, client host), each
+		// ordered by session id like mSessionMap. mIndexKeys remembers the
+		// key a session was indexed with so it can be removed again.
+		TUserDomainIndex mUserDomainIndex;
+		TUserDomainHostIndex mUserDomainHostIndex;
+		std::map<UINT32, TUserDomainHostKey> mIndexKeys;
+		std::shared_mutex mLock;
 	};
 
 } /*session*/ } /*sessionmanager*/ } /*ogon*/
@@ -52,7 +52,7 @@ namespace ogon { namespace sessionmanager { namespace session {
 			logoffSession->setConnectionId(connectionId);
 			APP_CONTEXT.getRpcOutgoingQueue()->addElement(logoffSession);
 
-			DWORD result = WaitForSingleObject(logoffSession->getAnswerHandle(), SHUTDOWN_TIME_OUT);
+			DWORD result = taskNS::ThreadPool::blockingWait(logoffSession->getAnswerHandle(), SHUTDOWN_TIME_OUT);
 
 			switch (result) {
 			case WAIT_OBJECT_0:
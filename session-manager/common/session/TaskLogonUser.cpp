@@ -79,6 +79,10 @@ namespace ogon { namespace sessionmanager { namespace session {
 	}
 
 	void TaskLogonUser::run() {
+		static metricsNS::Counter *logonSuccess = APP_CONTEXT.getMetricsRegistry()->getCounter(
+			"ogon_logons_total", "Logon requests handled", "result=\"success\"");
+		static metricsNS::Counter *logonFailure = APP_CONTEXT.getMetricsRegistry()->getCounter(
+			"ogon_logons_total", "Logon requests handled", "result=\"failure\"");
 		sessionNS::SessionPtr session;
 		if (mCreateAuthSession) {
 			session = getAuthSession();
@@ -89,11 +93,17 @@ namespace ogon { namespace sessionmanager { namespace session {
 		if (session) {
 			session->storeCookies(mOgonCookie, mBackendCookie);
 			mResult = 0;
+			logonSuccess->add();
 		} else {
 			mResult = 1;
+			logonFailure->add();
 		}
 		// send result
 		if (mCurrentCall) {
+			sessionNS::ConnectionPtr currentConnection = APP_CONTEXT.getConnectionStore()->getConnection(mConnectionId);
+			if (currentConnection) {
+				currentConnection->logonTraceEnd(LOGON_PHASE_LOGON_USER);
+			}
 			mCurrentCall->updateResult(mResult, mPipeName, mMaxHeight, mMaxWidth, mBackendCookie, mOgonCookie);
 			APP_CONTEXT.getRpcOutgoingQueue()->addElement(mCurrentCall);
 		}
@@ -118,7 +128,7 @@ namespace ogon { namespace sessionmanager { namespace session {
 
 		APP_CONTEXT.getRpcOutgoingQueue()->addElement(logoffSession);
 
-		DWORD result = WaitForSingleObject(logoffSession->getAnswerHandle(), SHUTDOWN_TIME_OUT);
+		DWORD result = taskNS::ThreadPool::blockingWait(logoffSession->getAnswerHandle(), SHUTDOWN_TIME_OUT);
 
 		switch (result) {
 		case WAIT_OBJECT_0:
@@ -170,7 +180,7 @@ namespace ogon { namespace sessionmanager { namespace session {
 				sessionNS::TaskEndPtr shutdown(new sessionNS::TaskEnd());
 				shutdown->setSessionId(mLogoffSession);
 				logoffSession->addTask(shutdown);
-				WaitForSingleObject(shutdown->getHandle(), INFINITE);
+				taskNS::ThreadPool::blockingWait(shutdown->getHandle(), INFINITE);
 			}
 		}
 
@@ -238,6 +248,7 @@ namespace ogon { namespace sessionmanager { namespace session {
 
 		if (currentSession->getConnectState() == WTSInit) {
 			std::string pipeName;
+			currentConnection->logonTraceBegin(LOGON_PHASE_MODULE_START);
 			if (!startModule(pipeName)) {
 				WLog_Print(logger_TaskLogonUser, WLOG_ERROR,
 					"s %" PRIu32 ": ModuleConfig %s does not start properly for user %s in domain %s",
@@ -246,6 +257,7 @@ namespace ogon { namespace sessionmanager { namespace session {
 				sessionStore->removeSession(currentSession->getSessionID());
 				goto errorOut;
 			}
+			currentConnection->logonTraceEnd(LOGON_PHASE_MODULE_START);
 			setConnectState(WTSConnected);
 		}
 		fetchQueuedCalls(currentConnection);
@@ -268,6 +280,7 @@ namespace ogon { namespace sessionmanager { namespace session {
 		sessionNS::SessionPtr currentSession = sessionStore->getSession(mSessionId);
 		std::string greeter;
 		pCLIENT_INFORMATION clientInformation;
+		bool preStarted;
 
 		if (currentSession == NULL) {
 			WLog_Print(logger_TaskLogonUser, WLOG_ERROR, "s %" PRIu32 ": Could not get session with sessionID %" PRIu32 "", mSessionId, mSessionId);
@@ -290,7 +303,10 @@ namespace ogon { namespace sessionmanager { namespace session {
 
 		initPermissions();
 
-		if (!generateAuthEnvBlockAndModify(mClientHostName, mClientAddress)) {
+		// a greeter taken from the greeter pool is already running
+		preStarted = currentSession->isModuleStarted();
+
+		if (!preStarted && !generateAuthEnvBlockAndModify(mClientHostName, mClientAddress)) {
 			WLog_Print(logger_TaskLogonUser, WLOG_ERROR, "s %" PRIu32 ": generateEnvBlockAndModify failed for user %s with domain %s",
 						mSessionId, mUserName.c_str(), mDomainName.c_str());
 			goto errorOut;
@@ -323,13 +339,19 @@ namespace ogon { namespace sessionmanager { namespace session {
 		clientInformation->initialWidth = mWidth;
 		clientInformation->initialHeight = mHeight;
 
-		if (!startModule(greeter)) {
+		if (!preStarted) {
+			currentConnection->logonTraceBegin(LOGON_PHASE_MODULE_START);
+		}
+		if (!preStarted && !startModule(greeter)) {
 			WLog_Print(logger_TaskLogonUser, WLOG_ERROR,
 					   "s %" PRIu32 ": ModuleConfig %s does not start properly for user %s in domain %s",
 					   mSessionId, currentSession->getModuleConfigName().c_str(),
 					   mUserName.c_str(), mDomainName.c_str());
 			goto errorOut;
 		}
+		if (!preStarted) {
+			currentConnection->logonTraceEnd(LOGON_PHASE_MODULE_START);
+		}
 		fetchQueuedCalls(currentConnection);
 		// fetch queued tasks from the connection object
 		setConnectState(WTSConnected);
@@ -28,7 +28,6 @@
 #include "TaskSessionTimeout.h"
 #include <winpr/wlog.h>
 #include <appcontext/ApplicationContext.h>
-#include <boost/date_time/posix_time/posix_time.hpp>
 #include <session/TaskEnd.h>
 
 
@@ -36,49 +35,23 @@ namespace ogon { namespace sessionmanager { namespace session {
 
 	static wLog *logger_TaskSessionTimeout = WLog_Get("ogon.sessionmanager.session.tasksessiontimeout");
 
-	bool TaskSessionTimeout::isThreaded() {
-		return true;
-	};
+	TaskSessionTimeout::TaskSessionTimeout(UINT32 sessionId, long timeout)
+		: mSessionId(sessionId), mTimeout(timeout) {
+	}
 
 	void TaskSessionTimeout::run() {
-		long timeout;
-		DWORD status;
-		for (;;) {
-			status = WaitForSingleObject(mhStop, 10 * 1000);
-			if (status == WAIT_OBJECT_0) {
-				// shutdown
-				return;
-			}
-			if (status == WAIT_TIMEOUT) {
-				// check all session if they need to be disconnected.
-				std::list<SessionPtr> allSessions = APP_CONTEXT.getSessionStore()->getAllSessions();
-				boost::posix_time::ptime currentTime = boost::date_time::second_clock<boost::posix_time::ptime>::universal_time();
-				std::list<sessionNS::SessionPtr>::iterator iterator;
-				for (iterator = allSessions.begin(); iterator != allSessions.end(); ++iterator) {
-					sessionNS::SessionPtr currentSession = (*iterator);
-					if (currentSession->getConnectState() == WTSDisconnected) {
-						if (!APP_CONTEXT.getPropertyManager()->getPropertyNumber(currentSession->getSessionID(), "session.timeout", timeout)) {
-							WLog_Print(logger_TaskSessionTimeout, WLOG_INFO,
-								"session.timeout was not found for session %" PRIu32 ", using value of 0",
-								currentSession->getSessionID());
-							timeout = 0;
-						}
-
-						if ((timeout >= 0) && (((currentTime - currentSession->getConnectStateChangeTime()).ticks()) / ((boost::posix_time::time_duration::ticks_per_second() * 60)) >= timeout)) {
-							// shutdown current Session
-							WLog_Print(logger_TaskSessionTimeout, WLOG_INFO,
-								"s %" PRIu32 ": Session for user %s is stopped after %ld minutes after the disconnect.",
-								currentSession->getSessionID(),
-								currentSession->getUserName().c_str(),
-								timeout);
-							sessionNS::TaskEndPtr task = sessionNS::TaskEndPtr(new sessionNS::TaskEnd());
-							task->setSessionId(currentSession->getSessionID());
-							currentSession->addTask(task);
-						}
-					}
-				} // for loop of all sessions
-			}// WAIT_TIMEOUT
-		} // for loop
+		sessionNS::SessionPtr currentSession = APP_CONTEXT.getSessionStore()->getSession(mSessionId);
+		if (!currentSession || (currentSession->getConnectState() != WTSDisconnected)) {
+			return;
+		}
+
+		// shutdown current Session
+		WLog_Print(logger_TaskSessionTimeout, WLOG_INFO,
+			"s %" PRIu32 ": Session for user %s is stopped after %ld minutes after the disconnect.",
+			mSessionId, currentSession->getUserName().c_str(), mTimeout);
+		sessionNS::TaskEndPtr task = sessionNS::TaskEndPtr(new sessionNS::TaskEnd());
+		task->setSessionId(mSessionId);
+		currentSession->addTask(task);
 	}
 
 } /*session*/ } /*sessionmanager*/ } /*ogon*/
@@ -24,14 +24,24 @@
 #ifndef _OGON_SMGR_SESSION_TASKSESSIONTIMEOUT_H_
 #define _OGON_SMGR_SESSION_TASKSESSIONTIMEOUT_H_
 
-#include <task/ThreadTask.h>
+#include <task/Task.h>
+#include <winpr/wtypes.h>
 
 namespace ogon { namespace sessionmanager { namespace session {
 
-	class TaskSessionTimeout: public taskNS::ThreadTask {
+	/**
+	 * @brief armed on the timer service when a session gets disconnected,
+	 * ends the session if it is still disconnected once session.timeout
+	 * expired.
+	 */
+	class TaskSessionTimeout: public taskNS::Task {
 	public:
+		TaskSessionTimeout(UINT32 sessionId, long timeout);
 		virtual void run();
-		virtual bool isThreaded();
+
+	private:
+		UINT32 mSessionId;
+		long mTimeout;
 	};
 
 	typedef std::shared_ptr<TaskSessionTimeout> TaskSessionTimeoutPtr;
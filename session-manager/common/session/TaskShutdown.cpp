@@ -55,7 +55,7 @@ namespace ogon { namespace sessionmanager { namespace session {
 
 		unregisterSession();
 		removeAuthToken();
-		getAccessorSession()->stopExecutorThread(false);
+		getAccessorSession()->stopExecutor(false);
 	}
 
 } /*session*/ } /*sessionmanager*/ } /*ogon*/
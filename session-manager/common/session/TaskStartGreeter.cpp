@@ -0,0 +1,71 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Task starting a greeter for the greeter pool
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "TaskStartGreeter.h"
+#include <winpr/wlog.h>
+#include <appcontext/ApplicationContext.h>
+
+
+namespace ogon { namespace sessionmanager { namespace session {
+
+	static wLog *logger_TaskStartGreeter = WLog_Get("ogon.sessionmanager.session.taskstartgreeter");
+
+	TaskStartGreeter::TaskStartGreeter(UINT32 sessionId, const std::string &greeter)
+		: mSessionId(sessionId), mGreeter(greeter) {
+	}
+
+	void TaskStartGreeter::run() {
+		sessionNS::SessionPtr currentSession = APP_CONTEXT.getSessionStore()->getSession(mSessionId);
+		std::string pipeName;
+		bool success = false;
+
+		if (!currentSession || APP_CONTEXT.isShutdown()) {
+			APP_CONTEXT.getGreeterPool()->greeterStarted(mSessionId, mGreeter, false);
+			return;
+		}
+
+		setAccessorSession(currentSession);
+		setModuleConfigName(mGreeter);
+		initPermissions();
+
+		if (!generateAuthEnvBlockAndModify("", "")) {
+			WLog_Print(logger_TaskStartGreeter, WLOG_ERROR,
+				"s %" PRIu32 ": generateAuthEnvBlockAndModify failed", mSessionId);
+		} else if (!startModule(pipeName)) {
+			WLog_Print(logger_TaskStartGreeter, WLOG_ERROR,
+				"s %" PRIu32 ": ModuleConfig %s does not start properly", mSessionId, mGreeter.c_str());
+		} else {
+			success = true;
+		}
+		resetAccessorSession();
+
+		APP_CONTEXT.getGreeterPool()->greeterStarted(mSessionId, mGreeter, success);
+	}
+
+	void TaskStartGreeter::abortTask() {
+		APP_CONTEXT.getGreeterPool()->greeterStarted(mSessionId, mGreeter, false);
+		Task::abortTask();
+	}
+
+} /*session*/ } /*sessionmanager*/ } /*ogon*/
@@ -0,0 +1,51 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Task starting a greeter for the greeter pool
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifndef _OGON_SMGR_SESSION_TASKSTARTGREETER_H_
+#define _OGON_SMGR_SESSION_TASKSTARTGREETER_H_
+
+#include <task/Task.h>
+#include <session/SessionAccessor.h>
+#include <winpr/wtypes.h>
+
+namespace ogon { namespace sessionmanager { namespace session {
+
+	/**
+	 * @brief starts the greeter backend of a GreeterPool session and
+	 * reports the result back to the pool.
+	 */
+	class TaskStartGreeter: public taskNS::Task, public SessionAccessor {
+	public:
+		TaskStartGreeter(UINT32 sessionId, const std::string &greeter);
+		virtual void run();
+		virtual void abortTask();
+
+	private:
+		UINT32 mSessionId;
+		std::string mGreeter;
+	};
+
+	typedef std::shared_ptr<TaskStartGreeter> TaskStartGreeterPtr;
+
+} /*session*/ } /*sessionmanager*/ } /*ogon*/
+
+namespace sessionNS = ogon::sessionmanager::session;
+
+#endif /* _OGON_SMGR_SESSION_TASKSTARTGREETER_H_ */
@@ -69,7 +69,7 @@ namespace ogon { namespace sessionmanager { namespace session {
 		switchToCall->setMaxWidth(session->getMaxXRes());
 
 		APP_CONTEXT.getRpcOutgoingQueue()->addElement(switchToCall);
-		WaitForSingleObject(switchToCall->getAnswerHandle(), INFINITE);
+		taskNS::ThreadPool::blockingWait(switchToCall->getAnswerHandle(), INFINITE);
 		setAccessorSession(session);
 
 		if (switchToCall->getResult() != 0) {
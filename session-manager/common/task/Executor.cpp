@@ -45,12 +45,10 @@ namespace ogon { namespace sessionmanager { namespace task {
 
 	static wLog *logger_Executor = WLog_Get("ogon.sessionmanager.task.Executor");
 
-	Executor::Executor() {
-		mhStopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
-		mhTaskThreadStarted = CreateEvent(NULL, TRUE, FALSE, NULL);
+	Executor::Executor() : mPool("executor"), mStrandPool("strand") {
 		mhStopThreads = CreateEvent(NULL, TRUE, FALSE, NULL);
 
-		if (!mhStopEvent || !mhTaskThreadStarted || !mhStopThreads) {
+		if (!mhStopThreads) {
 			WLog_Print(logger_Executor, WLOG_FATAL,
 				"Failed to create executor events");
 			throw std::bad_alloc();
@@ -60,14 +58,11 @@ namespace ogon { namespace sessionmanager { namespace task {
 				"Failed to initialize executor critical section");
 			throw std::bad_alloc();
 		}
-		mhServerThread = NULL;
 		mRunning = false;
 	}
 
 	Executor::~Executor() {
 		DeleteCriticalSection(&mCSection);
-		CloseHandle(mhStopEvent);
-		CloseHandle(mhTaskThreadStarted);
 		CloseHandle(mhStopThreads);
 	}
 
@@ -76,124 +71,101 @@ namespace ogon { namespace sessionmanager { namespace task {
 
 		if (mRunning) {
 			WLog_Print(logger_Executor, WLOG_ERROR,
-				"Executor Thread already started!");
+				"Executor already started!");
 			return false;
 		}
 
-		if (!(mhServerThread = CreateThread(NULL, 0,
-				(LPTHREAD_START_ROUTINE) Executor::execThread, (void*) this,
-				0, NULL)))
-		{
-			WLog_Print(logger_Executor, WLOG_ERROR, "failed to create thread");
+		ResetEvent(mhStopThreads);
+		if (!mPool.start(EXECUTOR_WORKER_THREADS)) {
+			WLog_Print(logger_Executor, WLOG_ERROR, "failed to start executor thread pool");
+			return false;
+		}
+		if (!mStrandPool.start(EXECUTOR_STRAND_THREADS, EXECUTOR_STRAND_MAX_THREADS)) {
+			WLog_Print(logger_Executor, WLOG_ERROR, "failed to start strand thread pool");
+			mPool.stop();
 			return false;
 		}
+		WLog_Print(logger_Executor, WLOG_INFO, "started Executor");
 		mRunning = true;
 		return true;
 	}
 
 	bool Executor::stop() {
-		CSGuard guard(&mCSection);
-
-		mRunning = false;
-		if (mhServerThread) {
-			SetEvent(mhStopEvent);
-			WaitForSingleObject(mhServerThread, INFINITE);
-			CloseHandle(mhServerThread);
-			mhServerThread = NULL;
-		} else {
-			WLog_Print(logger_Executor, WLOG_ERROR,
-				"Executor was not started before.");
-			return false;
+		std::list<HANDLE> taskThreads;
+		{
+			CSGuard guard(&mCSection);
+			if (!mRunning) {
+				WLog_Print(logger_Executor, WLOG_ERROR,
+					"Executor was not started before.");
+				return false;
+			}
+			mRunning = false;
+			taskThreads.swap(mTaskThreadList);
 		}
-		return true;
-	}
 
-	void Executor::runExecutor() {
-		DWORD nCount;
-		HANDLE queueHandle = mTasks.getSignalHandle();
-		HANDLE events[2];
-
-		nCount = 0;
-		events[nCount++] = mhStopEvent;
-		events[nCount++] = queueHandle;
-
-		while (1) {
-			WaitForMultipleObjects(nCount, events, FALSE, INFINITE);
-
-			if (WaitForSingleObject(mhStopEvent, 0) == WAIT_OBJECT_0) {
-				SetEvent(mhStopThreads);
-				// shut down all threads
-				mTaskThreadList.erase(
-					remove_if(mTaskThreadList.begin(), mTaskThreadList.end(),
-						std::bind1st( std::mem_fun( &Executor::waitThreadHandles), this))
-					, mTaskThreadList.end());
-				break;
-			}
+		// shut down all threads
+		SetEvent(mhStopThreads);
+		taskThreads.erase(
+			remove_if(taskThreads.begin(), taskThreads.end(),
+				std::bind1st( std::mem_fun( &Executor::waitThreadHandles), this))
+			, taskThreads.end());
 
-			if (WaitForSingleObject(queueHandle, 0) == WAIT_OBJECT_0) {
-				std::list<TaskPtr> currentTasks = mTasks.getAllElements();
-				std::list<TaskPtr>::const_iterator iter;
-				for(iter = currentTasks.begin(); iter != currentTasks.end(); ++iter) {
-					TaskPtr currentTask = *iter;
-					ThreadTaskPtr threadTask = std::dynamic_pointer_cast<ThreadTask>(currentTask);
-					if (threadTask) {
-						// start Task as thread
-						threadTask->setHandles(mhStopThreads, mhTaskThreadStarted);
-						HANDLE taskThread = CreateThread(NULL, 0,
-							(LPTHREAD_START_ROUTINE) Executor::execTask,
-							(void*) &currentTask, 0, NULL);
-						if (!taskThread) {
-							WLog_Print(logger_Executor, WLOG_ERROR, "failed to create task thread");
-							// dont abort the whole Sessionmanager, just signal the failure
-							// of the task
-							currentTask->abortTask();
-							currentTask.reset();
-							continue;
-						}
-						mTaskThreadList.push_back(taskThread);
-						WaitForSingleObject(mhTaskThreadStarted, INFINITE);
-						ResetEvent(mhTaskThreadStarted);
-						currentTask.reset();
-					} else {
-						currentTask->preProcess();
-						currentTask->run();
-						currentTask->postProcess();
-						currentTask.reset();
-					}
-				}
-				mTaskThreadList.erase(
-					remove_if(mTaskThreadList.begin(), mTaskThreadList.end(),
-						std::bind1st( std::mem_fun( &Executor::checkThreadHandles), this)),
-					mTaskThreadList.end());
-			}
-		}
+		mStrandPool.stop();
+		mPool.stop();
+		WLog_Print(logger_Executor, WLOG_INFO, "stopped Executor");
+		return true;
 	}
 
 	bool Executor::addTask(TaskPtr task) {
+		ThreadTaskPtr threadTask = std::dynamic_pointer_cast<ThreadTask>(task);
+		if (!threadTask) {
+			return mPool.addTask(task);
+		}
+
 		CSGuard guard(&mCSection);
-		if (mRunning) {
-			mTasks.addElement(task);
-			return true;
-		} else {
+		if (!mRunning) {
 			return false;
 		}
-	}
 
-	void* Executor::execThread(void *arg) {
-		Executor *executor;
+		mTaskThreadList.erase(
+			remove_if(mTaskThreadList.begin(), mTaskThreadList.end(),
+				std::bind1st( std::mem_fun( &Executor::checkThreadHandles), this)),
+			mTaskThreadList.end());
+
+		// start Task as thread, the thread owns the copy of the pointer
+		threadTask->setHandles(mhStopThreads, NULL);
+		ThreadTaskPtr *taskptr = new ThreadTaskPtr(threadTask);
+		HANDLE taskThread = CreateThread(NULL, 0,
+			(LPTHREAD_START_ROUTINE) Executor::execTask,
+			(void*) taskptr, 0, NULL);
+		if (!taskThread) {
+			WLog_Print(logger_Executor, WLOG_ERROR, "failed to create task thread");
+			// dont abort the whole Sessionmanager, just signal the failure
+			// of the task
+			delete taskptr;
+			task->abortTask();
+			return false;
+		}
+		mTaskThreadList.push_back(taskThread);
+		return true;
+	}
 
-		executor = (Executor *) arg;
-		WLog_Print(logger_Executor, WLOG_INFO, "started Executor thread");
+	StrandPtr Executor::createStrand() {
+		return StrandPtr(new Strand(mStrandPool));
+	}
 
-		executor->runExecutor();
+	ThreadPoolStats Executor::getStats() const {
+		return mPool.getStats();
+	}
 
-		WLog_Print(logger_Executor, WLOG_INFO, "stopped Executor thread");
-		return NULL;
+	ThreadPoolStats Executor::getStrandStats() const {
+		return mStrandPool.getStats();
 	}
 
 	void* Executor::execTask(void *arg) {
 		ThreadTaskPtr *taskptr = static_cast<ThreadTaskPtr*>(arg);
 		ThreadTaskPtr task = *taskptr;
+		delete taskptr;
 
 		task->preProcess();
 		WLog_Print(logger_Executor, WLOG_TRACE, "started Task thread");
@@ -25,13 +25,27 @@
 #define _OGON_SMGR_EXECUTOR_H_
 
 #include "Task.h"
-#include <utils/SignalingQueue.h>
+#include "ThreadPool.h"
+#include "Strand.h"
 #include <list>
 
 #define PIPE_BUFFER_SIZE	0xFFFF
+#define EXECUTOR_WORKER_THREADS	4
+#define EXECUTOR_STRAND_THREADS	16
+#define EXECUTOR_STRAND_MAX_THREADS	1024
 
 namespace ogon { namespace sessionmanager { namespace task {
 
+	/**
+	 * @brief runs independent tasks on a work stealing ThreadPool.
+	 *
+	 * Tasks which have to keep their order are added to a Strand created
+	 * with createStrand(). Strands run on a separate, larger pool since
+	 * session tasks block waiting for answers or for tasks of other
+	 * strands; that pool adds workers (up to EXECUTOR_STRAND_MAX_THREADS)
+	 * while all of them are blocked in ThreadPool::blockingWait().
+	 * ThreadTasks are long running and still get a thread of their own.
+	 */
 	class Executor {
 	public:
 		Executor();
@@ -40,30 +54,27 @@ namespace ogon { namespace sessionmanager { namespace task {
 		bool start();
 		bool stop();
 
-		void runExecutor();
-
 		bool addTask(TaskPtr task);
+		StrandPtr createStrand();
 
+		ThreadPoolStats getStats() const;
+		ThreadPoolStats getStrandStats() const;
 
 	private:
-		static void* execThread(void *arg);
 		static void* execTask(void *arg);
 
 		bool checkThreadHandles(const HANDLE value) const;
 		bool waitThreadHandles(const HANDLE value) const;
 
 	private:
-		HANDLE mhStopEvent;
-		HANDLE mhServerThread;
-
 		HANDLE mhStopThreads;
-		HANDLE mhTaskThreadStarted;
 
 		bool mRunning;
 
 		std::list<HANDLE> mTaskThreadList;
 		CRITICAL_SECTION mCSection;
-		SignalingQueue<TaskPtr> mTasks;
+		ThreadPool mPool;
+		ThreadPool mStrandPool;
 	};
 
 } /*task*/ } /*sessionmanager*/ } /*ogon*/
@@ -0,0 +1,174 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Serial task queue executed on a ThreadPool
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "Strand.h"
+
+#include <utils/CSGuard.h>
+
+#include <winpr/wlog.h>
+
+namespace ogon { namespace sessionmanager { namespace task {
+
+	static wLog *logger_Strand = WLog_Get("ogon.sessionmanager.task.strand");
+
+	// strand the current thread is running tasks for, if any
+	static thread_local Strand *gCurrentStrand = NULL;
+
+	/**
+	 * @brief pool task draining a strand.
+	 */
+	class TaskStrandRun : public Task {
+	public:
+		TaskStrandRun(StrandPtr strand) : mStrand(strand) {}
+
+		virtual void run() {
+			mStrand->runTasks();
+		}
+
+		virtual void abortTask() {
+			mStrand->abortTasks();
+		}
+
+	private:
+		StrandPtr mStrand;
+	};
+
+	Strand::Strand(ThreadPool &pool) : mPool(pool), mScheduled(false), mAborted(false),
+		mExecuting(false) {
+		if (!(mhIdleEvent = CreateEvent(NULL, TRUE, TRUE, NULL))) {
+			WLog_Print(logger_Strand, WLOG_FATAL,
+				"Failed to create strand idle event");
+			throw std::bad_alloc();
+		}
+		if (!InitializeCriticalSectionAndSpinCount(&mCSection, 0x00000400)) {
+			WLog_Print(logger_Strand, WLOG_FATAL,
+				"Failed to initialize strand critical section");
+			throw std::bad_alloc();
+		}
+	}
+
+	Strand::~Strand() {
+		DeleteCriticalSection(&mCSection);
+		CloseHandle(mhIdleEvent);
+	}
+
+	void Strand::updateIdle() {
+		if (mScheduled || mExecuting) {
+			ResetEvent(mhIdleEvent);
+		} else {
+			SetEvent(mhIdleEvent);
+		}
+	}
+
+	bool Strand::addTask(TaskPtr task) {
+		CSGuard guard(&mCSection);
+		if (mAborted) {
+			task->abortTask();
+			return false;
+		}
+
+		mTasks.push_back(task);
+		if (mScheduled) {
+			return true;
+		}
+
+		if (!mPool.addTask(TaskPtr(new TaskStrandRun(shared_from_this())))) {
+			mTasks.pop_back();
+			task->abortTask();
+			return false;
+		}
+		mScheduled = true;
+		updateIdle();
+		return true;
+	}
+
+	void Strand::abortTasks() {
+		std::list<TaskPtr> tasks;
+		{
+			CSGuard guard(&mCSection);
+			mAborted = true;
+			mScheduled = false;
+			updateIdle();
+			tasks.swap(mTasks);
+		}
+
+		for (std::list<TaskPtr>::iterator it = tasks.begin(); it != tasks.end(); ++it) {
+			(*it)->abortTask();
+		}
+	}
+
+	void Strand::waitIdle() {
+		// a task can't wait for its own strand to finish
+		if (gCurrentStrand == this) {
+			return;
+		}
+		ThreadPool::blockingWait(mhIdleEvent, INFINITE);
+	}
+
+	size_t Strand::getQueueDepth() const {
+		CSGuard guard(&mCSection);
+		return mTasks.size();
+	}
+
+	void Strand::runTasks() {
+		gCurrentStrand = this;
+		for (size_t i = 0; i < STRAND_BATCH_SIZE; i++) {
+			TaskPtr task;
+			{
+				CSGuard guard(&mCSection);
+				if (mTasks.empty() || mAborted) {
+					mScheduled = false;
+					updateIdle();
+					gCurrentStrand = NULL;
+					return;
+				}
+				task = mTasks.front();
+				mTasks.pop_front();
+				mExecuting = true;
+			}
+
+			task->preProcess();
+			task->run();
+			task->postProcess();
+			task.reset();
+
+			CSGuard guard(&mCSection);
+			mExecuting = false;
+			updateIdle();
+		}
+		gCurrentStrand = NULL;
+
+		CSGuard guard(&mCSection);
+		if (mTasks.empty() || mAborted) {
+			mScheduled = false;
+			updateIdle();
+			return;
+		}
+		if (!mPool.addTask(TaskPtr(new TaskStrandRun(shared_from_this())))) {
+			guard.leaveGuard();
+			abortTasks();
+		}
+	}
+
+} /*task*/ } /*sessionmanager*/ } /*ogon*/
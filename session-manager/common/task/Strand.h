@@ -0,0 +1,73 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Serial task queue executed on a ThreadPool
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifndef _OGON_SMGR_STRAND_H_
+#define _OGON_SMGR_STRAND_H_
+
+#include "Task.h"
+#include "ThreadPool.h"
+#include <winpr/synch.h>
+#include <list>
+#include <memory>
+
+#define STRAND_BATCH_SIZE 16
+
+namespace ogon { namespace sessionmanager { namespace task {
+
+	/**
+	 * @brief runs its tasks one after another in the order they were added,
+	 * borrowing a worker of the pool only while tasks are pending.
+	 *
+	 * After STRAND_BATCH_SIZE tasks the strand gives the worker back and
+	 * requeues itself, so a busy strand can't starve the others.
+	 * Once aborted, all pending and later added tasks are aborted.
+	 */
+	class Strand : public std::enable_shared_from_this<Strand> {
+	public:
+		Strand(ThreadPool &pool);
+		~Strand();
+
+		bool addTask(TaskPtr task);
+		void abortTasks();
+		void waitIdle();
+
+		size_t getQueueDepth() const;
+
+	private:
+		friend class TaskStrandRun;
+		void runTasks();
+		void updateIdle();
+
+		ThreadPool &mPool;
+		std::list<TaskPtr> mTasks;
+		bool mScheduled;
+		bool mAborted;
+		bool mExecuting;
+		HANDLE mhIdleEvent;
+		mutable CRITICAL_SECTION mCSection;
+	};
+
+	typedef std::shared_ptr<Strand> StrandPtr;
+
+} /*task*/ } /*sessionmanager*/ } /*ogon*/
+
+namespace taskNS = ogon::sessionmanager::task;
+
+#endif /* _OGON_SMGR_STRAND_H_ */
@@ -0,0 +1,346 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Fixed size work stealing pool of worker threads running Task objects
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "ThreadPool.h"
+
+#include <utils/CSGuard.h>
+
+#include <winpr/thread.h>
+#include <winpr/wlog.h>
+
+namespace ogon { namespace sessionmanager { namespace task {
+
+	static wLog *logger_ThreadPool = WLog_Get("ogon.sessionmanager.task.threadpool");
+
+	// worker of the pool the current thread belongs to, if any
+	static thread_local void *gCurrentWorker = NULL;
+
+	ThreadPool::ThreadPool(const std::string &name) : mName(name), mRunning(false),
+		mThreads(0), mWorkerCount(0), mBlockedWorkers(0), mNextWorker(0), mQueueDepth(0),
+		mTasksExecuted(0), mTasksStolen(0), mTotalLatency(0), mMaxLatency(0) {
+
+		mhStopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+		mhTaskSemaphore = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
+
+		if (!mhStopEvent || !mhTaskSemaphore) {
+			WLog_Print(logger_ThreadPool, WLOG_FATAL,
+				"Failed to create thread pool events");
+			throw std::bad_alloc();
+		}
+		if (!InitializeCriticalSectionAndSpinCount(&mCSection, 0x00000400)) {
+			WLog_Print(logger_ThreadPool, WLOG_FATAL,
+				"Failed to initialize thread pool critical section");
+			throw std::bad_alloc();
+		}
+	}
+
+	ThreadPool::~ThreadPool() {
+		clearWorkers();
+		DeleteCriticalSection(&mCSection);
+		CloseHandle(mhStopEvent);
+		CloseHandle(mhTaskSemaphore);
+	}
+
+	void ThreadPool::clearWorkers() {
+		size_t count = mWorkerCount;
+		for (size_t i = 0; i < count; i++) {
+			DeleteCriticalSection(&mWorkers[i]->cs);
+			delete mWorkers[i];
+		}
+		mWorkers.clear();
+		mWorkerCount = 0;
+	}
+
+	ThreadPool::Worker *ThreadPool::addWorker() {
+		// called with mCSection held
+		size_t index = mWorkerCount;
+		if (index >= mWorkers.size()) {
+			return NULL;
+		}
+
+		Worker *worker = new Worker();
+		if (!InitializeCriticalSectionAndSpinCount(&worker->cs, 0x00000400)) {
+			delete worker;
+			return NULL;
+		}
+		worker->pool = this;
+		worker->index = index;
+		worker->thread = NULL;
+
+		// the queue has to be visible before the worker can steal or be stolen from
+		mWorkers[index] = worker;
+		mWorkerCount = index + 1;
+
+		worker->thread = CreateThread(NULL, 0,
+			(LPTHREAD_START_ROUTINE) ThreadPool::workerThread, (void*) worker,
+			0, NULL);
+		if (!worker->thread) {
+			WLog_Print(logger_ThreadPool, WLOG_ERROR,
+				"%s: failed to create worker thread %" PRIuz "", mName.c_str(), index);
+		}
+		return worker;
+	}
+
+	bool ThreadPool::start(size_t threads, size_t maxThreads) {
+		CSGuard guard(&mCSection);
+
+		if (mRunning) {
+			WLog_Print(logger_ThreadPool, WLOG_ERROR,
+				"%s: thread pool already started!", mName.c_str());
+			return false;
+		}
+
+		ResetEvent(mhStopEvent);
+		mThreads = threads;
+		mWorkers.assign(maxThreads > threads ? maxThreads : threads, NULL);
+		mBlockedWorkers = 0;
+
+		size_t started = 0;
+		for (size_t i = 0; i < threads; i++) {
+			Worker *worker = addWorker();
+			if (!worker || !worker->thread) {
+				break;
+			}
+			started++;
+		}
+
+		if (started != threads) {
+			SetEvent(mhStopEvent);
+			for (size_t i = 0; i < mWorkerCount; i++) {
+				if (mWorkers[i]->thread) {
+					WaitForSingleObject(mWorkers[i]->thread, INFINITE);
+					CloseHandle(mWorkers[i]->thread);
+				}
+			}
+			clearWorkers();
+			return false;
+		}
+
+		mRunning = true;
+		return true;
+	}
+
+	bool ThreadPool::stop() {
+		{
+			CSGuard guard(&mCSection);
+			if (!mRunning) {
+				WLog_Print(logger_ThreadPool, WLOG_ERROR,
+					"%s: thread pool was not started before.", mName.c_str());
+				return false;
+			}
+			mRunning = false;
+		}
+
+		// no workers are added once mRunning is false
+		SetEvent(mhStopEvent);
+		size_t count = mWorkerCount;
+		for (size_t i = 0; i < count; i++) {
+			if (mWorkers[i]->thread) {
+				WaitForSingleObject(mWorkers[i]->thread, INFINITE);
+				CloseHandle(mWorkers[i]->thread);
+			}
+		}
+
+		ThreadPoolStats stats = getStats();
+		WLog_Print(logger_ThreadPool, WLOG_DEBUG,
+			"%s: executed %" PRIu64 " tasks (%" PRIu64 " stolen) on %" PRIuz " workers, average latency %" PRIu64 "us, max latency %" PRIu64 "us",
+			mName.c_str(), stats.tasksExecuted, stats.tasksStolen, stats.workers, stats.averageLatency, stats.maxLatency);
+
+		CSGuard guard(&mCSection);
+		for (size_t i = 0; i < count; i++) {
+			std::deque<QueuedTask>::iterator taskIt;
+			for (taskIt = mWorkers[i]->tasks.begin(); taskIt != mWorkers[i]->tasks.end(); ++taskIt) {
+				taskIt->task->abortTask();
+			}
+		}
+		clearWorkers();
+
+		// drain the semaphore for a later restart
+		while (WaitForSingleObject(mhTaskSemaphore, 0) == WAIT_OBJECT_0);
+		mQueueDepth = 0;
+		return true;
+	}
+
+	bool ThreadPool::addTask(TaskPtr task) {
+		CSGuard guard(&mCSection);
+		if (!mRunning) {
+			return false;
+		}
+
+		Worker *worker = (Worker *) gCurrentWorker;
+		if (!worker || worker->pool != this) {
+			worker = mWorkers[mNextWorker++ % mWorkerCount];
+		}
+
+		QueuedTask queued;
+		queued.task = task;
+		queued.queued = std::chrono::steady_clock::now();
+		{
+			CSGuard workerGuard(&worker->cs);
+			worker->tasks.push_back(queued);
+		}
+		mQueueDepth++;
+		ReleaseSemaphore(mhTaskSemaphore, 1, NULL);
+		return true;
+	}
+
+	bool ThreadPool::nextTask(Worker *worker, QueuedTask &task) {
+		{
+			CSGuard guard(&worker->cs);
+			if (!worker->tasks.empty()) {
+				task = worker->tasks.front();
+				worker->tasks.pop_front();
+				return true;
+			}
+		}
+
+		// steal the most recently added task of another worker
+		size_t count = mWorkerCount;
+		for (size_t i = 1; i < count; i++) {
+			Worker *victim = mWorkers[(worker->index + i) % count];
+			CSGuard guard(&victim->cs);
+			if (!victim->tasks.empty()) {
+				task = victim->tasks.back();
+				victim->tasks.pop_back();
+				mTasksStolen++;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void ThreadPool::beginBlocking() {
+		size_t blocked = ++mBlockedWorkers;
+		if (blocked < mWorkerCount) {
+			return;
+		}
+
+		// every worker waits, queued tasks (maybe the ones they wait for)
+		// would never run
+		CSGuard guard(&mCSection);
+		if (!mRunning || (mBlockedWorkers < mWorkerCount)) {
+			return;
+		}
+		if (mWorkers.size() == mThreads) {
+			// a fixed size pool
+			return;
+		}
+		Worker *worker = addWorker();
+		if (!worker) {
+			WLog_Print(logger_ThreadPool, WLOG_WARN,
+				"%s: all %" PRIuz " workers are blocked, can't add another one",
+				mName.c_str(), (size_t) mWorkerCount);
+			return;
+		}
+		WLog_Print(logger_ThreadPool, WLOG_DEBUG,
+			"%s: all workers are blocked, added worker %" PRIuz "", mName.c_str(), worker->index);
+	}
+
+	void ThreadPool::endBlocking() {
+		mBlockedWorkers--;
+	}
+
+	DWORD ThreadPool::blockingWait(HANDLE handle, DWORD timeout) {
+		Worker *worker = (Worker *) gCurrentWorker;
+
+		// no need to account for waits that return right away
+		DWORD status = WaitForSingleObject(handle, 0);
+		if ((status != WAIT_TIMEOUT) || (timeout == 0)) {
+			return status;
+		}
+		if (!worker) {
+			return WaitForSingleObject(handle, timeout);
+		}
+
+		worker->pool->beginBlocking();
+		status = WaitForSingleObject(handle, timeout);
+		worker->pool->endBlocking();
+		return status;
+	}
+
+	void ThreadPool::runWorker(Worker *worker) {
+		HANDLE events[2];
+		DWORD nCount = 0;
+
+		events[nCount++] = mhStopEvent;
+		events[nCount++] = mhTaskSemaphore;
+
+		gCurrentWorker = worker;
+
+		while (1) {
+			DWORD status = WaitForMultipleObjects(nCount, events, FALSE, INFINITE);
+
+			if (status != WAIT_OBJECT_0 + 1) {
+				break;
+			}
+
+			// every semaphore count stands for a queued task, but it might
+			// sit in a queue that is currently locked by another worker
+			QueuedTask queued;
+			while (!nextTask(worker, queued)) {
+				if (WaitForSingleObject(mhStopEvent, 0) == WAIT_OBJECT_0) {
+					return;
+				}
+				SwitchToThread();
+			}
+			mQueueDepth--;
+
+			UINT64 latency = std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - queued.queued).count();
+			mTotalLatency += latency;
+			UINT64 maxLatency = mMaxLatency;
+			while (latency > maxLatency && !mMaxLatency.compare_exchange_weak(maxLatency, latency));
+
+			queued.task->preProcess();
+			queued.task->run();
+			queued.task->postProcess();
+			mTasksExecuted++;
+		}
+	}
+
+	ThreadPoolStats ThreadPool::getStats() const {
+		ThreadPoolStats stats;
+		stats.workers = mWorkerCount;
+		stats.blockedWorkers = mBlockedWorkers;
+		stats.queueDepth = mQueueDepth;
+		stats.tasksExecuted = mTasksExecuted;
+		stats.tasksStolen = mTasksStolen;
+		stats.maxLatency = mMaxLatency;
+		stats.averageLatency = stats.tasksExecuted ? mTotalLatency / stats.tasksExecuted : 0;
+		return stats;
+	}
+
+	void* ThreadPool::workerThread(void *arg) {
+		Worker *worker = (Worker *) arg;
+		ThreadPool *pool = worker->pool;
+
+		WLog_Print(logger_ThreadPool, WLOG_TRACE, "%s: started worker thread %" PRIuz "",
+			pool->mName.c_str(), worker->index);
+		pool->runWorker(worker);
+		WLog_Print(logger_ThreadPool, WLOG_TRACE, "%s: stopped worker thread %" PRIuz "",
+			pool->mName.c_str(), worker->index);
+		return NULL;
+	}
+
+} /*task*/ } /*sessionmanager*/ } /*ogon*/
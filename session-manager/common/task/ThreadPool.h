@@ -0,0 +1,128 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Fixed size work stealing pool of worker threads running Task objects
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifndef _OGON_SMGR_THREADPOOL_H_
+#define _OGON_SMGR_THREADPOOL_H_
+
+#include "Task.h"
+#include <winpr/synch.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <string>
+
+namespace ogon { namespace sessionmanager { namespace task {
+
+	/**
+	 * @brief counters of a ThreadPool, latencies are in microseconds and
+	 * measured from addTask until a worker starts the task.
+	 */
+	struct ThreadPoolStats {
+		size_t workers;
+		size_t blockedWorkers;
+		size_t queueDepth;
+		UINT64 tasksExecuted;
+		UINT64 tasksStolen;
+		UINT64 averageLatency;
+		UINT64 maxLatency;
+	};
+
+	/**
+	 * @brief runs tasks on worker threads.
+	 *
+	 * Every worker owns a queue. Tasks added from a worker thread go to its
+	 * own queue, all others are distributed round robin. A worker without
+	 * work steals from the other queues, so tasks may run concurrently and
+	 * in any order; use a Strand if tasks need to be serialized.
+	 *
+	 * A task that waits for another task (or an answer that another task
+	 * produces) has to wait with blockingWait(). While every worker of the
+	 * pool is blocked like this, the pool starts another worker, up to
+	 * maxThreads, so the tasks they wait for still get to run.
+	 */
+	class ThreadPool {
+	public:
+		ThreadPool(const std::string &name);
+		~ThreadPool();
+
+		bool start(size_t threads, size_t maxThreads = 0);
+		bool stop();
+
+		bool addTask(TaskPtr task);
+
+		ThreadPoolStats getStats() const;
+
+		/**
+		 * @brief WaitForSingleObject() for tasks, on a pool worker the
+		 * worker counts as blocked until the wait returns.
+		 */
+		static DWORD blockingWait(HANDLE handle, DWORD timeout);
+
+	private:
+		struct QueuedTask {
+			TaskPtr task;
+			std::chrono::steady_clock::time_point queued;
+		};
+
+		struct Worker {
+			ThreadPool *pool;
+			size_t index;
+			HANDLE thread;
+			std::deque<QueuedTask> tasks;
+			CRITICAL_SECTION cs;
+		};
+
+		static void* workerThread(void *arg);
+		void runWorker(Worker *worker);
+		bool nextTask(Worker *worker, QueuedTask &task);
+		Worker *addWorker();
+		void beginBlocking();
+		void endBlocking();
+		void clearWorkers();
+
+	private:
+		std::string mName;
+		HANDLE mhStopEvent;
+		HANDLE mhTaskSemaphore;
+		bool mRunning;
+		size_t mThreads;
+
+		// sized to the maximum number of workers on start, the first
+		// mWorkerCount entries are in use. Workers are only added while
+		// running, so the queues can be walked without mCSection.
+		std::vector<Worker *> mWorkers;
+		std::atomic<size_t> mWorkerCount;
+		std::atomic<size_t> mBlockedWorkers;
+		mutable CRITICAL_SECTION mCSection;
+
+		std::atomic<size_t> mNextWorker;
+		std::atomic<size_t> mQueueDepth;
+		std::atomic<UINT64> mTasksExecuted;
+		std::atomic<UINT64> mTasksStolen;
+		std::atomic<UINT64> mTotalLatency;
+		std::atomic<UINT64> mMaxLatency;
+	};
+
+} /*task*/ } /*sessionmanager*/ } /*ogon*/
+
+namespace taskNS = ogon::sessionmanager::task;
+
+#endif /* _OGON_SMGR_THREADPOOL_H_ */
@@ -44,7 +44,9 @@ namespace ogon { namespace sessionmanager { namespace task {
 		};
 
 		void informStarted() {
-			SetEvent(mhStarted);
+			if (mhStarted) {
+				SetEvent(mhStarted);
+			}
 		}
 
 	private:
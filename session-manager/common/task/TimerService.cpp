@@ -0,0 +1,191 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Timer service running Task objects after a timeout
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "TimerService.h"
+
+#include <utils/CSGuard.h>
+
+#include <winpr/sysinfo.h>
+#include <winpr/thread.h>
+#include <winpr/wlog.h>
+
+#include <list>
+
+namespace ogon { namespace sessionmanager { namespace task {
+
+	static wLog *logger_TimerService = WLog_Get("ogon.sessionmanager.task.timerservice");
+
+	TimerService::TimerService() : mhServerThread(NULL), mRunning(false), mNextTimerId(0) {
+		mhStopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+		mhWakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+		if (!mhStopEvent || !mhWakeEvent) {
+			WLog_Print(logger_TimerService, WLOG_FATAL,
+				"Failed to create timer service events");
+			throw std::bad_alloc();
+		}
+		if (!InitializeCriticalSectionAndSpinCount(&mCSection, 0x00000400)) {
+			WLog_Print(logger_TimerService, WLOG_FATAL,
+				"Failed to initialize timer service critical section");
+			throw std::bad_alloc();
+		}
+	}
+
+	TimerService::~TimerService() {
+		DeleteCriticalSection(&mCSection);
+		CloseHandle(mhStopEvent);
+		CloseHandle(mhWakeEvent);
+	}
+
+	bool TimerService::start() {
+		CSGuard guard(&mCSection);
+
+		if (mRunning) {
+			WLog_Print(logger_TimerService, WLOG_ERROR,
+				"Timer service already started!");
+			return false;
+		}
+
+		ResetEvent(mhStopEvent);
+		if (!(mhServerThread = CreateThread(NULL, 0,
+				(LPTHREAD_START_ROUTINE) TimerService::execThread, (void*) this,
+				0, NULL)))
+		{
+			WLog_Print(logger_TimerService, WLOG_ERROR, "failed to create thread");
+			return false;
+		}
+		mRunning = true;
+		return true;
+	}
+
+	bool TimerService::stop() {
+		{
+			CSGuard guard(&mCSection);
+			if (!mRunning) {
+				WLog_Print(logger_TimerService, WLOG_ERROR,
+					"Timer service was not started before.");
+				return false;
+			}
+			mRunning = false;
+		}
+
+		SetEvent(mhStopEvent);
+		WaitForSingleObject(mhServerThread, INFINITE);
+		CloseHandle(mhServerThread);
+		mhServerThread = NULL;
+
+		CSGuard guard(&mCSection);
+		std::map<TTimerKey, TaskPtr>::iterator iter;
+		for (iter = mTimers.begin(); iter != mTimers.end(); ++iter) {
+			iter->second->abortTask();
+		}
+		mTimers.clear();
+		mDueTimes.clear();
+		return true;
+	}
+
+	TimerId TimerService::addTimer(UINT64 timeout, TaskPtr task) {
+		CSGuard guard(&mCSection);
+		if (!mRunning) {
+			return 0;
+		}
+
+		TimerId timerId = ++mNextTimerId;
+		UINT64 due = GetTickCount64() + timeout;
+		bool first = mTimers.empty() || (TTimerKey(due, timerId) < mTimers.begin()->first);
+
+		mTimers[TTimerKey(due, timerId)] = task;
+		mDueTimes[timerId] = due;
+
+		if (first) {
+			// the thread has to recalculate its sleep time
+			SetEvent(mhWakeEvent);
+		}
+		return timerId;
+	}
+
+	bool TimerService::cancelTimer(TimerId timerId) {
+		CSGuard guard(&mCSection);
+		std::unordered_map<TimerId, UINT64>::iterator iter = mDueTimes.find(timerId);
+		if (iter == mDueTimes.end()) {
+			return false;
+		}
+		mTimers.erase(TTimerKey(iter->second, timerId));
+		mDueTimes.erase(iter);
+		return true;
+	}
+
+	void TimerService::run() {
+		HANDLE events[2];
+		DWORD nCount = 0;
+
+		events[nCount++] = mhStopEvent;
+		events[nCount++] = mhWakeEvent;
+
+		while (1) {
+			std::list<TaskPtr> expired;
+			DWORD timeout = INFINITE;
+			{
+				CSGuard guard(&mCSection);
+				UINT64 now = GetTickCount64();
+				while (!mTimers.empty()) {
+					std::map<TTimerKey, TaskPtr>::iterator iter = mTimers.begin();
+					if (iter->first.first > now) {
+						UINT64 remaining = iter->first.first - now;
+						timeout = remaining < INFINITE ? (DWORD) remaining : INFINITE - 1;
+						break;
+					}
+					expired.push_back(iter->second);
+					mDueTimes.erase(iter->first.second);
+					mTimers.erase(iter);
+				}
+			}
+
+			std::list<TaskPtr>::iterator taskIt;
+			for (taskIt = expired.begin(); taskIt != expired.end(); ++taskIt) {
+				(*taskIt)->preProcess();
+				(*taskIt)->run();
+				(*taskIt)->postProcess();
+			}
+			if (!expired.empty()) {
+				// running the tasks took time, check again
+				continue;
+			}
+
+			if (WaitForMultipleObjects(nCount, events, FALSE, timeout) == WAIT_OBJECT_0) {
+				break;
+			}
+		}
+	}
+
+	void* TimerService::execThread(void *arg) {
+		TimerService *service = (TimerService *) arg;
+
+		WLog_Print(logger_TimerService, WLOG_INFO, "started TimerService thread");
+		service->run();
+		WLog_Print(logger_TimerService, WLOG_INFO, "stopped TimerService thread");
+		return NULL;
+	}
+
+} /*task*/ } /*sessionmanager*/ } /*ogon*/
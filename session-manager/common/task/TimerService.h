@@ -0,0 +1,78 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Timer service running Task objects after a timeout
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifndef _OGON_SMGR_TIMERSERVICE_H_
+#define _OGON_SMGR_TIMERSERVICE_H_
+
+#include "Task.h"
+#include <winpr/synch.h>
+#include <map>
+#include <unordered_map>
+
+namespace ogon { namespace sessionmanager { namespace task {
+
+	typedef UINT64 TimerId;
+
+	/**
+	 * @brief runs tasks once their timeout has expired.
+	 *
+	 * All timers are kept ordered by due time and served by a single
+	 * thread which sleeps until the next one expires. Expired tasks run on
+	 * that thread, so they should only hand the actual work to a session or
+	 * the executor.
+	 */
+	class TimerService {
+	public:
+		TimerService();
+		~TimerService();
+
+		bool start();
+		bool stop();
+
+		/**
+		 * @brief arms a timer expiring after timeout milliseconds, returns 0
+		 * if the service is not running.
+		 */
+		TimerId addTimer(UINT64 timeout, TaskPtr task);
+		bool cancelTimer(TimerId timerId);
+
+	private:
+		static void* execThread(void *arg);
+		void run();
+
+		typedef std::pair<UINT64, TimerId> TTimerKey;
+
+	private:
+		HANDLE mhStopEvent;
+		HANDLE mhWakeEvent;
+		HANDLE mhServerThread;
+		bool mRunning;
+
+		TimerId mNextTimerId;
+		std::map<TTimerKey, TaskPtr> mTimers;
+		std::unordered_map<TimerId, UINT64> mDueTimes;
+		CRITICAL_SECTION mCSection;
+	};
+
+} /*task*/ } /*sessionmanager*/ } /*ogon*/
+
+namespace taskNS = ogon::sessionmanager::task;
+
+#endif /* _OGON_SMGR_TIMERSERVICE_H_ */
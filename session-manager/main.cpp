@@ -111,6 +111,7 @@ static void signal_handler_internal(int signal) {
 		/* signals handled specially */
 		case SIGHUP:
 			reloadConfig(signal);
+			APP_CONTEXT.getGreeterPool()->fill();
 			return;
 		/* these signals trigger a shutdown */
 		case SIGINT:
@@ -572,6 +573,20 @@ int main(int argc, char **argv) {
 		goto stop;
 	}
 
+	// sessions are created from ICP calls and run their tasks on the executor
+	if (!APP_CONTEXT.startTaskExecutor()) {
+		goto stop;
+	}
+
+	if (!APP_CONTEXT.startAuthWorkers()) {
+		goto stop;
+	}
+
+	// disconnecting a session arms its timeout, that can happen with the first ICP call
+	if (!APP_CONTEXT.startTimerService()) {
+		goto stop;
+	}
+
 	if (!APP_CONTEXT.startRPCEngines()) {
 		goto stop;
 	}
@@ -587,8 +602,11 @@ int main(int argc, char **argv) {
 		goto stop;
 	}
 
-	APP_CONTEXT.startTaskExecutor();
-	APP_CONTEXT.startSessionTimoutMonitor();
+	APP_CONTEXT.getGreeterPool()->fill();
+
+	if (!APP_CONTEXT.startMetricsServer()) {
+		WLog_Print(logger_sessionManager, WLOG_ERROR, "metrics are not available");
+	}
 
 	setupSignalHandler();
 
@@ -613,7 +631,10 @@ int main(int argc, char **argv) {
 	WLog_Print(logger_sessionManager, WLOG_INFO, "stopping ...");
 
 stop:
+	APP_CONTEXT.stopMetricsServer();
 	APP_CONTEXT.shutdown();
+	APP_CONTEXT.stopTimerService();
+	APP_CONTEXT.stopAuthWorkers();
 	APP_CONTEXT.stopProcessMonitor();
 	APP_CONTEXT.stopTaskExecutor();
 	APP_CONTEXT.stopRPCEngines();
@@ -0,0 +1,247 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Synthetic Backend Module
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <winpr/crt.h>
+#include <winpr/wlog.h>
+#include <winpr/pipe.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/environment.h>
+
+#include <ogon/backend.h>
+#include <ogon/module.h>
+
+#include "synthetic_module.h"
+#include "../common/module_helper.h"
+#include "../../common/global.h"
+
+/**
+ * Starts ogon-synthetic-backend, a backend drawing a canned workload which
+ * is used to load test the rdp server (see "Load testing" in doc/rdpServer.md).
+ */
+
+static RDS_MODULE_CONFIG_CALLBACKS gConfig;
+static RDS_MODULE_STATUS_CALLBACKS gStatus;
+
+static wLog *gModuleLog;
+
+struct rds_module_synthetic
+{
+	RDS_MODULE_COMMON commonModule;
+
+	STARTUPINFO si;
+	PROCESS_INFORMATION pi;
+};
+typedef struct rds_module_synthetic rdsModuleSynthetic;
+
+static DWORD synthetic_clean_up_process(PROCESS_INFORMATION *pi) {
+	DWORD ret = 0;
+	if (pi->hProcess) {
+		GetExitCodeProcess(pi->hProcess, &ret);
+		CloseHandle(pi->hProcess);
+		pi->hProcess = NULL;
+	}
+	if (pi->hThread) {
+		CloseHandle(pi->hThread);
+		pi->hThread = NULL;
+	}
+	return ret;
+}
+
+static int synthetic_rds_stop_process(PROCESS_INFORMATION *pi, unsigned int wait_sec, UINT32 sessionId) {
+	if (gStatus.removeMonitoringProcess(pi->dwProcessId)) {
+		TerminateChildProcess(pi->dwProcessId, wait_sec * 1000, NULL, sessionId);
+	}
+	synthetic_clean_up_process(pi);
+	return 0;
+}
+
+static RDS_MODULE_COMMON* synthetic_rds_module_new(void)
+{
+	rdsModuleSynthetic* synthetic = (rdsModuleSynthetic *)calloc(1, sizeof(*synthetic));
+	if (!synthetic) {
+		fprintf(stderr, "%s: error allocating synthetic module memory\n", __FUNCTION__);
+		return NULL;
+	}
+
+	WLog_Print(gModuleLog, WLOG_DEBUG, "RdsModuleNew");
+
+	return &synthetic->commonModule;
+}
+
+static void synthetic_rds_module_free(RDS_MODULE_COMMON* module)
+{
+	WLog_Print(gModuleLog, WLOG_DEBUG, "s %" PRIu32 ": RdsModuleFree", module->sessionId);
+	free(module);
+}
+
+static char* synthetic_rds_module_start(RDS_MODULE_COMMON* module)
+{
+	BOOL status;
+	char* pipeName;
+	long xres, yres, colordepth;
+	long rate = -1;
+	char lpCommandLine[512];
+	const char* endpoint = "Synthetic";
+	char cmd[256];
+	char workload[32];
+
+	rdsModuleSynthetic *synthetic = (rdsModuleSynthetic *)module;
+	DWORD SessionId = module->sessionId;
+
+	WLog_Print(gModuleLog, WLOG_DEBUG, "s %" PRIu32 ": RdsModuleStart: Endpoint: %s", SessionId, endpoint);
+
+	ZeroMemory(&(synthetic->si), sizeof(STARTUPINFO));
+	synthetic->si.cb = sizeof(STARTUPINFO);
+	ZeroMemory(&(synthetic->pi), sizeof(PROCESS_INFORMATION));
+
+	initResolutions(&gConfig, SessionId, &xres, &yres, &colordepth);
+
+	if (!getPropertyStringWrapper(module->baseConfigPath, &gConfig, SessionId, "cmd", cmd, sizeof(cmd))) {
+		WLog_Print(gModuleLog, WLOG_FATAL, "s %" PRIu32 ": Could not query %s.cmd, stopping synthetic module, because of missing command ",
+				   SessionId, module->baseConfigPath);
+		return NULL;
+	}
+
+	if (!getPropertyStringWrapper(module->baseConfigPath, &gConfig, SessionId, "workload", workload, sizeof(workload))) {
+		strcpy(workload, "idle");
+	}
+	getPropertyNumberWrapper(module->baseConfigPath, &gConfig, SessionId, "rate", &rate);
+
+	if (rate >= 0) {
+		sprintf_s(lpCommandLine, sizeof(lpCommandLine), "%s --session-id=%" PRIu32 " --width=%ld --height=%ld --workload=%s --rate=%ld",
+				cmd, SessionId, xres, yres, workload, rate);
+	} else {
+		sprintf_s(lpCommandLine, sizeof(lpCommandLine), "%s --session-id=%" PRIu32 " --width=%ld --height=%ld --workload=%s",
+				cmd, SessionId, xres, yres, workload);
+	}
+
+	WLog_Print(gModuleLog, WLOG_DEBUG, "s %" PRIu32 ": Starting process with command line: %s", SessionId, lpCommandLine);
+
+	status = CreateProcessAsUserA(module->userToken, NULL, lpCommandLine, NULL,
+			NULL, FALSE, 0, module->envBlock, NULL, &(synthetic->si), &(synthetic->pi));
+	if (!status) {
+		WLog_Print(gModuleLog, WLOG_FATAL, "s %" PRIu32 ": Could not start synthetic backend %s", SessionId, cmd);
+		goto out_create_process_error;
+	}
+
+	gStatus.addMonitoringProcess(synthetic->pi.dwProcessId, module->sessionId, TRUE, module);
+
+	WLog_Print(gModuleLog, WLOG_DEBUG, "s %" PRIu32 ": Process %" PRIu32 "/%" PRIu32 " created with status: %" PRId32 "",
+			   SessionId, synthetic->pi.dwProcessId, synthetic->pi.dwThreadId, status);
+
+	pipeName = (char *)malloc(256);
+	if (!pipeName) {
+		WLog_Print(gModuleLog, WLOG_FATAL, "s %" PRIu32 ": out of memory while allocating pipeName", SessionId);
+		goto out_pipe_name_error;
+	}
+
+	ogon_named_pipe_get_endpoint_name(SessionId, endpoint, pipeName, 256);
+	ogon_named_pipe_clean(pipeName);
+
+	if (!WaitNamedPipeA(pipeName, 5 * 1000)) {
+		WLog_Print(gModuleLog, WLOG_FATAL, "s %" PRIu32 ": WaitNamedPipe failure: %s", SessionId, pipeName);
+		goto out_wait_pipe_error;
+	}
+	return pipeName;
+
+out_wait_pipe_error:
+	free(pipeName);
+out_pipe_name_error:
+	synthetic_rds_stop_process(&(synthetic->pi), 2, SessionId);
+out_create_process_error:
+	return NULL;
+}
+
+static int synthetic_rds_module_stop(RDS_MODULE_COMMON *module)
+{
+	rdsModuleSynthetic *synthetic = (rdsModuleSynthetic *) module;
+
+	WLog_Print(gModuleLog, WLOG_DEBUG, "s %" PRIu32 ": RdsModuleStop", module->sessionId);
+
+	synthetic_rds_stop_process(&(synthetic->pi), 2, module->sessionId);
+	return 0;
+}
+
+static char *synthetic_get_custom_info(RDS_MODULE_COMMON *module)
+{
+	rdsModuleSynthetic *synthetic = (rdsModuleSynthetic *)module;
+	char *customInfo = (char *)malloc(11);
+	if (!customInfo) {
+		WLog_Print(gModuleLog, WLOG_ERROR, "s %" PRIu32 ": malloc failed", module->sessionId);
+		return NULL;
+	}
+
+	snprintf(customInfo, 11, "%" PRIu32 "", synthetic->pi.dwProcessId);
+	return customInfo;
+}
+
+int synthetic_module_init() {
+	WLog_Init();
+	gModuleLog = WLog_Get("com.ogon.module.synthetic");
+	return 0;
+}
+
+int synthetic_module_destroy() {
+	return 0;
+}
+
+static int synthetic_rds_module_connect(RDS_MODULE_COMMON *module) {
+	OGON_UNUSED(module);
+	return 0;
+}
+
+static int synthetic_rds_module_disconnect(RDS_MODULE_COMMON *module) {
+	OGON_UNUSED(module);
+	return 0;
+}
+
+OGON_API int RdsModuleEntry(RDS_MODULE_ENTRY_POINTS* pEntryPoints)
+{
+	pEntryPoints->Version = 1;
+	pEntryPoints->Name = "Synthetic";
+
+	pEntryPoints->Init = synthetic_module_init;
+	pEntryPoints->New = synthetic_rds_module_new;
+	pEntryPoints->Free = synthetic_rds_module_free;
+
+	pEntryPoints->Start = synthetic_rds_module_start;
+	pEntryPoints->Stop = synthetic_rds_module_stop;
+	pEntryPoints->getCustomInfo = synthetic_get_custom_info;
+	pEntryPoints->Destroy = synthetic_module_destroy;
+	pEntryPoints->Connect = synthetic_rds_module_connect;
+	pEntryPoints->Disconnect = synthetic_rds_module_disconnect;
+
+	gStatus = pEntryPoints->status;
+	gConfig = pEntryPoints->config;
+
+	return 0;
+}
@@ -33,14 +33,27 @@
 #include <winpr/environment.h>
 #include <winpr/wtypes.h>
 #include <winpr/string.h>
+#include <winpr/sysinfo.h>
+#include <winpr/synch.h>
 #include <stdbool.h>
 
 #ifndef WIN32
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <poll.h>
+#include <unistd.h>
 #include <errno.h>
 #endif
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#endif
+
+#define CYCLE_TIME 100
+
 #include "../../common/global.h"
 
 static wLog *logger_ModuleHelper = WLog_Get(OGON_TAG("sessionmanager.module.helper"));
@@ -140,6 +153,76 @@ void initResolutions(RDS_MODULE_CONFIG_CALLBACKS *config, UINT32 sessionId, long
 	}
 }
 
+#ifndef WIN32
+typedef enum {
+	CHILD_EXITED,
+	CHILD_RUNNING,
+	CHILD_GONE,
+	CHILD_ERROR
+} CHILD_WAIT_RESULT;
+
+/**
+ * Waits up to dwMilliseconds for the child to exit. A pidfd is polled if the
+ * kernel supports it, otherwise we fall back to checking every CYCLE_TIME.
+ */
+static CHILD_WAIT_RESULT waitChildProcess(pid_t pid, int *status, DWORD dwMilliseconds, UINT32 sessionID) {
+	CHILD_WAIT_RESULT result;
+	UINT64 end = GetTickCount64() + dwMilliseconds;
+	int pidfd = -1;
+	pid_t rv;
+
+#ifdef __linux__
+	pidfd = (int) syscall(SYS_pidfd_open, pid, 0);
+#endif
+
+	for (;;) {
+		rv = waitpid(pid, status, WNOHANG);
+		if (rv == pid) {
+			result = CHILD_EXITED;
+			break;
+		}
+		if (rv == -1 && errno == EINTR) {
+			continue;
+		}
+		if (rv == -1 && errno == ECHILD) {
+			/* no such child processes */
+			WLog_Print(logger_ModuleHelper, WLOG_ERROR, "s %" PRIu32 ": nonblocking waitpid(%lu) failed (errno=ECHILD)",
+				sessionID, (unsigned long) pid);
+			result = CHILD_GONE;
+			break;
+		}
+		if (rv != 0) {
+			WLog_Print(logger_ModuleHelper, WLOG_ERROR, "s %" PRIu32 ": nonblocking waitpid(%lu) failed with return value %ld (errno=%d)",
+				sessionID, (unsigned long) pid, (long) rv, errno);
+			result = CHILD_ERROR;
+			break;
+		}
+
+		/* child is still running */
+		UINT64 now = GetTickCount64();
+		if (now >= end) {
+			result = CHILD_RUNNING;
+			break;
+		}
+
+		if (pidfd >= 0) {
+			struct pollfd pfd;
+			pfd.fd = pidfd;
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+			poll(&pfd, 1, (int) (end - now));
+		} else {
+			Sleep((end - now) < CYCLE_TIME ? (DWORD) (end - now) : CYCLE_TIME);
+		}
+	}
+
+	if (pidfd >= 0) {
+		close(pidfd);
+	}
+	return result;
+}
+#endif /* WIN32 not defined */
+
 bool TerminateChildProcessAfterTimeout(DWORD dwProcessId, DWORD dwMilliseconds, int *pExitCode, UINT32 sessionID)
 {
 #ifdef WIN32
@@ -148,7 +231,6 @@ bool TerminateChildProcessAfterTimeout(DWORD dwProcessId, DWORD dwMilliseconds,
 	pid_t pid;
 	pid_t rv;
 	unsigned kills = 0;
-	unsigned ms;
 	int status;
 	int exitCode = 255;
 
@@ -191,40 +273,34 @@ bool TerminateChildProcessAfterTimeout(DWORD dwProcessId, DWORD dwMilliseconds,
 		goto out;
 	}
 
-	while (pid != (rv = waitpid(pid, &status, WNOHANG))) {
-		if (rv == -1 && errno == ECHILD) {
-			/* no such child processes */
-			WLog_Print(logger_ModuleHelper, WLOG_ERROR, "s %" PRIu32 ": nonblocking waitpid(%lu) failed (errno=ECHILD)",
-				sessionID, (unsigned long) pid);
-			return true;
-		}
-		if (rv != 0) {
-			WLog_Print(logger_ModuleHelper, WLOG_ERROR, "s %" PRIu32 ": nonblocking waitpid(%lu) failed with return value %ld (errno=%d)",
-				sessionID, (unsigned long) pid, (long) rv, errno);
-			return false;
+	for (;;) {
+		switch (waitChildProcess(pid, &status, dwMilliseconds, sessionID)) {
+			case CHILD_EXITED:
+				goto out;
+			case CHILD_GONE:
+				return true;
+			case CHILD_ERROR:
+				return false;
+			default:
+				break;
 		}
-		/* child is still running */
-		if (!(ms = dwMilliseconds < 250 ? dwMilliseconds : 250)) {
-			/* grace time expired */
-			switch (kills++) {
-				case 0:
-					WLog_Print(logger_ModuleHelper, WLOG_DEBUG, "s %" PRIu32 ": sending SIGTERM to process %lu", sessionID, (unsigned long) pid);
-					kill(pid, SIGTERM);
-					break;
-				case 1:
-					WLog_Print(logger_ModuleHelper, WLOG_DEBUG, "s %" PRIu32 ": sending SIGKILL to process %lu", sessionID, (unsigned long) pid);
-					kill(pid, SIGKILL);
-					break;
-				default:
-					WLog_Print(logger_ModuleHelper, WLOG_ERROR, "s %" PRIu32 ": process %lu still active after assassination attempt", sessionID, (unsigned long) pid);
-					return false;
-			}
-			/* wait another 500ms after sending term/kill signal */
-			dwMilliseconds = 500;
-			continue;
+
+		/* grace time expired */
+		switch (kills++) {
+			case 0:
+				WLog_Print(logger_ModuleHelper, WLOG_DEBUG, "s %" PRIu32 ": sending SIGTERM to process %lu", sessionID, (unsigned long) pid);
+				kill(pid, SIGTERM);
+				break;
+			case 1:
+				WLog_Print(logger_ModuleHelper, WLOG_DEBUG, "s %" PRIu32 ": sending SIGKILL to process %lu", sessionID, (unsigned long) pid);
+				kill(pid, SIGKILL);
+				break;
+			default:
+				WLog_Print(logger_ModuleHelper, WLOG_ERROR, "s %" PRIu32 ": process %lu still active after assassination attempt", sessionID, (unsigned long) pid);
+				return false;
 		}
-		Sleep(ms);
-		dwMilliseconds -= ms;
+		/* wait another 500ms after sending term/kill signal */
+		dwMilliseconds = 500;
 	}
 
 out:
@@ -251,11 +327,8 @@ bool TerminateChildProcess(DWORD dwProcessId, DWORD dwTimeout, int *pExitCode, U
 #ifdef WIN32
 	return false;
 #else
-#define CYCLE_TIME 100
 	pid_t pid;
-	pid_t rv;
 	unsigned kills = 0;
-	unsigned ms;
 	int status;
 	int exitCode = 255;
 
@@ -278,33 +351,26 @@ bool TerminateChildProcess(DWORD dwProcessId, DWORD dwTimeout, int *pExitCode, U
 	/* Immediately send SIGTERM then wait until the timeout is reached */
 	kill(pid, SIGTERM);
 
-	/* Clamp the timeout to a multiple of CYCLE_TIME */
-	ms = (dwTimeout / CYCLE_TIME) * CYCLE_TIME + CYCLE_TIME;
-	while (pid != (rv = waitpid(pid, &status, WNOHANG))) {
-		if (rv == -1 && errno == ECHILD) {
-			/* no such child processes */
-			WLog_Print(logger_ModuleHelper, WLOG_ERROR, "s %" PRIu32 ": nonblocking waitpid(%lu) failed with return value %ld (errno=ECHILD)",
-				sessionID, (unsigned long) pid, (long) rv);
-			return true;
-		}
-		if (rv != 0) {
-			WLog_Print(logger_ModuleHelper, WLOG_ERROR, "s %" PRIu32 ": nonblocking waitpid(%lu) failed with return value %ld (errno=%d)",
-				sessionID, (unsigned long) pid, (long) rv, errno);
-			return false;
-		}
-		if (!ms) {
-			/* SIGKILL already sent but no response after 10 * CYCLE_TIME */
-			if (kills > 1) {
-				WLog_Print(logger_ModuleHelper, WLOG_ERROR, "s %" PRIu32 ": failed to terminate process %lu via SIGKILL",
-					sessionID, (unsigned long) pid);
+	while (1) {
+		switch (waitChildProcess(pid, &status, kills ? CYCLE_TIME * 10 : dwTimeout, sessionID)) {
+			case CHILD_EXITED:
+				break;
+			case CHILD_GONE:
+				return true;
+			case CHILD_ERROR:
 				return false;
-			}
-			kill(pid, SIGKILL);
-			kills++;
-			ms = CYCLE_TIME * 10;
+			default:
+				/* SIGKILL already sent but no response after 10 * CYCLE_TIME */
+				if (kills > 1) {
+					WLog_Print(logger_ModuleHelper, WLOG_ERROR, "s %" PRIu32 ": failed to terminate process %lu via SIGKILL",
+						sessionID, (unsigned long) pid);
+					return false;
+				}
+				kill(pid, SIGKILL);
+				kills++;
+				continue;
 		}
-		Sleep(CYCLE_TIME);
-		ms -= CYCLE_TIME;
+		break;
 	}
 
 	if (WIFEXITED(status)) {
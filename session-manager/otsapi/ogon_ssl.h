@@ -45,6 +45,27 @@ public:
 		}
 	};
 
+	/**
+	 * Offers the session of an earlier connection to the server, which then
+	 * can skip the full handshake. Has to be called after open() and before
+	 * the first read or write.
+	 */
+	void resumeSession(SSL_SESSION *session) {
+		if (!session || ssl_ || !TSocket::isOpen()) {
+			return;
+		}
+		/* TSSLSocket creates ssl_ lazily on the first read or write and then
+		 * skips this, it also switches the socket to non-blocking mode which
+		 * the reads and writes rely on */
+		initializeHandshakeParams();
+		SSL_set_session(ssl_, session);
+	}
+
+	/** @return the session of the connection with a reference held for the caller or NULL */
+	SSL_SESSION *getSession() {
+		return ssl_ ? SSL_get1_session(ssl_) : NULL;
+	}
+
 protected:
 
 	pid_t firstProcessId;
@@ -37,10 +37,19 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <limits.h>
 #include <arpa/inet.h>
 #include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include <map>
+#include <atomic>
+#include <deque>
+#include <vector>
 #include <sstream>
 #include <fstream>
 
@@ -52,17 +61,21 @@
 #include <winpr/environment.h>
 #include <winpr/handle.h>
 #include <winpr/ssl.h>
+#include <winpr/sysinfo.h>
 
 #include <ogon/version.h>
 #include <ogon/api.h>
+#include <ogon/wtsapi.h>
 
 #include <otsapi/otsapi.h>
 
 #include <otsapi/ogon_ssl.h>
+#include <utils/CSGuard.h>
 #include <thrift/transport/TBufferTransports.h>
 #include <thrift/protocol/TBinaryProtocol.h>
 
 #include "../../common/global.h"
+#include "../../common/channelring.h"
 
 
 using namespace apache::thrift;
@@ -78,27 +91,90 @@ typedef struct {
 typedef std::map<HANDLE , THandleInfo> THandleInfoMap;
 typedef std::pair<HANDLE, THandleInfo> THandleInfoPair;
 
+typedef std::pair<UINT32, INT32> TInfoCacheKey;
+typedef std::map<TInfoCacheKey, ogon::TReturnQuerySessionInformation> TInfoCache;
+
+/**
+ * @brief TLS connection to a session manager, used by one call at a time
+ */
 typedef struct {
+	std::shared_ptr<TSSLSocket> socket;
 	std::shared_ptr<TTransport> transport;
 	std::shared_ptr<ogon::otsapiClient> client;
+	pid_t pid;
+} TClient;
+
+/**
+ * @brief a session manager and its idle connections
+ *
+ * Servers are kept for the lifetime of the process and shared by all
+ * handles opened for the same server. A call takes an idle connection or
+ * opens a new one and puts it back when it is done, so calls of several
+ * threads don't wait for each other. cSection only guards idleClients and
+ * tlsSession.
+ */
+typedef struct {
+	std::vector<TClient *> idleClients;
+	SSL_SESSION *tlsSession;
+	CRITICAL_SECTION cSection;
+	std::string host;
+	DWORD port;
+} TConnection;
+
+typedef std::map<std::string, TConnection *> TConnectionPool;
+
+typedef struct {
+	TConnection *connection;
 	std::string authToken;
 	bool authTokenScanned;
 	THandleInfoMap handleInfoMap;
 	CRITICAL_SECTION cSection;
 	DWORD sessionId;
-	std::string host;
-	DWORD port;
+	TInfoCache infoCache;
+	UINT64 infoCacheExpires;
+	UINT64 infoCacheGeneration;
+	bool noEnumerateEx;
+	/* session events, a wait blocks its own connection instead of a shared one */
+	TClient *eventConnection;
+	CRITICAL_SECTION eventSection;
+	std::deque<ogon::TSessionEvent> pendingEvents;
+	INT64 eventSequence;
+	bool eventsLost;
+	int eventSocket;
+	/* every WTS_EVENT_FLUSH aborts the waits which started before it */
+	UINT64 eventFlushCount;
+	/* threads waiting for events, the handle is only freed when none is left */
+	DWORD eventWaiters;
+	HANDLE eventIdle;
 } TSessionInfo;
 
 typedef std::map<HANDLE, TSessionInfo *> TSessionMap;
+typedef std::map<HANDLE, ogon_channel_ring *> TChannelRingMap;
 
 TSessionInfo gCurrentServer;
 CRITICAL_SECTION gCSection;
 TSessionMap gSessionMap;
+TConnectionPool gConnectionPool;
+TChannelRingMap gChannelRings;
+/* bumped whenever sessions are known to have changed, voids all info caches */
+std::atomic<UINT64> gInfoCacheGeneration(0);
+/* WTSEnumerateSessions prefetches session information if OGON_WTSAPI_PREFETCH is set */
+bool gPrefetchSessionInfo = false;
+
+/**
+ * Voids the info caches of all handles, called when this process changed a
+ * session or learned about a change from a session event.
+ */
+static void invalidateInfoCaches(void) {
+	gInfoCacheGeneration++;
+}
 
 #define TOKEN_DIR_PREFIX "/tmp/ogon.session."
+#define INFO_CACHE_TIMEOUT 2000
+#define COUNT_OF(a) (sizeof(a) / sizeof((a)[0]))
 #define CHECK_AUTH_TOKEN(con) if(!con->authTokenScanned){ getAuthToken(con->authToken, con->sessionId); con->authTokenScanned=true;}
-#define CHECK_CLIENT_CONNECTION(con) if(!con->transport || !con->transport->isOpen()) { connectClient(con, con->host.c_str(), con->port);}
+#define OTSAPI_PORT 9091
+#define CHECK_CLIENT_CONNECTION(con) TClientLease connection(con->connection); if(!connection->client) { SetLastError(ERROR_INTERNAL_ERROR); return FALSE;}
 
 void lib_load(void );
 void lib_unload(void );
@@ -116,34 +192,61 @@ public :
 
 static APIInitMgr gInitMgr;
 
-static BOOL connectClient(TSessionInfo *con, const std::string &host, DWORD port) {
-	try {
-		TSSLSocketFactory::setManualOpenSSLInitialization(true);
-		std::shared_ptr<TSSLSocketFactory> factory(new OgonSSLSocketFactory());
-		factory->authenticate(false);
+static std::shared_ptr<TSSLSocketFactory> createSSLSocketFactory() {
+	TSSLSocketFactory::setManualOpenSSLInitialization(true);
+	std::shared_ptr<TSSLSocketFactory> factory(new OgonSSLSocketFactory());
+	factory->authenticate(false);
+	return factory;
+}
 
-		std::shared_ptr<TSSLSocket> socket = factory->createSocket(host, port);
+/** @return the factory of the process, all connections share its SSL context */
+static std::shared_ptr<TSSLSocketFactory> getSSLSocketFactory() {
+	static std::shared_ptr<TSSLSocketFactory> factory = createSSLSocketFactory();
+	return factory;
+}
+
+/** connects client to the server of con */
+static BOOL connectClient(TConnection *con, TClient *client) {
+	try {
+		std::shared_ptr<TSSLSocket> socket = getSSLSocketFactory()->createSocket(con->host, con->port);
 		socket->setConnTimeout(5 * 1000);
 
 		std::shared_ptr<TTransport> transport(new TFramedTransport(socket));
 		std::shared_ptr<TProtocol> protocol(new TBinaryProtocol(transport));
 
-		std::shared_ptr<ogon::otsapiClient> client(new ogon::otsapiClient(protocol));
+		std::shared_ptr<OgonSSLSocket> ogonSocket = std::static_pointer_cast<OgonSSLSocket>(socket);
 
-		con->client = client;
-		con->transport = transport;
+		client->client.reset(new ogon::otsapiClient(protocol));
+		client->socket = socket;
+		client->transport = transport;
+		client->pid = getpid();
 		transport->open();
+		{
+			/* skip the full handshake if the server still knows the last session */
+			CSGuard guard(&con->cSection);
+			ogonSocket->resumeSession(con->tlsSession);
+		}
+
 		ogon::TVersion smversion;
 		ogon::TVersion ourversion;
 		ourversion.VersionMajor = OGON_PROTOCOL_VERSION_MAJOR;
 		ourversion.VersionMinor = OGON_PROTOCOL_VERSION_MINOR;
-		client->getVersionInfo(smversion, ourversion);
+		client->client->getVersionInfo(smversion, ourversion);
 		if (smversion.VersionMajor != OGON_PROTOCOL_VERSION_MAJOR) {
 			fprintf(stderr, "%s: received protocol version info with %" PRId32 ".%" PRId32 " but own protocol version is %d.%d\n",
 				__FUNCTION__, smversion.VersionMajor, smversion.VersionMinor,
 				OGON_PROTOCOL_VERSION_MAJOR, OGON_PROTOCOL_VERSION_MINOR);
 			return FALSE;
 		}
+
+		SSL_SESSION *session = ogonSocket->getSession();
+		if (session) {
+			CSGuard guard(&con->cSection);
+			if (con->tlsSession) {
+				SSL_SESSION_free(con->tlsSession);
+			}
+			con->tlsSession = session;
+		}
 		return TRUE;
 	} catch (const TException &tx) {
 		fprintf(stderr, "%s: TException: %s\n", __FUNCTION__, tx.what());
@@ -154,6 +257,37 @@ static BOOL connectClient(TSessionInfo *con, const std::string &host, DWORD port
 	}
 }
 
+/**
+ * The session manager closes idle connections. No call is pending between
+ * two calls, so the socket being readable means that it did.
+ */
+static bool isConnectionAlive(TClient *client) {
+	if (client->pid != getpid()) {
+		/* inherited from the parent process, leave the socket to it */
+		client->client.reset();
+		client->transport.reset();
+		client->socket.reset();
+		return false;
+	}
+
+	if (!client->transport || !client->transport->isOpen()) {
+		return false;
+	}
+
+	struct pollfd pfd;
+	pfd.fd = client->socket->getSocketFD();
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, 0) != 0) {
+		try {
+			client->transport->close();
+		} catch (...) {
+		}
+		return false;
+	}
+	return true;
+}
+
 static int getAuthToken(std::string &authToken, DWORD &sessionId) {
 	char* sid;
 
@@ -203,16 +337,157 @@ static TSessionInfo *getSessionInfo(HANDLE serverHandle) {
 	return returnValue;
 }
 
+/**
+ * @return a new connection which is not connected yet
+ */
+static TClient *newClient(void) {
+	TClient *client = new TClient();
+	client->pid = getpid();
+	return client;
+}
+
+static void freeClient(TClient *client) {
+	if (client->transport && (client->pid == getpid())) {
+		try {
+			client->transport->close();
+		} catch (...) {
+		}
+	}
+	delete client;
+}
+
+/**
+ * @return a new server entry without connections
+ */
+static TConnection *newConnection(const std::string &host, DWORD port) {
+	TConnection *con = new TConnection();
+	if (!InitializeCriticalSectionAndSpinCount(&con->cSection, 0x00000400)) {
+		fprintf(stderr, "%s: failed to initialize critical section", __FUNCTION__);
+		delete con;
+		return NULL;
+	}
+	con->tlsSession = NULL;
+	con->host = host;
+	con->port = port;
+	return con;
+}
+
+/**
+ * @return the pooled server entry, connections are opened on first use
+ */
+static TConnection *getConnection(const std::string &host, DWORD port) {
+	std::ostringstream key;
+	key << host << ":" << port;
+
+	EnterCriticalSection(&gCSection);
+	TConnectionPool::iterator it = gConnectionPool.find(key.str());
+	if (it != gConnectionPool.end()) {
+		LeaveCriticalSection(&gCSection);
+		return it->second;
+	}
+
+	TConnection *con = newConnection(host, port);
+	if (con) {
+		gConnectionPool[key.str()] = con;
+	}
+	LeaveCriticalSection(&gCSection);
+	return con;
+}
+
+static void freeConnection(TConnection *con) {
+	for (size_t index = 0; index < con->idleClients.size(); index++) {
+		freeClient(con->idleClients[index]);
+	}
+	if (con->tlsSession) {
+		SSL_SESSION_free(con->tlsSession);
+	}
+	DeleteCriticalSection(&con->cSection);
+	delete con;
+}
+
+/**
+ * @brief hands out a connection of a server for the duration of one call
+ *
+ * The connection is (re)connected if necessary, connecting may fail and
+ * leave the call to fail with a TException. Afterwards an open connection
+ * goes back to the idle connections of the server.
+ */
+class TClientLease {
+public:
+	TClientLease(TConnection *con) : mConnection(con), mClient(NULL) {
+		{
+			CSGuard guard(&con->cSection);
+			if (!con->idleClients.empty()) {
+				mClient = con->idleClients.back();
+				con->idleClients.pop_back();
+			}
+		}
+		if (!mClient) {
+			mClient = newClient();
+		}
+		if (!isConnectionAlive(mClient)) {
+			connectClient(con, mClient);
+		}
+	}
+
+	~TClientLease() {
+		if ((mClient->pid == getpid()) && mClient->transport && mClient->transport->isOpen()) {
+			CSGuard guard(&mConnection->cSection);
+			mConnection->idleClients.push_back(mClient);
+			return;
+		}
+		freeClient(mClient);
+	}
+
+	TClient *operator->() const {
+		return mClient;
+	}
+
+	TClient *get() const {
+		return mClient;
+	}
+
+private:
+	TClientLease(const TClientLease &);
+	TClientLease &operator=(const TClientLease &);
+
+	TConnection *mConnection;
+	TClient *mClient;
+};
+
 static BOOL initSessionInfo(TSessionInfo *info) {
 	if (info == NULL) {
 		return FALSE;
 	}
+	info->connection = NULL;
 	info->authToken = "";
 	info->authTokenScanned = false;
 	info->sessionId = 0;
+	info->infoCacheExpires = 0;
+	info->infoCacheGeneration = 0;
+	info->noEnumerateEx = false;
+	info->eventConnection = NULL;
+	info->eventSequence = -1;
+	info->eventsLost = false;
+	info->eventSocket = -1;
+	info->eventFlushCount = 0;
+	info->eventWaiters = 0;
+	if (!(info->eventIdle = CreateEvent(NULL, TRUE, TRUE, NULL)))
+	{
+		fprintf(stderr, "%s: failed to create event", __FUNCTION__);
+		return FALSE;
+	}
 	if (!InitializeCriticalSectionAndSpinCount(&info->cSection, 0x00000400))
 	{
 		fprintf(stderr, "%s: failed to initialize critical section", __FUNCTION__);
+		CloseHandle(info->eventIdle);
+		return FALSE;
+	}
+	if (!InitializeCriticalSectionAndSpinCount(&info->eventSection, 0x00000400))
+	{
+		fprintf(stderr, "%s: failed to initialize critical section", __FUNCTION__);
+		DeleteCriticalSection(&info->cSection);
+		CloseHandle(info->eventIdle);
 		return FALSE;
 	}
   	return TRUE;
@@ -233,48 +508,146 @@ static BOOL freeSessionInfo(TSessionInfo *info) {
 	if (info == NULL) {
 		return FALSE;
 	}
+	if (info->eventConnection) {
+		freeClient(info->eventConnection);
+	}
+	DeleteCriticalSection(&info->eventSection);
 	DeleteCriticalSection(&info->cSection);
+	CloseHandle(info->eventIdle);
 	delete(info);
 	return TRUE;
 }
 
+/**
+ * Aborts the waits for session events on the handle, also the ones which
+ * are still connecting or waiting for the eventSection.
+ */
+static void flushSessionEvents(TSessionInfo *con) {
+	EnterCriticalSection(&con->cSection);
+	con->eventFlushCount++;
+	if (con->eventSocket >= 0) {
+		shutdown(con->eventSocket, SHUT_RDWR);
+	}
+	LeaveCriticalSection(&con->cSection);
+}
+
+static void closeChannels(TSessionInfo *sessionInfo) {
+	THandleInfoMap::iterator iter;
+
+	if (!sessionInfo->connection || sessionInfo->handleInfoMap.empty()) {
+		return;
+	}
+
+	TClientLease connection(sessionInfo->connection);
+	if (!connection->client) {
+		return;
+	}
+
+	for (iter = sessionInfo->handleInfoMap.begin(); iter != sessionInfo->handleInfoMap.end(); ++iter) {
+		THandleInfo info = iter->second;
+		try {
+			connection->client->virtualChannelClose(sessionInfo->authToken,
+				getSessionId(sessionInfo, info.sessionId),
+				info.virtualName, info.instance);
+		} catch (...) {
+		}
+	}
+}
+
 void lib_unload(void) {
 	EnterCriticalSection(&gCSection);
 
 	TSessionMap::iterator sessionIter;
 
 	for (sessionIter = gSessionMap.begin(); sessionIter != gSessionMap.end(); ++sessionIter) {
-		THandleInfoMap::iterator iter;
-		TSessionInfo *sessionInfo = sessionIter->second;
-		for (iter = sessionInfo->handleInfoMap.begin(); iter != sessionInfo->handleInfoMap.end(); ++iter) {
-			THandleInfo info = iter->second;
-			sessionInfo->client->virtualChannelClose(sessionInfo->authToken,
-				getSessionId(sessionInfo, info.sessionId),
-				info.virtualName, info.instance);
-			sessionInfo->transport->close();
-		}
-		WTSCloseServer((HANDLE)sessionInfo);
-		freeSessionInfo(sessionInfo);
+		closeChannels(sessionIter->second);
+		freeSessionInfo(sessionIter->second);
 	}
+	gSessionMap.clear();
+	closeChannels(&gCurrentServer);
+	if (gCurrentServer.eventConnection) {
+		freeClient(gCurrentServer.eventConnection);
+		gCurrentServer.eventConnection = NULL;
+	}
+
+	TConnectionPool::iterator poolIter;
+	for (poolIter = gConnectionPool.begin(); poolIter != gConnectionPool.end(); ++poolIter) {
+		freeConnection(poolIter->second);
+	}
+	gConnectionPool.clear();
 
-	if (gCurrentServer.transport) {
-		gCurrentServer.transport->close();
+	TChannelRingMap::iterator ringIter;
+	for (ringIter = gChannelRings.begin(); ringIter != gChannelRings.end(); ++ringIter) {
+		channel_ring_destroy(ringIter->second);
+		delete ringIter->second;
 	}
+	gChannelRings.clear();
 	LeaveCriticalSection(&gCSection);
 
 	DeleteCriticalSection(&gCSection);
 }
 
+/* the pools must not be changed while the process forks */
+static void forkPrepare(void) {
+	EnterCriticalSection(&gCSection);
+	for (TConnectionPool::iterator it = gConnectionPool.begin(); it != gConnectionPool.end(); ++it) {
+		EnterCriticalSection(&it->second->cSection);
+	}
+}
+
+static void forkParent(void) {
+	for (TConnectionPool::iterator it = gConnectionPool.begin(); it != gConnectionPool.end(); ++it) {
+		LeaveCriticalSection(&it->second->cSection);
+	}
+	LeaveCriticalSection(&gCSection);
+}
+
+static void reinitSessionInfoLocks(TSessionInfo *info) {
+	InitializeCriticalSectionAndSpinCount(&info->cSection, 0x00000400);
+	InitializeCriticalSectionAndSpinCount(&info->eventSection, 0x00000400);
+	info->eventWaiters = 0;
+	SetEvent(info->eventIdle);
+}
+
+/**
+ * Only the forking thread exists in the child, locks held by other threads
+ * of the parent would never be released. The connections belong to the
+ * parent, the child opens its own.
+ */
+static void forkChild(void) {
+	for (TConnectionPool::iterator it = gConnectionPool.begin(); it != gConnectionPool.end(); ++it) {
+		TConnection *con = it->second;
+		for (size_t index = 0; index < con->idleClients.size(); index++) {
+			freeClient(con->idleClients[index]);
+		}
+		con->idleClients.clear();
+		InitializeCriticalSectionAndSpinCount(&con->cSection, 0x00000400);
+	}
+	for (TSessionMap::iterator it = gSessionMap.begin(); it != gSessionMap.end(); ++it) {
+		reinitSessionInfoLocks(it->second);
+	}
+	reinitSessionInfoLocks(&gCurrentServer);
+	InitializeCriticalSectionAndSpinCount(&gCSection, 0x00000400);
+}
+
 void lib_load(void) {
 	if (!InitializeCriticalSectionAndSpinCount(&gCSection, 0x00000400))
 	{
 		fprintf(stderr, "%s: failed to initialize critical section", __FUNCTION__);
 		throw std::bad_alloc();
 	}
+	if (pthread_atfork(forkPrepare, forkParent, forkChild)) {
+		fprintf(stderr, "%s: failed to register fork handlers", __FUNCTION__);
+		throw std::bad_alloc();
+	}
 	initSessionInfo(&gCurrentServer);
-	gCurrentServer.host = "localhost";
-	gCurrentServer.port = 9091;
+	if (!(gCurrentServer.connection = getConnection("localhost", OTSAPI_PORT))) {
+		throw std::bad_alloc();
+	}
 	winpr_InitializeSSL(WINPR_SSL_INIT_DEFAULT);
+
+	const char *prefetch = getenv("OGON_WTSAPI_PREFETCH");
+	gPrefetchSessionInfo = prefetch && *prefetch && strcmp(prefetch, "0");
 }
 
 HANDLE connect2Pipe(const std::string &pipeName) {
@@ -321,9 +694,10 @@ BOOL WINAPI ogon_WTSStartRemoteControlSessionExA(LPSTR pTargetServerName,
 
 	CHECK_AUTH_TOKEN(currentCon);
 	CHECK_CLIENT_CONNECTION(currentCon);
+	invalidateInfoCaches();
 
 	try {
-		bSuccess = currentCon->client->startRemoteControlSession(currentCon->authToken, currentCon->sessionId,
+		bSuccess = connection->client->startRemoteControlSession(currentCon->authToken, currentCon->sessionId,
 				TargetLogonId, HotkeyVk, HotkeyModifiers, flags);
 	} catch (const TException &tx) {
 		fprintf(stderr, "%s: TException: %s\n", __FUNCTION__, tx.what());
@@ -380,9 +754,10 @@ BOOL WINAPI ogon_WTSStopRemoteControlSession(ULONG LogonId) {
 
 	CHECK_AUTH_TOKEN(currentCon);
 	CHECK_CLIENT_CONNECTION(currentCon);
+	invalidateInfoCaches();
 
 	try {
-		bSuccess = currentCon->client->stopRemoteControlSession(currentCon->authToken, currentCon->sessionId, LogonId);
+		bSuccess = connection->client->stopRemoteControlSession(currentCon->authToken, currentCon->sessionId, LogonId);
 	} catch (const TException &tx) {
 		fprintf(stderr, "%s: TException: %s\n", __FUNCTION__, tx.what());
 		SetLastError(ERROR_INTERNAL_ERROR);
@@ -450,10 +825,21 @@ HANDLE WINAPI ogon_WTSOpenServerA(LPSTR pServerName) {
 		return INVALID_HANDLE_VALUE;
 	}
 
-	if (connectClient(sessionInfo, pServerName, 9091)) {
+	if (!(sessionInfo->connection = getConnection(pServerName, OTSAPI_PORT))) {
+		SetLastError(ERROR_OUTOFMEMORY);
+		freeSessionInfo(sessionInfo);
+		return INVALID_HANDLE_VALUE;
+	}
+
+	BOOL connected;
+	{
+		/* reuses the connection of an earlier handle if it is still up */
+		TClientLease connection(sessionInfo->connection);
+		connected = connection->transport && connection->transport->isOpen();
+	}
+
+	if (connected) {
 		EnterCriticalSection(&gCSection);
-		sessionInfo->host.assign(pServerName);
-		sessionInfo->port = 9091;
 		gSessionMap[(HANDLE)sessionInfo] = sessionInfo;
 		LeaveCriticalSection(&gCSection);
 		SetLastError(ERROR_SUCCESS);
@@ -502,11 +888,102 @@ void WINAPI ogon_WTSCloseServer(HANDLE hServer) {
 	}
 	LeaveCriticalSection(&gCSection);
 
-	if (!returnValue) {
+	/* the connection stays in the pool for the next handle */
+	if (returnValue) {
+		/* no new waits can start, abort the running ones and let them return */
+		flushSessionEvents(returnValue);
+		WaitForSingleObject(returnValue->eventIdle, INFINITE);
 		freeSessionInfo(returnValue);
 	}
 }
 
+/* info classes fetched along with a session enumeration if asked for, WTSWinStationName has to be first */
+static const INT32 gPrefetchClasses[] = {
+	WTSWinStationName,
+	WTSSessionInfo,
+	WTSUserName,
+	WTSDomainName,
+	WTSClientName,
+	WTSClientAddress,
+	WTSClientDisplay,
+	WTSClientProtocolType,
+	WTSClientBuildNumber,
+	WTSClientProductId,
+	WTSClientHardwareId
+};
+
+static bool lookupInfoCache(TSessionInfo *con, UINT32 sessionId, INT32 infoClass,
+	ogon::TReturnQuerySessionInformation &result) {
+
+	bool found = false;
+
+	EnterCriticalSection(&con->cSection);
+	if ((GetTickCount64() < con->infoCacheExpires) &&
+			(con->infoCacheGeneration == gInfoCacheGeneration)) {
+		TInfoCache::iterator it = con->infoCache.find(TInfoCacheKey(sessionId, infoClass));
+		if (it != con->infoCache.end()) {
+			result = it->second;
+			found = true;
+			/* a value is only handed out once, asking again goes to the server */
+			con->infoCache.erase(it);
+		}
+	}
+	LeaveCriticalSection(&con->cSection);
+	return found;
+}
+
+/**
+ * Fetches all visible sessions together with the requested info classes in
+ * a single call. The values are kept for INFO_CACHE_TIMEOUT milliseconds so
+ * that the WTSQuerySessionInformation calls which usually follow an
+ * enumeration don't need a round trip each. Every value is served at most
+ * once and all of them are dropped as soon as a session change is seen.
+ * Sets ERROR_NOT_SUPPORTED and noEnumerateEx if the session manager is too
+ * old to know the call.
+ */
+static BOOL enumerateSessionsEx(TSessionInfo *con, TClient *client, const ogon::TInfoClassList &infoClasses,
+	ogon::TReturnEnumerateSessionEx &result) {
+
+	/* a change seen while the call is running voids its result */
+	UINT64 generation = gInfoCacheGeneration;
+	try {
+		client->client->enumerateSessionsEx(result, con->authToken, 1, infoClasses);
+		if (!result.returnValue) {
+			SetLastError(ERROR_INTERNAL_ERROR);
+			return FALSE;
+		}
+	} catch (const TApplicationException &tx) {
+		if (tx.getType() == TApplicationException::UNKNOWN_METHOD) {
+			con->noEnumerateEx = true;
+			SetLastError(ERROR_NOT_SUPPORTED);
+			return FALSE;
+		}
+		fprintf(stderr, "%s: TException: %s\n", __FUNCTION__, tx.what());
+		SetLastError(ERROR_INTERNAL_ERROR);
+		return FALSE;
+	} catch (const TException &tx) {
+		fprintf(stderr, "%s: TException: %s\n", __FUNCTION__, tx.what());
+		SetLastError(ERROR_INTERNAL_ERROR);
+		return FALSE;
+	} catch (...) {
+		SetLastError(ERROR_INTERNAL_ERROR);
+		return FALSE;
+	}
+
+	EnterCriticalSection(&con->cSection);
+	con->infoCache.clear();
+	for (ogon::TSessionListEx::const_iterator it = result.sessionInfoList.begin();
+			it != result.sessionInfoList.end(); ++it) {
+		for (size_t index = 0; (index < infoClasses.size()) && (index < it->infoValues.size()); index++) {
+			con->infoCache[TInfoCacheKey(it->sessionId, infoClasses[index])] = it->infoValues[index];
+		}
+	}
+	con->infoCacheExpires = GetTickCount64() + INFO_CACHE_TIMEOUT;
+	con->infoCacheGeneration = generation;
+	LeaveCriticalSection(&con->cSection);
+	return TRUE;
+}
+
 BOOL WINAPI ogon_WTSEnumerateSessionsA(HANDLE hServer, DWORD Reserved,
 	DWORD Version, PWTS_SESSION_INFOA *ppSessionInfo, DWORD *pCount) {
 
@@ -531,19 +1008,41 @@ BOOL WINAPI ogon_WTSEnumerateSessionsA(HANDLE hServer, DWORD Reserved,
 	CHECK_AUTH_TOKEN(currentCon);
 	CHECK_CLIENT_CONNECTION(currentCon);
 
-	try {
-		currentCon->client->enumerateSessions(result, currentCon->authToken, Version);
-		if (!result.returnValue){
+	if (gPrefetchSessionInfo && !currentCon->noEnumerateEx) {
+		ogon::TInfoClassList infoClasses(gPrefetchClasses, gPrefetchClasses + COUNT_OF(gPrefetchClasses));
+		ogon::TReturnEnumerateSessionEx resultEx;
+
+		if (enumerateSessionsEx(currentCon, connection.get(), infoClasses, resultEx)) {
+			for (ogon::TSessionListEx::const_iterator it = resultEx.sessionInfoList.begin();
+					it != resultEx.sessionInfoList.end(); ++it) {
+				ogon::TSessionInfo sessionInfo;
+				sessionInfo.sessionId = it->sessionId;
+				sessionInfo.connectState = it->connectState;
+				if (!it->infoValues.empty()) {
+					sessionInfo.winStationName = it->infoValues[0].infoValue.stringValue;
+				}
+				result.sessionInfoList.push_back(sessionInfo);
+			}
+		} else if (!currentCon->noEnumerateEx) {
+			return FALSE;
+		}
+	}
+
+	if (!gPrefetchSessionInfo || currentCon->noEnumerateEx) {
+		try {
+			connection->client->enumerateSessions(result, currentCon->authToken, Version);
+			if (!result.returnValue){
+				SetLastError(ERROR_INTERNAL_ERROR);
+				return FALSE;
+			}
+		} catch (const TException &tx) {
+			fprintf(stderr, "%s: TException: %s\n", __FUNCTION__, tx.what());
+			SetLastError(ERROR_INTERNAL_ERROR);
+			return FALSE;
+		} catch (...) {
 			SetLastError(ERROR_INTERNAL_ERROR);
 			return FALSE;
 		}
-	} catch (const TException &tx) {
-		fprintf(stderr, "%s: TException: %s\n", __FUNCTION__, tx.what());
-		SetLastError(ERROR_INTERNAL_ERROR);
-		return FALSE;
-	} catch (...) {
-		SetLastError(ERROR_INTERNAL_ERROR);
-		return FALSE;
 	}
 
 	SetLastError(ERROR_SUCCESS);
@@ -630,39 +1129,188 @@ BOOL WINAPI ogon_WTSEnumerateSessionsW(HANDLE hServer, DWORD Reserved,
 			int size = MultiByteToWideChar(CP_ACP, 0, pSessionInfoA[index].pWinStationName,
 				-1, pSessionInfoW[index].pWinStationName, cbExtra);
 			pExtra += size;
-			cbExtra -= size;
+			cbExtra -= size;
+		}
+	}
+	*ppSessionInfo = pSessionInfoW;
+	*pCount = count;
+
+	return TRUE;
+}
+
+/** name of the server the handle is connected to, as reported in pHostName */
+static std::string serverHostName(TSessionInfo *con) {
+	char name[HOST_NAME_MAX + 1];
+
+	if ((con->connection->host != "localhost") || gethostname(name, sizeof(name))) {
+		return con->connection->host;
+	}
+	name[HOST_NAME_MAX] = '\0';
+	return name;
+}
+
+BOOL WINAPI ogon_WTSEnumerateSessionsExA(HANDLE hServer, DWORD *pLevel,
+	DWORD Filter, PWTS_SESSION_INFO_1A *ppSessionInfo, DWORD *pCount) {
+
+	/* fill pSessionName, pUserName and pDomainName, pHostName is the server */
+	static const INT32 levelOneClasses[] = {
+		WTSWinStationName,
+		WTSUserName,
+		WTSDomainName
+	};
+	ogon::TReturnEnumerateSessionEx result;
+	PWTS_SESSION_INFO_1A pSessionInfoA = NULL;
+	TSessionInfo *currentCon;
+
+	/* Check parameters. */
+	if ((pLevel == NULL) || (*pLevel != 1) || (Filter != 0) ||
+			(ppSessionInfo == NULL) || (pCount == NULL)) {
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return FALSE;
+	}
+
+	currentCon = getSessionInfo(hServer);
+	if (currentCon == NULL) {
+		SetLastError(ERROR_INVALID_HANDLE);
+		return FALSE;
+	}
+
+	CHECK_AUTH_TOKEN(currentCon);
+	CHECK_CLIENT_CONNECTION(currentCon);
+
+	ogon::TInfoClassList infoClasses(levelOneClasses, levelOneClasses + COUNT_OF(levelOneClasses));
+	if (!enumerateSessionsEx(currentCon, connection.get(), infoClasses, result)) {
+		return FALSE;
+	}
+
+	SetLastError(ERROR_SUCCESS);
+
+	DWORD count = (DWORD)result.sessionInfoList.size();
+	if (!count) {
+		*pCount = 0;
+		*ppSessionInfo = NULL;
+		return TRUE;
+	}
+
+	std::string hostName = serverHostName(currentCon);
+
+	/* Allocate memory (including space for strings), failed classes are left NULL. */
+	int cbExtra = 0;
+	for (DWORD index = 0; index < count; index++) {
+		const ogon::TSessionInfoEx &sessionInfo = result.sessionInfoList.at(index);
+		cbExtra += hostName.length() + 1;
+		for (size_t i = 0; i < sessionInfo.infoValues.size(); i++) {
+			if (sessionInfo.infoValues[i].returnValue) {
+				cbExtra += sessionInfo.infoValues[i].infoValue.stringValue.length() + 1;
+			}
+		}
+	}
+
+	pSessionInfoA = (PWTS_SESSION_INFO_1A)calloc(1, sizeof(WTS_SESSION_INFO_1A) * count + cbExtra);
+	if (!pSessionInfoA) {
+		SetLastError(ERROR_OUTOFMEMORY);
+		return FALSE;
+	}
+
+	LPBYTE pExtra = (LPBYTE)pSessionInfoA + (count * sizeof(WTS_SESSION_INFO_1A));
+
+	for (DWORD index = 0; index < count; index++) {
+		const ogon::TSessionInfoEx &sessionInfo = result.sessionInfoList.at(index);
+		LPSTR *strings[] = { &pSessionInfoA[index].pSessionName,
+			&pSessionInfoA[index].pUserName, &pSessionInfoA[index].pDomainName };
+
+		pSessionInfoA[index].ExecEnvId = (DWORD)sessionInfo.sessionId;
+		pSessionInfoA[index].State = (WTS_CONNECTSTATE_CLASS)sessionInfo.connectState;
+		pSessionInfoA[index].SessionId = (DWORD)sessionInfo.sessionId;
+		pSessionInfoA[index].pHostName = (LPSTR)pExtra;
+		memcpy(pExtra, hostName.c_str(), hostName.length() + 1);
+		pExtra += hostName.length() + 1;
+
+		for (size_t i = 0; (i < COUNT_OF(strings)) && (i < sessionInfo.infoValues.size()); i++) {
+			if (!sessionInfo.infoValues[i].returnValue) {
+				continue;
+			}
+			const std::string &value = sessionInfo.infoValues[i].infoValue.stringValue;
+			*strings[i] = (LPSTR)pExtra;
+			memcpy(pExtra, value.c_str(), value.length() + 1);
+			pExtra += value.length() + 1;
+		}
+	}
+
+	*ppSessionInfo = pSessionInfoA;
+	*pCount = count;
+
+	return TRUE;
+}
+
+BOOL WINAPI ogon_WTSEnumerateSessionsExW(HANDLE hServer, DWORD *pLevel,
+	DWORD Filter, PWTS_SESSION_INFO_1W *ppSessionInfo, DWORD *pCount) {
+
+	PWTS_SESSION_INFO_1A pSessionInfoA;
+	PWTS_SESSION_INFO_1W pSessionInfoW;
+	DWORD count;
+
+	if (!ogon_WTSEnumerateSessionsExA(hServer, pLevel, Filter, &pSessionInfoA, &count)) {
+		return FALSE;
+	}
+
+	if (!count) {
+		*ppSessionInfo = NULL;
+		*pCount = 0;
+		return TRUE;
+	}
+
+	/* Allocate memory (including space for strings). */
+	int cbExtra = 0;
+	for (DWORD index = 0; index < count; index++) {
+		LPSTR strings[] = { pSessionInfoA[index].pSessionName, pSessionInfoA[index].pHostName,
+			pSessionInfoA[index].pUserName, pSessionInfoA[index].pDomainName };
+		for (size_t i = 0; i < COUNT_OF(strings); i++) {
+			if (strings[i]) {
+				cbExtra += MultiByteToWideChar(CP_ACP, 0, strings[i], -1, NULL, 0) * sizeof(WCHAR);
+			}
+		}
+	}
+
+	pSessionInfoW = (PWTS_SESSION_INFO_1W)calloc(1, sizeof(WTS_SESSION_INFO_1W) * count + cbExtra);
+	if (!pSessionInfoW) {
+		SetLastError(ERROR_OUTOFMEMORY);
+		WTSFreeMemoryEx(WTSTypeSessionInfoLevel1, pSessionInfoA, count);
+		return FALSE;
+	}
+
+	LPWSTR pExtra = (LPWSTR)((LPBYTE)pSessionInfoW + (count * sizeof(WTS_SESSION_INFO_1W)));
+	int cchExtra = cbExtra / sizeof(WCHAR);
+
+	/* Fill memory with session information. */
+	for (DWORD index = 0; index < count; index++) {
+		pSessionInfoW[index].ExecEnvId = pSessionInfoA[index].ExecEnvId;
+		pSessionInfoW[index].State = pSessionInfoA[index].State;
+		pSessionInfoW[index].SessionId = pSessionInfoA[index].SessionId;
+
+		LPSTR stringsA[] = { pSessionInfoA[index].pSessionName, pSessionInfoA[index].pHostName,
+			pSessionInfoA[index].pUserName, pSessionInfoA[index].pDomainName };
+		LPWSTR *stringsW[] = { &pSessionInfoW[index].pSessionName, &pSessionInfoW[index].pHostName,
+			&pSessionInfoW[index].pUserName, &pSessionInfoW[index].pDomainName };
+		for (size_t i = 0; i < COUNT_OF(stringsA); i++) {
+			if (!stringsA[i]) {
+				continue;
+			}
+			*stringsW[i] = pExtra;
+			int size = MultiByteToWideChar(CP_ACP, 0, stringsA[i], -1, pExtra, cchExtra);
+			pExtra += size;
+			cchExtra -= size;
 		}
 	}
+
+	WTSFreeMemoryEx(WTSTypeSessionInfoLevel1, pSessionInfoA, count);
+
 	*ppSessionInfo = pSessionInfoW;
 	*pCount = count;
 
 	return TRUE;
 }
 
-BOOL WINAPI ogon_WTSEnumerateSessionsExW(HANDLE hServer, DWORD *pLevel,
-	DWORD Filter, PWTS_SESSION_INFO_1W *ppSessionInfo, DWORD *pCount) {
-
-	OGON_UNUSED(hServer);
-	OGON_UNUSED(pLevel);
-	OGON_UNUSED(Filter);
-	OGON_UNUSED(ppSessionInfo);
-	OGON_UNUSED(pCount);
-
-	return FALSE;
-}
-
-BOOL WINAPI ogon_WTSEnumerateSessionsExA(HANDLE hServer, DWORD *pLevel,
-	DWORD Filter, PWTS_SESSION_INFO_1A *ppSessionInfo, DWORD *pCount) {
-
-	OGON_UNUSED(hServer);
-	OGON_UNUSED(pLevel);
-	OGON_UNUSED(Filter);
-	OGON_UNUSED(ppSessionInfo);
-	OGON_UNUSED(pCount);
-
-	return FALSE;
-}
-
 BOOL WINAPI ogon_WTSEnumerateProcessesW(HANDLE hServer, DWORD Reserved,
 	DWORD Version, PWTS_PROCESS_INFOW *ppProcessInfo, DWORD *pCount) {
 
@@ -720,24 +1368,58 @@ BOOL WINAPI ogon_WTSQuerySessionInformationA(HANDLE hServer, DWORD SessionId,
 	*ppBuffer = NULL;
 	*pBytesReturned = 0;
 
-	try {
-		currentCon->client->querySessionInformation(result, currentCon->authToken,
-			getSessionId(currentCon, SessionId), wtsInfoClass);
-		if (!result.returnValue) {
+	if (!lookupInfoCache(currentCon, getSessionId(currentCon, SessionId), wtsInfoClass, result)) {
+		try {
+			connection->client->querySessionInformation(result, currentCon->authToken,
+				getSessionId(currentCon, SessionId), wtsInfoClass);
+		} catch (const TException &tx) {
+			fprintf(stderr, "%s: TException: %s\n", __FUNCTION__, tx.what());
+			SetLastError(ERROR_INTERNAL_ERROR);
+			return FALSE;
+		} catch (...) {
 			SetLastError(ERROR_INTERNAL_ERROR);
 			return FALSE;
 		}
-	} catch (const TException &tx) {
-		fprintf(stderr, "%s: TException: %s\n", __FUNCTION__, tx.what());
-		SetLastError(ERROR_INTERNAL_ERROR);
-		return FALSE;
-	} catch (...) {
+	}
+
+	if (!result.returnValue) {
 		SetLastError(ERROR_INTERNAL_ERROR);
 		return FALSE;
 	}
 
 	SetLastError(ERROR_SUCCESS);
 
+	/* ogon specific classes, not part of the WTS_INFO_CLASS enum */
+	if (wtsInfoClass == OGON_WTS_INFO_FRAME_STATS) {
+		const ogon::TFrameStats &frameStats = result.infoValue.frameStatsValue;
+		ogon_frame_stats *stats = (ogon_frame_stats *)calloc(1, sizeof(ogon_frame_stats));
+		if (!stats) {
+			SetLastError(ERROR_OUTOFMEMORY);
+			return FALSE;
+		}
+
+		stats->frames = frameStats.frames;
+		stats->suppressedFrames = frameStats.suppressedFrames;
+		stats->bytesSent = frameStats.bytesSent;
+		stats->codecMetric = frameStats.codecMetric;
+		for (size_t index = 0; index < frameStats.histograms.size(); index++) {
+			const ogon::TFrameHistogram &histogram = frameStats.histograms[index];
+			if ((histogram.metric < 0) || (histogram.metric >= OGON_FRAME_METRIC_COUNT)) {
+				continue;
+			}
+			ogon_frame_histogram *dest = &stats->histograms[histogram.metric];
+			dest->count = histogram.count;
+			dest->sum = histogram.sum;
+			for (size_t bucket = 0; (bucket < histogram.buckets.size()) && (bucket < OGON_FRAME_STATS_BUCKETS); bucket++) {
+				dest->buckets[bucket] = histogram.buckets[bucket];
+			}
+		}
+
+		*ppBuffer = (LPSTR)stats;
+		*pBytesReturned = sizeof(ogon_frame_stats);
+		return TRUE;
+	}
+
 	/* Return the result. */
 	switch (wtsInfoClass) {
 		case WTSSessionId:
@@ -1036,7 +1718,7 @@ BOOL WINAPI ogon_WTSSendMessageA(HANDLE hServer, DWORD SessionId, LPSTR pTitle,
 	CHECK_CLIENT_CONNECTION(currentCon);
 
 	try {
-		result = currentCon->client->sendMessage(currentCon->authToken,
+		result = connection->client->sendMessage(currentCon->authToken,
 			getSessionId(currentCon, SessionId), title, message, Style, Timeout,
 			bWait);
 	} catch (const TException &tx) {
@@ -1061,9 +1743,10 @@ BOOL WINAPI ogon_WTSDisconnectSession(HANDLE hServer, DWORD SessionId, BOOL bWai
 	CHECK_AUTH_TOKEN(currentCon);
 	CHECK_CLIENT_CONNECTION(currentCon);
 	SetLastError(ERROR_SUCCESS);
+	invalidateInfoCaches();
 
 	try {
-		bool result = currentCon->client->disconnectSession(currentCon->authToken,
+		bool result = connection->client->disconnectSession(currentCon->authToken,
 			getSessionId(currentCon, SessionId), bWait);
 		if (!result) {
 			SetLastError(ERROR_INTERNAL_ERROR);
@@ -1091,9 +1774,10 @@ BOOL WINAPI ogon_WTSLogoffSession(HANDLE hServer, DWORD SessionId, BOOL bWait) {
 	CHECK_AUTH_TOKEN(currentCon);
 	CHECK_CLIENT_CONNECTION(currentCon);
 	SetLastError(ERROR_SUCCESS);
+	invalidateInfoCaches();
 
 	try {
-		bool result = currentCon->client->logoffSession(currentCon->authToken,
+		bool result = connection->client->logoffSession(currentCon->authToken,
 			getSessionId(currentCon, SessionId), bWait);
 		if (!result) {
 			SetLastError(ERROR_INTERNAL_ERROR);
@@ -1117,14 +1801,300 @@ BOOL WINAPI ogon_WTSShutdownSystem(HANDLE hServer, DWORD ShutdownFlag) {
 	return FALSE;
 }
 
+/**
+ * Waits up to timeout milliseconds for session events and appends them to
+ * pendingEvents. The first call only subscribes, events which happened
+ * before are not reported. Has to be called with eventSection held.
+ * Sets ERROR_OPERATION_ABORTED if the handle was flushed since flushCount was
+ * taken and ERROR_NOT_SUPPORTED if the session manager is too old to know the call.
+ */
+static BOOL fetchSessionEvents(TSessionInfo *con, DWORD timeout, UINT64 flushCount) {
+	if (!con->eventConnection) {
+		con->eventConnection = newClient();
+	}
+
+	TClient *events = con->eventConnection;
+	if (!isConnectionAlive(events) && !connectClient(con->connection, events)) {
+		SetLastError(ERROR_INTERNAL_ERROR);
+		return FALSE;
+	}
+
+	/* WTS_EVENT_FLUSH shuts the socket down to abort the call */
+	EnterCriticalSection(&con->cSection);
+	if (con->eventFlushCount != flushCount) {
+		LeaveCriticalSection(&con->cSection);
+		SetLastError(ERROR_OPERATION_ABORTED);
+		return FALSE;
+	}
+	con->eventSocket = events->socket->getSocketFD();
+	LeaveCriticalSection(&con->cSection);
+
+	BOOL ret = FALSE;
+	DWORD error = ERROR_INTERNAL_ERROR;
+	try {
+		ogon::TReturnWaitSessionEvents result;
+		if (con->eventSequence < 0) {
+			events->client->waitSessionEvents(result, con->authToken, -1, 0);
+			if (result.returnValue) {
+				con->eventSequence = result.lastSequence;
+			}
+		}
+		if (con->eventSequence >= 0) {
+			events->client->waitSessionEvents(result, con->authToken, con->eventSequence, timeout);
+		}
+		if (result.returnValue) {
+			con->eventSequence = result.lastSequence;
+			if (result.eventsLost) {
+				con->eventsLost = true;
+			}
+			if (result.eventsLost || !result.events.empty()) {
+				invalidateInfoCaches();
+			}
+			con->pendingEvents.insert(con->pendingEvents.end(), result.events.begin(), result.events.end());
+			ret = TRUE;
+		}
+	} catch (const TApplicationException &tx) {
+		if (tx.getType() == TApplicationException::UNKNOWN_METHOD) {
+			error = ERROR_NOT_SUPPORTED;
+		} else {
+			fprintf(stderr, "%s: TException: %s\n", __FUNCTION__, tx.what());
+		}
+	} catch (const TException &) {
+		/* reconnected on the next wait */
+		try {
+			events->transport->close();
+		} catch (...) {
+		}
+	} catch (...) {
+	}
+
+	EnterCriticalSection(&con->cSection);
+	if ((con->eventFlushCount != flushCount) && !ret) {
+		error = ERROR_OPERATION_ABORTED;
+	}
+	con->eventSocket = -1;
+	LeaveCriticalSection(&con->cSection);
+
+	if (!ret) {
+		SetLastError(error);
+	}
+	return ret;
+}
+
+/**
+ * @brief registers a wait for session events on a server handle.
+ *
+ * WTSCloseServer doesn't free the handle before all registered waits are
+ * gone, the lookup and the registration happen under gCSection for that.
+ */
+class TEventWait {
+public:
+	TEventWait(HANDLE hServer) : con(NULL), flushCount(0) {
+		CSGuard guard(&gCSection);
+		if (hServer == WTS_CURRENT_SERVER_HANDLE) {
+			con = &gCurrentServer;
+		} else {
+			TSessionMap::iterator it = gSessionMap.find(hServer);
+			if (it == gSessionMap.end()) {
+				return;
+			}
+			con = it->second;
+		}
+		CSGuard conGuard(&con->cSection);
+		if (con->eventWaiters++ == 0) {
+			ResetEvent(con->eventIdle);
+		}
+		flushCount = con->eventFlushCount;
+	}
+
+	~TEventWait() {
+		if (!con) {
+			return;
+		}
+		CSGuard guard(&con->cSection);
+		if (--con->eventWaiters == 0) {
+			SetEvent(con->eventIdle);
+		}
+	}
+
+	TSessionInfo *con;
+	/* flushes up to here don't abort this wait */
+	UINT64 flushCount;
+};
+
+static DWORD sessionEventFlags(DWORD reason) {
+	switch (reason) {
+		case WTS_CONSOLE_CONNECT:
+		case WTS_REMOTE_CONNECT:
+			return WTS_EVENT_CONNECT | WTS_EVENT_STATECHANGE;
+		case WTS_CONSOLE_DISCONNECT:
+		case WTS_REMOTE_DISCONNECT:
+			return WTS_EVENT_DISCONNECT | WTS_EVENT_STATECHANGE;
+		case WTS_SESSION_LOGON:
+			return WTS_EVENT_LOGON | WTS_EVENT_STATECHANGE;
+		case WTS_SESSION_LOGOFF:
+			return WTS_EVENT_LOGOFF | WTS_EVENT_STATECHANGE;
+		case WTS_SESSION_CREATE:
+			return WTS_EVENT_CREATE;
+		case WTS_SESSION_TERMINATE:
+			return WTS_EVENT_DELETE;
+		default:
+			return WTS_EVENT_STATECHANGE;
+	}
+}
+
+/* longest single wait, the session manager limits it anyway */
+#define SESSION_EVENT_WAIT (60 * 1000)
+
 BOOL WINAPI ogon_WTSWaitSystemEvent(HANDLE hServer, DWORD EventMask,
 	DWORD *pEventFlags) {
 
-	OGON_UNUSED(hServer);
-	OGON_UNUSED(EventMask);
-	OGON_UNUSED(pEventFlags);
+	if (EventMask & WTS_EVENT_FLUSH) {
+		TSessionInfo *flushCon = getSessionInfo(hServer);
+		if (!flushCon) {
+			SetLastError(ERROR_INVALID_HANDLE);
+			return FALSE;
+		}
+		flushSessionEvents(flushCon);
+		if (pEventFlags) {
+			*pEventFlags = WTS_EVENT_NONE;
+		}
+		return TRUE;
+	}
 
-	return FALSE;
+	if (!pEventFlags) {
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return FALSE;
+	}
+
+	TEventWait wait(hServer);
+	TSessionInfo *currentCon = wait.con;
+	if (!currentCon) {
+		SetLastError(ERROR_INVALID_HANDLE);
+		return FALSE;
+	}
+
+	CHECK_AUTH_TOKEN(currentCon);
+
+	CSGuard guard(&currentCon->eventSection);
+	for (;;) {
+		DWORD flags = WTS_EVENT_NONE;
+
+		if (currentCon->eventsLost) {
+			/* we can't tell what happened, report everything */
+			flags = WTS_EVENT_ALL;
+			currentCon->eventsLost = false;
+		}
+		while (!currentCon->pendingEvents.empty()) {
+			flags |= sessionEventFlags(currentCon->pendingEvents.front().reason);
+			currentCon->pendingEvents.pop_front();
+		}
+
+		if (flags & EventMask) {
+			*pEventFlags = flags & EventMask;
+			return TRUE;
+		}
+
+		if (!fetchSessionEvents(currentCon, SESSION_EVENT_WAIT, wait.flushCount)) {
+			return FALSE;
+		}
+	}
+}
+
+/* messages are sent with a 4 byte little endian length header */
+#define CHANNEL_HEADER_LENGTH 4
+#define CHANNEL_BATCH_MESSAGES (IOV_MAX / 2)
+
+static void encodeChannelHeader(char *header, ULONG length) {
+	header[0] = length & 0xFF;
+	header[1] = (length >> 8) & 0xFF;
+	header[2] = (length >> 16) & 0xFF;
+	header[3] = (length >> 24) & 0xFF;
+}
+
+/* how long a writer waits on a full ring before checking that the rdp server is still there */
+#define CHANNEL_RING_WAIT_TIMEOUT 1000
+
+/**
+ * Switches a freshly connected channel to a shared memory ring. The setup
+ * message must be the first thing sent on the pipe, on any error the channel
+ * just stays with the pipe.
+ */
+static void setupChannelRing(HANDLE hChannelHandle) {
+	int fd = GetEventFileDescriptor(hChannelHandle);
+	union {
+		struct cmsghdr align;
+		char buffer[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	char header[CHANNEL_HEADER_LENGTH];
+	ssize_t sent;
+
+	if (fd < 0) {
+		return;
+	}
+
+	ogon_channel_ring *ring = new ogon_channel_ring;
+	if (!channel_ring_create(ring, OGON_CHANNEL_RING_DEFAULT_SIZE)) {
+		delete ring;
+		return;
+	}
+
+	encodeChannelHeader(header, OGON_CHANNEL_RING_SETUP);
+	iov.iov_base = header;
+	iov.iov_len = CHANNEL_HEADER_LENGTH;
+	memset(&msg, 0, sizeof(msg));
+	memset(&control, 0, sizeof(control));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buffer;
+	msg.msg_controllen = sizeof(control.buffer);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &ring->fd, sizeof(int));
+
+	do {
+		sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+	} while ((sent < 0) && (errno == EINTR));
+
+	if (sent != CHANNEL_HEADER_LENGTH) {
+		fprintf(stderr, "%s: failed to send the ring setup (errno=%d)\n", __FUNCTION__, errno);
+		channel_ring_destroy(ring);
+		delete ring;
+		return;
+	}
+
+	/* the rdp server holds its own reference now */
+	close(ring->fd);
+	ring->fd = -1;
+
+	CSGuard guard(&gCSection);
+	gChannelRings[hChannelHandle] = ring;
+}
+
+static ogon_channel_ring *lookupChannelRing(HANDLE hChannelHandle) {
+	CSGuard guard(&gCSection);
+	TChannelRingMap::iterator it = gChannelRings.find(hChannelHandle);
+	return (it == gChannelRings.end()) ? NULL : it->second;
+}
+
+static void releaseChannelRing(HANDLE hChannelHandle) {
+	ogon_channel_ring *ring;
+	{
+		CSGuard guard(&gCSection);
+		TChannelRingMap::iterator it = gChannelRings.find(hChannelHandle);
+		if (it == gChannelRings.end()) {
+			return;
+		}
+		ring = it->second;
+		gChannelRings.erase(it);
+	}
+	channel_ring_destroy(ring);
+	delete ring;
 }
 
 HANDLE WINAPI ogon_WTSVirtualChannelOpenEx(DWORD SessionId, LPSTR pVirtualName, DWORD flags) {
@@ -1142,7 +2112,7 @@ HANDLE WINAPI ogon_WTSVirtualChannelOpenEx(DWORD SessionId, LPSTR pVirtualName,
 	ogon::TReturnVirtualChannelOpen result;
 
 	try {
-		currentCon->client->virtualChannelOpen(result, currentCon->authToken,
+		connection->client->virtualChannelOpen(result, currentCon->authToken,
 			getSessionId(currentCon, SessionId), virtualName,
 			(flags & WTS_CHANNEL_OPTION_DYNAMIC) ? true : false, flags);
 	} catch (TException &ex) {
@@ -1160,6 +2130,18 @@ HANDLE WINAPI ogon_WTSVirtualChannelOpenEx(DWORD SessionId, LPSTR pVirtualName,
 		return NULL;
 	}
 
+	if ((flags & OGON_CHANNEL_OPTION_SHM_RING) &&
+			!(result.supportedOptions & OGON_CHANNEL_OPTION_SHM_RING)) {
+		/* an older rdp server would read the ring setup as channel data */
+		try {
+			connection->client->virtualChannelClose(currentCon->authToken,
+				getSessionId(currentCon, SessionId), virtualName, result.instance);
+		} catch (...) {
+		}
+		SetLastError(ERROR_NOT_SUPPORTED);
+		return NULL;
+	}
+
 	HANDLE hNamedPipe = connect2Pipe(result.pipeName);
 	if (hNamedPipe == INVALID_HANDLE_VALUE) {
 		SetLastError(ERROR_NOT_FOUND);
@@ -1173,6 +2155,10 @@ HANDLE WINAPI ogon_WTSVirtualChannelOpenEx(DWORD SessionId, LPSTR pVirtualName,
 		return NULL;
 	}
 
+	if (flags & OGON_CHANNEL_OPTION_SHM_RING) {
+		setupChannelRing(hNamedPipe);
+	}
+
 	THandleInfo info;
 	info.sessionId = getSessionId(currentCon, SessionId);
 	info.instance = result.instance;
@@ -1209,7 +2195,9 @@ BOOL WINAPI ogon_WTSVirtualChannelClose(HANDLE hChannelHandle) {
 	if (it == currentCon->handleInfoMap.end()) {
 		LeaveCriticalSection(&currentCon->cSection);
 		SetLastError(ERROR_INVALID_HANDLE);
-		goto out;
+		releaseChannelRing(hChannelHandle);
+		CloseHandle(hChannelHandle);
+		return FALSE;
 	}
 
 	info = it->second;
@@ -1221,7 +2209,7 @@ BOOL WINAPI ogon_WTSVirtualChannelClose(HANDLE hChannelHandle) {
 	SetLastError(ERROR_SUCCESS);
 
 	try {
-		result = currentCon->client->virtualChannelClose(currentCon->authToken,
+		result = connection->client->virtualChannelClose(currentCon->authToken,
 				getSessionId(currentCon, info.sessionId), info.virtualName, info.instance);
 		if (!result) {
 			SetLastError(ERROR_INTERNAL_ERROR);
@@ -1233,7 +2221,7 @@ BOOL WINAPI ogon_WTSVirtualChannelClose(HANDLE hChannelHandle) {
 		SetLastError(ERROR_INTERNAL_ERROR);
 	}
 
-out:
+	releaseChannelRing(hChannelHandle);
 	CloseHandle(hChannelHandle);
 	return result;
 }
@@ -1272,53 +2260,141 @@ BOOL WINAPI ogon_WTSVirtualChannelRead(HANDLE hChannelHandle, ULONG TimeOut,
 	return FALSE;
 }
 
-BOOL WINAPI ogon_WTSVirtualChannelWrite(HANDLE hChannelHandle, PCHAR Buffer,
-	ULONG Length, PULONG pBytesWritten) {
+/**
+ * Copies the buffers into the shared memory ring of the channel, rings the
+ * doorbell if the rdp server sleeps and waits for it to make space.
+ */
+static BOOL writeChannelRing(ogon_channel_ring *ring, int fd, struct iovec *iov, int iovcnt, size_t *pWritten) {
+	struct pollfd pfd;
+
+	for (int index = 0; index < iovcnt; index++) {
+		const BYTE *data = (const BYTE *)iov[index].iov_base;
+		size_t length = iov[index].iov_len;
+
+		while (length > 0) {
+			UINT32 chunk = (length > UINT32_MAX) ? UINT32_MAX : (UINT32)length;
+			UINT32 written = channel_ring_write(ring, data, chunk);
+
+			if (written) {
+				data += written;
+				length -= written;
+				*pWritten += written;
+
+				if (channel_ring_need_doorbell(ring) &&
+					(send(fd, "", 1, MSG_NOSIGNAL | MSG_DONTWAIT) < 0) &&
+					(errno != EAGAIN) && (errno != EWOULDBLOCK))
+				{
+					SetLastError(ERROR_BROKEN_PIPE);
+					return FALSE;
+				}
+				continue;
+			}
 
-	ULONG written;
-	ULONG writtenTotal = 0;
-	BOOL success = TRUE;
-	BOOL reentry = FALSE;
-
-	char buffer[4];
-	buffer[0] = 0xFF & Length;
-	buffer[1] = ((0xFF << 8) & Length) >> 8;
-	buffer[2] = ((0xFF << 16) & Length) >> 16;
-	buffer[3] = ((0xFF << 24) & Length) >> 24;
-
-	while (writtenTotal < 4) {
-		// writting headers for ogon
-		if (reentry) {
-			Sleep(10);
-		}
-		reentry = TRUE;
-		success = WriteFile(hChannelHandle, buffer + writtenTotal, 4 - writtenTotal, &written, NULL);
-		if (!success) {
-			*pBytesWritten = 0;
-			return FALSE;
+			if (channel_ring_wait_writable(ring, CHANNEL_RING_WAIT_TIMEOUT)) {
+				continue;
+			}
+
+			/* the ring stays full, make sure there still is someone reading it */
+			pfd.fd = fd;
+			pfd.events = 0;
+			pfd.revents = 0;
+			if ((poll(&pfd, 1, 0) < 0) || (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))) {
+				SetLastError(ERROR_BROKEN_PIPE);
+				return FALSE;
+			}
 		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * Writes the buffers to the channel pipe with a single system call as long
+ * as the pipe takes them and waits for the pipe to drain in between.
+ * iov is modified.
+ */
+static BOOL writeChannel(HANDLE hChannelHandle, struct iovec *iov, int iovcnt, size_t *pWritten) {
+	int fd = GetEventFileDescriptor(hChannelHandle);
+	struct msghdr msg;
+	struct pollfd pfd;
+	ssize_t written;
+	ogon_channel_ring *ring;
+
+	*pWritten = 0;
+	if (fd < 0) {
+		SetLastError(ERROR_INVALID_HANDLE);
+		return FALSE;
+	}
 
-		writtenTotal += written;
+	if ((ring = lookupChannelRing(hChannelHandle))) {
+		return writeChannelRing(ring, fd, iov, iovcnt, pWritten);
 	}
 
-	writtenTotal = 0;
-	reentry = FALSE;
-	while (writtenTotal < Length) {
-		if (reentry) {
-			Sleep(10);
+	while (iovcnt > 0) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = iovcnt;
+
+		/* the channel pipe is a unix socket, don't get killed if the session went away */
+		written = sendmsg(fd, &msg, MSG_NOSIGNAL);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+				SetLastError(ERROR_BROKEN_PIPE);
+				return FALSE;
+			}
+
+			pfd.fd = fd;
+			pfd.events = POLLOUT;
+			pfd.revents = 0;
+			if ((poll(&pfd, 1, -1) < 0) && (errno != EINTR)) {
+				SetLastError(ERROR_BROKEN_PIPE);
+				return FALSE;
+			}
+			if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+				SetLastError(ERROR_BROKEN_PIPE);
+				return FALSE;
+			}
+			continue;
 		}
-		reentry = TRUE;
-		success = WriteFile(hChannelHandle, Buffer + writtenTotal, Length - writtenTotal, &written, NULL);
-		if (!success) {
-			*pBytesWritten = 4 + writtenTotal;
-			return FALSE;
+
+		*pWritten += written;
+		while ((iovcnt > 0) && ((size_t)written >= iov->iov_len)) {
+			written -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (char *)iov->iov_base + written;
+			iov->iov_len -= written;
 		}
-		writtenTotal += written;
 	}
 
-	*pBytesWritten = writtenTotal;
+	return TRUE;
+}
+
+BOOL WINAPI ogon_WTSVirtualChannelWrite(HANDLE hChannelHandle, PCHAR Buffer,
+	ULONG Length, PULONG pBytesWritten) {
+
+	char header[CHANNEL_HEADER_LENGTH];
+	struct iovec iov[2];
+	size_t written;
+
+	encodeChannelHeader(header, Length);
+	iov[0].iov_base = header;
+	iov[0].iov_len = CHANNEL_HEADER_LENGTH;
+	iov[1].iov_base = Buffer;
+	iov[1].iov_len = Length;
+
+	if (!writeChannel(hChannelHandle, iov, Length ? 2 : 1, &written)) {
+		*pBytesWritten = (ULONG)written;
+		return FALSE;
+	}
 
-	return success;
+	*pBytesWritten = Length;
+	return TRUE;
 }
 
 BOOL WINAPI ogon_WTSVirtualChannelPurgeInput(HANDLE hChannelHandle) {
@@ -1377,21 +2453,22 @@ VOID WINAPI ogon_WTSFreeMemory(PVOID pMemory) {
 BOOL WINAPI ogon_WTSFreeMemoryExW(WTS_TYPE_CLASS WTSTypeClass, PVOID pMemory,
 	ULONG NumberOfEntries) {
 
-	OGON_UNUSED(WTSTypeClass);
-	OGON_UNUSED(pMemory);
-	OGON_UNUSED(NumberOfEntries);
-
-	return FALSE;
+	return ogon_WTSFreeMemoryExA(WTSTypeClass, pMemory, NumberOfEntries);
 }
 
 BOOL WINAPI ogon_WTSFreeMemoryExA(WTS_TYPE_CLASS WTSTypeClass, PVOID pMemory,
 	ULONG NumberOfEntries) {
 
-	OGON_UNUSED(WTSTypeClass);
-	OGON_UNUSED(pMemory);
 	OGON_UNUSED(NumberOfEntries);
 
-	return FALSE;
+	/* session infos are a single allocation, see ogon_WTSEnumerateSessionsExA */
+	if (WTSTypeClass != WTSTypeSessionInfoLevel1) {
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return FALSE;
+	}
+
+	free(pMemory);
+	return TRUE;
 }
 
 BOOL WINAPI ogon_WTSRegisterSessionNotification(HWND hWnd, DWORD dwFlags) {
@@ -1634,7 +2711,7 @@ BOOL CDECL ogon_WTSLogoffUser(HANDLE hServer) {
 	CHECK_CLIENT_CONNECTION(currentCon);
 
 	try {
-		retVal = currentCon->client->logoffConnection(currentCon->authToken);
+		retVal = connection->client->logoffConnection(currentCon->authToken);
 	} catch (const TException &tx) {
 		fprintf(stderr, "%s: TException: %s\n", __FUNCTION__, tx.what());
 		SetLastError(ERROR_INTERNAL_ERROR);
@@ -1685,7 +2762,7 @@ BOOL CDECL ogon_WTSLogonUser(HANDLE hServer, LPCSTR username, LPCSTR password, L
 	}
 
 	try {
-		currentCon->client->logonConnection(result, stdusername, stdpassword, stddomain);
+		connection->client->logonConnection(result, stdusername, stdpassword, stddomain);
 	} catch (const TException &tx) {
 		fprintf(stderr, "%s: TException: %s\n", __FUNCTION__, tx.what());
 		SetLastError(ERROR_INTERNAL_ERROR);
@@ -1801,6 +2878,124 @@ OGON_API PWtsApiFunctionTable CDECL ogon_InitWtsApi(void) {
 	return &ogon_WtsApiFunctionTable;
 }
 
+OGON_API BOOL CDECL ogon_WTSWaitSessionEvents(HANDLE hServer, DWORD timeout,
+	ogon_session_event *events, ULONG count, PULONG pReturned) {
+
+	if (!events || !count || !pReturned) {
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return FALSE;
+	}
+	*pReturned = 0;
+
+	TEventWait wait(hServer);
+	TSessionInfo *currentCon = wait.con;
+	if (!currentCon) {
+		SetLastError(ERROR_INVALID_HANDLE);
+		return FALSE;
+	}
+
+	CHECK_AUTH_TOKEN(currentCon);
+
+	CSGuard guard(&currentCon->eventSection);
+	UINT64 deadline = GetTickCount64() + timeout;
+	DWORD remaining = timeout;
+	for (;;) {
+		if (currentCon->eventsLost || !currentCon->pendingEvents.empty()) {
+			break;
+		}
+		if (!fetchSessionEvents(currentCon, remaining > SESSION_EVENT_WAIT ? SESSION_EVENT_WAIT : remaining,
+				wait.flushCount)) {
+			return FALSE;
+		}
+		/* the session manager limits a single wait, longer ones simply ask again */
+		if (timeout != INFINITE) {
+			UINT64 now = GetTickCount64();
+			if (now >= deadline) {
+				break;
+			}
+			remaining = (DWORD)(deadline - now);
+		}
+	}
+
+	ULONG returned = 0;
+	if (currentCon->eventsLost) {
+		events[returned].reason = OGON_SESSION_EVENT_RESYNC;
+		events[returned].sessionId = 0;
+		returned++;
+		currentCon->eventsLost = false;
+	}
+	while ((returned < count) && !currentCon->pendingEvents.empty()) {
+		events[returned].reason = currentCon->pendingEvents.front().reason;
+		events[returned].sessionId = currentCon->pendingEvents.front().sessionId;
+		currentCon->pendingEvents.pop_front();
+		returned++;
+	}
+
+	*pReturned = returned;
+	return TRUE;
+}
+
+OGON_API BOOL CDECL ogon_WTSVirtualChannelWriteBatch(HANDLE hChannelHandle,
+	const ogon_channel_message *messages, ULONG count, PULONG pMessagesWritten) {
+
+	char headers[CHANNEL_BATCH_MESSAGES][CHANNEL_HEADER_LENGTH];
+	struct iovec iov[CHANNEL_BATCH_MESSAGES * 2];
+	ULONG done = 0;
+
+	if (pMessagesWritten) {
+		*pMessagesWritten = 0;
+	}
+	if (!messages && count) {
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return FALSE;
+	}
+
+	while (done < count) {
+		ULONG batch = count - done;
+		int iovcnt = 0;
+		size_t written;
+
+		if (batch > CHANNEL_BATCH_MESSAGES) {
+			batch = CHANNEL_BATCH_MESSAGES;
+		}
+
+		for (ULONG index = 0; index < batch; index++) {
+			const ogon_channel_message *message = &messages[done + index];
+			encodeChannelHeader(headers[index], message->length);
+			iov[iovcnt].iov_base = headers[index];
+			iov[iovcnt].iov_len = CHANNEL_HEADER_LENGTH;
+			iovcnt++;
+			if (message->length) {
+				iov[iovcnt].iov_base = message->buffer;
+				iov[iovcnt].iov_len = message->length;
+				iovcnt++;
+			}
+		}
+
+		if (!writeChannel(hChannelHandle, iov, iovcnt, &written)) {
+			/* count the messages which made it completely */
+			for (ULONG index = 0; index < batch; index++) {
+				size_t size = CHANNEL_HEADER_LENGTH + messages[done + index].length;
+				if (written < size) {
+					break;
+				}
+				written -= size;
+				done++;
+			}
+			if (pMessagesWritten) {
+				*pMessagesWritten = done;
+			}
+			return FALSE;
+		}
+		done += batch;
+	}
+
+	if (pMessagesWritten) {
+		*pMessagesWritten = done;
+	}
+	return TRUE;
+}
+
 #ifdef __cplusplus
 }
 #endif
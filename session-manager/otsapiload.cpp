@@ -0,0 +1,247 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * OTSAPI connection load driver
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <winpr/cmdline.h>
+#include <winpr/ssl.h>
+
+#include <ogon/version.h>
+
+#include <otsapi/otsapi.h>
+#include <otsapi/ogon_ssl.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+
+using namespace apache::thrift;
+using namespace apache::thrift::protocol;
+using namespace apache::thrift::transport;
+
+/**
+ * Connects many OTSAPI clients to a running session manager the way the
+ * client library does: every client keeps its connection open and stays
+ * idle most of the time. Then all of them make calls at the same time.
+ * With more clients than otsapi.workers every client still has to be
+ * answered, a client that is not answered within --max-ms fails the run.
+ */
+
+static COMMAND_LINE_ARGUMENT_A load_args[] = {
+	{ "help", COMMAND_LINE_VALUE_FLAG, "", NULL, NULL, -1, NULL, "prints help" },
+	{ "host", COMMAND_LINE_VALUE_REQUIRED, "<host>", NULL, NULL, -1, NULL, "session manager host" },
+	{ "port", COMMAND_LINE_VALUE_REQUIRED, "<port>", NULL, NULL, -1, NULL, "OTSAPI port" },
+	{ "connections", COMMAND_LINE_VALUE_REQUIRED, "<count>", NULL, NULL, -1, NULL, "persistent clients" },
+	{ "calls", COMMAND_LINE_VALUE_REQUIRED, "<count>", NULL, NULL, -1, NULL, "calls per client" },
+	{ "max-ms", COMMAND_LINE_VALUE_REQUIRED, "<ms>", NULL, NULL, -1, NULL, "fail above this time per call" },
+	{ NULL, 0, NULL, NULL, NULL, -1, NULL, NULL }
+};
+
+static void printhelprow(const char *kshort, const char *klong, const char *helptext) {
+	if (kshort) {
+		printf("    %s, %-20s %s\n", kshort, klong, helptext);
+	} else {
+		printf("        %-20s %s\n", klong, helptext);
+	}
+}
+
+static void printhelp(const char *bin) {
+	printf("Usage: %s [options]\n", bin);
+	printf("\noptions:\n\n");
+	printhelprow(NULL, "--help", "prints this help screen");
+	printhelprow(NULL, "--host=<host>", "session manager host (default localhost)");
+	printhelprow(NULL, "--port=<port>", "OTSAPI port (default 9091)");
+	printhelprow(NULL, "--connections=<count>", "persistent clients (default 64)");
+	printhelprow(NULL, "--calls=<count>", "calls per client (default 100)");
+	printhelprow(NULL, "--max-ms=<ms>", "fail above this time per call (default 5000)");
+}
+
+/**
+ * @brief one persistent client connection.
+ */
+struct LoadClient {
+	std::shared_ptr<TTransport> transport;
+	std::shared_ptr<ogon::otsapiClient> client;
+};
+
+static bool load_connect(std::shared_ptr<TSSLSocketFactory> factory, const std::string &host,
+		int port, unsigned long maxMs, LoadClient &client) {
+	try {
+		std::shared_ptr<TSSLSocket> socket = factory->createSocket(host, port);
+		socket->setConnTimeout(maxMs);
+		// a client which is never served shows up as a timeout instead of a hang
+		socket->setRecvTimeout(maxMs);
+
+		client.transport.reset(new TFramedTransport(socket));
+		std::shared_ptr<TProtocol> protocol(new TBinaryProtocol(client.transport));
+		client.client.reset(new ogon::otsapiClient(protocol));
+		client.transport->open();
+		return true;
+	} catch (const TException &tx) {
+		fprintf(stderr, "connecting failed: %s\n", tx.what());
+		return false;
+	}
+}
+
+static bool load_call(LoadClient &client, std::vector<double> &latencies) {
+	ogon::TVersion smversion;
+	ogon::TVersion ourversion;
+	ourversion.VersionMajor = OGON_PROTOCOL_VERSION_MAJOR;
+	ourversion.VersionMinor = OGON_PROTOCOL_VERSION_MINOR;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	try {
+		client.client->getVersionInfo(smversion, ourversion);
+	} catch (const TException &tx) {
+		fprintf(stderr, "call failed: %s\n", tx.what());
+		return false;
+	}
+	latencies.push_back(std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count());
+	return true;
+}
+
+int main(int argc, char **argv) {
+	std::string host("localhost");
+	unsigned long port = 9091, connections = 64, calls = 100, maxMs = 5000;
+	COMMAND_LINE_ARGUMENT_A *arg;
+	DWORD flags;
+	int status;
+
+	flags = COMMAND_LINE_SEPARATOR_EQUAL | COMMAND_LINE_SIGIL_DOUBLE_DASH;
+	status = CommandLineParseArgumentsA(argc, argv, load_args, flags, NULL, NULL, NULL);
+	if (status != 0) {
+		printhelp(argv[0]);
+		return 1;
+	}
+
+	arg = load_args;
+	do {
+		if (!(arg->Flags & COMMAND_LINE_VALUE_PRESENT))
+			continue;
+
+		CommandLineSwitchStart(arg)
+
+		CommandLineSwitchCase(arg, "help") {
+			printhelp(argv[0]);
+			return 0;
+		}
+		CommandLineSwitchCase(arg, "host") {
+			host = arg->Value;
+		}
+		CommandLineSwitchCase(arg, "port") {
+			port = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchCase(arg, "connections") {
+			connections = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchCase(arg, "calls") {
+			calls = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchCase(arg, "max-ms") {
+			maxMs = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchEnd(arg)
+	}
+	while ((arg = CommandLineFindNextArgumentA(arg)) != NULL);
+
+	if ((connections < 1) || (calls < 1) || (maxMs < 1) || !port || (port > 0xFFFF)) {
+		printhelp(argv[0]);
+		return 1;
+	}
+
+	winpr_InitializeSSL(WINPR_SSL_INIT_DEFAULT);
+	TSSLSocketFactory::setManualOpenSSLInitialization(true);
+	std::shared_ptr<TSSLSocketFactory> factory(new OgonSSLSocketFactory());
+	factory->authenticate(false);
+
+	// every client makes one call and then stays connected and idle
+	std::vector<LoadClient> clients(connections);
+	std::vector<double> connectLatencies;
+	for (unsigned long i = 0; i < connections; i++) {
+		if (!load_connect(factory, host, port, maxMs, clients[i]) ||
+				!load_call(clients[i], connectLatencies)) {
+			printf("client %lu of %lu was not served, %lu clients are connected\n", i + 1, connections, i);
+			return 1;
+		}
+	}
+
+	std::vector<std::vector<double> > latencies(connections);
+	std::vector<std::thread> threads;
+	std::atomic<unsigned long> failed(0);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (unsigned long i = 0; i < connections; i++) {
+		threads.push_back(std::thread([&, i]() {
+			for (unsigned long c = 0; c < calls; c++) {
+				if (!load_call(clients[i], latencies[i])) {
+					failed++;
+					return;
+				}
+			}
+		}));
+	}
+	for (size_t i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::vector<double> all;
+	for (size_t i = 0; i < latencies.size(); i++) {
+		all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+	}
+	std::sort(all.begin(), all.end());
+
+	double p50 = all.empty() ? 0.0 : all[all.size() / 2];
+	double p99 = all.empty() ? 0.0 : all[(all.size() * 99) / 100];
+	double slowest = all.empty() ? 0.0 : all.back();
+
+	printf("%-12s %10s %12s %10s %10s %10s\n", "connections", "calls", "calls/s", "p50 ms", "p99 ms", "max ms");
+	printf("%-12lu %10" PRIuz " %12.0f %10.2f %10.2f %10.2f\n", connections, all.size(),
+		all.size() / seconds, p50, p99, slowest);
+
+	for (size_t i = 0; i < clients.size(); i++) {
+		try {
+			clients[i].transport->close();
+		} catch (...) {
+		}
+	}
+
+	if (failed) {
+		printf("%lu clients failed\n", failed.load());
+		return 1;
+	}
+	if (slowest > maxMs) {
+		printf("exceeds %lu ms per call\n", maxMs);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,242 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Property lookup benchmark
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <winpr/cmdline.h>
+#include <winpr/wlog.h>
+
+#include <config/PropertyManager.h>
+
+/**
+ * Looks up properties from several threads the way the ICP property calls
+ * do (session id 0 with a user name), while one thread keeps changing a
+ * property at runtime. Every change publishes a new snapshot; the resident
+ * set size before and after the run shows that the replaced snapshots are
+ * freed again.
+ */
+
+static COMMAND_LINE_ARGUMENT_A bench_args[] = {
+	{ "help", COMMAND_LINE_VALUE_FLAG, "", NULL, NULL, -1, NULL, "prints help" },
+	{ "threads", COMMAND_LINE_VALUE_REQUIRED, "<count>", NULL, NULL, -1, NULL, "lookup threads" },
+	{ "properties", COMMAND_LINE_VALUE_REQUIRED, "<count>", NULL, NULL, -1, NULL, "global properties" },
+	{ "users", COMMAND_LINE_VALUE_REQUIRED, "<count>", NULL, NULL, -1, NULL, "users with overrides" },
+	{ "updates", COMMAND_LINE_VALUE_REQUIRED, "<count>", NULL, NULL, -1, NULL, "property changes per second" },
+	{ "duration", COMMAND_LINE_VALUE_REQUIRED, "<seconds>", NULL, NULL, -1, NULL, "run time" },
+	{ "max-ns", COMMAND_LINE_VALUE_REQUIRED, "<ns>", NULL, NULL, -1, NULL, "fail above this time per lookup" },
+	{ NULL, 0, NULL, NULL, NULL, -1, NULL, NULL }
+};
+
+static void printhelprow(const char *kshort, const char *klong, const char *helptext) {
+	if (kshort) {
+		printf("    %s, %-20s %s\n", kshort, klong, helptext);
+	} else {
+		printf("        %-20s %s\n", klong, helptext);
+	}
+}
+
+static void printhelp(const char *bin) {
+	printf("Usage: %s [options]\n", bin);
+	printf("\noptions:\n\n");
+	printhelprow(NULL, "--help", "prints this help screen");
+	printhelprow(NULL, "--threads=<count>", "lookup threads (default 4)");
+	printhelprow(NULL, "--properties=<count>", "global properties (default 200)");
+	printhelprow(NULL, "--users=<count>", "users with overrides (default 50)");
+	printhelprow(NULL, "--updates=<count>", "property changes per second (default 100)");
+	printhelprow(NULL, "--duration=<seconds>", "run time (default 5)");
+	printhelprow(NULL, "--max-ns=<ns>", "exit with 1 above this time per lookup");
+}
+
+static long bench_rss_kb() {
+	long pages = 0, resident = 0;
+	FILE *fp = fopen("/proc/self/statm", "re");
+
+	if (!fp) {
+		return 0;
+	}
+	if (fscanf(fp, "%ld %ld", &pages, &resident) != 2) {
+		resident = 0;
+	}
+	fclose(fp);
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static std::string bench_property(unsigned long index) {
+	return "bench.property" + std::to_string(index);
+}
+
+static std::string bench_user(unsigned long index) {
+	return "benchuser" + std::to_string(index);
+}
+
+int main(int argc, char **argv) {
+	unsigned long threads = 4, properties = 200, users = 50, updates = 100, duration = 5;
+	unsigned long long maxNs = 0;
+	COMMAND_LINE_ARGUMENT_A *arg;
+	DWORD flags;
+	int status;
+
+	flags = COMMAND_LINE_SEPARATOR_EQUAL | COMMAND_LINE_SIGIL_DOUBLE_DASH;
+	status = CommandLineParseArgumentsA(argc, argv, bench_args, flags, NULL, NULL, NULL);
+	if (status != 0) {
+		printhelp(argv[0]);
+		return 1;
+	}
+
+	arg = bench_args;
+	do {
+		if (!(arg->Flags & COMMAND_LINE_VALUE_PRESENT))
+			continue;
+
+		CommandLineSwitchStart(arg)
+
+		CommandLineSwitchCase(arg, "help") {
+			printhelp(argv[0]);
+			return 0;
+		}
+		CommandLineSwitchCase(arg, "threads") {
+			threads = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchCase(arg, "properties") {
+			properties = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchCase(arg, "users") {
+			users = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchCase(arg, "updates") {
+			updates = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchCase(arg, "duration") {
+			duration = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchCase(arg, "max-ns") {
+			maxNs = strtoull(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchEnd(arg)
+	}
+	while ((arg = CommandLineFindNextArgumentA(arg)) != NULL);
+
+	if ((threads < 1) || (properties < 1) || (users < 1) || (duration < 1)) {
+		printhelp(argv[0]);
+		return 1;
+	}
+
+	WLog_SetLogLevel(WLog_GetRoot(), WLOG_ERROR);
+
+	configNS::PropertyManager manager;
+	for (unsigned long i = 0; i < properties; i++) {
+		manager.setPropertyNumber(Global, 0, bench_property(i), i);
+	}
+	// every user overrides every tenth property
+	for (unsigned long u = 0; u < users; u++) {
+		for (unsigned long i = 0; i < properties; i += 10) {
+			manager.setPropertyNumber(User, 0, bench_property(i), i + 1, bench_user(u));
+		}
+	}
+
+	// the same path strings the ICP calls would hand in, built once
+	std::vector<std::string> paths, userNames;
+	for (unsigned long i = 0; i < properties; i++) {
+		paths.push_back(bench_property(i));
+	}
+	for (unsigned long u = 0; u < users; u++) {
+		userNames.push_back(bench_user(u));
+	}
+	// users without overrides fall back to the global values
+	userNames.push_back("");
+	userNames.push_back("unknownuser");
+
+	std::atomic<bool> stop(false);
+	std::atomic<unsigned long long> lookups(0), misses(0);
+	std::vector<std::thread> readers;
+	long rssBefore = bench_rss_kb();
+	unsigned long long published = 0;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (unsigned long t = 0; t < threads; t++) {
+		readers.push_back(std::thread([&, t]() {
+			unsigned long long count = 0, failed = 0;
+			size_t p = t, u = t;
+			long value;
+
+			while (!stop.load(std::memory_order_relaxed)) {
+				for (int i = 0; i < 1000; i++) {
+					p = (p + 7) % paths.size();
+					u = (u + 3) % userNames.size();
+					if (!manager.getPropertyNumber(0, paths[p], value, userNames[u])) {
+						failed++;
+					}
+				}
+				count += 1000;
+			}
+			lookups += count;
+			misses += failed;
+		}));
+	}
+
+	std::chrono::steady_clock::time_point end = start + std::chrono::seconds(duration);
+	std::chrono::steady_clock::time_point next = start;
+	while (std::chrono::steady_clock::now() < end) {
+		if (updates) {
+			manager.setPropertyNumber(Global, 0, "bench.update", (long)published++);
+			next += std::chrono::microseconds(1000000 / updates);
+			std::this_thread::sleep_until(std::min(next, end));
+		} else {
+			std::this_thread::sleep_until(end);
+		}
+	}
+	stop = true;
+	for (size_t t = 0; t < readers.size(); t++) {
+		readers[t].join();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	long rssAfter = bench_rss_kb();
+
+	double perSecond = lookups / seconds;
+	double nsPerLookup = perSecond ? threads * 1e9 / perSecond : 0.0;
+
+	printf("%-10s %10s %8s %12s %14s %10s %12s %12s\n", "threads", "properties", "users", "lookups",
+		"lookups/s", "ns/lookup", "snapshots", "rss kB");
+	printf("%-10lu %10lu %8lu %12llu %14.0f %10.1f %12llu %5ld->%ld\n", threads, properties, users,
+		lookups.load(), perSecond, nsPerLookup, published, rssBefore, rssAfter);
+
+	if (misses) {
+		printf("%llu lookups did not find their property\n", misses.load());
+		return 1;
+	}
+	if (maxNs && (nsPerLookup > maxNs)) {
+		printf("exceeds %llu ns per lookup\n", maxNs);
+		return 1;
+	}
+	return 0;
+}
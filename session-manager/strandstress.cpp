@@ -0,0 +1,271 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * Session strand stress test
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <winpr/cmdline.h>
+#include <winpr/synch.h>
+#include <winpr/wlog.h>
+
+#include <task/Executor.h>
+#include <task/InformableTask.h>
+#include <task/Strand.h>
+#include <task/ThreadPool.h>
+
+/**
+ * Runs many concurrent logons on session strands, on a pool sized like the
+ * executor's strand pool. Like TaskAuthenticateUser and TaskLogonUser, every
+ * logon shuts down an old session of its user and waits for that task. The
+ * task is queued on the old session's strand and itself waits for an answer
+ * of the rdp server. Then the logon waits for an answer of its own. With
+ * more logons than EXECUTOR_STRAND_THREADS this only finishes if the pool
+ * adds workers while all of them are blocked.
+ */
+
+static COMMAND_LINE_ARGUMENT_A stress_args[] = {
+	{ "help", COMMAND_LINE_VALUE_FLAG, "", NULL, NULL, -1, NULL, "prints help" },
+	{ "sessions", COMMAND_LINE_VALUE_REQUIRED, "<count>", NULL, NULL, -1, NULL, "concurrent logons" },
+	{ "answer-ms", COMMAND_LINE_VALUE_REQUIRED, "<ms>", NULL, NULL, -1, NULL, "rdp server answer time" },
+	{ "timeout", COMMAND_LINE_VALUE_REQUIRED, "<seconds>", NULL, NULL, -1, NULL, "time until a deadlock is reported" },
+	{ NULL, 0, NULL, NULL, NULL, -1, NULL, NULL }
+};
+
+static void printhelprow(const char *kshort, const char *klong, const char *helptext) {
+	if (kshort) {
+		printf("    %s, %-20s %s\n", kshort, klong, helptext);
+	} else {
+		printf("        %-20s %s\n", klong, helptext);
+	}
+}
+
+static void printhelp(const char *bin) {
+	printf("Usage: %s [options]\n", bin);
+	printf("\noptions:\n\n");
+	printhelprow(NULL, "--help", "prints this help screen");
+	printhelprow(NULL, "--sessions=<count>", "concurrent logons (default 256)");
+	printhelprow(NULL, "--answer-ms=<ms>", "rdp server answer time (default 20)");
+	printhelprow(NULL, "--timeout=<seconds>", "time until a deadlock is reported (default 30)");
+}
+
+/**
+ * @brief answers "ICP calls" after a delay, like the rdp server would.
+ */
+class StressAnswers {
+public:
+	StressAnswers(unsigned long delayMs) : mDelay(delayMs), mStop(false) {
+		mThread = std::thread([this]() { run(); });
+	}
+
+	~StressAnswers() {
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStop = true;
+		}
+		mCondition.notify_one();
+		mThread.join();
+	}
+
+	void request(HANDLE answer) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		mPending.push_back(std::make_pair(std::chrono::steady_clock::now() + mDelay, answer));
+		mCondition.notify_one();
+	}
+
+private:
+	void run() {
+		std::unique_lock<std::mutex> lock(mMutex);
+		while (!mStop) {
+			if (mPending.empty()) {
+				mCondition.wait(lock);
+				continue;
+			}
+			std::chrono::steady_clock::time_point due = mPending.front().first;
+			if (std::chrono::steady_clock::now() < due) {
+				mCondition.wait_until(lock, due);
+				continue;
+			}
+			SetEvent(mPending.front().second);
+			mPending.erase(mPending.begin());
+		}
+	}
+
+	std::chrono::milliseconds mDelay;
+	bool mStop;
+	std::vector<std::pair<std::chrono::steady_clock::time_point, HANDLE> > mPending;
+	std::mutex mMutex;
+	std::condition_variable mCondition;
+	std::thread mThread;
+};
+
+/**
+ * @brief asks for an answer and blocks its strand until it arrived.
+ */
+class StressTaskAnswer : public taskNS::InformableTask {
+public:
+	StressTaskAnswer(StressAnswers &answers) : mAnswers(answers) {
+		if (!(mhAnswer = CreateEvent(NULL, TRUE, FALSE, NULL))) {
+			throw std::bad_alloc();
+		}
+	}
+
+	virtual ~StressTaskAnswer() {
+		CloseHandle(mhAnswer);
+	}
+
+	virtual void run() {
+		mAnswers.request(mhAnswer);
+		taskNS::ThreadPool::blockingWait(mhAnswer, INFINITE);
+	}
+
+protected:
+	StressAnswers &mAnswers;
+
+private:
+	HANDLE mhAnswer;
+};
+
+/**
+ * @brief shuts down another session, then waits for its own answer.
+ */
+class StressTaskLogon : public StressTaskAnswer {
+public:
+	StressTaskLogon(StressAnswers &answers, taskNS::StrandPtr other)
+		: StressTaskAnswer(answers), mOther(other) {}
+
+	virtual void run() {
+		taskNS::InformableTaskPtr shutdown(new StressTaskAnswer(mAnswers));
+		if (mOther->addTask(shutdown)) {
+			taskNS::ThreadPool::blockingWait(shutdown->getHandle(), INFINITE);
+		}
+		StressTaskAnswer::run();
+	}
+
+private:
+	taskNS::StrandPtr mOther;
+};
+
+int main(int argc, char **argv) {
+	unsigned long sessions = 256, answerMs = 20, timeout = 30;
+	COMMAND_LINE_ARGUMENT_A *arg;
+	DWORD flags;
+	int status;
+
+	flags = COMMAND_LINE_SEPARATOR_EQUAL | COMMAND_LINE_SIGIL_DOUBLE_DASH;
+	status = CommandLineParseArgumentsA(argc, argv, stress_args, flags, NULL, NULL, NULL);
+	if (status != 0) {
+		printhelp(argv[0]);
+		return 1;
+	}
+
+	arg = stress_args;
+	do {
+		if (!(arg->Flags & COMMAND_LINE_VALUE_PRESENT))
+			continue;
+
+		CommandLineSwitchStart(arg)
+
+		CommandLineSwitchCase(arg, "help") {
+			printhelp(argv[0]);
+			return 0;
+		}
+		CommandLineSwitchCase(arg, "sessions") {
+			sessions = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchCase(arg, "answer-ms") {
+			answerMs = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchCase(arg, "timeout") {
+			timeout = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchEnd(arg)
+	}
+	while ((arg = CommandLineFindNextArgumentA(arg)) != NULL);
+
+	if ((sessions < 2) || (timeout < 1)) {
+		printhelp(argv[0]);
+		return 1;
+	}
+
+	WLog_SetLogLevel(WLog_GetRoot(), WLOG_ERROR);
+
+	taskNS::ThreadPool pool("strand stress");
+	if (!pool.start(EXECUTOR_STRAND_THREADS, EXECUTOR_STRAND_MAX_THREADS)) {
+		fprintf(stderr, "failed to start the thread pool\n");
+		return 1;
+	}
+
+	{
+		StressAnswers answers(answerMs);
+		std::vector<taskNS::StrandPtr> strands;
+		std::vector<taskNS::InformableTaskPtr> logons;
+
+		// the logging on sessions and the old sessions they replace
+		for (unsigned long i = 0; i < 2 * sessions; i++) {
+			strands.push_back(taskNS::StrandPtr(new taskNS::Strand(pool)));
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (unsigned long i = 0; i < sessions; i++) {
+			taskNS::InformableTaskPtr logon(new StressTaskLogon(answers, strands[sessions + i]));
+			logons.push_back(logon);
+			strands[i]->addTask(logon);
+		}
+
+		std::chrono::steady_clock::time_point end = start + std::chrono::seconds(timeout);
+		unsigned long finished = 0;
+		for (unsigned long i = 0; i < sessions; i++) {
+			std::chrono::steady_clock::duration remaining = end - std::chrono::steady_clock::now();
+			long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(remaining).count();
+			if (WaitForSingleObject(logons[i]->getHandle(), ms > 0 ? (DWORD) ms : 0) == WAIT_OBJECT_0) {
+				finished++;
+			}
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		taskNS::ThreadPoolStats stats = pool.getStats();
+		printf("%-10s %10s %10s %10s %10s\n", "sessions", "finished", "seconds", "workers", "blocked");
+		printf("%-10lu %10lu %10.2f %10" PRIuz " %10" PRIuz "\n", sessions, finished, seconds,
+			stats.workers, stats.blockedWorkers);
+
+		if (finished != sessions) {
+			printf("deadlock: %lu of %lu logons did not finish within %lu seconds\n",
+				sessions - finished, sessions, timeout);
+			// the blocked workers would never return from stop()
+			fflush(stdout);
+			_exit(1);
+		}
+	}
+
+	pool.stop();
+	return 0;
+}
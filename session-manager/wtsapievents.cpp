@@ -0,0 +1,187 @@
+/**
+ * ogon - Free Remote Desktop Services
+ * Session Manager
+ * WTSAPI session event wait driver
+ *
+ * Copyright (c) 2013-2018 Thincast Technologies GmbH
+ *
+ * This file may be used under the terms of the GNU Affero General
+ * Public License version 3 as published by the Free Software Foundation
+ * and appearing in the file LICENSE-AGPL included in the distribution
+ * of this file.
+ *
+ * Under the GNU Affero General Public License version 3 section 7 the
+ * copyright holders grant the additional permissions set forth in the
+ * ogon Core AGPL Exceptions version 1 as published by
+ * Thincast Technologies GmbH.
+ *
+ * For more information see the file LICENSE in the distribution of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <winpr/cmdline.h>
+#include <winpr/wtsapi.h>
+
+/**
+ * Waits for session events with the client library against a running
+ * session manager and aborts the waits. Every round starts two waits on a
+ * fresh server handle: the first one is connecting or already in the call,
+ * the second one still waits for the first and has no socket of its own
+ * yet. One WTS_EVENT_FLUSH must abort both. Then a third wait is started
+ * and the handle is closed under it, the wait must return and the close
+ * must not free the handle before. Run it under valgrind or with
+ * AddressSanitizer to see use after free errors.
+ */
+
+extern "C" PWtsApiFunctionTable ogon_InitWtsApi(void);
+
+static COMMAND_LINE_ARGUMENT_A events_args[] = {
+	{ "help", COMMAND_LINE_VALUE_FLAG, "", NULL, NULL, -1, NULL, "prints help" },
+	{ "host", COMMAND_LINE_VALUE_REQUIRED, "<host>", NULL, NULL, -1, NULL, "session manager host" },
+	{ "rounds", COMMAND_LINE_VALUE_REQUIRED, "<count>", NULL, NULL, -1, NULL, "flush and close rounds" },
+	{ "settle-ms", COMMAND_LINE_VALUE_REQUIRED, "<ms>", NULL, NULL, -1, NULL, "time until the waits are started" },
+	{ "max-ms", COMMAND_LINE_VALUE_REQUIRED, "<ms>", NULL, NULL, -1, NULL, "fail if a wait isn't aborted in time" },
+	{ NULL, 0, NULL, NULL, NULL, -1, NULL, NULL }
+};
+
+static void printhelprow(const char *kshort, const char *klong, const char *helptext) {
+	if (kshort) {
+		printf("    %s, %-20s %s\n", kshort, klong, helptext);
+	} else {
+		printf("        %-20s %s\n", klong, helptext);
+	}
+}
+
+static void printhelp(const char *bin) {
+	printf("Usage: %s [options]\n", bin);
+	printf("\noptions:\n\n");
+	printhelprow(NULL, "--help", "prints this help screen");
+	printhelprow(NULL, "--host=<host>", "session manager host (default localhost)");
+	printhelprow(NULL, "--rounds=<count>", "flush and close rounds (default 100)");
+	printhelprow(NULL, "--settle-ms=<ms>", "time until the waits are started (default 50)");
+	printhelprow(NULL, "--max-ms=<ms>", "fail if a wait isn't aborted in time (default 2000)");
+}
+
+/** @return the error of an aborted wait, ERROR_SUCCESS if it reported events */
+static std::future<DWORD> events_wait(PWtsApiFunctionTable api, HANDLE hServer) {
+	return std::async(std::launch::async, [api, hServer]() {
+		DWORD flags = WTS_EVENT_NONE;
+		if (api->pWaitSystemEvent(hServer, WTS_EVENT_ALL, &flags)) {
+			return (DWORD) ERROR_SUCCESS;
+		}
+		return GetLastError();
+	});
+}
+
+static bool events_check(std::future<DWORD> &wait, unsigned long maxMs, const char *what,
+		unsigned long round) {
+	if (wait.wait_for(std::chrono::milliseconds(maxMs)) != std::future_status::ready) {
+		printf("round %lu: %s was not aborted within %lu ms\n", round, what, maxMs);
+		// the waiting thread can't be joined
+		fflush(stdout);
+		_exit(1);
+	}
+	DWORD error = wait.get();
+	if (error != ERROR_OPERATION_ABORTED) {
+		printf("round %lu: %s returned with %" PRIu32 " instead of ERROR_OPERATION_ABORTED\n",
+			round, what, error);
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char **argv) {
+	std::string host("localhost");
+	unsigned long rounds = 100, settleMs = 50, maxMs = 2000;
+	COMMAND_LINE_ARGUMENT_A *arg;
+	DWORD flags;
+	int status;
+
+	flags = COMMAND_LINE_SEPARATOR_EQUAL | COMMAND_LINE_SIGIL_DOUBLE_DASH;
+	status = CommandLineParseArgumentsA(argc, argv, events_args, flags, NULL, NULL, NULL);
+	if (status != 0) {
+		printhelp(argv[0]);
+		return 1;
+	}
+
+	arg = events_args;
+	do {
+		if (!(arg->Flags & COMMAND_LINE_VALUE_PRESENT))
+			continue;
+
+		CommandLineSwitchStart(arg)
+
+		CommandLineSwitchCase(arg, "help") {
+			printhelp(argv[0]);
+			return 0;
+		}
+		CommandLineSwitchCase(arg, "host") {
+			host = arg->Value;
+		}
+		CommandLineSwitchCase(arg, "rounds") {
+			rounds = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchCase(arg, "settle-ms") {
+			settleMs = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchCase(arg, "max-ms") {
+			maxMs = strtoul(arg->Value, NULL, 0);
+		}
+		CommandLineSwitchEnd(arg)
+	}
+	while ((arg = CommandLineFindNextArgumentA(arg)) != NULL);
+
+	if ((rounds < 1) || (maxMs < 1)) {
+		printhelp(argv[0]);
+		return 1;
+	}
+
+	PWtsApiFunctionTable api = ogon_InitWtsApi();
+	unsigned long failed = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (unsigned long round = 0; round < rounds; round++) {
+		HANDLE hServer = api->pOpenServerA((LPSTR) host.c_str());
+		if (!hServer || (hServer == INVALID_HANDLE_VALUE)) {
+			printf("round %lu: WTSOpenServer failed with %" PRIu32 "\n", round, GetLastError());
+			return 1;
+		}
+
+		// the second wait queues behind the first one before it has a socket
+		std::future<DWORD> first = events_wait(api, hServer);
+		std::future<DWORD> second = events_wait(api, hServer);
+		std::this_thread::sleep_for(std::chrono::milliseconds(settleMs));
+		DWORD none;
+		api->pWaitSystemEvent(hServer, WTS_EVENT_FLUSH, &none);
+		if (!events_check(first, maxMs, "the connected wait", round) ||
+				!events_check(second, maxMs, "the queued wait", round)) {
+			failed++;
+		}
+
+		// the handle must stay valid until the wait returned
+		std::future<DWORD> closed = events_wait(api, hServer);
+		std::this_thread::sleep_for(std::chrono::milliseconds(settleMs));
+		api->pCloseServer(hServer);
+		if (!events_check(closed, maxMs, "the wait on the closed handle", round)) {
+			failed++;
+		}
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("%-10s %10s %10s\n", "rounds", "failed", "seconds");
+	printf("%-10lu %10lu %10.2f\n", rounds, failed, seconds);
+	return failed ? 1 : 0;
+}